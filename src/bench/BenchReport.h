@@ -0,0 +1,89 @@
+#ifndef BENCHREPORT_H
+#define BENCHREPORT_H
+
+/**
+ * Shared "key=value" report format for the benchmarks.
+ *
+ * Lines starting with '#' are comments, and keys starting with "config."
+ * describe the run rather than measure it, so they aren't compared.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+inline map<string, double> readReport(const string &path) {
+  map<string, double> report;
+  ifstream in(path);
+  string line;
+
+  if (!in) {
+    cerr << "Bench failed to open baseline '" << path << "'." << endl;
+    return report;
+  }
+
+  while (getline(in, line)) {
+    size_t eq = line.find('=');
+    if (eq == string::npos || line[0] == '#') {
+      continue;
+    }
+    try {
+      report[line.substr(0, eq)] = stod(line.substr(eq + 1));
+    } catch (...) {
+      // Non-numeric entries aren't compared.
+    }
+  }
+
+  return report;
+}
+
+/**
+ * Print the report, optionally save it to outPath,
+ * and optionally print each metric's change vs. a saved baseline.
+ */
+inline void publishReport(const string &report, const string &outPath,
+                          const string &baselinePath) {
+  cout << report;
+
+  if (!outPath.empty()) {
+    ofstream out(outPath);
+    out << report;
+    if (!out) {
+      cerr << "Bench failed to write report to '" << outPath << "'." << endl;
+    }
+  }
+
+  if (baselinePath.empty()) {
+    return;
+  }
+
+  map<string, double> baseline = readReport(baselinePath);
+  istringstream current(report);
+  string line;
+
+  cout << "\n# Change vs. baseline (" << baselinePath << ")\n";
+  while (getline(current, line)) {
+    size_t eq = line.find('=');
+    if (eq == string::npos || line[0] == '#' ||
+        line.rfind("config.", 0) == 0) {
+      continue;
+    }
+
+    auto it = baseline.find(line.substr(0, eq));
+    if (it == baseline.end()) {
+      continue;
+    }
+
+    double now = stod(line.substr(eq + 1));
+    double pct =
+        it->second != 0 ? 100.0 * (now - it->second) / it->second : 0;
+    cout << it->first << ": " << it->second << " -> " << now << " ("
+         << (pct >= 0 ? "+" : "") << pct << "%)\n";
+  }
+}
+
+#endif // BENCHREPORT_H
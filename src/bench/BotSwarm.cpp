@@ -0,0 +1,490 @@
+/**
+ * Headless bot-swarm load generator and end-to-end latency benchmark.
+ *
+ * Starts a ServerNetworkAPI (in a child process, so its CPU time is measured
+ * separately from the bots) and N simulated players built on ClientNetworkAPI,
+ * all on loopback. Each bot registers, then streams moves at a fixed rate with
+ * Actions and chat messages mixed in. The server echoes every move back as a
+ * Location broadcast, and each bot records the round-trip latency of its own
+ * moves.
+ *
+ * The run is reproducible for a given set of options (all randomness comes
+ * from --seed), and the report is written as "key=value" lines so a later run
+ * can be compared against it with --baseline.
+ *
+ * --delay-ms, --jitter-ms and --loss run the server's UDP traffic through the
+ * in-process impairment shim (applied in each direction).
+ *
+ * Compile (from the repo root):
+ *   g++ -std=c++20 -O2 -Isrc src/core/*.cpp src/server/*.cpp
+ *       src/client/*.cpp src/bench/BotSwarm.cpp -o botswarm -lpthread
+ *
+ * Usage:
+ *   ./botswarm --bots 64 --rate 20 --duration 30 --seed 1 --out base.txt
+ *   ./botswarm --bots 64 --rate 20 --duration 30 --seed 1 --baseline base.txt
+ */
+
+#include "../core/NetworkAPI.h"
+#include "BenchReport.h"
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+struct SwarmConfig {
+  string host = "127.0.0.1";
+  string tcpPort = "9100";
+  string udpPort = "9101";
+  uint32_t bots = 32;
+  double moveRateHz = 20;    // Moves per second, per bot.
+  double actionRatio = 0.1;  // Chance a tick also sends an Action.
+  double chatRatio = 0.01;   // Chance a tick also sends a chat message.
+  double durationSec = 20;   // Measured run time.
+  double warmupSec = 2;      // Samples before this are discarded.
+  uint32_t seed = 1;
+  ImpairmentConfig impairment; // Server UDP, each direction.
+  string outPath;
+  string baselinePath;
+};
+
+// =======================================
+// Server (child process)
+
+// Read by the SIGTERM handler, so they must be lock-free.
+static atomic<uint64_t> serverMovesHandled{0};
+static atomic<uint64_t> serverActionsHandled{0};
+static atomic<uint64_t> serverChatsHandled{0};
+static int serverStatsPipe = -1;
+
+static void onServerTerm(int) {
+  uint64_t stats[3] = {serverMovesHandled.load(), serverActionsHandled.load(),
+                       serverChatsHandled.load()};
+  ssize_t ignored = write(serverStatsPipe, stats, sizeof(stats));
+  (void)ignored;
+  _exit(0);
+}
+
+/**
+ * Minimal game server: hands out objectIDs and relays every event
+ * to all clients (moves come back as Locations).
+ */
+static void runServer(const SwarmConfig &cfg) {
+  signal(SIGTERM, onServerTerm);
+
+  ServerNetworkAPI server(const_cast<char *>(cfg.host.c_str()),
+                          const_cast<char *>(cfg.tcpPort.c_str()),
+                          const_cast<char *>(cfg.udpPort.c_str()));
+  atomic<uint32_t> nextObjectID{1};
+
+  ImpairmentConfig inbound = cfg.impairment;
+  inbound.seed = cfg.impairment.seed + 1; // Independent loss per direction.
+  server.getTransport().setUDPImpairment(cfg.impairment, inbound);
+
+  server.registerCallback(EventCode::Register,
+                          std::function<void(uint32_t *)>(
+                              [&](uint32_t *objectID) {
+                                *objectID = nextObjectID++;
+                              }));
+
+  server.registerCallback(
+      EventCode::Movement,
+      std::function<void(uint32_t, uint32_t, uint32_t)>(
+          [&](uint32_t objectID, uint32_t xCoord, uint32_t yCoord) {
+            serverMovesHandled++;
+            Coord2D location(objectID, xCoord, yCoord);
+            server.sendUDPEvent(ServerNetworkAPI::BROADCAST_ID, location);
+          }));
+
+  server.registerCallback(
+      EventCode::Action,
+      std::function<void(uint8_t, uint32_t, uint32_t)>(
+          [&](uint8_t actionType, uint32_t actionValue, uint32_t impactedID) {
+            serverActionsHandled++;
+            Action action(actionType, actionValue, impactedID);
+            server.sendUDPEvent(ServerNetworkAPI::BROADCAST_ID, action);
+          }));
+
+  server.registerCallback(EventCode::Chat,
+                          std::function<void(string)>([&](string chat) {
+                            serverChatsHandled++;
+                            ChatMessage chatMssg(chat);
+                            server.sendTCPEvent(ServerNetworkAPI::BROADCAST_ID,
+                                                chatMssg);
+                          }));
+
+  server.start(vector<pair<EventCode, std::function<void()>>>{});
+}
+
+// =======================================
+// Bots
+
+/**
+ * One simulated player. xCoord of each move carries the bot's move sequence
+ * number, so the echoed Location can be matched to its send time. Moves
+ * aren't predicted, so the Location arrives as the server echoed it.
+ *
+ * Each bot moves its own object, numbered from OBJECT_BASE: The server
+ * hands out publicIDs in registration order, and a player's publicID can
+ * only be moved by that player.
+ */
+class Bot {
+public:
+  static constexpr size_t SEND_WINDOW = 4096; // Must be a power of 2.
+  static constexpr uint32_t OBJECT_BASE = 1u << 20;
+
+  Bot(const SwarmConfig &cfg, uint32_t index)
+      : cfg(cfg), objectID(OBJECT_BASE + index), rng(cfg.seed * 7919u + index),
+        client(const_cast<char *>(cfg.host.c_str()),
+               const_cast<char *>(cfg.tcpPort.c_str()),
+               const_cast<char *>(cfg.udpPort.c_str())),
+        sendTimes(SEND_WINDOW) {}
+
+  // After the server is stopped, which ends the client's read loop.
+  ~Bot() {
+    if (ioThread.joinable()) {
+      ioThread.join();
+    }
+  }
+
+  void run(Clock::time_point start, Clock::time_point end,
+           Clock::time_point measureFrom) {
+    // A member: The I/O thread outlives this call.
+    this->measureFrom = measureFrom;
+    client.registerCallback(
+        EventCode::Location,
+        std::function<void(uint32_t, uint32_t, uint32_t)>(
+            [this](uint32_t id, uint32_t seq, uint32_t) {
+              onLocation(id, seq);
+            }));
+
+    // Returns once the server hangs up (see ~Bot).
+    ioThread = thread([this] { client.start(); });
+
+    if (!client.registerPlayer()) {
+      cerr << "Bot " << objectID << " failed to register." << endl;
+      return;
+    }
+    // Written before registerPlayer() sees the connection.
+    connectMs = client.getTransport().getConnectStats().connectMs;
+
+    // Stagger bots within one period so they don't send in lock-step.
+    auto period = chrono::duration_cast<Clock::duration>(
+        chrono::duration<double>(1.0 / cfg.moveRateHz));
+    uniform_real_distribution<double> phase(0.0, 1.0);
+    auto next = start + chrono::duration_cast<Clock::duration>(
+                            period * phase(rng));
+
+    uniform_real_distribution<double> chance(0.0, 1.0);
+    uniform_int_distribution<int> step(-1, 1);
+    uint32_t yCoord = 1u << 16;
+
+    while (next < end) {
+      this_thread::sleep_until(next);
+      next += period;
+
+      uint32_t seq = nextSeq++;
+      yCoord += step(rng);
+
+      {
+        lock_guard<mutex> lock(sendMutex);
+        sendTimes[seq & (SEND_WINDOW - 1)] = {seq, Clock::now()};
+      }
+      client.sendUnpredictedMove(objectID, seq, yCoord);
+      if (Clock::now() >= measureFrom) {
+        movesSent++;
+      }
+
+      if (chance(rng) < cfg.actionRatio) {
+        client.sendAction(1, 10, objectID);
+        actionsSent++;
+      }
+
+      if (chance(rng) < cfg.chatRatio) {
+        char chat[] = "brains";
+        client.sendChat(chat);
+        chatsSent++;
+      }
+    }
+  }
+
+  // Echo results are written by the client's I/O thread; copy under the lock.
+  pair<vector<double>, uint64_t> echoResults() {
+    lock_guard<mutex> lock(sendMutex);
+    return {latenciesUs, movesEchoed};
+  }
+
+  uint64_t movesSent = 0;
+  uint64_t actionsSent = 0;
+  uint64_t chatsSent = 0;
+  atomic<uint64_t> locationsReceived{0};
+  double connectMs = -1; // -1: Never connected.
+
+private:
+  struct SendTime {
+    uint32_t seq = UINT32_MAX;
+    Clock::time_point sentAt;
+  };
+
+  const SwarmConfig &cfg;
+  uint32_t objectID;
+  mt19937 rng;
+  ClientNetworkAPI client;
+  Clock::time_point measureFrom;
+  thread ioThread;
+
+  mutex sendMutex;
+  vector<SendTime> sendTimes;
+  uint32_t nextSeq = 0;
+  vector<double> latenciesUs;
+  uint64_t movesEchoed = 0;
+
+  void onLocation(uint32_t id, uint32_t seq) {
+    locationsReceived++;
+    if (id != objectID) {
+      return; // Another bot's move.
+    }
+
+    Clock::time_point now = Clock::now();
+    lock_guard<mutex> lock(sendMutex);
+
+    SendTime &sent = sendTimes[seq & (SEND_WINDOW - 1)];
+    if (sent.seq != seq || sent.sentAt < measureFrom) {
+      return; // Too old (overwritten), or sent during warmup.
+    }
+
+    latenciesUs.push_back(
+        chrono::duration<double, micro>(now - sent.sentAt).count());
+    movesEchoed++;
+    sent.seq = UINT32_MAX; // Ignore duplicates.
+  }
+};
+
+// =======================================
+// Report
+
+static double percentile(const vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t idx = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[min(idx, sorted.size() - 1)];
+}
+
+static double cpuSeconds(const struct rusage &usage) {
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static bool parseArgs(int argc, char **argv, SwarmConfig &cfg) {
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      cerr << "Missing value for " << arg << "." << endl;
+      return false;
+    }
+    string val = argv[++i];
+
+    if (arg == "--host") {
+      cfg.host = val;
+    } else if (arg == "--tcp-port") {
+      cfg.tcpPort = val;
+    } else if (arg == "--udp-port") {
+      cfg.udpPort = val;
+    } else if (arg == "--bots") {
+      cfg.bots = stoul(val);
+    } else if (arg == "--rate") {
+      cfg.moveRateHz = stod(val);
+    } else if (arg == "--action-ratio") {
+      cfg.actionRatio = stod(val);
+    } else if (arg == "--chat-ratio") {
+      cfg.chatRatio = stod(val);
+    } else if (arg == "--duration") {
+      cfg.durationSec = stod(val);
+    } else if (arg == "--warmup") {
+      cfg.warmupSec = stod(val);
+    } else if (arg == "--seed") {
+      cfg.seed = stoul(val);
+      cfg.impairment.seed = cfg.seed;
+    } else if (arg == "--delay-ms") {
+      cfg.impairment.delayMs = stoul(val);
+    } else if (arg == "--jitter-ms") {
+      cfg.impairment.jitterMs = stoul(val);
+    } else if (arg == "--loss") {
+      cfg.impairment.lossRate = stod(val);
+    } else if (arg == "--out") {
+      cfg.outPath = val;
+    } else if (arg == "--baseline") {
+      cfg.baselinePath = val;
+    } else {
+      cerr << "Unknown option " << arg << "." << endl;
+      return false;
+    }
+  }
+
+  return cfg.bots > 0 && cfg.moveRateHz > 0 && cfg.durationSec > 0;
+}
+
+int main(int argc, char **argv) {
+  SwarmConfig cfg;
+  if (!parseArgs(argc, argv, cfg)) {
+    cerr << "Usage: " << argv[0]
+         << " [--bots N] [--rate HZ] [--duration SEC] [--warmup SEC]"
+            " [--action-ratio R] [--chat-ratio R] [--seed S]"
+            " [--delay-ms MS] [--jitter-ms MS] [--loss R]"
+            " [--host H] [--tcp-port P] [--udp-port P]"
+            " [--out FILE] [--baseline FILE]"
+         << endl;
+    return 1;
+  }
+
+  int statsPipe[2];
+  if (pipe(statsPipe) < 0) {
+    cerr << "BotSwarm pipe failed: " << strerror(errno) << endl;
+    return 1;
+  }
+
+  pid_t serverPid = fork();
+  if (serverPid == 0) {
+    close(statsPipe[0]);
+    serverStatsPipe = statsPipe[1];
+    runServer(cfg);
+    _exit(0);
+  }
+  close(statsPipe[1]);
+
+  // Give the server time to bind.
+  this_thread::sleep_for(chrono::milliseconds(500));
+
+  vector<unique_ptr<Bot>> bots;
+  for (uint32_t i = 0; i < cfg.bots; i++) {
+    bots.push_back(make_unique<Bot>(cfg, i));
+  }
+
+  Clock::time_point start = Clock::now();
+  Clock::time_point measureFrom =
+      start + chrono::duration_cast<Clock::duration>(
+                  chrono::duration<double>(cfg.warmupSec));
+  Clock::time_point end =
+      measureFrom + chrono::duration_cast<Clock::duration>(
+                        chrono::duration<double>(cfg.durationSec));
+
+  struct rusage botUsageBefore;
+  getrusage(RUSAGE_SELF, &botUsageBefore);
+
+  vector<thread> botThreads;
+  for (auto &bot : bots) {
+    botThreads.emplace_back(
+        [&, b = bot.get()] { b->run(start, end, measureFrom); });
+  }
+  for (thread &t : botThreads) {
+    t.join();
+  }
+
+  // Let in-flight echoes land before stopping the server.
+  this_thread::sleep_for(chrono::milliseconds(200));
+
+  struct rusage botUsageAfter;
+  getrusage(RUSAGE_SELF, &botUsageAfter);
+
+  kill(serverPid, SIGTERM);
+  uint64_t serverStats[3] = {0, 0, 0};
+  if (read(statsPipe[0], serverStats, sizeof(serverStats)) !=
+      sizeof(serverStats)) {
+    cerr << "BotSwarm: Server exited without reporting its stats." << endl;
+  }
+  waitpid(serverPid, nullptr, 0);
+
+  struct rusage serverUsage;
+  getrusage(RUSAGE_CHILDREN, &serverUsage);
+
+  // Merge per-bot results.
+  vector<double> latencies;
+  vector<double> connectMs;
+  uint64_t movesSent = 0, movesEchoed = 0, actionsSent = 0, chatsSent = 0;
+  uint64_t locationsReceived = 0;
+
+  for (auto &bot : bots) {
+    auto [botLatencies, botEchoed] = bot->echoResults();
+    latencies.insert(latencies.end(), botLatencies.begin(),
+                     botLatencies.end());
+    movesSent += bot->movesSent;
+    movesEchoed += botEchoed;
+    actionsSent += bot->actionsSent;
+    chatsSent += bot->chatsSent;
+    locationsReceived += bot->locationsReceived;
+    if (bot->connectMs >= 0) {
+      connectMs.push_back(bot->connectMs);
+    }
+  }
+  sort(latencies.begin(), latencies.end());
+  sort(connectMs.begin(), connectMs.end());
+
+  double mean = 0;
+  for (double l : latencies) {
+    mean += l;
+  }
+  mean = latencies.empty() ? 0 : mean / latencies.size();
+
+  // Server counters cover warmup too, so rates use the whole run.
+  double runSec = cfg.warmupSec + cfg.durationSec;
+  double serverCpu = cpuSeconds(serverUsage);
+
+  ostringstream report;
+  report << "# BotSwarm report\n"
+         << "config.bots=" << cfg.bots << "\n"
+         << "config.rate_hz=" << cfg.moveRateHz << "\n"
+         << "config.action_ratio=" << cfg.actionRatio << "\n"
+         << "config.chat_ratio=" << cfg.chatRatio << "\n"
+         << "config.duration_sec=" << cfg.durationSec << "\n"
+         << "config.warmup_sec=" << cfg.warmupSec << "\n"
+         << "config.seed=" << cfg.seed << "\n"
+         << "config.delay_ms=" << cfg.impairment.delayMs << "\n"
+         << "config.jitter_ms=" << cfg.impairment.jitterMs << "\n"
+         << "config.loss=" << cfg.impairment.lossRate << "\n"
+         << "rtt_us.samples=" << latencies.size() << "\n"
+         << "rtt_us.mean=" << mean << "\n"
+         << "rtt_us.p50=" << percentile(latencies, 50) << "\n"
+         << "rtt_us.p90=" << percentile(latencies, 90) << "\n"
+         << "rtt_us.p99=" << percentile(latencies, 99) << "\n"
+         << "rtt_us.p999=" << percentile(latencies, 99.9) << "\n"
+         << "rtt_us.max=" << (latencies.empty() ? 0 : latencies.back())
+         << "\n"
+         << "connect_ms.p50=" << percentile(connectMs, 50) << "\n"
+         << "connect_ms.max=" << (connectMs.empty() ? 0 : connectMs.back())
+         << "\n"
+         << "moves.sent=" << movesSent << "\n"
+         << "moves.echo_loss_pct="
+         << (movesSent ? 100.0 * (movesSent - movesEchoed) / movesSent : 0)
+         << "\n"
+         << "actions.sent=" << actionsSent << "\n"
+         << "chats.sent=" << chatsSent << "\n"
+         << "client.locations_per_sec=" << locationsReceived / runSec << "\n"
+         << "client.cpu_sec="
+         << cpuSeconds(botUsageAfter) - cpuSeconds(botUsageBefore) << "\n"
+         << "server.moves_per_sec=" << serverStats[0] / runSec << "\n"
+         << "server.actions_per_sec=" << serverStats[1] / runSec << "\n"
+         << "server.chats_per_sec=" << serverStats[2] / runSec << "\n"
+         << "server.cpu_sec=" << serverCpu << "\n"
+         << "server.cpu_pct=" << 100.0 * serverCpu / runSec << "\n"
+         << "server.cpu_us_per_move="
+         << (serverStats[0] ? serverCpu * 1e6 / serverStats[0] : 0) << "\n";
+
+  publishReport(report.str(), cfg.outPath, cfg.baselinePath);
+  return 0;
+}
@@ -0,0 +1,275 @@
+/**
+ * Projectile collision benchmark: Pellets vs mobs, per tick.
+ *
+ * One room's worth of mobs wander a square world while projectiles fly
+ * through it (see core/Trajectory.h), topped up to a fixed count in flight
+ * every tick. Each tick, the same projectiles are checked three ways:
+ *   brute:       Every pellet against every mob (EntityArrays).
+ *   grid_scalar: The spatial hash (see server/BroadPhase.h), scalar
+ *                narrow-phase.
+ *   grid_simd:   The spatial hash with this build's SIMD narrow-phase
+ *                (config.simd).
+ * All three must find the same hits (check.mismatched_ticks).
+ *
+ * With the defaults (5k mobs over 4096x4096, 64 unit cells), buckets hold
+ * a mob or two, so the grid is nearly all of the win over brute force
+ * (~180x), and SIMD adds ~20% with AVX2 (~13% SSE2). It gains more as the
+ * buckets fill up: ~2x with AVX2 at --cell 256 (~1.6x SSE2).
+ *
+ * Compile (from the repo root; -mavx2 or -march=native for AVX2,
+ * SSE2 otherwise):
+ *   g++ -std=c++20 -O3 -mavx2 -Isrc src/bench/CollisionBench.cpp \
+ *     -o collisionbench
+ *
+ * Usage:
+ *   ./collisionbench --mobs 5000 --projectiles 1000 --out base.txt
+ *   ./collisionbench --mobs 5000 --projectiles 1000 --baseline base.txt
+ */
+
+#include "../server/BroadPhase.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+struct CollisionBenchConfig {
+  uint32_t mobs = 5000;
+  uint32_t projectiles = 1000; // In flight every tick.
+  uint32_t pellets = 1;        // Per projectile.
+  uint32_t ticks = 300;        // Measured ticks.
+  uint32_t warmupTicks = 30;
+  float world = 4096;          // Side of the square world.
+  float radius = 8;            // Mob hit radius.
+  float speed = 24;            // Projectile units per tick.
+  uint16_t lifetime = 60;      // Projectile ticks.
+  float cellSize = 64;
+  uint32_t seed = 1;
+  string outPath;
+  string baselinePath;
+};
+
+static constexpr uint32_t FIRST_MOB_ID = 1000000;
+static constexpr float MOB_SPEED = 2; // Units per tick.
+
+static double elapsedUs(Clock::time_point since) {
+  return chrono::duration<double, micro>(Clock::now() - since).count();
+}
+
+static double percentile(const vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t idx = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[min(idx, sorted.size() - 1)];
+}
+
+static bool sameHits(const vector<ProjectileHit> &a,
+                     const vector<ProjectileHit> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].objectID != b[i].objectID || a[i].pellet != b[i].pellet ||
+        a[i].targetID != b[i].targetID) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool parseArgs(int argc, char **argv, CollisionBenchConfig &cfg) {
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      cerr << "Missing value for " << arg << "." << endl;
+      return false;
+    }
+    string val = argv[++i];
+
+    if (arg == "--mobs") {
+      cfg.mobs = stoul(val);
+    } else if (arg == "--projectiles") {
+      cfg.projectiles = stoul(val);
+    } else if (arg == "--pellets") {
+      cfg.pellets = stoul(val);
+    } else if (arg == "--ticks") {
+      cfg.ticks = stoul(val);
+    } else if (arg == "--warmup") {
+      cfg.warmupTicks = stoul(val);
+    } else if (arg == "--world") {
+      cfg.world = stof(val);
+    } else if (arg == "--radius") {
+      cfg.radius = stof(val);
+    } else if (arg == "--speed") {
+      cfg.speed = stof(val);
+    } else if (arg == "--lifetime") {
+      cfg.lifetime = uint16_t(stoul(val));
+    } else if (arg == "--cell") {
+      cfg.cellSize = stof(val);
+    } else if (arg == "--seed") {
+      cfg.seed = stoul(val);
+    } else if (arg == "--out") {
+      cfg.outPath = val;
+    } else if (arg == "--baseline") {
+      cfg.baselinePath = val;
+    } else {
+      cerr << "Unknown option " << arg << "." << endl;
+      return false;
+    }
+  }
+
+  return cfg.mobs > 0 && cfg.ticks > 0 && cfg.pellets > 0 &&
+         cfg.pellets <= ProjectileSet::MAX_PELLETS && cfg.world > 0 &&
+         cfg.cellSize > 0 && cfg.lifetime > 0;
+}
+
+int main(int argc, char **argv) {
+  CollisionBenchConfig cfg;
+  if (!parseArgs(argc, argv, cfg)) {
+    cerr << "Usage: " << argv[0]
+         << " [--mobs N] [--projectiles N] [--pellets N] [--ticks N]"
+            " [--warmup N] [--world UNITS] [--radius UNITS] [--speed UNITS]"
+            " [--lifetime TICKS] [--cell UNITS] [--seed S]"
+            " [--out FILE] [--baseline FILE]"
+         << endl;
+    return 1;
+  }
+
+  mt19937 rng(cfg.seed);
+  uniform_real_distribution<float> coord(0, cfg.world);
+  uniform_real_distribution<float> direction(-MOB_SPEED, MOB_SPEED);
+  uniform_int_distribution<uint32_t> heading(0, 65535);
+
+  EntityStore mobs;
+  mobs.reserve(cfg.mobs);
+  for (uint32_t m = 0; m < cfg.mobs; m++) {
+    EntityHandle mob = mobs.create(FIRST_MOB_ID + m, coord(rng), coord(rng));
+    mobs.setVelocity(mob, direction(rng), direction(rng));
+  }
+
+  ProjectileSet projectiles;
+  SpatialHash scalarGrid(cfg.cellSize);
+  SpatialHash simdGrid(cfg.cellSize);
+  scalarGrid.setSimd(false);
+
+  vector<double> bruteUs, scalarUs, simdUs, buildUs;
+  vector<ProjectileHit> bruteHits, scalarHits, simdHits;
+  uint64_t hits = 0, mismatchedTicks = 0;
+  uint32_t nextProjectileID = 1;
+
+  for (uint32_t tick = 1; tick <= cfg.warmupTicks + cfg.ticks; tick++) {
+    bool measured = tick > cfg.warmupTicks;
+
+    // Mobs wander, bouncing off the world's edges.
+    float *x = mobs.xCoords();
+    float *y = mobs.yCoords();
+    float *vx = mobs.xVelocities();
+    float *vy = mobs.yVelocities();
+    for (size_t i = 0; i < mobs.size(); i++) {
+      vx[i] = (x[i] < 0 || x[i] > cfg.world) ? -vx[i] : vx[i];
+      vy[i] = (y[i] < 0 || y[i] > cfg.world) ? -vy[i] : vy[i];
+    }
+    mobs.integrate(1);
+    mobs.clearDirty();
+
+    projectiles.expire(tick);
+    while (projectiles.size() < cfg.projectiles) {
+      ProjectileSpawn spawn;
+      spawn.objectID = nextProjectileID++;
+      spawn.xCoord = uint32_t(coord(rng));
+      spawn.yCoord = uint32_t(coord(rng));
+      spawn.rotation = uint16_t(heading(rng));
+      spawn.spread = cfg.pellets > 1 ? 2048 : 0;
+      spawn.speed = uint32_t(cfg.speed * Trajectory::FIXED_ONE);
+      spawn.seed = rng();
+      spawn.spawnTick = tick;
+      spawn.lifetimeTicks = cfg.lifetime;
+      spawn.pellets = uint8_t(cfg.pellets);
+      projectiles.add(spawn);
+    }
+
+    // The same flights, three ways; the last one's hits are kept.
+    ProjectileSet bruteSet = projectiles;
+    ProjectileSet scalarSet = projectiles;
+
+    Clock::time_point start = Clock::now();
+    bruteSet.collide(tick, mobs.size(), mobs.objectIDs(), mobs.xCoords(),
+                     mobs.yCoords(), cfg.radius, bruteHits);
+    double brute = elapsedUs(start);
+
+    start = Clock::now();
+    scalarGrid.build(mobs);
+    scalarSet.collide(tick, scalarGrid, cfg.radius, scalarHits);
+    double scalar = elapsedUs(start);
+
+    start = Clock::now();
+    simdGrid.build(mobs);
+    double build = elapsedUs(start);
+    projectiles.collide(tick, simdGrid, cfg.radius, simdHits);
+    double simd = elapsedUs(start);
+
+    if (!measured) {
+      continue;
+    }
+    bruteUs.push_back(brute);
+    scalarUs.push_back(scalar);
+    simdUs.push_back(simd);
+    buildUs.push_back(build);
+    hits += simdHits.size();
+    mismatchedTicks += !sameHits(bruteHits, simdHits) ||
+                       !sameHits(scalarHits, simdHits);
+  }
+
+  sort(bruteUs.begin(), bruteUs.end());
+  sort(scalarUs.begin(), scalarUs.end());
+  sort(simdUs.begin(), simdUs.end());
+  sort(buildUs.begin(), buildUs.end());
+
+  SpatialHashStats grid = simdGrid.getStats();
+  uint64_t pelletsTested = grid.queries;
+  double scalarP50 = percentile(scalarUs, 50);
+  double simdP50 = percentile(simdUs, 50);
+
+  ostringstream report;
+  report << "# CollisionBench report\n"
+         << "config.mobs=" << cfg.mobs << "\n"
+         << "config.projectiles=" << cfg.projectiles << "\n"
+         << "config.pellets=" << cfg.pellets << "\n"
+         << "config.ticks=" << cfg.ticks << "\n"
+         << "config.world=" << cfg.world << "\n"
+         << "config.radius=" << cfg.radius << "\n"
+         << "config.speed=" << cfg.speed << "\n"
+         << "config.cell=" << cfg.cellSize << "\n"
+         << "config.seed=" << cfg.seed << "\n"
+         << "config.simd=" << SpatialHash::simdName() << "\n"
+         << "brute_us.p50=" << percentile(bruteUs, 50) << "\n"
+         << "brute_us.p99=" << percentile(bruteUs, 99) << "\n"
+         << "grid_scalar_us.p50=" << scalarP50 << "\n"
+         << "grid_scalar_us.p99=" << percentile(scalarUs, 99) << "\n"
+         << "grid_simd_us.p50=" << simdP50 << "\n"
+         << "grid_simd_us.p99=" << percentile(simdUs, 99) << "\n"
+         << "grid_build_us.p50=" << percentile(buildUs, 50) << "\n"
+         << "speedup.grid_vs_brute="
+         << (simdP50 > 0 ? percentile(bruteUs, 50) / simdP50 : 0) << "\n"
+         << "speedup.simd_vs_scalar="
+         << (simdP50 > 0 ? scalarP50 / simdP50 : 0) << "\n"
+         << "grid.candidates_per_pellet="
+         << (pelletsTested ? double(grid.candidates) / pelletsTested : 0)
+         << "\n"
+         << "grid.cells_per_pellet="
+         << (pelletsTested ? double(grid.cellsVisited) / pelletsTested : 0)
+         << "\n"
+         << "hits.per_tick=" << double(hits) / cfg.ticks << "\n"
+         << "check.mismatched_ticks=" << mismatchedTicks << "\n";
+
+  publishReport(report.str(), cfg.outPath, cfg.baselinePath);
+  return 0;
+}
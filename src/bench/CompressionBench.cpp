@@ -0,0 +1,266 @@
+/**
+ * Payload compression benchmark: Bytes saved vs. CPU spent.
+ *
+ * For each kind of large reliable mssg the server sends (a game list, a
+ * map chunk, a batch of chat, and random bytes as the worst case), reports
+ * the codec's (see core/Compression.h) ratio and compress/decompress speed.
+ * Then, for links from 10Mbit/s to 10Gbit/s, the payload throughput
+ * (MB/s of uncompressed mssg) a connection gets sending them raw vs.
+ * compressed, counting the compression's CPU time against the link's, and
+ * what fraction AdaptiveCompressor chose to compress on that link. It should
+ * compress where that's the faster column, and stop where it isn't.
+ *
+ * Compile (from the repo root):
+ *   g++ -std=c++20 -O2 -Isrc src/bench/CompressionBench.cpp \
+ *     -o compressionbench
+ *
+ * Usage:
+ *   ./compressionbench --out base.txt
+ *   ./compressionbench --baseline base.txt
+ */
+
+#include "../core/Compression.h"
+#include "../core/messages.h"
+#include "BenchReport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+struct CompressionBenchConfig {
+  double minSec = 0.2; // Per measurement.
+  uint32_t adaptiveMssgs = 2000;
+  uint32_t seed = 1;
+  string outPath;
+  string baselinePath;
+};
+
+struct Payload {
+  string name;
+  vector<uint8_t> bytes;
+};
+
+struct LinkSpeed {
+  string name;
+  double bytesPerSec;
+};
+
+// Keeps the compiler from optimizing away a benchmarked result.
+template <typename T> inline void doNotOptimize(T const &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Fastest ns per call of fn, over batches of at least minSec.
+template <typename Fn> static double nsPerCall(double minSec, Fn &&fn) {
+  const int REPS = 5;
+
+  uint64_t iters = 1;
+  while (true) {
+    Clock::time_point start = Clock::now();
+    for (uint64_t i = 0; i < iters; i++) {
+      fn();
+    }
+    double sec = chrono::duration<double>(Clock::now() - start).count();
+    if (sec >= minSec / REPS || iters >= (1ull << 30)) {
+      break;
+    }
+    iters *= 2;
+  }
+
+  double bestNs = 1e300;
+  for (int rep = 0; rep < REPS; rep++) {
+    Clock::time_point start = Clock::now();
+    for (uint64_t i = 0; i < iters; i++) {
+      fn();
+    }
+    double ns = chrono::duration<double, nano>(Clock::now() - start).count();
+    bestNs = min(bestNs, ns / iters);
+  }
+  return bestNs;
+}
+
+// A mssg as it's sent (without its Header).
+static vector<uint8_t> wireBytes(const MessageProperties &mssg) {
+  unsigned char *bytes = serialize(mssg);
+  vector<uint8_t> wire(bytes, bytes + mssg.size());
+  delete[] bytes;
+  return wire;
+}
+
+// A JoinGame/GameList reply: Game names in a Verification's detail.
+static Payload gameList() {
+  Verification reply(1, true);
+  string games;
+  for (int i = 1; games.size() < VERIFICATION_DETAIL_LENGTH - 24; i++) {
+    games += (i % 3 ? "arena-" : "capture-the-flag-") + to_string(i) + "\n";
+  }
+  reply.setDetail(games);
+
+  return {"game_list", wireBytes(reply)};
+}
+
+// Terrain: Patches of a few tile types, with some scattered detail.
+static Payload mapChunk(mt19937 &rng) {
+  MapChunk chunk(3, 7);
+  uniform_int_distribution<int> detail(0, 15);
+  for (int y = 0; y < MAP_CHUNK_TILES; y++) {
+    for (int x = 0; x < MAP_CHUNK_TILES; x++) {
+      uint8_t tile = uint8_t(((x / 8) ^ (y / 6)) & 3);
+      chunk.tiles[y * MAP_CHUNK_TILES + x] =
+          detail(rng) == 0 ? uint8_t(4 + detail(rng) % 4) : tile;
+    }
+  }
+
+  return {"map_chunk", wireBytes(chunk)};
+}
+
+// 32 chat lines, as a batch would carry them.
+static Payload chatBatch(mt19937 &rng) {
+  const vector<string> names = {"grim", "zed", "mara", "boltz", "ana"};
+  const vector<string> words = {"brains", "left", "right", "behind", "you",
+                                "go",     "wait", "heal",  "now",    "gg",
+                                "push",   "the",  "door",  "north",  "help"};
+  uniform_int_distribution<size_t> pickName(0, names.size() - 1);
+  uniform_int_distribution<size_t> pickWord(0, words.size() - 1);
+  uniform_int_distribution<int> lineWords(2, 8);
+
+  string text;
+  for (int line = 0; line < 32; line++) {
+    text += names[pickName(rng)] + ":";
+    for (int w = lineWords(rng); w > 0; w--) {
+      text += " " + words[pickWord(rng)];
+    }
+    text += "\n";
+  }
+  return {"chat_batch", vector<uint8_t>(text.begin(), text.end())};
+}
+
+static Payload randomBytes(mt19937 &rng) {
+  Payload payload{"random", vector<uint8_t>(4096)};
+  for (uint8_t &byte : payload.bytes) {
+    byte = uint8_t(rng());
+  }
+  return payload;
+}
+
+static bool parseArgs(int argc, char **argv, CompressionBenchConfig &cfg) {
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      cerr << "Missing value for " << arg << "." << endl;
+      return false;
+    }
+    string val = argv[++i];
+
+    if (arg == "--min-time") {
+      cfg.minSec = stod(val);
+    } else if (arg == "--adaptive-mssgs") {
+      cfg.adaptiveMssgs = stoul(val);
+    } else if (arg == "--seed") {
+      cfg.seed = stoul(val);
+    } else if (arg == "--out") {
+      cfg.outPath = val;
+    } else if (arg == "--baseline") {
+      cfg.baselinePath = val;
+    } else {
+      cerr << "Unknown option " << arg << "." << endl;
+      return false;
+    }
+  }
+
+  return cfg.minSec > 0;
+}
+
+int main(int argc, char **argv) {
+  CompressionBenchConfig cfg;
+  if (!parseArgs(argc, argv, cfg)) {
+    cerr << "Usage: " << argv[0]
+         << " [--min-time SEC] [--adaptive-mssgs N] [--seed S]"
+            " [--out FILE] [--baseline FILE]"
+         << endl;
+    return 1;
+  }
+
+  mt19937 rng(cfg.seed);
+  vector<Payload> payloads = {gameList(), mapChunk(rng), chatBatch(rng),
+                              randomBytes(rng)};
+  const vector<LinkSpeed> links = {{"10mbit", 10e6 / 8},
+                                   {"100mbit", 100e6 / 8},
+                                   {"1gbit", 1e9 / 8},
+                                   {"10gbit", 10e9 / 8}};
+
+  ostringstream report;
+  report << "# CompressionBench report\n"
+         << "config.min_time_sec=" << cfg.minSec << "\n"
+         << "config.adaptive_mssgs=" << cfg.adaptiveMssgs << "\n"
+         << "config.seed=" << cfg.seed << "\n";
+
+  uint64_t roundTripFailures = 0;
+
+  for (const Payload &payload : payloads) {
+    const vector<uint8_t> &raw = payload.bytes;
+    vector<uint8_t> packed(lzBound(raw.size()));
+    vector<uint8_t> unpacked(raw.size());
+
+    size_t packedLength =
+        lzCompress(raw.data(), raw.size(), packed.data(), packed.size());
+    roundTripFailures +=
+        !lzDecompress(packed.data(), packedLength, unpacked.data(),
+                      unpacked.size()) ||
+        unpacked != raw;
+
+    double compressNs = nsPerCall(cfg.minSec, [&] {
+      doNotOptimize(
+          lzCompress(raw.data(), raw.size(), packed.data(), packed.size()));
+    });
+    double decompressNs = nsPerCall(cfg.minSec, [&] {
+      doNotOptimize(lzDecompress(packed.data(), packedLength,
+                                 unpacked.data(), unpacked.size()));
+    });
+
+    // Bytes per ns is GB/s, so * 1000 for MB/s.
+    const string &name = payload.name;
+    report << name << ".bytes=" << raw.size() << "\n"
+           << name << ".ratio=" << double(raw.size()) / packedLength << "\n"
+           << name << ".compress_MBps=" << raw.size() / compressNs * 1000
+           << "\n"
+           << name << ".decompress_MBps="
+           << raw.size() / decompressNs * 1000 << "\n";
+
+    // As the server sends it: Raw if it wouldn't be smaller.
+    size_t wireLength = min(packedLength, raw.size());
+
+    for (const LinkSpeed &link : links) {
+      double rawSec = raw.size() / link.bytesPerSec;
+      double packedSec = compressNs / 1e9 + wireLength / link.bytesPerSec;
+
+      AdaptiveCompressor compressor;
+      compressor.setLinkCapacity(uint64_t(link.bytesPerSec));
+      for (uint32_t m = 0; m < cfg.adaptiveMssgs; m++) {
+        if (compressor.shouldTry(raw.size())) {
+          compressor.record(raw.size(), packedLength, uint64_t(compressNs));
+        }
+      }
+      CompressionStats stats = compressor.getStats();
+
+      string prefix = name + "." + link.name;
+      report << prefix << ".raw_MBps=" << raw.size() / rawSec / 1e6 << "\n"
+             << prefix << ".lz_MBps=" << raw.size() / packedSec / 1e6 << "\n"
+             << prefix << ".adaptive_compressed="
+             << double(stats.compressed) / cfg.adaptiveMssgs << "\n";
+    }
+  }
+
+  report << "check.roundtrip_failures=" << roundTripFailures << "\n";
+
+  publishReport(report.str(), cfg.outPath, cfg.baselinePath);
+  return 0;
+}
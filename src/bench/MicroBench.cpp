@@ -0,0 +1,749 @@
+/**
+ * Microbenchmarks for the per-message hot paths:
+ * - serialize/deserialize for each struct in messages.h,
+ * - SerializedMessage construction and parsing, and Header decode,
+ * - Observers::notifyObservers dispatch with 1/10/100 observers,
+ * - TCP::writeTo/readFrom over a socketpair,
+ * - SourceSessionMap lookups (sender validation) with 10k sessions, and a
+ *   miss after heavy join/leave churn,
+ * - SpscQueue hand-off of a frame (the client's network thread -> game),
+ * - EntityStore passes over 4096 entities (integrate, dirty set, interest
+ *   query), and the same integrate over a map of per-entity objects,
+ * - LagHistory: recording a tick of 4096 entities, and a rewind lookup,
+ * - MapStream: A client joining (25 chunks) with every chunk encoded for it
+ *   vs. sent from the chunk cache, and a chunk written with writev() vs.
+ *   sendfile() over a socketpair,
+ * - the network API's read -> decode -> dispatch path over the in-memory
+ *   transport (no kernel), one way and echoed back,
+ * - a traffic capture replayed into a fresh server (a check, not timed).
+ *
+ * Each benchmark reports ns/op and heap allocations/op (counted by replacing
+ * the global operator new), so extra copies or allocations on the hot path
+ * show up as a regression.
+ *
+ * Some groups also assert what they measured (reported as check.NAME=value):
+ * If one doesn't hold, it's printed and the run exits 1, so the bench doubles
+ * as the repo's test.
+ *
+ * Compile (from the repo root):
+ *   g++ -std=c++20 -O2 -Isrc src/core/*.cpp src/bench/MicroBench.cpp
+ *       -o microbench
+ * (Add -fvect-cost-model=dynamic to see the entities.* passes vectorized,
+ * as a server built with -O3 would have them.)
+ *
+ * Usage:
+ *   ./microbench [--filter SUBSTRING] [--min-time SEC]
+ *                [--out FILE] [--baseline FILE]
+ */
+
+#include "../core/InMemoryTransport.h"
+#include "../core/NetworkAPI.h"
+#include "../core/Observers.h"
+#include "../core/SourceSessionMap.h"
+#include "../core/SpscQueue.h"
+#include "../core/TCP.h"
+#include "../core/messages.h"
+#include "../server/EntityStore.h"
+#include "../server/LagCompensation.h"
+#include "../server/MapStream.h"
+#include "BenchReport.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+// =======================================
+// Allocation counting
+
+static atomic<uint64_t> allocCount{0};
+
+void *operator new(size_t size) {
+  allocCount.fetch_add(1, memory_order_relaxed);
+  if (void *ptr = malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+// =======================================
+// Harness
+
+// Keeps the compiler from optimizing away a benchmarked result.
+template <typename T> inline void doNotOptimize(T const &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchResult {
+  string name;
+  double nsPerOp;
+  double allocsPerOp;
+};
+
+/**
+ * Grows the iteration count until one batch takes at least minSec,
+ * then reports the fastest of REPS batches.
+ */
+template <typename Fn>
+BenchResult runBench(const string &name, double minSec, Fn &&fn) {
+  const int REPS = 5;
+
+  uint64_t iters = 1;
+  while (true) {
+    Clock::time_point start = Clock::now();
+    for (uint64_t i = 0; i < iters; i++) {
+      fn();
+    }
+    double sec = chrono::duration<double>(Clock::now() - start).count();
+    if (sec >= minSec || iters >= (1ull << 30)) {
+      break;
+    }
+    iters *= 2;
+  }
+
+  double bestNs = 1e300;
+  uint64_t allocs = 0;
+
+  for (int rep = 0; rep < REPS; rep++) {
+    uint64_t allocsBefore = allocCount.load(memory_order_relaxed);
+    Clock::time_point start = Clock::now();
+
+    for (uint64_t i = 0; i < iters; i++) {
+      fn();
+    }
+
+    double ns = chrono::duration<double, nano>(Clock::now() - start).count();
+    bestNs = min(bestNs, ns / iters);
+    allocs = allocCount.load(memory_order_relaxed) - allocsBefore;
+  }
+
+  return {name, bestNs, double(allocs) / iters};
+}
+
+// TCP is abstract only for its socket setup, which a socketpair replaces.
+class SocketPairTCP : public TCP {
+public:
+  bool initSocket() override { return true; }
+};
+
+// =======================================
+// Benchmarks
+
+template <typename mssgStruct>
+void benchSerialization(vector<BenchResult> &results, const string &name,
+                        const mssgStruct &mssg, double minSec) {
+  results.push_back(runBench("serialize." + name, minSec, [&] {
+    unsigned char *bytes = serialize(mssg);
+    doNotOptimize(bytes);
+    delete[] bytes;
+  }));
+
+  unsigned char *bytes = serialize(mssg);
+  results.push_back(runBench("deserialize." + name, minSec, [&] {
+    if constexpr (is_base_of_v<MessageProperties, mssgStruct>) {
+      mssgStruct copy;
+      doNotOptimize(deserialize(bytes, mssg.size(), copy));
+      doNotOptimize(copy);
+    } else {
+      mssgStruct copy = deserialize<mssgStruct>(bytes);
+      doNotOptimize(copy);
+    }
+  }));
+  delete[] bytes;
+}
+
+void benchObservers(vector<BenchResult> &results, size_t numObservers,
+                    double minSec) {
+  Observers observers;
+  uint64_t sum = 0;
+
+  for (size_t i = 0; i < numObservers; i++) {
+    observers.registerObserver(
+        static_cast<uint8_t>(EventCode::Movement),
+        std::function<void(uint32_t, uint32_t, uint32_t)>(
+            [&sum](uint32_t objectID, uint32_t xCoord, uint32_t yCoord) {
+              sum += objectID + xCoord + yCoord;
+            }));
+  }
+
+  uint32_t objectID = 7, xCoord = 100, yCoord = 200;
+  results.push_back(runBench(
+      "observers.notify." + to_string(numObservers), minSec, [&] {
+        observers.notifyObservers(static_cast<uint8_t>(EventCode::Movement),
+                                  objectID, xCoord, yCoord);
+      }));
+  doNotOptimize(sum);
+}
+
+void benchTCP(vector<BenchResult> &results, size_t payloadSize,
+              double minSec) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    cerr << "MicroBench socketpair failed: " << strerror(errno) << endl;
+    return;
+  }
+
+  SocketPairTCP tcp;
+
+  // writeTo sends a C string, so the payload can't contain '\0'.
+  string payload(payloadSize, 'z');
+
+  results.push_back(runBench(
+      "tcp.write_read." + to_string(payloadSize), minSec, [&] {
+        tcp.writeTo(fds[0], payload.c_str());
+        char *mssg = tcp.readFrom(fds[1], payloadSize);
+        doNotOptimize(mssg);
+        delete[] mssg;
+      }));
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// A measured value, and whether it's what the group expects.
+struct Check {
+  uint64_t value = 0;
+  bool passed = true;
+};
+
+using InMemoryServerAPI = BasicServerNetworkAPI<InMemoryServerTransport>;
+using InMemoryClientAPI = BasicClientNetworkAPI<InMemoryClientTransport>;
+
+// The server needs a Register callback set.
+bool registerInMemory(InMemoryServerAPI &server, InMemoryClientAPI &client) {
+  // Registration needs both sides reading while registerPlayer waits.
+  client.connect();
+  atomic<bool> registering{true};
+  thread serverThread([&] {
+    while (registering) {
+      server.pump(1);
+    }
+  });
+  thread clientThread([&] {
+    while (registering) {
+      client.pump(1);
+    }
+  });
+  bool registered = client.registerPlayer();
+  registering = false;
+  serverThread.join();
+  clientThread.join();
+  server.pump(0); // The client's UDP-bind Register.
+
+  if (!registered) {
+    cerr << "MicroBench: In-memory registration failed." << endl;
+  }
+  return registered;
+}
+
+/**
+ * A client move through BasicServerNetworkAPI<InMemoryServerTransport>:
+ * send, pump (decode + dispatch to the Movement callback), and for the echo,
+ * the server's Location broadcast back to the client's callback.
+ *
+ * Checks first that the server's congestion Pings come back: Each one
+ * the client doesn't echo (or echoes with the wrong seq) is counted.
+ */
+void benchInMemoryAPI(vector<BenchResult> &results,
+                      map<string, Check> &checks, double minSec) {
+  InMemoryHub hub;
+  InMemoryServerAPI server(hub);
+  InMemoryClientAPI client(hub);
+
+  // A Ping every flush, for the round-trip check (a limited link, as
+  // unlimited ones aren't probed).
+  SchedulerConfig probeEveryFlush;
+  probeEveryFlush.congestion.probeIntervalMs = 0;
+  server.setSendConfig(probeEveryFlush);
+  server.getTransport().setCapacity(1 << 30);
+
+  uint64_t movesHandled = 0, locationsReceived = 0;
+  bool echo = false;
+
+  server.registerCallback(EventCode::Register,
+                          std::function<void(uint32_t *)>(
+                              [](uint32_t *objectID) { *objectID = 1; }));
+  server.registerCallback(
+      EventCode::Movement,
+      std::function<void(uint32_t, uint32_t, uint32_t)>(
+          [&](uint32_t objectID, uint32_t xCoord, uint32_t yCoord) {
+            movesHandled++;
+            if (echo) {
+              Coord2D location(objectID, xCoord, yCoord);
+              server.sendUDPEvent(decltype(server)::BROADCAST_ID, location);
+            }
+          }));
+  client.registerCallback(
+      EventCode::Location,
+      std::function<void(uint32_t, uint32_t, uint32_t)>(
+          [&](uint32_t, uint32_t, uint32_t) { locationsReceived++; }));
+
+  if (!registerInMemory(server, client)) {
+    return;
+  }
+
+  const uint64_t PINGS = 8;
+  for (uint64_t i = 0; i < PINGS; i++) {
+    server.flushWrites();
+    client.pump(0);
+    server.pump(0);
+  }
+  CongestionStats congestion;
+  for (const auto &[id, stats] : server.getSendStats()) {
+    congestion = stats.congestion;
+  }
+  uint64_t unanswered = congestion.probesSent - congestion.probesEchoed;
+  checks["ping_sent"] = {congestion.probesSent, congestion.probesSent > 0};
+  checks["ping_unanswered"] = {unanswered, unanswered == 0};
+  server.setSendConfig(SchedulerConfig());
+  server.getTransport().setCapacity(UNLIMITED_CAPACITY);
+
+  // These measure the dispatch path; drops are measured below.
+  RateLimitConfig noLimits;
+  noLimits.enabled = false;
+  server.setRateLimits(noLimits);
+
+  results.push_back(runBench("api.inmemory.move_dispatch", minSec, [&] {
+    client.sendMove(1, 100, 200);
+    server.pump(0);
+  }));
+
+  echo = true;
+  results.push_back(runBench("api.inmemory.move_echo", minSec, [&] {
+    client.sendMove(1, 100, 200);
+    server.pump(0);
+    server.flushWrites();
+    client.pump(0);
+  }));
+
+  // A flooding client: Moves over its limit are dropped once the Header
+  // is read. One Move, serialized up front and injected as if it had
+  // arrived from the client, so allocs/op are the drop path's alone (the
+  // client's send and the hub's copy allocate), and must be 0.
+  echo = false;
+  RateLimitConfig floodLimits;
+  floodLimits.setLimit(EventCode::Movement, {1, 1}, {1, 1});
+  server.setRateLimits(floodLimits);
+
+  SerializedMessage move(1, Coord2D(1, 100, 200)); // The server's session 1.
+  vector<char> moveFrame(sizeof(Header) + frameMssgLength(move));
+  memcpy(moveFrame.data(), move.header, sizeof(Header));
+  memcpy(moveFrame.data() + sizeof(Header), move.message,
+         moveFrame.size() - sizeof(Header));
+  InMemoryServerTransport::Peer fromClient{0}; // The hub's first client.
+
+  BenchResult floodDrop =
+      runBench("api.inmemory.move_flood_drop", minSec, [&] {
+        server.getTransport().inject(server, fromClient, moveFrame.data(),
+                                     moveFrame.size(), Delivery::Unreliable);
+      });
+  results.push_back(floodDrop);
+  checks["move_flood_drop_allocs_per_op"] = {
+      uint64_t(ceil(floodDrop.allocsPerOp)), floodDrop.allocsPerOp == 0};
+
+  doNotOptimize(movesHandled);
+  doNotOptimize(locationsReceived);
+}
+
+/**
+ * Capture -> replay over the in-memory transport: A server captures a
+ * client's moves, then a second server replays the log twice, and must
+ * have none of the log's sessions left after. The live server must refuse
+ * to replay it over its own sessions.
+ */
+void checkReplay(map<string, Check> &checks) {
+  string path = "/tmp/microbench-replay-" + to_string(getpid()) + ".log";
+  std::function<void(uint32_t *)> onRegister(
+      [](uint32_t *objectID) { *objectID = 1; });
+
+  InMemoryHub hub;
+  InMemoryServerAPI server(hub);
+  InMemoryClientAPI client(hub);
+  uint64_t liveMoves = 0;
+  server.registerCallback(EventCode::Register, onRegister);
+  server.registerCallback(
+      EventCode::Movement,
+      std::function<void(uint32_t, uint32_t, uint32_t)>(
+          [&](uint32_t, uint32_t, uint32_t) { liveMoves++; }));
+  if (!registerInMemory(server, client) || !server.startCapture(path)) {
+    checks["replay_captured"] = {0, false};
+    return;
+  }
+
+  RateLimitConfig noLimits;
+  noLimits.enabled = false;
+  server.setRateLimits(noLimits);
+  for (uint32_t i = 0; i < 100; i++) {
+    client.sendUnpredictedMove(1, i, i);
+    server.pump(0);
+  }
+  server.stopCapture();
+  uint64_t captured = liveMoves;
+  checks["replay_captured"] = {captured, captured == 100};
+
+  uint64_t overLive = server.replayCapture(path, 0);
+  checks["replay_over_live_sessions"] = {overLive, overLive == 0};
+
+  InMemoryHub replayHub;
+  InMemoryServerAPI replayServer(replayHub);
+  uint64_t replayedMoves = 0;
+  replayServer.registerCallback(
+      EventCode::Movement,
+      std::function<void(uint32_t, uint32_t, uint32_t)>(
+          [&](uint32_t, uint32_t, uint32_t) { replayedMoves++; }));
+
+  for (const char *pass : {"replay_moves", "replay_moves_again"}) {
+    replayedMoves = 0;
+    uint64_t replayed = replayServer.replayCapture(path, 0);
+    checks[pass] = {replayedMoves, replayed == captured &&
+                                       replayedMoves == captured};
+  }
+
+  // The client was the live server's first session, 1: Only a session can
+  // join a room.
+  uint32_t room = replayServer.createRoom(
+      "replay", 1, [](Room &, const vector<RoomInput> &, double) {});
+  uint64_t left = replayServer.joinRoom(room, 1) ? 1 : 0;
+  checks["replay_sessions_left"] = {left, left == 0};
+
+  unlink(path.c_str());
+}
+
+/**
+ * Whole-store passes over a room's worth of mobs, and for comparison,
+ * the integrate pass over one heap object per entity (in a map by objectID).
+ */
+void benchEntities(vector<BenchResult> &results, double minSec) {
+  const uint32_t COUNT = 4096;
+  EntityStore entities;
+  entities.reserve(COUNT);
+
+  struct MobObject {
+    uint32_t objectID;
+    float xCoord, yCoord, xVelocity, yVelocity;
+    uint32_t seq;
+    bool dirty;
+  };
+  unordered_map<uint32_t, unique_ptr<MobObject>> mobObjects;
+
+  for (uint32_t i = 0; i < COUNT; i++) {
+    float x = float(i * 37 % 1024), y = float(i * 91 % 1024);
+    // A quarter of them moving.
+    float v = i % 4 == 0 ? 60.0f : 0.0f;
+    EntityHandle handle = entities.create(1000 + i, x, y);
+    entities.setVelocity(handle, v, -v);
+    mobObjects.emplace(1000 + i, make_unique<MobObject>(
+                                     MobObject{1000 + i, x, y, v, -v, 0, false}));
+  }
+
+  results.push_back(runBench("entities.integrate_4096", minSec, [&] {
+    entities.integrate(1.0f / 30);
+    doNotOptimize(entities.xCoords()[0]);
+  }));
+
+  results.push_back(runBench("entities.map_integrate_4096", minSec, [&] {
+    for (auto &[objectID, mob] : mobObjects) {
+      mob->xCoord += mob->xVelocity * (1.0f / 30);
+      mob->yCoord += mob->yVelocity * (1.0f / 30);
+      mob->dirty |= mob->xVelocity != 0 || mob->yVelocity != 0;
+    }
+    doNotOptimize(mobObjects.begin()->second->xCoord);
+  }));
+
+  vector<uint32_t> indices;
+  indices.reserve(COUNT);
+  results.push_back(runBench("entities.collect_dirty_4096", minSec, [&] {
+    entities.clearDirty();
+    entities.integrate(1.0f / 30);
+    doNotOptimize(entities.collectDirty(DIRTY_POSITION, indices));
+  }));
+
+  results.push_back(runBench("entities.query_radius_4096", minSec, [&] {
+    doNotOptimize(entities.queryRadius(512, 512, 128, indices));
+  }));
+
+  // A quarter of them move each tick, so are recorded.
+  LagHistory history;
+  uint32_t tick = 0;
+  results.push_back(runBench("lag.record_4096", minSec, [&] {
+    entities.integrate(1.0f / 30);
+    history.record(++tick, entities);
+    entities.clearDirty();
+  }));
+
+  uint32_t objectID = 1000;
+  results.push_back(runBench("lag.rewind_lookup", minSec, [&] {
+    doNotOptimize(history.wasWithin(objectID, tick - 4.5, 100, 100, 16));
+    objectID = objectID + 1 == 1000 + COUNT ? 1000 : objectID + 1;
+  }));
+}
+
+static void fillChunk(int32_t chunkX, int32_t chunkY, uint8_t *tiles) {
+  for (int i = 0; i < MAP_CHUNK_TILES * MAP_CHUNK_TILES; i++) {
+    tiles[i] = uint8_t(chunkX * 7 + chunkY * 13 + i % 5);
+  }
+}
+
+/**
+ * A client joining: The 25 chunks around it, each generated and serialized
+ * for it (as every mssg is), vs. from the MapStream's cache (only the first
+ * client pays for encoding). Then one chunk's frame on a socketpair, copied
+ * through writev() vs. sent from the cache file with sendfile().
+ */
+void benchMapStream(vector<BenchResult> &results, double minSec) {
+  MapStream stream(fillChunk);
+  if (!stream.open()) {
+    return;
+  }
+
+  vector<OutboundMssg> queued;
+  queued.reserve(32);
+  results.push_back(runBench("map.join_encoded", minSec, [&] {
+    queued.clear();
+    for (int32_t cy = 10; cy < 15; cy++) {
+      for (int32_t cx = 10; cx < 15; cx++) {
+        MapChunk chunk(cx, cy);
+        fillChunk(cx, cy, chunk.tiles);
+        OutboundMssg outbound;
+        outbound.mssg = make_shared<SerializedMessage>(0, chunk);
+        queued.push_back(std::move(outbound));
+      }
+    }
+  }));
+
+  uint32_t sessionID = 1;
+  auto queue = [&](OutboundMssg chunk) { queued.push_back(std::move(chunk)); };
+  stream.streamAround(sessionID, 6000, 6000, queue); // Fills the cache.
+  results.push_back(runBench("map.join_cached", minSec, [&] {
+    queued.clear();
+    stream.forget(sessionID);
+    stream.streamAround(++sessionID, 6000, 6000, queue);
+  }));
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    cerr << "MicroBench socketpair failed: " << strerror(errno) << endl;
+    return;
+  }
+
+  SocketPairTCP tcp;
+  const FileFrame frame = *queued.front().file;
+  SerializedMessage mssg(const_cast<unsigned char *>(frame.data));
+  vector<unsigned char> received(frame.length);
+
+  results.push_back(runBench("map.chunk_writev", minSec, [&] {
+    tcp.writeFrame(fds[0], mssg.header, sizeof(Header), mssg.message,
+                   frame.length - sizeof(Header));
+    tcp.readExactly(fds[1], received.data(), frame.length);
+  }));
+
+  results.push_back(runBench("map.chunk_sendfile", minSec, [&] {
+    tcp.writeFile(fds[0], frame.fd, frame.offset, frame.length);
+    tcp.readExactly(fds[1], received.data(), frame.length);
+  }));
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+int main(int argc, char **argv) {
+  string filter, outPath, baselinePath;
+  double minSec = 0.2;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    string arg = argv[i];
+    if (arg == "--filter") {
+      filter = argv[i + 1];
+    } else if (arg == "--min-time") {
+      minSec = stod(argv[i + 1]);
+    } else if (arg == "--out") {
+      outPath = argv[i + 1];
+    } else if (arg == "--baseline") {
+      baselinePath = argv[i + 1];
+    } else {
+      cerr << "Usage: " << argv[0]
+           << " [--filter SUBSTRING] [--min-time SEC] [--out FILE]"
+              " [--baseline FILE]"
+           << endl;
+      return 1;
+    }
+  }
+
+  vector<BenchResult> results;
+
+  // Each group is skipped entirely if none of its names can match the filter.
+  auto wanted = [&](const string &group) {
+    return filter.empty() || group.find(filter) != string::npos ||
+           filter.find(group) != string::npos;
+  };
+
+  map<string, Check> checks;
+
+  if (wanted("serialize")) {
+    benchSerialization(results, "Header", Header(EventCode::Movement, 1, 12),
+                       minSec);
+    benchSerialization(results, "Verification", Verification(true), minSec);
+    benchSerialization(results, "ChatMessage", ChatMessage("grr... brains"),
+                       minSec);
+    benchSerialization(results, "Coord2D", Coord2D(7, 100, 200), minSec);
+    benchSerialization(results, "Action", Action(1, 10, 7), minSec);
+  }
+
+  if (wanted("serialized_message")) {
+    Coord2D coord(7, 100, 200);
+
+    results.push_back(runBench("serialized_message.construct", minSec, [&] {
+      SerializedMessage mssg(1, coord);
+      doNotOptimize(mssg.message);
+    }));
+
+    // Wire layout: Header, then the message.
+    SerializedMessage sent(1, coord);
+    Header hdr = deserialize<Header>(sent.header);
+    vector<unsigned char> wire(sizeof(Header) + hdr.mssgLength);
+    memcpy(wire.data(), sent.header, sizeof(Header));
+    memcpy(wire.data() + sizeof(Header), sent.message, hdr.mssgLength);
+
+    results.push_back(runBench("serialized_message.parse", minSec, [&] {
+      SerializedMessage mssg(wire.data());
+      doNotOptimize(mssg.message);
+    }));
+
+    results.push_back(runBench("header.decode", minSec, [&] {
+      Header decoded = deserialize<Header>(wire.data());
+      doNotOptimize(decoded);
+    }));
+  }
+
+  if (wanted("observers")) {
+    for (size_t n : {1, 10, 100}) {
+      benchObservers(results, n, minSec);
+    }
+  }
+
+  if (wanted("tcp")) {
+    for (size_t n : {16, 256, 4096}) {
+      benchTCP(results, n, minSec);
+    }
+  }
+
+  if (wanted("session_lookup")) {
+    // Keys shaped like UDP sources: IP << 16 | port.
+    SourceSessionMap sourceSessions;
+    vector<uint64_t> sources;
+    for (uint32_t id = 1; id <= 10000; id++) {
+      sources.push_back((uint64_t(0x0A000000 + id) << 16) | (40000 + id % 997));
+      sourceSessions.insert(sources.back(), id);
+    }
+
+    size_t next = 0;
+    results.push_back(runBench("session_lookup.find", minSec, [&] {
+      doNotOptimize(sourceSessions.find(sources[next]));
+      next = next + 1 == sources.size() ? 0 : next + 1;
+    }));
+
+    // Churn: Sessions leave and new ones join from anywhere, many times the
+    // capacity over, so tombstones fill every slot that isn't live. A miss
+    // (a spoofed source) must still stop within a short probe.
+    mt19937_64 rng(1);
+    for (uint32_t id = 10001; id <= 20 * 65536; id++) {
+      size_t leaving = id % sources.size();
+      sourceSessions.erase(sources[leaving]);
+      sources[leaving] = rng() & 0xFFFFFFFFFFFFull; // IP << 16 | port
+      sourceSessions.insert(sources[leaving], id);
+    }
+    uint64_t maxProbe = sourceSessions.getMaxProbe();
+    checks["session_max_probe_after_churn"] = {maxProbe, maxProbe <= 64};
+
+    uint64_t spoofed = uint64_t(0xC0A80000) << 16;
+    results.push_back(runBench("session_lookup.miss_after_churn", minSec, [&] {
+      doNotOptimize(sourceSessions.find(spoofed++));
+    }));
+  }
+
+  if (wanted("spsc")) {
+    // Same thread pushes and pops: The cost of the hand-off itself.
+    SpscQueue<vector<char>> frames(1024);
+    char frame[sizeof(Header) + 12] = {};
+
+    results.push_back(runBench("spsc.frame_push_pop", minSec, [&] {
+      vector<char> *slot = frames.prepare();
+      slot->assign(frame, frame + sizeof(frame));
+      frames.publish();
+      doNotOptimize(frames.front()->data());
+      frames.pop();
+    }));
+  }
+
+  if (wanted("entities") || wanted("lag")) {
+    benchEntities(results, minSec);
+  }
+
+  if (wanted("map")) {
+    benchMapStream(results, minSec);
+  }
+
+  if (wanted("api.inmemory")) {
+    benchInMemoryAPI(results, checks, minSec);
+  }
+
+  if (wanted("replay")) {
+    checkReplay(checks);
+  }
+
+  ostringstream report;
+  report << "# MicroBench report (ns/op, allocs/op)\n"
+         << "config.min_time_sec=" << minSec << "\n";
+
+  cerr << left << setw(32) << "benchmark" << right << setw(12) << "ns/op"
+       << setw(12) << "allocs/op" << endl;
+
+  for (const BenchResult &r : results) {
+    if (!filter.empty() && r.name.find(filter) == string::npos) {
+      continue;
+    }
+
+    cerr << left << setw(32) << r.name << right << setw(12) << fixed
+         << setprecision(1) << r.nsPerOp << setw(12) << setprecision(2)
+         << r.allocsPerOp << endl;
+
+    report << r.name << ".ns_per_op=" << r.nsPerOp << "\n"
+           << r.name << ".allocs_per_op=" << r.allocsPerOp << "\n";
+  }
+  cerr << endl;
+
+  bool passed = true;
+  for (const auto &[name, check] : checks) {
+    report << "check." << name << "=" << check.value << "\n";
+    if (!check.passed) {
+      cerr << "Check failed: " << name << "=" << check.value << endl;
+      passed = false;
+    }
+  }
+
+  publishReport(report.str(), outPath, baselinePath);
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,403 @@
+/**
+ * Many-rooms benchmark: How many concurrent matches one process can tick.
+ *
+ * Creates N rooms on a RoomManager (see server/Rooms.h), each with a few
+ * players and a crowd of mobs, and ticks them all on the shared
+ * work-stealing pool. A feeder thread plays the server's read thread: it
+ * queues each player's moves on its room at a fixed rate. Each tick applies
+ * its moves, steers and integrates the mobs, checks every pair of entities
+ * for contact, collects the dirty entities a snapshot would send (on the
+ * room's EntityStore) and records them in its lag-compensation history.
+ * Every move is also checked as a shot, against a mob rewound to what the
+ * player saw. Room sizes (drawn between --min-mobs and --max-mobs) give
+ * uneven ticks for the pool to balance.
+ *
+ * Reports how late ticks start (a due tick waiting for a worker), how long
+ * they run, overruns (ticks skipped because the previous one was still
+ * running), the per-room CPU time from RoomStats, and how many ticks the
+ * workers stole from each other.
+ *
+ * Compile (from the repo root):
+ *   g++ -std=c++20 -O3 -Isrc src/bench/RoomBench.cpp -o roombench -lpthread
+ *
+ * Usage:
+ *   ./roombench --rooms 500 --tick-hz 30 --duration 10 --out base.txt
+ *   ./roombench --rooms 500 --tick-hz 30 --duration 10 --baseline base.txt
+ */
+
+#include "../server/Rooms.h"
+#include "BenchReport.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+struct RoomBenchConfig {
+  uint32_t rooms = 500;
+  uint32_t playersPerRoom = 4;
+  uint32_t minMobs = 16;   // Mobs per room, drawn from [minMobs, maxMobs].
+  uint32_t maxMobs = 128;
+  double tickHz = 30;
+  double inputHz = 20;     // Moves per second, per player.
+  size_t threads = 0;      // Pool threads (0: One per core).
+  double durationSec = 10; // Measured run time.
+  double warmupSec = 1;    // Samples before this are discarded.
+  uint32_t seed = 1;
+  string outPath;
+  string baselinePath;
+};
+
+// Tick-only, per room: Written by its ticks, read after the pool stops.
+struct RoomSamples {
+  vector<double> lateUs;
+  vector<double> tickUs;
+  uint64_t contacts = 0;
+  uint64_t dirty = 0;
+  uint64_t hits = 0;
+  vector<uint32_t> dirtyIndices; // Scratch.
+};
+
+struct MobSpawn {
+  uint32_t objectID;
+  float xCoord;
+  float yCoord;
+};
+
+static constexpr uint32_t FIRST_MOB_ID = 1000000;
+static constexpr float MOB_SPEED = 60; // Units per second.
+
+// The shooter's view, for the rewind: RTT and interpolation delay.
+static constexpr double VIEW_RTT_MS = 80;
+static constexpr double VIEW_DELAY_MS = 50;
+
+static int64_t steadyNs() {
+  return chrono::duration_cast<chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+// =======================================
+// Room simulation
+
+/**
+ * Players' entities take their latest move; mobs head for a point that
+ * drifts over time, and are integrated. Then every pair is checked for
+ * contact (the broad-phase a real game would do per tick), and the dirty
+ * entities are collected as for a snapshot.
+ */
+static void simulateTick(Room &room, const vector<RoomInput> &inputs,
+                         double dtSec, RoomSamples &samples,
+                         const atomic<bool> &measuring) {
+  int64_t startNs = steadyNs();
+  EntityStore &entities = room.entities;
+
+  for (const RoomInput &input : inputs) {
+    EntityHandle handle = entities.find(input.objectID);
+    if (handle == EntityStore::NO_ENTITY) {
+      handle = entities.create(input.objectID, input.xCoord, input.yCoord);
+    }
+    entities.setPosition(handle, input.xCoord, input.yCoord, input.seq);
+  }
+
+  float targetX = float(startNs / 1000000 % 1024);
+  float targetY = 1024 - targetX;
+  size_t count = entities.size();
+  const uint32_t *objectIDs = entities.objectIDs();
+  const float *x = entities.xCoords();
+  const float *y = entities.yCoords();
+  float *vx = entities.xVelocities();
+  float *vy = entities.yVelocities();
+
+  for (size_t i = 0; i < count; i++) {
+    float speed = objectIDs[i] >= FIRST_MOB_ID ? MOB_SPEED : 0;
+    vx[i] = x[i] < targetX ? speed : -speed;
+    vy[i] = y[i] < targetY ? speed : -speed;
+  }
+  entities.integrate(float(dtSec));
+
+  uint64_t contacts = 0;
+  for (size_t a = 0; a < count; a++) {
+    for (size_t b = a + 1; b < count; b++) {
+      float dx = x[a] - x[b];
+      float dy = y[a] - y[b];
+      contacts += dx * dx + dy * dy < 64;
+    }
+  }
+
+  size_t dirty = entities.collectDirty(DIRTY_POSITION, samples.dirtyIndices);
+  room.history.record(room.getTickNumber(), entities);
+  entities.clearDirty();
+
+  // Each move doubles as a shot at the room's first mob.
+  double viewTick = room.history.viewTick(room.getTickNumber(), VIEW_RTT_MS,
+                                          VIEW_DELAY_MS);
+  uint64_t hits = 0;
+  for (const RoomInput &input : inputs) {
+    hits += room.history.wasWithin(FIRST_MOB_ID, viewTick, input.xCoord,
+                                   input.yCoord, 64);
+  }
+
+  if (measuring.load(memory_order_relaxed)) {
+    samples.lateUs.push_back(double(startNs - room.getTickDueNs()) / 1e3);
+    samples.tickUs.push_back(double(steadyNs() - startNs) / 1e3);
+    samples.contacts += contacts;
+    samples.dirty += dirty;
+    samples.hits += hits;
+  }
+}
+
+// =======================================
+// Report
+
+static double percentile(const vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t idx = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[min(idx, sorted.size() - 1)];
+}
+
+static double cpuSeconds(const struct rusage &usage) {
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static bool parseArgs(int argc, char **argv, RoomBenchConfig &cfg) {
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      cerr << "Missing value for " << arg << "." << endl;
+      return false;
+    }
+    string val = argv[++i];
+
+    if (arg == "--rooms") {
+      cfg.rooms = stoul(val);
+    } else if (arg == "--players") {
+      cfg.playersPerRoom = stoul(val);
+    } else if (arg == "--min-mobs") {
+      cfg.minMobs = stoul(val);
+    } else if (arg == "--max-mobs") {
+      cfg.maxMobs = stoul(val);
+    } else if (arg == "--tick-hz") {
+      cfg.tickHz = stod(val);
+    } else if (arg == "--input-hz") {
+      cfg.inputHz = stod(val);
+    } else if (arg == "--threads") {
+      cfg.threads = stoul(val);
+    } else if (arg == "--duration") {
+      cfg.durationSec = stod(val);
+    } else if (arg == "--warmup") {
+      cfg.warmupSec = stod(val);
+    } else if (arg == "--seed") {
+      cfg.seed = stoul(val);
+    } else if (arg == "--out") {
+      cfg.outPath = val;
+    } else if (arg == "--baseline") {
+      cfg.baselinePath = val;
+    } else {
+      cerr << "Unknown option " << arg << "." << endl;
+      return false;
+    }
+  }
+
+  return cfg.rooms > 0 && cfg.tickHz > 0 && cfg.inputHz > 0 &&
+         cfg.durationSec > 0 && cfg.minMobs <= cfg.maxMobs;
+}
+
+int main(int argc, char **argv) {
+  RoomBenchConfig cfg;
+  if (!parseArgs(argc, argv, cfg)) {
+    cerr << "Usage: " << argv[0]
+         << " [--rooms N] [--players N] [--min-mobs N] [--max-mobs N]"
+            " [--tick-hz HZ] [--input-hz HZ] [--threads N]"
+            " [--duration SEC] [--warmup SEC] [--seed S]"
+            " [--out FILE] [--baseline FILE]"
+         << endl;
+    return 1;
+  }
+
+  mt19937 rng(cfg.seed);
+  uniform_int_distribution<uint32_t> mobCount(cfg.minMobs, cfg.maxMobs);
+  uniform_int_distribution<uint32_t> coord(0, 1023);
+
+  auto manager = make_unique<RoomManager>();
+  manager->setThreadCount(cfg.threads);
+
+  atomic<bool> measuring{false};
+  vector<RoomSamples> samples(cfg.rooms);
+  vector<uint32_t> roomIDs;
+
+  // Rooms start ticking as they're created; mobs are added on their first.
+  for (uint32_t r = 0; r < cfg.rooms; r++) {
+    uint32_t mobs = mobCount(rng);
+    vector<MobSpawn> spawn;
+    for (uint32_t m = 0; m < mobs; m++) {
+      spawn.push_back({FIRST_MOB_ID + m, float(coord(rng)), float(coord(rng))});
+    }
+
+    RoomSamples *roomSamples = &samples[r];
+    roomIDs.push_back(manager->createRoom(
+        "room" + to_string(r), cfg.tickHz,
+        [&measuring, roomSamples, spawn](Room &room,
+                                         const vector<RoomInput> &inputs,
+                                         double dtSec) {
+          if (room.entities.empty()) {
+            room.entities.reserve(spawn.size() + 16);
+            for (const MobSpawn &mob : spawn) {
+              room.entities.create(mob.objectID, mob.xCoord, mob.yCoord);
+            }
+          }
+          simulateTick(room, inputs, dtSec, *roomSamples, measuring);
+        }));
+  }
+
+  // Sessions 1.. are the players, in room order.
+  uint32_t players = cfg.rooms * cfg.playersPerRoom;
+  for (uint32_t p = 0; p < players; p++) {
+    manager->join(roomIDs[p / cfg.playersPerRoom], p + 1);
+  }
+
+  Clock::time_point start = Clock::now();
+  Clock::time_point measureFrom =
+      start + chrono::duration_cast<Clock::duration>(
+                  chrono::duration<double>(cfg.warmupSec));
+  Clock::time_point end =
+      measureFrom + chrono::duration_cast<Clock::duration>(
+                        chrono::duration<double>(cfg.durationSec));
+
+  // The read thread's part: Every player's moves, spread over each second.
+  atomic<uint64_t> inputsSent{0};
+  thread feeder([&] {
+    mt19937 feedRng(cfg.seed + 1);
+    uniform_int_distribution<uint32_t> feedCoord(0, 1023);
+    auto interval = chrono::duration_cast<Clock::duration>(
+        chrono::duration<double>(1.0 / (cfg.inputHz * max(players, 1u))));
+    vector<uint32_t> seqs(players, 0);
+    Clock::time_point nextSend = start;
+
+    for (uint32_t p = 0; Clock::now() < end && players > 0;
+         p = (p + 1) % players) {
+      RoomInput input;
+      input.senderID = p + 1;
+      input.mssgType = EventCode::Movement;
+      input.objectID = p + 1;
+      input.xCoord = feedCoord(feedRng);
+      input.yCoord = feedCoord(feedRng);
+      input.seq = ++seqs[p];
+      manager->submitInput(input);
+      inputsSent++;
+
+      nextSend += interval;
+      this_thread::sleep_until(nextSend);
+    }
+  });
+
+  this_thread::sleep_until(measureFrom);
+  map<uint32_t, RoomStats> statsBefore = manager->getStats();
+  WorkStealingStats poolBefore = manager->getPoolStats();
+  struct rusage usageBefore;
+  getrusage(RUSAGE_SELF, &usageBefore);
+  measuring = true;
+
+  this_thread::sleep_until(end);
+  measuring = false;
+  map<uint32_t, RoomStats> statsAfter = manager->getStats();
+  WorkStealingStats poolAfter = manager->getPoolStats();
+  struct rusage usageAfter;
+  getrusage(RUSAGE_SELF, &usageAfter);
+
+  feeder.join();
+  manager.reset(); // Stops the clock and waits for running ticks.
+
+  // Merge per-tick samples, and per-room CPU over the measured run.
+  vector<double> lateUs, tickUs, roomCpuPct;
+  uint64_t ticks = 0, overruns = 0, inputs = 0, contacts = 0, dirty = 0;
+  uint64_t hits = 0;
+  for (uint32_t r = 0; r < cfg.rooms; r++) {
+    lateUs.insert(lateUs.end(), samples[r].lateUs.begin(),
+                  samples[r].lateUs.end());
+    tickUs.insert(tickUs.end(), samples[r].tickUs.begin(),
+                  samples[r].tickUs.end());
+    contacts += samples[r].contacts;
+    dirty += samples[r].dirty;
+    hits += samples[r].hits;
+
+    const RoomStats &before = statsBefore[roomIDs[r]];
+    const RoomStats &after = statsAfter[roomIDs[r]];
+    ticks += after.ticks - before.ticks;
+    overruns += after.overruns - before.overruns;
+    inputs += after.inputs - before.inputs;
+    roomCpuPct.push_back(100.0 * (after.cpuNs - before.cpuNs) / 1e9 /
+                         cfg.durationSec);
+  }
+  sort(lateUs.begin(), lateUs.end());
+  sort(tickUs.begin(), tickUs.end());
+  sort(roomCpuPct.begin(), roomCpuPct.end());
+
+  double roomCpuTotal = 0;
+  for (double pct : roomCpuPct) {
+    roomCpuTotal += pct;
+  }
+
+  double processCpu = cpuSeconds(usageAfter) - cpuSeconds(usageBefore);
+  uint64_t executed = poolAfter.executed - poolBefore.executed;
+  uint64_t stolen = poolAfter.stolen - poolBefore.stolen;
+  double expectedTicks = cfg.rooms * cfg.tickHz * cfg.durationSec;
+
+  ostringstream report;
+  report << "# RoomBench report\n"
+         << "config.rooms=" << cfg.rooms << "\n"
+         << "config.players_per_room=" << cfg.playersPerRoom << "\n"
+         << "config.min_mobs=" << cfg.minMobs << "\n"
+         << "config.max_mobs=" << cfg.maxMobs << "\n"
+         << "config.tick_hz=" << cfg.tickHz << "\n"
+         << "config.input_hz=" << cfg.inputHz << "\n"
+         << "config.threads=" << poolAfter.threads << "\n"
+         << "config.duration_sec=" << cfg.durationSec << "\n"
+         << "config.warmup_sec=" << cfg.warmupSec << "\n"
+         << "config.seed=" << cfg.seed << "\n"
+         << "ticks.per_sec=" << ticks / cfg.durationSec << "\n"
+         << "ticks.on_schedule_pct="
+         << (expectedTicks > 0 ? 100.0 * ticks / expectedTicks : 0) << "\n"
+         << "ticks.overruns=" << overruns << "\n"
+         << "tick_late_us.p50=" << percentile(lateUs, 50) << "\n"
+         << "tick_late_us.p99=" << percentile(lateUs, 99) << "\n"
+         << "tick_late_us.max=" << (lateUs.empty() ? 0 : lateUs.back())
+         << "\n"
+         << "tick_us.p50=" << percentile(tickUs, 50) << "\n"
+         << "tick_us.p99=" << percentile(tickUs, 99) << "\n"
+         << "tick_us.max=" << (tickUs.empty() ? 0 : tickUs.back()) << "\n"
+         << "room_cpu_pct.p50=" << percentile(roomCpuPct, 50) << "\n"
+         << "room_cpu_pct.p99=" << percentile(roomCpuPct, 99) << "\n"
+         << "room_cpu_pct.max="
+         << (roomCpuPct.empty() ? 0 : roomCpuPct.back()) << "\n"
+         << "room_cpu_pct.total=" << roomCpuTotal << "\n"
+         << "process.cpu_pct=" << 100.0 * processCpu / cfg.durationSec
+         << "\n"
+         << "pool.stolen_pct=" << (executed ? 100.0 * stolen / executed : 0)
+         << "\n"
+         << "inputs.per_sec=" << inputs / cfg.durationSec << "\n"
+         << "inputs.sent=" << inputsSent.load() << "\n"
+         << "sim.contacts_per_tick=" << (ticks ? double(contacts) / ticks : 0)
+         << "\n"
+         << "sim.dirty_per_tick=" << (ticks ? double(dirty) / ticks : 0)
+         << "\n"
+         << "sim.hit_pct=" << (inputs ? 100.0 * hits / inputs : 0) << "\n";
+
+  publishReport(report.str(), cfg.outPath, cfg.baselinePath);
+  return 0;
+}
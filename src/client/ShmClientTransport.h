@@ -0,0 +1,66 @@
+#ifndef SHMCLIENTTRANSPORT_H
+#define SHMCLIENTTRANSPORT_H
+
+/**
+ * Client transport for a process on the same host as the server: both
+ * delivery classes go over one shared-memory channel (see
+ * SharedMemoryTransport.h), which the server accepts with
+ * SocketServerTransport::listenSharedMemory(name).
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../core/SharedMemoryTransport.h"
+#include "../core/Transport.h"
+
+using namespace std;
+
+class ShmClientTransport {
+public:
+  ShmClientTransport(const string &name) : name(name) {}
+
+  bool connect() {
+    channel = connectSharedMemory(name);
+    return channel != nullptr;
+  }
+
+  template <typename Sink> size_t poll(int timeoutMs, Sink &sink) {
+    size_t delivered = drain(sink);
+
+    if (delivered == 0 && !channel->isPeerClosed()) {
+      channel->waitForFrame(timeoutMs);
+      delivered = drain(sink);
+    }
+
+    if (channel->isPeerClosed() && !notifiedClosed) {
+      notifiedClosed = true;
+      sink.onDisconnect();
+    }
+
+    return delivered;
+  }
+
+  bool send(const SerializedMessage &mssg, Delivery delivery) {
+    return sendShmFrame(*channel, mssg, delivery);
+  }
+
+private:
+  string name;
+  unique_ptr<ShmChannel> channel;
+  vector<unsigned char> frame;
+  bool notifiedClosed = false;
+
+  template <typename Sink> size_t drain(Sink &sink) {
+    size_t delivered = 0;
+    while (channel->receive(frame)) {
+      sink.onFrame(reinterpret_cast<const char *>(frame.data()), frame.size(),
+                   Delivery::Reliable);
+      delivered++;
+    }
+    return delivered;
+  }
+};
+
+#endif // SHMCLIENTTRANSPORT_H
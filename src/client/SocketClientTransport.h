@@ -0,0 +1,144 @@
+#ifndef SOCKETCLIENTTRANSPORT_H
+#define SOCKETCLIENTTRANSPORT_H
+
+/**
+ * Client transport over the kernel: a TCP connection to the server
+ * (reliable) and a UDP socket (unreliable), multiplexed by one poll().
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+
+#include <mutex>
+#include <vector>
+
+#include "../core/Transport.h"
+#include "../core/UDP.h"
+#include "TCPClient.h"
+
+using namespace std;
+
+class SocketClientTransport {
+public:
+  SocketClientTransport(char *host, char *tcpPort, char *udpPort)
+      : tcpClient(host, tcpPort), udpClient(host, udpPort) {}
+
+  bool connect() {
+    if (!tcpClient.initSocket()) {
+      return false;
+    }
+
+    // Connected, so only the server's datagrams are read.
+    if (!udpClient.initSocket() || !udpClient.connectSocket()) {
+      return false;
+    }
+    int flags = fcntl(udpClient.getSfd(), F_GETFL, 0);
+    fcntl(udpClient.getSfd(), F_SETFL, flags | O_NONBLOCK);
+    return true;
+  }
+
+  // Time-to-connected and the address used (see TCPClient::initSocket).
+  const ConnectStats &getConnectStats() const {
+    return tcpClient.getConnectStats();
+  }
+
+  // See UDP::setImpairment.
+  void setUDPImpairment(const ImpairmentConfig &outbound,
+                        const ImpairmentConfig &inbound) {
+    udpClient.setImpairment(outbound, inbound);
+  }
+
+  template <typename Sink> size_t poll(int timeoutMs, Sink &sink) {
+    int pollTimeout = timeoutMs;
+    int nextRelease = udpClient.nextImpairmentRelease();
+    if (nextRelease >= 0 && (pollTimeout < 0 || nextRelease < pollTimeout)) {
+      pollTimeout = nextRelease;
+    }
+
+    struct pollfd pfds[2];
+    pfds[0] = {tcpClient.getSfd(), POLLIN, 0};
+    pfds[1] = {udpClient.getSfd(), POLLIN, 0};
+
+    int ready = ::poll(pfds, 2, pollTimeout);
+    if (ready < 0 && errno != EINTR) {
+      cerr << "SocketClientTransport poll error: (" << errno << ") "
+           << strerror(errno) << endl;
+      return 0;
+    }
+
+    {
+      lock_guard<mutex> lock(udpSendMutex);
+      udpClient.pumpImpairment();
+    }
+    size_t delivered = 0;
+
+    // UDP (drained until EAGAIN, including datagrams the shim released).
+    struct sockaddr_in from;
+    int len;
+    while ((len = udpClient.recvDatagram(frameBuf.data(), frameBuf.size(),
+                                         from)) >= 0) {
+      sink.onFrame(frameBuf.data(), len, Delivery::Unreliable);
+      delivered++;
+    }
+
+    if (pfds[0].revents != 0) {
+      if (readTCPFrame(sink)) {
+        delivered++;
+      } else {
+        sink.onDisconnect();
+      }
+    }
+
+    return delivered;
+  }
+
+  bool send(const SerializedMessage &mssg, Delivery delivery) {
+    uint32_t mssgLength = frameMssgLength(mssg);
+
+    if (delivery == Delivery::Reliable) {
+      return tcpClient.writeFrame(tcpClient.getSfd(), mssg.header,
+                                  sizeof(Header), mssg.message, mssgLength);
+    }
+
+    // A datagram has to go out in one piece. The read thread sends too
+    // (ex. Ping echoes), so the buffer and the shim are shared.
+    lock_guard<mutex> lock(udpSendMutex);
+    datagram.resize(sizeof(Header) + mssgLength);
+    memcpy(datagram.data(), mssg.header, sizeof(Header));
+    if (mssgLength > 0) {
+      memcpy(datagram.data() + sizeof(Header), mssg.message, mssgLength);
+    }
+    return udpClient.write(datagram.data(), datagram.size()) >= 0;
+  }
+
+private:
+  TCPClient tcpClient;
+  UDP udpClient;
+
+  // Reused, so the read/write paths don't allocate.
+  vector<char> frameBuf = vector<char>(MAX_FRAME_BYTES + sizeof(Header));
+  vector<char> datagram; // Under udpSendMutex.
+  mutex udpSendMutex;
+
+  // Returns false if the server hung up (or sent garbage).
+  template <typename Sink> bool readTCPFrame(Sink &sink) {
+    int sfd = tcpClient.getSfd();
+    if (!tcpClient.readExactly(sfd, frameBuf.data(), sizeof(Header))) {
+      return false;
+    }
+
+    Header hdr = deserialize<Header>(frameBuf.data());
+    if (hdr.mssgLength > MAX_FRAME_BYTES ||
+        (hdr.mssgLength > 0 &&
+         !tcpClient.readExactly(sfd, frameBuf.data() + sizeof(Header),
+                                hdr.mssgLength))) {
+      return false;
+    }
+
+    sink.onFrame(frameBuf.data(), sizeof(Header) + hdr.mssgLength,
+                 Delivery::Reliable);
+    return true;
+  }
+};
+
+#endif // SOCKETCLIENTTRANSPORT_H
@@ -3,84 +3,63 @@
 
 #include "../core/TCP.h"
 
-class TCPClient : public TCP {
+#include <poll.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+// How the last initSocket() went.
+struct ConnectStats {
+  bool connected = false;
+  double connectMs = 0; // From the first resolve to connected (or giving up).
+  int rounds = 0;       // Resolve + connect rounds (1 if the first worked).
+  int attempts = 0;     // connect() calls, across rounds.
+  bool usedCachedEndpoint = false; // Won with the address that worked last.
+  string endpoint;                 // Numeric address and port connected to.
+};
+
+class TCPClient final : public TCP {
 public:
-  TCPClient(char *host_, char *port_) : host(host_), port(port_);
+  TCPClient(char *host_, char *port_) : TCP(host_, port_) {}
 
   /**
    * @brief Resolves the server's address and established TCP connection.
    *
-   * Network calls: (1) socket, and (2) connect.
+   * "Happy eyeballs" (RFC 8305): Connects to the resolved addresses in
+   * parallel, non-blocking, starting the next one every
+   * CONNECTION_ATTEMPT_DELAY_MS (or as soon as one fails), and keeps the first
+   * that succeeds. So a dead route (ex. IPv6 that's configured but broken)
+   * costs 250ms instead of a connect() timeout. The families alternate, and
+   * the address that worked last time for this host:port goes first.
+   * If a whole round fails, waits a jittered, growing backoff before the next.
+   *
+   * Network calls: (1) getaddrinfo, (2) socket, (3) connect, and (4) poll.
    */
   bool initSocket() override {
-    int sfd = -1;
-    int MAX_ATTEMPTS = 3; // Allow a few failures.
-
-    try {
-      int attemptCount = 0;
-
-      while (sfd < 0 && attemptCount < MAX_ATTEMPTS) {
-        attemptCount++;
-
-        // hints: Instructions on connections to look for.
-        // results: Pointer to a linked list of addrinfo structs
-        //          (currently empty)
-        // result_ptr: For iterating through results.
-        struct addrinfo hints, *results, *result_ptr;
-
-        memset(&hints, 0, sizeof hints); // Init. hints as empty.
-        hints.ai_family = AF_UNSPEC;     // IPv4 &/or IPv6
-        hints.ai_socktype = SOCK_STREAM; // TCP
-
-        // Returns a list of address structures (stored in results).
-        int status = getaddrinfo(this->host, this->port, &hints, &results);
-
-        if (status != 0) { // Non-zero status indicates failure.
-          cerr
-              << "TCP Client failed to get a list of address structures (host: "
-              << std::string(this->host) + ", port: " << std::string(this->port)
-              << ").\n"
-              << "Cause of Error: " + std::string(gai_strerror(status)) + "."
-              << endl;
-
-        } else {
-          // First result might not be valid. Look in results for valid conn.
-          for (result_ptr = results; result_ptr != nullptr;
-               result_ptr = result_ptr->ai_next) {
-            // Try each result until a succesful connection (2).
-
-            sfd = socket(result_ptr->ai_family, result_ptr->ai_socktype,
-                         result_ptr->ai_protocol);
-
-            if (sfd == -1) {
-              // If the socket fails, try the next address
-              continue; // (Don't try connecting)
-            }
-
-            if (connect(sfd, result_ptr->ai_addr, result_ptr->ai_addrlen) !=
-                -1) {
-              break; // Success. Stop iterating through results.
-            }
-
-            close(sfd); // Failed. Close this socket and try the next addr.
-          }
-        }
+    auto started = chrono::steady_clock::now();
+    connectStats = ConnectStats();
 
-        if (result_ptr == nullptr) { // No address succeeded.
-          cerr << "TCP Client could not find an available address (host: "
-               << std::string(this->host)
-               << ", port: " + std::string(this->port) << ").\n"
-               <<
+    int connectedSfd = -1;
+    int backoffMs = BACKOFF_BASE_MS;
 
-              "Cause of Error: " << std::string(gai_strerror(status)) << "."
-               << endl;
+    try {
+      for (int round = 1; round <= MAX_ROUNDS && connectedSfd < 0; round++) {
+        connectStats.rounds = round;
 
-          sfd = -1; // Give some time before next retry.
-          std::this_thread::sleep_for(std::chrono::seconds(2));
+        vector<Endpoint> endpoints = resolve();
+        if (!endpoints.empty()) {
+          connectedSfd = raceConnect(endpoints);
         }
 
-        if (results) {           // Entire list of results no longer needed.
-          freeaddrinfo(results); // Free the memory.
+        if (connectedSfd < 0 && round < MAX_ROUNDS) {
+          // Jittered, so clients dropped by a server restart don't all
+          // reconnect in lockstep; short at first, so they reconnect fast.
+          uniform_int_distribution<int> jitter(backoffMs / 2, backoffMs);
+          std::this_thread::sleep_for(chrono::milliseconds(jitter(rng())));
+          backoffMs = min(backoffMs * 2, BACKOFF_MAX_MS);
         }
       }
 
@@ -88,15 +67,297 @@ public:
       cerr << "TCPClient failed to initialize the socket." << endl;
     }
 
-    this->sockfd = sfd;
-    return (sfd > 0);
+    connectStats.connected = connectedSfd >= 0;
+    connectStats.connectMs = chrono::duration<double, milli>(
+                                 chrono::steady_clock::now() - started)
+                                 .count();
+
+    if (connectedSfd < 0) {
+      cerr << "TCP Client could not connect to any address (host: "
+           << std::string(this->host) << ", port: " << std::string(this->port)
+           << ") after " << connectStats.rounds << " rounds." << endl;
+    }
+
+    this->sfd = connectedSfd;
+    return (connectedSfd >= 0);
   }
 
+  const ConnectStats &getConnectStats() const { return connectStats; }
+
   bool write(const char *data) const { return writeTo(sfd, data); }
 
   char *read(int bytesToRead) const { return readFrom(sfd, bytesToRead); }
 
-  bool socketReadyToRead() { return socketReadyToRead(this.sfd); }
+  bool socketReadyToRead() { return TCP::socketReadyToRead(this->sfd); }
+
+private:
+  static constexpr int CONNECTION_ATTEMPT_DELAY_MS = 250; // RFC 8305's.
+  static constexpr int ROUND_TIMEOUT_MS = 5000;
+  static constexpr int MAX_ROUNDS = 3; // Allow a few failures.
+  static constexpr int BACKOFF_BASE_MS = 100;
+  static constexpr int BACKOFF_MAX_MS = 2000;
+
+  struct Endpoint {
+    sockaddr_storage addr;
+    socklen_t addrLen = 0;
+    int family = AF_UNSPEC;
+    int socktype = SOCK_STREAM;
+    int protocol = 0;
+  };
+
+  ConnectStats connectStats;
+
+  /**
+   * getaddrinfo's results, alternating address families (ex. IPv6, IPv4,
+   * IPv6, ...), with the cached endpoint (if any) first.
+   */
+  vector<Endpoint> resolve() {
+    vector<Endpoint> endpoints;
+
+    // hints: Instructions on connections to look for.
+    // results: Pointer to a linked list of addrinfo structs
+    struct addrinfo hints, *results = nullptr;
+
+    memset(&hints, 0, sizeof hints); // Init. hints as empty.
+    hints.ai_family = AF_UNSPEC;     // IPv4 &/or IPv6
+    hints.ai_socktype = SOCK_STREAM; // TCP
+
+    // Returns a list of address structures (stored in results).
+    int status = getaddrinfo(this->host, this->port, &hints, &results);
+
+    if (status != 0) { // Non-zero status indicates failure.
+      cerr << "TCP Client failed to get a list of address structures (host: "
+           << std::string(this->host) + ", port: " << std::string(this->port)
+           << ").\n"
+           << "Cause of Error: " + std::string(gai_strerror(status)) + "."
+           << endl;
+
+    } else {
+      vector<Endpoint> primary, secondary; // By the first result's family.
+
+      for (addrinfo *result = results; result != nullptr;
+           result = result->ai_next) {
+        Endpoint endpoint;
+        memcpy(&endpoint.addr, result->ai_addr, result->ai_addrlen);
+        endpoint.addrLen = result->ai_addrlen;
+        endpoint.family = result->ai_family;
+        endpoint.socktype = result->ai_socktype;
+        endpoint.protocol = result->ai_protocol;
+
+        (endpoint.family == results->ai_family ? primary : secondary)
+            .push_back(endpoint);
+      }
+
+      for (size_t i = 0; i < max(primary.size(), secondary.size()); i++) {
+        if (i < primary.size()) {
+          endpoints.push_back(primary[i]);
+        }
+        if (i < secondary.size()) {
+          endpoints.push_back(secondary[i]);
+        }
+      }
+
+      freeaddrinfo(results); // Entire list of results no longer needed.
+    }
+
+    // Even if resolving failed (ex. DNS is down), the cached one may work.
+    Endpoint cached;
+    if (findCachedEndpoint(cached)) {
+      auto sameAddr = [&](const Endpoint &endpoint) {
+        return endpoint.addrLen == cached.addrLen &&
+               memcmp(&endpoint.addr, &cached.addr, cached.addrLen) == 0;
+      };
+      endpoints.erase(remove_if(endpoints.begin(), endpoints.end(), sameAddr),
+                      endpoints.end());
+      endpoints.insert(endpoints.begin(), cached);
+    }
+
+    return endpoints;
+  }
+
+  /**
+   * One round: Staggered non-blocking connects, until one succeeds (returns
+   * its sfd, switched back to blocking) or all fail or time out (-1).
+   */
+  int raceConnect(const vector<Endpoint> &endpoints) {
+    auto now = chrono::steady_clock::now();
+    auto deadline = now + chrono::milliseconds(ROUND_TIMEOUT_MS);
+    auto nextStart = now;
+
+    vector<pollfd> inFlight;
+    vector<size_t> inFlightEndpoint; // Index into endpoints, per inFlight.
+    size_t next = 0;
+    int winner = -1;
+    size_t winnerEndpoint = 0;
+
+    while (winner < 0 && now < deadline) {
+      // (1) Start the next attempt, if it's time.
+      if (next < endpoints.size() && now >= nextStart) {
+        bool done = false;
+        int attemptSfd = startConnect(endpoints[next], done);
+
+        if (done) {
+          winner = attemptSfd;
+          winnerEndpoint = next;
+          break;
+        }
+        if (attemptSfd >= 0) {
+          inFlight.push_back({attemptSfd, POLLOUT, 0});
+          inFlightEndpoint.push_back(next);
+        }
+
+        next++;
+        // If that one failed right away, don't wait to start the next.
+        nextStart = attemptSfd >= 0
+                        ? now + chrono::milliseconds(CONNECTION_ATTEMPT_DELAY_MS)
+                        : now;
+        continue;
+      }
+
+      if (inFlight.empty()) {
+        if (next >= endpoints.size()) {
+          break; // Every address failed.
+        }
+        nextStart = now;
+        continue;
+      }
+
+      // (2) Wait for an attempt to finish, or for the next one's turn.
+      auto wakeAt = next < endpoints.size() ? min(nextStart, deadline) : deadline;
+      int waitMs = max<int>(0, chrono::duration_cast<chrono::milliseconds>(
+                                   wakeAt - now)
+                                   .count());
+
+      int ready = poll(inFlight.data(), inFlight.size(), waitMs);
+      if (ready < 0 && errno != EINTR) {
+        cerr << "TCP Client poll error: (" << errno << ") " << strerror(errno)
+             << endl;
+        break;
+      }
+
+      // (3) Keep the first that connected; drop the ones that failed.
+      for (size_t i = 0; ready > 0 && i < inFlight.size();) {
+        if (inFlight[i].revents == 0) {
+          i++;
+          continue;
+        }
+
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(inFlight[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+
+        if (err == 0 && !(inFlight[i].revents & (POLLERR | POLLHUP))) {
+          winner = inFlight[i].fd;
+          winnerEndpoint = inFlightEndpoint[i];
+          inFlight.erase(inFlight.begin() + i);
+          inFlightEndpoint.erase(inFlightEndpoint.begin() + i);
+          break;
+        }
+
+        close(inFlight[i].fd);
+        inFlight.erase(inFlight.begin() + i);
+        inFlightEndpoint.erase(inFlightEndpoint.begin() + i);
+        nextStart = chrono::steady_clock::now(); // Try the next one now.
+      }
+
+      now = chrono::steady_clock::now();
+    }
+
+    for (const pollfd &attempt : inFlight) {
+      close(attempt.fd); // Lost the race (or timed out).
+    }
+
+    if (winner >= 0) {
+      // The reads and writes after this are blocking.
+      int flags = fcntl(winner, F_GETFL, 0);
+      fcntl(winner, F_SETFL, flags & ~O_NONBLOCK);
+
+      const Endpoint &endpoint = endpoints[winnerEndpoint];
+      Endpoint cached;
+      connectStats.usedCachedEndpoint =
+          findCachedEndpoint(cached) && cached.addrLen == endpoint.addrLen &&
+          memcmp(&cached.addr, &endpoint.addr, endpoint.addrLen) == 0;
+      connectStats.endpoint = endpointName(endpoint);
+      cacheEndpoint(endpoint);
+    }
+
+    return winner;
+  }
+
+  // A non-blocking connect. done: Connected already (ex. loopback).
+  int startConnect(const Endpoint &endpoint, bool &done) {
+    connectStats.attempts++;
+    done = false;
+
+    int attemptSfd =
+        socket(endpoint.family, endpoint.socktype, endpoint.protocol);
+    if (attemptSfd == -1) {
+      return -1; // If the socket fails, try the next address.
+    }
+
+    int flags = fcntl(attemptSfd, F_GETFL, 0);
+    fcntl(attemptSfd, F_SETFL, flags | O_NONBLOCK);
+
+    if (connect(attemptSfd, reinterpret_cast<const sockaddr *>(&endpoint.addr),
+                endpoint.addrLen) == 0) {
+      done = true;
+      return attemptSfd;
+    }
+
+    if (errno != EINPROGRESS) {
+      close(attemptSfd); // Failed. Close this socket and try the next addr.
+      return -1;
+    }
+    return attemptSfd;
+  }
+
+  static string endpointName(const Endpoint &endpoint) {
+    char hostBuf[NI_MAXHOST], portBuf[NI_MAXSERV];
+    if (getnameinfo(reinterpret_cast<const sockaddr *>(&endpoint.addr),
+                    endpoint.addrLen, hostBuf, sizeof(hostBuf), portBuf,
+                    sizeof(portBuf), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+      return "";
+    }
+    return string(hostBuf) + ":" + portBuf;
+  }
+
+  // ---- Endpoint cache ----
+  // The last address that worked per host:port, shared by every TCPClient in
+  // the process, so a reconnect (ex. after a server restart) tries it first.
+
+  string cacheKey() const {
+    return std::string(this->host) + ":" + std::string(this->port);
+  }
+
+  static mutex &cacheMutex() {
+    static mutex m;
+    return m;
+  }
+
+  static unordered_map<string, Endpoint> &endpointCache() {
+    static unordered_map<string, Endpoint> cache;
+    return cache;
+  }
+
+  bool findCachedEndpoint(Endpoint &cached) const {
+    lock_guard<mutex> lock(cacheMutex());
+    auto it = endpointCache().find(cacheKey());
+    if (it == endpointCache().end()) {
+      return false;
+    }
+    cached = it->second;
+    return true;
+  }
+
+  void cacheEndpoint(const Endpoint &endpoint) const {
+    lock_guard<mutex> lock(cacheMutex());
+    endpointCache()[cacheKey()] = endpoint;
+  }
+
+  static mt19937 &rng() {
+    thread_local mt19937 generator(random_device{}());
+    return generator;
+  }
 };
 
-#endif // TCPCLIENT_H
\ No newline at end of file
+#endif // TCPCLIENT_H
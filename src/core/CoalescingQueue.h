@@ -0,0 +1,122 @@
+#ifndef COALESCINGQUEUE_H
+#define COALESCINGQUEUE_H
+
+/**
+ * Outbound queue with latest-wins coalescing of per-entity state.
+ *
+ * Entries pushed with a CoalesceKey (recipient, objectID, EventCode) replace
+ * the queued entry with the same key, if it hasn't been sent yet: the newest
+ * state takes the older entry's place in line, and the stale one is dropped.
+ * Entries without a key (ex. Chat, Action) are order-sensitive and stay FIFO.
+ *
+ * So a lagging client (or a slow network) gets the freshest positions
+ * instead of a backlog, and the state part of the queue is bounded by
+ * recipients x objects x state types.
+ */
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+#include "events.h"
+
+using namespace std;
+
+struct CoalesceKey {
+  uint32_t recipientID;
+  uint32_t objectID;
+  EventCode mssgType;
+
+  bool operator==(const CoalesceKey &other) const {
+    return recipientID == other.recipientID && objectID == other.objectID &&
+           mssgType == other.mssgType;
+  }
+};
+
+struct CoalesceKeyHash {
+  size_t operator()(const CoalesceKey &key) const {
+    uint64_t packed = (uint64_t(key.recipientID) << 32) ^
+                      (uint64_t(key.objectID) << 8) ^
+                      uint64_t(key.mssgType);
+    return hash<uint64_t>()(packed * 0x9E3779B97F4A7C15ull);
+  }
+};
+
+struct CoalescingQueueStats {
+  uint64_t pushed = 0;
+  uint64_t coalesced = 0; // Stale entries replaced before being sent.
+  size_t depth = 0;       // Entries waiting now.
+};
+
+/**
+ * Not thread-safe; the owner locks around it (like the queues it replaces).
+ * Item is what gets sent (ex. shared_ptr<SerializedMessage>).
+ */
+template <typename Item> class CoalescingQueue {
+public:
+  // Order-sensitive: Always appended.
+  void push(uint32_t sendToID, Item item) {
+    slots.push_back({sendToID, std::move(item), false, {}});
+    stats.pushed++;
+  }
+
+  // State: Replaces the queued entry with the same key, if any.
+  void push(uint32_t sendToID, Item item, const CoalesceKey &key) {
+    stats.pushed++;
+
+    auto it = latest.find(key);
+    if (it != latest.end()) {
+      Slot &slot = slots[it->second - headSeq];
+      slot.item = std::move(item);
+      stats.coalesced++;
+      return;
+    }
+
+    latest.emplace(key, headSeq + slots.size());
+    slots.push_back({sendToID, std::move(item), true, key});
+  }
+
+  bool empty() const { return slots.empty(); }
+
+  size_t size() const { return slots.size(); }
+
+  // Front entry as (sendToID, item). Only call when !empty().
+  pair<uint32_t, Item> pop() {
+    Slot &slot = slots.front();
+    pair<uint32_t, Item> front(slot.sendToID, std::move(slot.item));
+
+    if (slot.keyed) {
+      latest.erase(slot.key);
+    }
+
+    slots.pop_front();
+    headSeq++;
+    return front;
+  }
+
+  CoalescingQueueStats getStats() const {
+    CoalescingQueueStats current = stats;
+    current.depth = slots.size();
+    return current;
+  }
+
+private:
+  struct Slot {
+    uint32_t sendToID;
+    Item item;
+    bool keyed;
+    CoalesceKey key;
+  };
+
+  deque<Slot> slots;
+  uint64_t headSeq = 0; // Sequence number of slots.front().
+
+  // Key -> sequence number of the queued entry holding it.
+  unordered_map<CoalesceKey, uint64_t, CoalesceKeyHash> latest;
+
+  CoalescingQueueStats stats;
+};
+
+#endif // COALESCINGQUEUE_H
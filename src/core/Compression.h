@@ -0,0 +1,346 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+/**
+ * Payload compression for large reliable mssgs (ex. game lists, map chunks,
+ * batched chat), and when it's worth it.
+ *
+ * lzCompress/lzDecompress: A small LZ77 codec in the LZ4 block format's
+ * style, built for speed over ratio: one hash probe per position, a
+ * 64KB window, and literal runs skipped faster the longer nothing matches,
+ * so incompressible data costs little. The decoder checks every length and
+ * offset against its buffers, as its input comes off the network.
+ *
+ * Block: Sequences of
+ *   token:    (literal count << 4) | (match length - MIN_MATCH), each 4 bits;
+ *             15 means more follows, as bytes added up until one isn't 255.
+ *   literals: That many bytes, copied as is.
+ *   offset:   2 bytes, little-endian: How far back the match starts.
+ * The last sequence is only literals (no offset).
+ *
+ * AdaptiveCompressor: Per connection, whether compressing is paying off.
+ * It weighs the CPU time spent against what the bytes saved are worth on
+ * that link (1 / its capacity); on a fast link (ex. loopback, a LAN), or
+ * with data that doesn't compress, it stops, and tries again every
+ * probeEvery mssgs in case that changed.
+ *
+ * Reference (format):
+ * https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+static constexpr size_t LZ_MIN_MATCH = 4;
+static constexpr size_t LZ_MAX_OFFSET = 65535;
+
+// Largest compressed size of srcLen bytes (all literals).
+inline size_t lzBound(size_t srcLen) { return srcLen + srcLen / 255 + 16; }
+
+namespace lzdetail {
+
+static constexpr int HASH_BITS = 12; // At most; fewer for small inputs.
+static constexpr size_t LAST_LITERALS = 5; // Matches stop this far from end.
+static constexpr size_t SKIP_SHIFT = 6;    // Step grows every 64 misses.
+
+inline uint32_t read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint32_t hashOf(uint32_t sequence, int bits) {
+  return (sequence * 2654435761u) >> (32 - bits);
+}
+
+// A length over 15 continues in 255s, then the rest. False if out of room.
+inline bool writeLength(uint8_t *&op, const uint8_t *end, size_t length) {
+  for (; length >= 255; length -= 255) {
+    if (op >= end) {
+      return false;
+    }
+    *op++ = 255;
+  }
+  if (op >= end) {
+    return false;
+  }
+  *op++ = uint8_t(length);
+  return true;
+}
+
+inline bool readLength(const uint8_t *&ip, const uint8_t *end,
+                       size_t &length) {
+  uint8_t more;
+  do {
+    if (ip >= end) {
+      return false;
+    }
+    more = *ip++;
+    length += more;
+  } while (more == 255);
+  return true;
+}
+
+// Token, literals, and the match's offset and length (unless last).
+inline bool writeSequence(uint8_t *&op, const uint8_t *end,
+                          const uint8_t *literals, size_t literalCount,
+                          size_t offset, size_t matchLength, bool last) {
+  if (op >= end) {
+    return false;
+  }
+  uint8_t *token = op++;
+  size_t matchCode = last ? 0 : matchLength - LZ_MIN_MATCH;
+  *token = uint8_t((min<size_t>(literalCount, 15) << 4) |
+                   min<size_t>(matchCode, 15));
+
+  if (literalCount >= 15 && !writeLength(op, end, literalCount - 15)) {
+    return false;
+  }
+  if (size_t(end - op) < literalCount) {
+    return false;
+  }
+  if (literalCount > 0) {
+    memcpy(op, literals, literalCount);
+    op += literalCount;
+  }
+
+  if (last) {
+    return true;
+  }
+  if (end - op < 2) {
+    return false;
+  }
+  *op++ = uint8_t(offset);
+  *op++ = uint8_t(offset >> 8);
+  return matchCode < 15 || writeLength(op, end, matchCode - 15);
+}
+
+} // namespace lzdetail
+
+/**
+ * Compress srcLen bytes into dst. Returns the compressed length, or 0 if
+ * it doesn't fit in capacity (ex. capacity = srcLen - 1: Give up once it
+ * wouldn't be smaller).
+ */
+inline size_t lzCompress(const uint8_t *src, size_t srcLen, uint8_t *dst,
+                         size_t capacity) {
+  using namespace lzdetail;
+
+  uint8_t *op = dst;
+  const uint8_t *end = dst + capacity;
+  const uint8_t *anchor = src; // First literal not yet written.
+
+  if (srcLen > LZ_MIN_MATCH + LAST_LITERALS) {
+    // Position + 1 (0 = empty). Sized to the input, as clearing it is most
+    // of the cost for a small mssg.
+    int bits = 8;
+    while (bits < HASH_BITS && (size_t(1) << bits) < srcLen) {
+      bits++;
+    }
+    uint32_t table[1 << HASH_BITS];
+    fill_n(table, size_t(1) << bits, 0);
+
+    const uint8_t *matchLimit = src + srcLen - LAST_LITERALS;
+    const uint8_t *ip = src;
+    size_t misses = 0;
+
+    while (ip + LZ_MIN_MATCH <= matchLimit) {
+      uint32_t sequence = read32(ip);
+      uint32_t &slot = table[hashOf(sequence, bits)];
+      const uint8_t *candidate = slot ? src + slot - 1 : nullptr;
+      slot = uint32_t(ip - src) + 1;
+
+      if (!candidate || size_t(ip - candidate) > LZ_MAX_OFFSET ||
+          read32(candidate) != sequence) {
+        ip += 1 + (misses++ >> SKIP_SHIFT);
+        continue;
+      }
+      misses = 0;
+
+      // Extend backwards over literals, then forwards.
+      while (ip > anchor && candidate > src && ip[-1] == candidate[-1]) {
+        ip--;
+        candidate--;
+      }
+      const uint8_t *matchEnd = ip + LZ_MIN_MATCH;
+      const uint8_t *from = candidate + LZ_MIN_MATCH;
+      while (matchEnd < matchLimit && *matchEnd == *from) {
+        matchEnd++;
+        from++;
+      }
+
+      if (!writeSequence(op, end, anchor, size_t(ip - anchor),
+                         size_t(ip - candidate), size_t(matchEnd - ip),
+                         false)) {
+        return 0;
+      }
+      ip = matchEnd;
+      anchor = ip;
+
+      // So the next match can start in this one's tail.
+      if (ip + LZ_MIN_MATCH <= matchLimit) {
+        table[hashOf(read32(ip - 2), bits)] = uint32_t(ip - 2 - src) + 1;
+      }
+    }
+  }
+
+  if (!writeSequence(op, end, anchor, size_t(src + srcLen - anchor), 0, 0,
+                     true)) {
+    return 0;
+  }
+  return size_t(op - dst);
+}
+
+/**
+ * Decompress a block into exactly dstLen bytes. False if it's malformed
+ * (ex. truncated, an offset before the start, or a different length).
+ */
+inline bool lzDecompress(const uint8_t *src, size_t srcLen, uint8_t *dst,
+                         size_t dstLen) {
+  using namespace lzdetail;
+
+  const uint8_t *ip = src;
+  const uint8_t *inEnd = src + srcLen;
+  uint8_t *op = dst;
+  uint8_t *outEnd = dst + dstLen;
+
+  while (ip < inEnd) {
+    uint8_t token = *ip++;
+
+    size_t literalCount = token >> 4;
+    if (literalCount == 15 && !readLength(ip, inEnd, literalCount)) {
+      return false;
+    }
+    if (size_t(inEnd - ip) < literalCount ||
+        size_t(outEnd - op) < literalCount) {
+      return false;
+    }
+    if (literalCount > 0) {
+      memcpy(op, ip, literalCount);
+      ip += literalCount;
+      op += literalCount;
+    }
+
+    if (ip == inEnd) {
+      break; // The last sequence.
+    }
+
+    if (inEnd - ip < 2) {
+      return false;
+    }
+    size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+    ip += 2;
+    size_t matchLength = token & 15;
+    if (matchLength == 15 && !readLength(ip, inEnd, matchLength)) {
+      return false;
+    }
+    matchLength += LZ_MIN_MATCH;
+
+    if (offset == 0 || offset > size_t(op - dst) ||
+        size_t(outEnd - op) < matchLength) {
+      return false;
+    }
+
+    // Overlapping (offset < length) repeats the last offset bytes.
+    const uint8_t *from = op - offset;
+    if (offset >= matchLength) {
+      memcpy(op, from, matchLength);
+      op += matchLength;
+    } else {
+      for (size_t i = 0; i < matchLength; i++) {
+        *op++ = *from++;
+      }
+    }
+  }
+
+  return op == outEnd;
+}
+
+struct CompressionConfig {
+  bool enabled = true;
+  uint32_t minBytes = 128; // Smaller mssgs aren't worth a try.
+
+  // CPU time one byte saved is worth, until the link's capacity is known
+  // (then 1s / capacity). 80ns is a ~100Mbit/s link.
+  double nsPerByteSaved = 80;
+
+  uint32_t probeEvery = 64; // While off, try 1 in this many mssgs.
+  double smoothing = 0.1;   // Weight of each try in the running averages.
+};
+
+struct CompressionStats {
+  uint64_t compressed = 0;     // Sent compressed.
+  uint64_t incompressible = 0; // Tried, but no smaller.
+  uint64_t skipped = 0;        // Large enough, but compression was off.
+  uint64_t small = 0;          // Under minBytes.
+  uint64_t rawBytes = 0;       // Payload bytes of the mssgs tried.
+  uint64_t wireBytes = 0;      // What they were sent as.
+  uint64_t cpuNs = 0;          // Spent compressing.
+  bool active = true;
+};
+
+// One connection's. Not thread-safe.
+class AdaptiveCompressor {
+public:
+  AdaptiveCompressor(const CompressionConfig &config = {})
+      : config(config), nsPerByteSaved(config.nsPerByteSaved) {}
+
+  // bytesPerSec: 0 if unknown, UINT64_MAX if unlimited (never worth it).
+  void setLinkCapacity(uint64_t bytesPerSec) {
+    if (bytesPerSec == UINT64_MAX) {
+      nsPerByteSaved = 0;
+    } else if (bytesPerSec > 0) {
+      nsPerByteSaved = 1e9 / double(bytesPerSec);
+    }
+  }
+
+  // Whether to compress a mssg of payloadBytes (then record() the try).
+  bool shouldTry(size_t payloadBytes) {
+    if (!config.enabled || payloadBytes < config.minBytes) {
+      stats.small++;
+      return false;
+    }
+    if (stats.active || ++sinceProbe >= config.probeEvery) {
+      sinceProbe = 0;
+      return true;
+    }
+    stats.skipped++;
+    return false;
+  }
+
+  // A try: packedBytes >= rawBytes if it wasn't smaller (sent raw).
+  void record(size_t rawBytes, size_t packedBytes, uint64_t costNs) {
+    bool smaller = packedBytes < rawBytes;
+    stats.compressed += smaller;
+    stats.incompressible += !smaller;
+    stats.rawBytes += rawBytes;
+    stats.wireBytes += smaller ? packedBytes : rawBytes;
+    stats.cpuNs += costNs;
+
+    double saved = smaller ? double(rawBytes - packedBytes) : 0;
+    avgSaved += config.smoothing * (saved - avgSaved);
+    avgCostNs += config.smoothing * (double(costNs) - avgCostNs);
+    stats.active = avgCostNs <= avgSaved * nsPerByteSaved;
+  }
+
+  bool isActive() const { return stats.active; }
+
+  CompressionStats getStats() const { return stats; }
+
+private:
+  CompressionConfig config;
+  double nsPerByteSaved;
+
+  // Running averages per try.
+  double avgSaved = 0;
+  double avgCostNs = 0;
+
+  uint32_t sinceProbe = 0;
+  CompressionStats stats;
+};
+
+#endif // COMPRESSION_H
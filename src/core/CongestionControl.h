@@ -0,0 +1,175 @@
+#ifndef CONGESTIONCONTROL_H
+#define CONGESTIONCONTROL_H
+
+/**
+ * Per-client congestion control for unreliable (UDP) sending.
+ *
+ * UDP has no feedback of its own, so the server sends a small Ping every
+ * probeIntervalMs and the client echoes it. From the echoes:
+ * - Queueing delay: smoothed RTT minus the path's base (minimum) RTT.
+ *   A growing queue (ex. a home router's buffer filling) shows up here
+ *   well before packets are dropped.
+ * - Loss: Pings not echoed within probeTimeoutMs.
+ *
+ * The send rate is AIMD: each Ping answered without excess delay adds
+ * increaseBytesPerSec; excess delay or a loss multiplies it by
+ * decreaseFactor, at most once per RTT (one congestion event per RTT), or
+ * per probeTimeoutMs until an echo has measured the RTT.
+ *
+ * Reference (delay-based control, LEDBAT):
+ * https://datatracker.ietf.org/doc/html/rfc6817
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+using namespace std;
+
+struct CongestionConfig {
+  bool enabled = true;
+  uint32_t probeIntervalMs = 100;
+  uint32_t probeTimeoutMs = 1000; // Unanswered longer = lost.
+  uint32_t targetQueueDelayMs = 20;
+  uint64_t increaseBytesPerSec = 4 * 1024; // Per Ping answered in time.
+  double decreaseFactor = 0.7;
+  uint32_t baseRttWindowMs = 10000; // Base RTT forgets older samples.
+};
+
+struct CongestionStats {
+  double srttMs = 0;
+  double baseRttMs = 0;
+  double queueDelayMs = 0;
+  double lossRate = 0; // Smoothed fraction of Pings lost.
+  uint64_t probesSent = 0;
+  uint64_t probesEchoed = 0;
+  uint64_t probesLost = 0;
+  uint64_t decreases = 0;
+};
+
+/**
+ * Not thread-safe; owned by SendScheduler (one per client).
+ */
+class CongestionController {
+public:
+  using Clock = chrono::steady_clock;
+
+  CongestionController() = default;
+
+  CongestionController(const CongestionConfig &config, double initialRate,
+                       double minRate, double maxRate)
+      : config(config), rate(initialRate), minRate(minRate),
+        maxRate(maxRate) {}
+
+  double getRate() const { return rate; }
+
+  CongestionStats getStats() const { return stats; }
+
+  bool probeDue(Clock::time_point now) const {
+    return config.enabled &&
+           now - lastProbe >= chrono::milliseconds(config.probeIntervalMs);
+  }
+
+  uint32_t nextProbeSeq() const { return nextSeq; }
+
+  // Call once the Ping numbered nextProbeSeq() went out.
+  void onProbeSent(Clock::time_point now) {
+    inFlight.push_back({nextSeq++, now});
+    lastProbe = now;
+    stats.probesSent++;
+  }
+
+  void onProbeEcho(uint32_t seq, Clock::time_point now) {
+    expireProbes(now);
+
+    auto it = find_if(inFlight.begin(), inFlight.end(),
+                      [&](const Probe &probe) { return probe.seq == seq; });
+    if (it == inFlight.end()) {
+      return; // Duplicate, or already counted as lost.
+    }
+
+    double rttMs = chrono::duration<double, milli>(now - it->sentAt).count();
+    inFlight.erase(it);
+    stats.probesEchoed++;
+
+    updateRtt(rttMs, now);
+    stats.lossRate *= 0.9;
+
+    if (stats.queueDelayMs > config.targetQueueDelayMs) {
+      decrease(now);
+    } else {
+      rate = min(rate + config.increaseBytesPerSec, maxRate);
+    }
+  }
+
+  // Pings older than probeTimeoutMs count as lost.
+  void expireProbes(Clock::time_point now) {
+    auto timeout = chrono::milliseconds(config.probeTimeoutMs);
+
+    while (!inFlight.empty() && now - inFlight.front().sentAt > timeout) {
+      inFlight.pop_front();
+      stats.probesLost++;
+      stats.lossRate = 0.9 * stats.lossRate + 0.1;
+      decrease(now);
+    }
+  }
+
+private:
+  struct Probe {
+    uint32_t seq;
+    Clock::time_point sentAt;
+  };
+
+  CongestionConfig config;
+  double rate = 0;
+  double minRate = 0;
+  double maxRate = 0;
+
+  uint32_t nextSeq = 1;
+  deque<Probe> inFlight;
+  Clock::time_point lastProbe;
+  Clock::time_point lastDecrease;
+
+  // Base RTT: Minimum over the current and previous window, so a route
+  // change that raises the RTT is picked up within two windows.
+  double windowMinRttMs = 0;
+  double prevWindowMinRttMs = 0;
+  Clock::time_point windowStart;
+
+  CongestionStats stats;
+
+  void updateRtt(double rttMs, Clock::time_point now) {
+    stats.srttMs =
+        stats.srttMs == 0 ? rttMs : 0.875 * stats.srttMs + 0.125 * rttMs;
+
+    if (now - windowStart >= chrono::milliseconds(config.baseRttWindowMs)) {
+      prevWindowMinRttMs = windowMinRttMs;
+      windowMinRttMs = 0;
+      windowStart = now;
+    }
+    if (windowMinRttMs == 0 || rttMs < windowMinRttMs) {
+      windowMinRttMs = rttMs;
+    }
+
+    stats.baseRttMs = prevWindowMinRttMs == 0
+                          ? windowMinRttMs
+                          : min(windowMinRttMs, prevWindowMinRttMs);
+    stats.queueDelayMs = max(0.0, stats.srttMs - stats.baseRttMs);
+  }
+
+  void decrease(Clock::time_point now) {
+    // Without an RTT yet (ex. no Ping answered), every expiry would count.
+    double spacingMs = stats.srttMs > 0 ? stats.srttMs : config.probeTimeoutMs;
+    auto spacing = chrono::duration<double, milli>(spacingMs);
+    if (now - lastDecrease < spacing) {
+      return; // Same congestion event.
+    }
+
+    lastDecrease = now;
+    rate = max(rate * config.decreaseFactor, minRate);
+    stats.decreases++;
+  }
+};
+
+#endif // CONGESTIONCONTROL_H
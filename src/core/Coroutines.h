@@ -0,0 +1,200 @@
+#ifndef COROUTINES_H
+#define COROUTINES_H
+
+/**
+ * Minimal C++20 coroutine support for the client API:
+ * - Task<T>: A lazily started coroutine returning T. co_await it from
+ *   another Task; the awaiting coroutine resumes when it finishes.
+ * - FrameExecutor: Single-threaded. Resumes coroutines whose awaited
+ *   network event has happened, when the game calls runReady() (once per
+ *   frame), so coroutine code always runs on the game's thread, between
+ *   frames, without locks or thread handoffs.
+ *
+ *   Task<void> joinGame(ClientNetworkAPI &client) {
+ *     bool registered = co_await client.registerPlayerAsync();
+ *     if (registered) {
+ *       co_await client.connectToGameAsync("alpha");
+ *     }
+ *   }
+ *   client.spawn(joinGame(client));
+ *   while (running) { client.pollFrame(); ... }
+ *
+ * References:
+ * https://en.cppreference.com/w/cpp/language/coroutines
+ * https://lewissbaker.github.io/2020/05/11/understanding_symmetric_transfer
+ */
+
+#include <coroutine>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+template <typename T = void> class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+  coroutine_handle<> continuation = noop_coroutine();
+
+  suspend_always initial_suspend() noexcept { return {}; }
+
+  // Hand control back to whoever co_awaited this Task.
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    coroutine_handle<> await_suspend(coroutine_handle<Promise> done) noexcept {
+      return done.promise().continuation;
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  // The network code doesn't throw; an escaping exception is a bug.
+  void unhandled_exception() noexcept { std::terminate(); }
+};
+
+template <typename T> struct TaskPromise : TaskPromiseBase {
+  optional<T> value;
+
+  Task<T> get_return_object() noexcept;
+  void return_value(T result) { value = std::move(result); }
+};
+
+template <> struct TaskPromise<void> : TaskPromiseBase {
+  Task<void> get_return_object() noexcept;
+  void return_void() noexcept {}
+};
+
+} // namespace detail
+
+template <typename T> class Task {
+public:
+  using promise_type = detail::TaskPromise<T>;
+
+  explicit Task(coroutine_handle<promise_type> handle) : handle(handle) {}
+
+  Task(Task &&other) noexcept : handle(exchange(other.handle, nullptr)) {}
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      destroy();
+      handle = exchange(other.handle, nullptr);
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() { destroy(); }
+
+  bool done() const { return !handle || handle.done(); }
+
+  // co_await starts the Task, and resumes the caller when it returns.
+  auto operator co_await() && noexcept {
+    struct Awaiter {
+      coroutine_handle<promise_type> handle;
+
+      bool await_ready() noexcept { return !handle || handle.done(); }
+
+      coroutine_handle<> await_suspend(coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+      }
+
+      T await_resume() {
+        if constexpr (!is_void_v<T>) {
+          return std::move(*handle.promise().value);
+        }
+      }
+    };
+    return Awaiter{handle};
+  }
+
+private:
+  friend class FrameExecutor;
+
+  coroutine_handle<promise_type> handle;
+
+  void destroy() {
+    if (handle) {
+      handle.destroy();
+      handle = nullptr;
+    }
+  }
+};
+
+namespace detail {
+
+template <typename T> Task<T> TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>(coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+  return Task<void>(coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+/**
+ * post() may be called from any thread (ex. a read thread completing a
+ * request); the coroutine is only resumed by runReady(), on the game's.
+ */
+class FrameExecutor {
+public:
+  // Run a top-level Task until its first suspension. Kept until it's done.
+  void spawn(Task<void> &&task) {
+    if (task.done()) {
+      return;
+    }
+    spawned.push_back(std::move(task));
+    spawned.back().handle.resume();
+    reap();
+  }
+
+  // Resume handle on the next runReady().
+  void post(coroutine_handle<> handle) {
+    lock_guard<mutex> lock(readyMutex);
+    ready.push_back(handle);
+  }
+
+  // Resume everything that became ready. Returns how many were resumed.
+  size_t runReady() {
+    {
+      lock_guard<mutex> lock(readyMutex);
+      running.swap(ready);
+    }
+
+    // Coroutines resumed here may post again; those wait for the next call.
+    for (coroutine_handle<> handle : running) {
+      handle.resume();
+    }
+    size_t resumed = running.size();
+    running.clear();
+
+    reap();
+    return resumed;
+  }
+
+  size_t pendingTasks() const { return spawned.size(); }
+
+private:
+  mutex readyMutex;
+  vector<coroutine_handle<>> ready;
+  vector<coroutine_handle<>> running; // Reused every runReady().
+  list<Task<void>> spawned;
+
+  void reap() {
+    spawned.remove_if([](const Task<void> &task) { return task.done(); });
+  }
+};
+
+#endif // COROUTINES_H
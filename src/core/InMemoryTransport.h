@@ -0,0 +1,237 @@
+#ifndef INMEMORYTRANSPORT_H
+#define INMEMORYTRANSPORT_H
+
+/**
+ * In-process loopback transport: server and clients share an InMemoryHub,
+ * and frames are copied between per-endpoint FIFO queues. No sockets and no
+ * loss, and delivery order is exactly send order, so server logic can be
+ * benchmarked (and replayed) deterministically.
+ *
+ *   InMemoryHub hub;
+ *   BasicServerNetworkAPI<InMemoryServerTransport> server(hub);
+ *   BasicClientNetworkAPI<InMemoryClientTransport> client(hub);
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "Transport.h"
+
+using namespace std;
+
+class InMemoryHub {
+public:
+  enum class EventKind : uint8_t { Connect, Disconnect, Frame };
+
+  struct Event {
+    EventKind kind;
+    uint32_t clientIndex;
+    Delivery delivery;
+    vector<char> frame;
+  };
+
+  // Returns the new client's index, and queues its Connect for the server.
+  uint32_t addClient() {
+    lock_guard<mutex> lock(hubMutex);
+    uint32_t clientIndex = clientInboxes.size();
+    clientInboxes.emplace_back();
+    clientOpen.push_back(true);
+    pushEvent(serverInbox, {EventKind::Connect, clientIndex,
+                            Delivery::Reliable, {}});
+    return clientIndex;
+  }
+
+  // Either side hanging up; the other side gets a Disconnect.
+  void removeClient(uint32_t clientIndex, bool fromServer) {
+    lock_guard<mutex> lock(hubMutex);
+    if (clientIndex >= clientOpen.size() || !clientOpen[clientIndex]) {
+      return;
+    }
+    clientOpen[clientIndex] = false;
+    pushEvent(fromServer ? clientInboxes[clientIndex] : serverInbox,
+              {EventKind::Disconnect, clientIndex, Delivery::Reliable, {}});
+  }
+
+  bool toServer(uint32_t clientIndex, const SerializedMessage &mssg,
+                Delivery delivery) {
+    lock_guard<mutex> lock(hubMutex);
+    if (clientIndex >= clientOpen.size() || !clientOpen[clientIndex]) {
+      return false;
+    }
+    pushEvent(serverInbox, {EventKind::Frame, clientIndex, delivery,
+                            copyFrame(mssg)});
+    return true;
+  }
+
+  bool toClient(uint32_t clientIndex, const SerializedMessage &mssg,
+                Delivery delivery) {
+    lock_guard<mutex> lock(hubMutex);
+    if (clientIndex >= clientOpen.size() || !clientOpen[clientIndex]) {
+      return false;
+    }
+    pushEvent(clientInboxes[clientIndex],
+              {EventKind::Frame, clientIndex, delivery, copyFrame(mssg)});
+    return true;
+  }
+
+  /**
+   * Swap out everything queued for the server (or a client), waiting up to
+   * timeoutMs for something to arrive. Events are handled outside the lock,
+   * so handlers may send; what they send is seen on the next drain.
+   */
+  deque<Event> drainServer(int timeoutMs) {
+    return drain(serverInbox, timeoutMs);
+  }
+
+  deque<Event> drainClient(uint32_t clientIndex, int timeoutMs) {
+    return drain(clientInboxes[clientIndex], timeoutMs);
+  }
+
+private:
+  mutex hubMutex;
+  condition_variable arrived;
+  deque<Event> serverInbox;
+  deque<deque<Event>> clientInboxes; // deque: Stable references on growth.
+  vector<bool> clientOpen;
+
+  void pushEvent(deque<Event> &inbox, Event &&event) {
+    inbox.push_back(std::move(event));
+    arrived.notify_all();
+  }
+
+  static vector<char> copyFrame(const SerializedMessage &mssg) {
+    uint32_t mssgLength = frameMssgLength(mssg);
+    vector<char> frame(sizeof(Header) + mssgLength);
+    memcpy(frame.data(), mssg.header, sizeof(Header));
+    if (mssgLength > 0) {
+      memcpy(frame.data() + sizeof(Header), mssg.message, mssgLength);
+    }
+    return frame;
+  }
+
+  deque<Event> drain(deque<Event> &inbox, int timeoutMs) {
+    unique_lock<mutex> lock(hubMutex);
+    auto ready = [&] { return !inbox.empty(); };
+
+    if (timeoutMs < 0) {
+      arrived.wait(lock, ready);
+    } else if (timeoutMs > 0) {
+      arrived.wait_for(lock, chrono::milliseconds(timeoutMs), ready);
+    }
+
+    deque<Event> events;
+    events.swap(inbox);
+    return events;
+  }
+};
+
+// =======================================
+
+class InMemoryServerTransport {
+public:
+  struct Peer {
+    uint32_t clientIndex = UINT32_MAX;
+  };
+
+  InMemoryServerTransport(InMemoryHub &hub) : hub(hub) {}
+
+  bool open() { return true; }
+
+  template <typename Sink> size_t poll(int timeoutMs, Sink &sink) {
+    deque<InMemoryHub::Event> events = hub.drainServer(timeoutMs);
+
+    for (InMemoryHub::Event &event : events) {
+      Peer peer{event.clientIndex};
+      switch (event.kind) {
+      case InMemoryHub::EventKind::Connect:
+        sink.onConnect(peer);
+        break;
+      case InMemoryHub::EventKind::Disconnect:
+        sink.onDisconnect(peer);
+        break;
+      case InMemoryHub::EventKind::Frame:
+        sink.onFrame(peer, event.frame.data(), event.frame.size(),
+                     event.delivery);
+        break;
+      }
+    }
+
+    return events.size();
+  }
+
+  // A frame as if it had just arrived from 'from', handed straight to the
+  // sink without the hub's copy (ex. to time the server's receive path).
+  template <typename Sink>
+  void inject(Sink &sink, const Peer &from, const char *frame,
+              size_t frameLen, Delivery delivery) {
+    sink.onFrame(from, frame, frameLen, delivery);
+  }
+
+  bool send(const Peer &peer, const SerializedMessage &mssg,
+            Delivery delivery) {
+    return hub.toClient(peer.clientIndex, mssg, delivery);
+  }
+
+  void closePeer(const Peer &peer) { hub.removeClient(peer.clientIndex, true); }
+
+  // Both delivery classes share one channel, so there is nothing to bind.
+  static void bindUnreliable(Peer &sessionPeer, const Peer &from) {}
+
+  static uint64_t sourceKey(const Peer &from, Delivery delivery) {
+    return from.clientIndex;
+  }
+
+  uint64_t measureCapacity(const Peer &peer) const { return capacity; }
+
+  // Reported as every client's link (ex. a limited one, so the server
+  // budgets and probes it like a real link). Unlimited by default.
+  void setCapacity(uint64_t bytesPerSec) { capacity = bytesPerSec; }
+
+private:
+  InMemoryHub &hub;
+  uint64_t capacity = UNLIMITED_CAPACITY;
+};
+
+class InMemoryClientTransport {
+public:
+  InMemoryClientTransport(InMemoryHub &hub) : hub(hub) {}
+
+  ~InMemoryClientTransport() {
+    if (clientIndex != UINT32_MAX) {
+      hub.removeClient(clientIndex, false);
+    }
+  }
+
+  bool connect() {
+    clientIndex = hub.addClient();
+    return true;
+  }
+
+  template <typename Sink> size_t poll(int timeoutMs, Sink &sink) {
+    deque<InMemoryHub::Event> events = hub.drainClient(clientIndex, timeoutMs);
+
+    for (InMemoryHub::Event &event : events) {
+      if (event.kind == InMemoryHub::EventKind::Disconnect) {
+        sink.onDisconnect();
+      } else if (event.kind == InMemoryHub::EventKind::Frame) {
+        sink.onFrame(event.frame.data(), event.frame.size(), event.delivery);
+      }
+    }
+
+    return events.size();
+  }
+
+  bool send(const SerializedMessage &mssg, Delivery delivery) {
+    return hub.toServer(clientIndex, mssg, delivery);
+  }
+
+private:
+  InMemoryHub &hub;
+  uint32_t clientIndex = UINT32_MAX;
+};
+
+#endif // INMEMORYTRANSPORT_H
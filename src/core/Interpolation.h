@@ -0,0 +1,239 @@
+#ifndef INTERPOLATION_H
+#define INTERPOLATION_H
+
+/**
+ * Client-side interpolation (jitter) buffer for other entities' Locations.
+ *
+ * Locations arrive over UDP with jitter, sometimes out of order or not at
+ * all, and only as often as the server sends them. Drawing each one as it
+ * arrives stutters. Instead, each entity keeps its recent snapshots,
+ * timestamped on arrival, and is drawn a little in the past (its delay):
+ * between the two snapshots around (now - delay), interpolated. If the next
+ * snapshot is late, the entity is extrapolated along its last velocity for a
+ * little while, then held.
+ *
+ * The delay adapts per entity: about one update interval, plus a multiple of
+ * the measured jitter (the mean deviation of the intervals, as RFC 3550
+ * estimates it), so a steady stream is drawn with little delay, and a
+ * jittery or infrequent one (ex. a far entity the server updates less often)
+ * gets enough buffering not to run dry.
+ *
+ * Reference:
+ * https://developer.valvesoftware.com/wiki/Source_Multiplayer_Networking#Entity_interpolation
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+using namespace std;
+
+struct InterpolationConfig {
+  double minDelayMs = 30;
+  double maxDelayMs = 300;
+  double jitterMultiplier = 3; // Delay = mean interval + this x jitter.
+  double maxExtrapolationMs = 100; // Then the entity is held in place.
+  double forgetAfterMs = 5000; // Entities not updated this long are dropped.
+};
+
+struct InterpolationStats {
+  uint64_t snapshots = 0;
+  uint64_t outOfOrder = 0;   // Older than one already buffered (dropped).
+  uint64_t interpolated = 0; // Samples between two snapshots.
+  uint64_t extrapolated = 0; // Samples past the newest snapshot.
+  uint64_t held = 0;         // Past it by more than maxExtrapolationMs.
+  size_t entities = 0;
+};
+
+/**
+ * Not thread-safe; the client locks around it.
+ * Times are steady_clock nanoseconds.
+ */
+class InterpolationBuffer {
+public:
+  static constexpr size_t SNAPSHOTS = 32; // Per entity.
+
+  InterpolationBuffer(const InterpolationConfig &config = InterpolationConfig())
+      : config(config) {}
+
+  void setConfig(const InterpolationConfig &newConfig) { config = newConfig; }
+
+  /**
+   * A Location arrived at nowNs. seq: Its Coord2D::seq (the owner's input
+   * sequence number), used to drop reordered ones; 0 if unknown.
+   */
+  void add(uint32_t objectID, uint32_t xCoord, uint32_t yCoord, uint32_t seq,
+           int64_t nowNs) {
+    Entity &entity = entities[objectID];
+
+    if (seq != 0 && entity.lastSeq != 0 && int32_t(seq - entity.lastSeq) <= 0) {
+      stats.outOfOrder++;
+      return;
+    }
+    if (seq != 0) {
+      entity.lastSeq = seq;
+    }
+
+    if (entity.count > 0) {
+      updateDelay(entity, double(nowNs - newest(entity).timeNs) / 1e6);
+    } else {
+      entity.delayMs = config.minDelayMs;
+    }
+
+    entity.snapshots[entity.head] = {nowNs, double(xCoord), double(yCoord)};
+    entity.head = (entity.head + 1) % SNAPSHOTS;
+    entity.count = min(entity.count + 1, SNAPSHOTS);
+    stats.snapshots++;
+
+    // Drop entities that went quiet (ex. left the game), now and then.
+    if (++addsSinceSweep >= 1024) {
+      addsSinceSweep = 0;
+      forgetStale(nowNs);
+    }
+  }
+
+  /**
+   * Where to draw objectID at nowNs. False if it has no snapshots.
+   */
+  bool sample(uint32_t objectID, int64_t nowNs, double &xCoord,
+              double &yCoord) {
+    auto it = entities.find(objectID);
+    if (it == entities.end() || it->second.count == 0) {
+      return false;
+    }
+
+    Entity &entity = it->second;
+    int64_t renderNs = nowNs - int64_t(entity.delayMs * 1e6);
+
+    // Walk back from the newest, to the pair around renderNs.
+    const Snapshot *later = &newest(entity);
+    if (renderNs >= later->timeNs) {
+      extrapolate(entity, renderNs, xCoord, yCoord);
+      return true;
+    }
+
+    for (size_t i = 1; i < entity.count; i++) {
+      const Snapshot &earlier = at(entity, i);
+      if (earlier.timeNs <= renderNs) {
+        double t = double(renderNs - earlier.timeNs) /
+                   double(later->timeNs - earlier.timeNs);
+        xCoord = earlier.xCoord + (later->xCoord - earlier.xCoord) * t;
+        yCoord = earlier.yCoord + (later->yCoord - earlier.yCoord) * t;
+        stats.interpolated++;
+        return true;
+      }
+      later = &earlier;
+    }
+
+    // Older than everything buffered: The oldest snapshot.
+    xCoord = later->xCoord;
+    yCoord = later->yCoord;
+    stats.interpolated++;
+    return true;
+  }
+
+  // The delay objectID is drawn with, in ms (0 if unknown).
+  double getDelayMs(uint32_t objectID) const {
+    auto it = entities.find(objectID);
+    return it == entities.end() ? 0 : it->second.delayMs;
+  }
+
+  void forget(uint32_t objectID) { entities.erase(objectID); }
+
+  InterpolationStats getStats() const {
+    InterpolationStats current = stats;
+    current.entities = entities.size();
+    return current;
+  }
+
+private:
+  struct Snapshot {
+    int64_t timeNs = 0;
+    double xCoord = 0;
+    double yCoord = 0;
+  };
+
+  struct Entity {
+    array<Snapshot, SNAPSHOTS> snapshots;
+    size_t head = 0; // Next slot to write.
+    size_t count = 0;
+    uint32_t lastSeq = 0;
+
+    double meanIntervalMs = 0;
+    double jitterMs = 0;
+    double delayMs = 0;
+  };
+
+  InterpolationConfig config;
+  unordered_map<uint32_t, Entity> entities;
+  InterpolationStats stats;
+  size_t addsSinceSweep = 0;
+
+  // i = 0: newest.
+  static const Snapshot &at(const Entity &entity, size_t i) {
+    return entity.snapshots[(entity.head + SNAPSHOTS - 1 - i) % SNAPSHOTS];
+  }
+
+  static const Snapshot &newest(const Entity &entity) { return at(entity, 0); }
+
+  void updateDelay(Entity &entity, double intervalMs) {
+    if (entity.meanIntervalMs == 0) {
+      entity.meanIntervalMs = intervalMs;
+    }
+
+    // Same gains as RFC 3550's jitter estimate.
+    double deviation = fabs(intervalMs - entity.meanIntervalMs);
+    entity.meanIntervalMs += (intervalMs - entity.meanIntervalMs) / 8;
+    entity.jitterMs += (deviation - entity.jitterMs) / 16;
+
+    double target = entity.meanIntervalMs +
+                    config.jitterMultiplier * entity.jitterMs;
+    target = clamp(target, config.minDelayMs, config.maxDelayMs);
+
+    // Eased, so the entity's render time doesn't jump (or run backwards).
+    entity.delayMs += (target - entity.delayMs) / 16;
+  }
+
+  void extrapolate(const Entity &entity, int64_t renderNs, double &xCoord,
+                   double &yCoord) {
+    const Snapshot &last = newest(entity);
+    xCoord = last.xCoord;
+    yCoord = last.yCoord;
+    if (entity.count < 2) {
+      stats.held++;
+      return;
+    }
+
+    const Snapshot &previous = at(entity, 1);
+    double spanNs = double(last.timeNs - previous.timeNs);
+    double aheadNs = min(double(renderNs - last.timeNs),
+                         config.maxExtrapolationMs * 1e6);
+    if (spanNs <= 0) {
+      stats.held++;
+      return;
+    }
+
+    xCoord += (last.xCoord - previous.xCoord) * aheadNs / spanNs;
+    yCoord += (last.yCoord - previous.yCoord) * aheadNs / spanNs;
+    if (renderNs - last.timeNs > config.maxExtrapolationMs * 1e6) {
+      stats.held++;
+    } else {
+      stats.extrapolated++;
+    }
+  }
+
+  void forgetStale(int64_t nowNs) {
+    int64_t cutoffNs = nowNs - int64_t(config.forgetAfterMs * 1e6);
+    for (auto it = entities.begin(); it != entities.end();) {
+      if (it->second.count > 0 && newest(it->second).timeNs < cutoffNs) {
+        it = entities.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+};
+
+#endif // INTERPOLATION_H
@@ -0,0 +1,220 @@
+#ifndef NETIMPAIRMENT_H
+#define NETIMPAIRMENT_H
+
+/**
+ * In-process network impairment shim for datagrams.
+ *
+ * An ImpairedLink sits below UDP's sendto()/recvfrom() and holds each
+ * datagram back according to an ImpairmentConfig: fixed delay plus jitter,
+ * random loss, duplication and reordering, and a bandwidth cap with a
+ * bounded bottleneck queue. Randomness comes from a seeded RNG, so a run
+ * can be repeated exactly.
+ *
+ * Modeled on Linux netem (without needing root or tc):
+ * https://man7.org/linux/man-pages/man8/tc-netem.8.html
+ */
+
+#include <netinet/in.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+struct ImpairmentConfig {
+  uint32_t delayMs = 0;     // Fixed one-way delay.
+  uint32_t jitterMs = 0;    // Uniform +/- jitter on top of delayMs.
+  double lossRate = 0;      // Chance [0, 1] a datagram is dropped.
+  double duplicateRate = 0; // Chance a datagram is delivered twice.
+  double reorderRate = 0;   // Chance a datagram skips the delay, overtaking
+                            // the ones in front of it.
+  uint64_t bandwidthBytesPerSec = 0; // 0 = unlimited.
+  uint32_t queueLimitBytes = 64 * 1024; // Bottleneck queue (tail drop).
+  uint32_t seed = 1;
+
+  bool enabled() const {
+    return delayMs > 0 || jitterMs > 0 || lossRate > 0 || duplicateRate > 0 ||
+           reorderRate > 0 || bandwidthBytesPerSec > 0;
+  }
+};
+
+struct ImpairmentStats {
+  uint64_t submitted = 0;
+  uint64_t delivered = 0;
+  uint64_t lost = 0;        // Random loss.
+  uint64_t queueDrops = 0;  // Bottleneck queue full.
+  uint64_t duplicated = 0;
+  uint64_t reordered = 0;
+};
+
+class ImpairedLink {
+public:
+  ImpairedLink(const ImpairmentConfig &config)
+      : config(config), rng(config.seed) {}
+
+  /**
+   * Take a datagram that would have been sent/received now.
+   * It comes back out of deliverDue(...) once its release time passes.
+   */
+  void submit(const sockaddr_in &addr, const char *data, size_t len) {
+    uint64_t now = nowNs();
+    lock_guard<mutex> lock(linkMutex);
+    stats.submitted++;
+
+    if (chance(config.lossRate)) {
+      stats.lost++;
+      return;
+    }
+
+    // Bandwidth cap: The datagram waits for the ones ahead of it to be
+    // "transmitted", and is tail-dropped if that queue is too long.
+    uint64_t departNs = now;
+    if (config.bandwidthBytesPerSec > 0) {
+      uint64_t start = max(now, linkFreeNs);
+      uint64_t queuedBytes =
+          (start - now) * config.bandwidthBytesPerSec / 1000000000ull;
+
+      if (queuedBytes + len > config.queueLimitBytes) {
+        stats.queueDrops++;
+        return;
+      }
+
+      linkFreeNs = start + len * 1000000000ull / config.bandwidthBytesPerSec;
+      departNs = linkFreeNs;
+    }
+
+    int copies = chance(config.duplicateRate) ? 2 : 1;
+    if (copies == 2) {
+      stats.duplicated++;
+    }
+
+    for (int i = 0; i < copies; i++) {
+      uint64_t releaseNs = departNs;
+
+      if (i == 0 && chance(config.reorderRate)) {
+        stats.reordered++; // Sent straight through.
+      } else {
+        releaseNs += delayNs();
+      }
+
+      Datagram dgram;
+      dgram.releaseNs = releaseNs;
+      dgram.seq = nextSeq++;
+      dgram.addr = addr;
+      dgram.data.assign(data, data + len);
+      pending.push(std::move(dgram));
+    }
+  }
+
+  /**
+   * Calls deliver(addr, data, len) for every datagram due by now.
+   * Returns the number delivered.
+   */
+  template <typename DeliverFunc> size_t deliverDue(DeliverFunc deliver) {
+    size_t count = 0;
+    Datagram dgram;
+
+    while (popDue(dgram)) {
+      deliver(dgram.addr, dgram.data.data(), dgram.data.size());
+      count++;
+    }
+
+    return count;
+  }
+
+  /**
+   * Copy the next due datagram into buf (truncated to cap, like recvfrom).
+   * Returns its length, or -1 if nothing is due yet.
+   */
+  ssize_t receiveDue(char *buf, size_t cap, sockaddr_in &from) {
+    Datagram dgram;
+    if (!popDue(dgram)) {
+      return -1;
+    }
+
+    size_t len = min(cap, dgram.data.size());
+    memcpy(buf, dgram.data.data(), len);
+    from = dgram.addr;
+    return len;
+  }
+
+  // Milliseconds until the next datagram is due (-1 if none are held),
+  // for bounding poll() timeouts.
+  int msUntilNextRelease() const {
+    lock_guard<mutex> lock(linkMutex);
+    if (pending.empty()) {
+      return -1;
+    }
+
+    uint64_t now = nowNs();
+    uint64_t release = pending.top().releaseNs;
+    return release <= now ? 0 : int((release - now + 999999) / 1000000);
+  }
+
+  ImpairmentStats getStats() const {
+    lock_guard<mutex> lock(linkMutex);
+    return stats;
+  }
+
+private:
+  struct Datagram {
+    uint64_t releaseNs = 0;
+    uint64_t seq = 0; // Ties keep submission order.
+    sockaddr_in addr = {};
+    vector<char> data;
+
+    bool operator>(const Datagram &other) const {
+      return releaseNs != other.releaseNs ? releaseNs > other.releaseNs
+                                          : seq > other.seq;
+    }
+  };
+
+  ImpairmentConfig config;
+  ImpairmentStats stats;
+  mt19937_64 rng;
+  uniform_real_distribution<double> unit{0.0, 1.0};
+
+  uint64_t linkFreeNs = 0; // When the bottleneck finishes its queue.
+  uint64_t nextSeq = 0;
+  priority_queue<Datagram, vector<Datagram>, greater<Datagram>> pending;
+  mutable mutex linkMutex;
+
+  static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+  }
+
+  bool chance(double rate) { return rate > 0 && unit(rng) < rate; }
+
+  uint64_t delayNs() {
+    double ms = config.delayMs;
+    if (config.jitterMs > 0) {
+      ms += (unit(rng) * 2.0 - 1.0) * config.jitterMs;
+    }
+    return ms <= 0 ? 0 : uint64_t(ms * 1000000.0);
+  }
+
+  bool popDue(Datagram &out) {
+    uint64_t now = nowNs();
+    lock_guard<mutex> lock(linkMutex);
+
+    if (pending.empty() || pending.top().releaseNs > now) {
+      return false;
+    }
+
+    // priority_queue::top is const; the element is popped right after.
+    out = std::move(const_cast<Datagram &>(pending.top()));
+    pending.pop();
+    stats.delivered++;
+    return true;
+  }
+};
+
+#endif // NETIMPAIRMENT_H
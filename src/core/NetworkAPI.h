@@ -1,19 +1,49 @@
 
-#include "TCP.h"
-#include "UDP.h"
+#include "CoalescingQueue.h"
+#include "Coroutines.h"
+#include "Interpolation.h"
+#include "PendingRequests.h"
+#include "Prediction.h"
+#include "RateLimiter.h"
+#include "SourceSessionMap.h"
+#include "SendScheduler.h"
+#include "SpscQueue.h"
+#include "Tracer.h"
+#include "TrafficLog.h"
+#include "Transport.h"
 #include "messages.h"
 
+// Transports (see Transport.h)
+#include "InMemoryTransport.h"
+#include "client/ShmClientTransport.h"
+#include "client/SocketClientTransport.h"
+#include "server/SocketServerTransport.h"
+
 // For server
 #include "Observers.h"
-#include "server/TCPServer.h"
+#include "server/MapStream.h"
+#include "server/Rooms.h"
+
+#include <sys/random.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <queue>
+#include <random>
 #include <string>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 using namespace std;
@@ -21,228 +51,1531 @@ using namespace std;
 #ifndef NETWORKAPI_H
 #define NETWORKAPI_H
 
-struct Connection {
+template <typename Peer> struct Connection {
   // If A needs to be aware of B, send B's publicID, NOT B's sessionID
   uint32_t publicID;
 
-  int sfd = -1;                    // TCP socket file descriptor
-  struct sockaddr_in udpAddr = {}; // UDP address
+  // Transport handle (ex. TCP sfd + UDP addr, or a shared-memory channel).
+  Peer peer;
+
+  // Session recreated by replaying a traffic log. Has no peer,
+  // so messages to it are dropped.
+  bool replayed = false;
 
-  Connection(uint32_t publicID, int tcpSfd) : publicID(publicID), sfd(tcpSfd) {}
+  // Sent to the client over its reliable channel; its unreliable channel
+  // is bound only by a Register carrying it (see Registration).
+  uint64_t bindNonce = 0;
 
-  Connection(uint32_t publicID, int tcpSfd, sockaddr_in udpAddr)
-      : publicID(publicID), sfd(tcpSfd), inAddr(udpAddr) {}
+  Connection(uint32_t publicID, const Peer &peer)
+      : publicID(publicID), peer(peer) {}
 };
 
+/**
+ * The client and server APIs are templates over a transport policy
+ * (see Transport.h), so nothing on the message path is virtual.
+ * TCP/UDP in the names below mean the delivery class (Reliable/Unreliable),
+ * whatever the transport actually is.
+ */
 class NetworkAPI {
 public:
 protected:
-  uint32_t sessionID;
+  // The client's is set by its read thread once registered, and read by
+  // every send from the game thread: Load it once per frame.
+  atomic<uint32_t> sessionID{0};
+};
 
-  virtual void handleIncomingMessage(const char *hdrMssg, const char *mssg) = 0;
+// See BasicClientNetworkAPI::startNetworkThread.
+struct ClientThreadConfig {
+  int moveSendHz = 30;  // Coalesced moves go out this often. 0: Don't coalesce.
+  int sendDelayMs = 1;  // Longest a queued mssg waits for the thread to wake.
+  size_t inboxCapacity = 4096;  // Incoming frames waiting for pollFrame().
+  size_t outboxCapacity = 4096; // Mssgs waiting to be sent.
+};
 
-  virtual void handleIncomingTCPHeader(const char *header) = 0;
-  void handleIncomingUDPHeader(const char *header) = 0;
+struct ClientThreadStats {
+  uint64_t movesQueued = 0;
+  uint64_t movesSent = 0;
+  uint64_t movesCoalesced = 0; // Replaced by a newer move before being sent.
+  uint64_t outboxFull = 0;     // Sends refused: The network thread is behind.
+  uint64_t inboxDropped = 0;   // Unreliable frames dropped: pollFrame() is behind.
 };
 
 // ============================================================
 // ------------------------------------------------------------
 
-class ClientNetworkAPI : NetworkAPI {
-  ClientNetworkAPI(char *host, char *tcpPort, char *udpPort) {
-    tcpClient = TCPClient(host, tcpPort);
-    udpClient = UDP(host, udpPort);
+template <ClientTransport Transport> class BasicClientNetworkAPI : NetworkAPI {
+public:
+  // Arguments go to the transport (ex. host, tcpPort, udpPort for sockets).
+  template <typename... TransportArgs>
+  BasicClientNetworkAPI(TransportArgs &&...transportArgs)
+      : transport(std::forward<TransportArgs>(transportArgs)...) {}
+
+  ~BasicClientNetworkAPI() { stopNetworkThread(); }
+
+  /**
+   * Connects, then blocks reading incoming mssgs (run it on its own thread).
+   * Client will not use thread for writing from buffers. Just send-on-invoke.
+   * (See startNetworkThread() for sending off the caller's thread.)
+   */
+  void start() {
+    if (!connect()) {
+      return;
+    }
+
+    // Wakes up at least every REQUEST_CHECK_MS to time out requests.
+    while (!disconnected.load(memory_order_acquire)) {
+      pump(REQUEST_CHECK_MS);
+    }
+  }
+
+  // For driving the client without start()'s loop.
+  bool connect() {
+    if (!transport.connect()) {
+      cerr << "ClientNetworkAPI failed to connect." << endl;
+      return false;
+    }
+
+    lock_guard<mutex> lock(registerMutex);
+    connected = true;
+    registerCV.notify_all();
+    return true;
+  }
+
+  /**
+   * Connects, then runs the network I/O on its own thread, for a game loop
+   * that can't wait on a syscall:
+   * - Sends are queued for it (lock-free) instead of written on the
+   *   caller's thread. Moves are coalesced: At most one per objectID goes
+   *   out every 1/config.moveSendHz seconds, with the latest coords.
+   * - Incoming events wait in an inbox until the game calls pollFrame(),
+   *   so their callbacks run on the game's thread.
+   * Registration, Pings and request replies are still handled on the
+   * network thread, so the blocking calls (ex. registerPlayer) keep working;
+   * sendRequest callbacks run there too.
+   * Sends must then come from one thread (the game's).
+   */
+  bool startNetworkThread(
+      const ClientThreadConfig &config = ClientThreadConfig()) {
+    if (ioThread.joinable()) {
+      return true;
+    }
+    if (!isConnected() && !connect()) {
+      return false;
+    }
+
+    threadConfig = config;
+    inbox = make_unique<SpscQueue<InboxFrame>>(config.inboxCapacity);
+    outbox = make_unique<SpscQueue<OutboxEntry>>(config.outboxCapacity);
+    stopIO.store(false, memory_order_relaxed);
+    threaded.store(true, memory_order_release);
+
+    ioThread = thread([this] { runNetworkThread(); });
+    return true;
+  }
+
+  // Sends whatever is still queued, then stops the network thread.
+  void stopNetworkThread() {
+    if (!ioThread.joinable()) {
+      return;
+    }
+
+    stopIO.store(true, memory_order_release);
+    ioThread.join();
+    threaded.store(false, memory_order_release);
+  }
+
+  ClientThreadStats getThreadStats() const {
+    ClientThreadStats stats;
+    stats.movesQueued = movesQueued.load(memory_order_relaxed);
+    stats.movesSent = movesSent.load(memory_order_relaxed);
+    stats.movesCoalesced = movesCoalesced.load(memory_order_relaxed);
+    stats.outboxFull = outboxFull.load(memory_order_relaxed);
+    stats.inboxDropped = inboxDropped.load(memory_order_relaxed);
+    return stats;
+  }
+
+  /**
+   * One pass of the read loop: Hand every frame the transport has
+   * (waiting up to timeoutMs) to the callbacks, then time out overdue
+   * requests.
+   */
+  size_t pump(int timeoutMs) {
+    size_t delivered = transport.poll(timeoutMs, *this);
+    pendingRequests.expire();
+    expireSessionWaiters();
+    return delivered;
+  }
+
+  /**
+   * Send a Request over TCP without waiting. callback gets the server's
+   * Verification, or nullptr after timeoutMs. Any number may be in flight,
+   * answered in any order. May be sent before registration completes:
+   * It is pipelined behind the Register on the same channel.
+   * Returns the requestID, or 0 if it couldn't be sent.
+   */
+  uint32_t sendRequest(RequestType type, const string &argument,
+                       PendingRequests::Callback callback,
+                       int timeoutMs = REQUEST_TIMEOUT_MS) {
+    uint32_t requestID = pendingRequests.add(timeoutMs, std::move(callback));
+
+    Request request(requestID, type, argument);
+    if (!sendTCPMessage(SerializedMessage(sessionID.load(), request))) {
+      pendingRequests.cancel(requestID);
+      return 0;
+    }
+    return requestID;
+  }
+
+  // Blocks until the server answers (up to REQUEST_TIMEOUT_MS).
+  bool connectToGame(string gamename) {
+    optional<Verification> reply =
+        waitForRequest(RequestType::JoinGame, gamename);
+    return reply && reply->status;
+  }
+
+  /**
+   * Register with the server. Waits (up to REGISTER_TIMEOUT_MS) for
+   * the connection and for the server to send back our sessionID,
+   * which is then sent over UDP so the server can map that address too.
+   * Needs start() or pump() running to read the reply.
+   */
+  bool registerPlayer() {
+    return registerPipelined([] {});
+  }
+
+  /**
+   * registerPlayer() then connectToGame(gamename), in about one round trip
+   * instead of two: The join request goes out right behind the Register.
+   */
+  bool registerAndJoin(const string &gamename) {
+    auto joined = make_shared<promise<bool>>();
+    future<bool> joinResult = joined->get_future();
+    bool requested = false;
+
+    bool registered = registerPipelined([&] {
+      requested = sendRequest(RequestType::JoinGame, gamename,
+                              [joined](const Verification *reply) {
+                                joined->set_value(reply && reply->status);
+                              }) != 0;
+    });
+
+    // Once sent, the join is answered or times out.
+    return registered && requested && joinResult.get();
+  }
+
+  // Blocks until the server answers (up to REQUEST_TIMEOUT_MS).
+  vector<string> getGameList() {
+    optional<Verification> reply = waitForRequest(RequestType::GameList, "");
+    return reply ? parseGameList(*reply) : vector<string>();
+  }
+
+  // @TODO: Returns true when server sends verification
+  // Sends move over UDP, recieves verification over UDP
+  bool sendMove(uint32_t xCoord, uint32_t yCoord) {
+    Coord2D coord(0, xCoord, yCoord);
+    return sendFrame(SerializedMessage(sessionID.load(), coord),
+                     Delivery::Unreliable, &coord);
+  }
+
+  /**
+   * Move for an object this client is in charge of (ex. its player, or a
+   * mob it spawned). Predicted: Applied locally right away, and reconciled
+   * with the server's Locations for it (see Prediction.h). Base the next
+   * move on getPredictedPosition().
+   */
+  bool sendMove(uint32_t objectID, uint32_t xCoord, uint32_t yCoord) {
+    uint32_t seq;
+    {
+      lock_guard<mutex> lock(predictionMutex);
+      seq = predictors[objectID].record(xCoord, yCoord);
+    }
+
+    Coord2D coord(objectID, xCoord, yCoord, seq);
+    return sendFrame(SerializedMessage(sessionID.load(), coord),
+                     Delivery::Unreliable, &coord);
+  }
+
+  /**
+   * Move an object without predicting it (ex. a bot timing the server's
+   * echo): Its Locations reach the callbacks as the server sent them.
+   */
+  bool sendUnpredictedMove(uint32_t objectID, uint32_t xCoord,
+                           uint32_t yCoord) {
+    Coord2D coord(objectID, xCoord, yCoord);
+    return sendFrame(SerializedMessage(sessionID.load(), coord),
+                     Delivery::Unreliable, &coord);
+  }
+
+  // Where a moved object is, predicted. False if it was never moved.
+  bool getPredictedPosition(uint32_t objectID, uint32_t &xCoord,
+                            uint32_t &yCoord) {
+    lock_guard<mutex> lock(predictionMutex);
+    auto it = predictors.find(objectID);
+    if (it == predictors.end()) {
+      return false;
+    }
+    xCoord = it->second.getX();
+    yCoord = it->second.getY();
+    return true;
+  }
+
+  PredictionStats getPredictionStats(uint32_t objectID) {
+    lock_guard<mutex> lock(predictionMutex);
+    auto it = predictors.find(objectID);
+    return it == predictors.end() ? PredictionStats() : it->second.getStats();
+  }
+
+  /**
+   * Where to draw another entity right now: Its Locations, timestamped on
+   * arrival and interpolated a little in the past, with a delay that
+   * follows their jitter (see Interpolation.h). Call it every frame;
+   * the Location callbacks still get each update as it arrives.
+   * False if no Location arrived for it.
+   */
+  bool getInterpolatedPosition(uint32_t objectID, double &xCoord,
+                               double &yCoord) {
+    lock_guard<mutex> lock(interpolationMutex);
+    return interpolation.sample(objectID, nowNs(), xCoord, yCoord);
+  }
+
+  void setInterpolationConfig(const InterpolationConfig &config) {
+    lock_guard<mutex> lock(interpolationMutex);
+    interpolation.setConfig(config);
+  }
+
+  InterpolationStats getInterpolationStats() {
+    lock_guard<mutex> lock(interpolationMutex);
+    return interpolation.getStats();
+  }
+
+  /**
+   * Fires a shot: It's flown locally from now, and sent once (reliably);
+   * the server and other clients fly it themselves (see Trajectory.h).
+   * The server names it (objectID, ownerID) and sets its spawnTick; until
+   * its copy comes back, the shot flies under a provisional objectID
+   * (spawn's objectID and ownerID are ignored).
+   */
+  bool sendProjectile(const ProjectileSpawn &spawn) {
+    ProjectileSpawn shot = spawn;
+    {
+      lock_guard<mutex> lock(projectileMutex);
+      shot.objectID = PROVISIONAL_PROJECTILE_BIT |
+                      (nextProvisionalID++ & ~PROVISIONAL_PROJECTILE_BIT);
+      projectiles.add(shot, nowNs());
+      unnamedShots.push_back(shot);
+      if (unnamedShots.size() > MAX_UNNAMED_SHOTS) {
+        unnamedShots.pop_front(); // Never came back (ex. dropped).
+      }
+    }
+    return sendTCPMessage(
+        SerializedMessage(sessionID.load(), Projectile(shot)));
+  }
+
+  /**
+   * Where to draw every projectile in flight right now, one per live
+   * pellet, into out. Call it every frame; ones past their lifetime are
+   * dropped.
+   */
+  void getProjectilePositions(vector<ProjectilePosition> &out) {
+    int64_t now = nowNs();
+    lock_guard<mutex> lock(projectileMutex);
+    projectiles.expireAt(now);
+    projectiles.sampleAt(now, out);
+  }
+
+  // Ex. when the server says it hit something.
+  bool removeProjectile(uint32_t objectID) {
+    lock_guard<mutex> lock(projectileMutex);
+    return projectiles.remove(objectID);
+  }
+
+  ProjectileStats getProjectileStats() {
+    lock_guard<mutex> lock(projectileMutex);
+    return projectiles.getStats();
+  }
+
+  // Sends action over UDP
+  void sendAction(uint8_t actionType, uint32_t actionValue,
+                  uint32_t impactedID) {
+    Action action(actionType, actionValue, impactedID);
+    sendUDPMessage(SerializedMessage(sessionID.load(), action));
+  }
+
+  // Sends mssg over TCP
+  void sendChat(char *chatMssg) {
+    ChatMessage chatMessage(chatMssg);
+    sendTCPMessage(SerializedMessage(sessionID.load(), chatMessage));
+  }
+
+  // Register a callback for an incoming event (ex. Location updates).
+  template <typename... Args>
+  void registerCallback(EventCode eventType,
+                        std::function<void(Args...)> callback) {
+    if (callback) {
+      observers.registerObserver(static_cast<uint8_t>(eventType), callback);
+    }
+  }
+
+  // Transport-specific settings (ex. setUDPImpairment for sockets).
+  Transport &getTransport() { return transport; }
+
+  // =======================================
+  // Coroutine API (see Coroutines.h): Awaitable versions of the calls
+  // above, for a game loop that can't block. Call connect() first, then
+  // pollFrame() once per frame; coroutines resume inside pollFrame().
+
+  /**
+   * Handle what has arrived (without waiting): Read it, or with the network
+   * thread running, take it from the inbox. Then resume the coroutines whose
+   * replies came in. Returns how many mssgs and coroutines that was.
+   */
+  size_t pollFrame() {
+    size_t handled = inbox ? dispatchInbox() : 0;
+    if (!threaded.load(memory_order_acquire)) {
+      handled += pump(0);
+    }
+    return handled + executor.runReady();
+  }
+
+  // Start a coroutine; it runs until its first co_await.
+  void spawn(Task<void> &&task) { executor.spawn(std::move(task)); }
+
+  // co_await: The server's Verification, or nullopt on timeout.
+  struct RequestAwaiter {
+    BasicClientNetworkAPI &client;
+    RequestType type;
+    string argument;
+    int timeoutMs;
+    optional<Verification> reply;
+
+    bool await_ready() const noexcept { return false; }
+
+    // Returns false (resume now, with nullopt) if it couldn't be sent.
+    bool await_suspend(coroutine_handle<> waiting) {
+      return client.sendRequest(type, argument,
+                                [this, waiting](const Verification *answer) {
+                                  if (answer) {
+                                    reply = *answer;
+                                  }
+                                  client.executor.post(waiting);
+                                },
+                                timeoutMs) != 0;
+    }
+
+    optional<Verification> await_resume() { return std::move(reply); }
+  };
+
+  RequestAwaiter requestAsync(RequestType type, string argument,
+                              int timeoutMs = REQUEST_TIMEOUT_MS) {
+    return {*this, type, std::move(argument), timeoutMs, nullopt};
+  }
+
+  // co_await: Our sessionID once the server replies to the Register,
+  // or 0 after REGISTER_TIMEOUT_MS.
+  struct SessionAwaiter {
+    BasicClientNetworkAPI &client;
+    uint32_t assignedID = 0;
+
+    bool await_ready() {
+      lock_guard<mutex> lock(client.registerMutex);
+      assignedID = client.sessionID.load();
+      return assignedID != 0;
+    }
+
+    bool await_suspend(coroutine_handle<> waiting) {
+      lock_guard<mutex> lock(client.registerMutex);
+      if (client.sessionID.load() != 0) {
+        assignedID = client.sessionID.load();
+        return false;
+      }
+
+      auto deadline = chrono::steady_clock::now() +
+                      chrono::milliseconds(REGISTER_TIMEOUT_MS);
+      client.sessionWaiters.push_back({deadline, [this, waiting](uint32_t id) {
+                                         assignedID = id;
+                                         client.executor.post(waiting);
+                                       }});
+      return true;
+    }
+
+    uint32_t await_resume() { return assignedID; }
+  };
+
+  Task<bool> registerPlayerAsync() {
+    if (!isConnected() || !sendRegister()) {
+      co_return false;
+    }
+
+    // Awaited outside the if: GCC 12 skips the body of a coroutine with a
+    // co_await in an if condition.
+    uint32_t assignedID = co_await SessionAwaiter{*this};
+    if (assignedID == 0) {
+      cerr << "ClientNetworkAPI: Registration timed out." << endl;
+      co_return false;
+    }
+
+    bindUnreliableChannel();
+    co_return true;
+  }
+
+  Task<bool> connectToGameAsync(string gamename) {
+    optional<Verification> reply =
+        co_await requestAsync(RequestType::JoinGame, std::move(gamename));
+    co_return reply && reply->status;
+  }
+
+  Task<vector<string>> getGameListAsync() {
+    optional<Verification> reply =
+        co_await requestAsync(RequestType::GameList, "");
+    co_return reply ? parseGameList(*reply) : vector<string>();
+  }
+
+private:
+  // The transport calls back into onFrame/onDisconnect.
+  friend Transport;
+
+  static constexpr int REGISTER_TIMEOUT_MS = 5000;
+  static constexpr int REQUEST_TIMEOUT_MS = 5000;
+  static constexpr int REQUEST_CHECK_MS = 50;
+
+  Transport transport;
+
+  // Map event (subject) types to callback functions (observer(s))
+  Observers observers;
+
+  // registerPlayer waits on these for connect() and the server's reply.
+  mutex registerMutex;
+  condition_variable registerCV;
+  bool connected = false;
+  atomic<bool> disconnected{false};
+  uint64_t bindNonce = 0; // From the server's Register reply.
+
+  // registerPlayerAsync's wait for the server's reply (see SessionAwaiter).
+  struct SessionWaiter {
+    chrono::steady_clock::time_point deadline;
+    std::function<void(uint32_t)> notify; // 0 on timeout.
+  };
+  vector<SessionWaiter> sessionWaiters;
+
+  // Resumes the coroutines (see pollFrame).
+  FrameExecutor executor;
+
+  // Requests waiting for their Verification.
+  PendingRequests pendingRequests;
+
+  // Objects this client moves, by objectID (see sendMove).
+  mutex predictionMutex;
+  unordered_map<uint32_t, MovePredictor> predictors;
+
+  // Everyone else's (see getInterpolatedPosition).
+  mutex interpolationMutex;
+  InterpolationBuffer interpolation;
+
+  // Shots in flight, fired or received (see getProjectilePositions).
+  // unnamedShots: Ours, not yet named by the server (see sendProjectile).
+  static constexpr size_t MAX_UNNAMED_SHOTS = 64;
+  mutex projectileMutex;
+  ProjectileSet projectiles;
+  deque<ProjectileSpawn> unnamedShots;
+  uint32_t nextProvisionalID = 1;
+
+  // Decompressed frames, on whichever thread reads them (see onFrame).
+  vector<char> inflated;
+
+  // Network thread (see startNetworkThread).
+  struct InboxFrame {
+    vector<char> bytes; // Header + message. Keeps its capacity across uses.
+    int64_t receivedNs = 0;
+  };
+
+  struct OutboxEntry {
+    unique_ptr<SerializedMessage> mssg;
+    Delivery delivery = Delivery::Reliable;
+    bool isMove = false;
+    uint32_t objectID = 0;
+  };
+
+  thread ioThread;
+  atomic<bool> threaded{false};
+  atomic<bool> stopIO{false};
+  ClientThreadConfig threadConfig;
+  unique_ptr<SpscQueue<InboxFrame>> inbox;   // Network thread -> game.
+  unique_ptr<SpscQueue<OutboxEntry>> outbox; // Game -> network thread.
+
+  // Network thread only: The latest unsent move per objectID.
+  CoalescingQueue<unique_ptr<SerializedMessage>> pendingMoves;
+
+  atomic<uint64_t> movesQueued{0};
+  atomic<uint64_t> movesSent{0};
+  atomic<uint64_t> movesCoalesced{0};
+  atomic<uint64_t> outboxFull{0};
+  atomic<uint64_t> inboxDropped{0};
+
+  static bool &onNetworkThread() {
+    thread_local bool isNetworkThread = false;
+    return isNetworkThread;
+  }
+
+  /**
+   * Sends now, or with the network thread running, queues it for that
+   * thread (false if the outbox is full). move: Coalesce it with later
+   * moves of the same object.
+   */
+  bool sendFrame(SerializedMessage &&mssg, Delivery delivery,
+                 const Coord2D *move = nullptr) {
+    if (!threaded.load(memory_order_acquire) || onNetworkThread()) {
+      return transport.send(mssg, delivery);
+    }
+
+    OutboxEntry *entry = outbox->prepare();
+    if (!entry) {
+      outboxFull.fetch_add(1, memory_order_relaxed);
+      return false;
+    }
+
+    // Take over mssg's buffers instead of copying them.
+    entry->mssg = make_unique<SerializedMessage>(exchange(mssg.header, nullptr),
+                                                 exchange(mssg.message, nullptr));
+    entry->mssg->traceID = mssg.traceID;
+    entry->delivery = delivery;
+    entry->isMove = move != nullptr;
+    entry->objectID = move ? move->objectID : 0;
+    outbox->publish();
+
+    if (move) {
+      movesQueued.fetch_add(1, memory_order_relaxed);
+    }
+    return true;
+  }
+
+  bool sendTCPMessage(SerializedMessage &&mssg) {
+    return sendFrame(std::move(mssg), Delivery::Reliable);
+  }
+
+  void runNetworkThread() {
+    onNetworkThread() = true;
+
+    auto movePeriod = chrono::microseconds(
+        threadConfig.moveSendHz > 0 ? 1000000 / threadConfig.moveSendHz : 0);
+    auto nextMoves = chrono::steady_clock::now();
+
+    while (!stopIO.load(memory_order_acquire) &&
+           !disconnected.load(memory_order_acquire)) {
+      sendOutbox(movePeriod.count() > 0);
+
+      auto now = chrono::steady_clock::now();
+      if (now >= nextMoves) {
+        sendPendingMoves();
+        nextMoves = max(nextMoves + movePeriod, now);
+      }
+
+      // Incoming frames, or at most sendDelayMs for the game to queue more.
+      pump(threadConfig.sendDelayMs);
+    }
+
+    sendOutbox(false);
+    sendPendingMoves();
+  }
+
+  void sendOutbox(bool coalesceMoves) {
+    while (OutboxEntry *entry = outbox->front()) {
+      if (entry->isMove && coalesceMoves) {
+        CoalesceKey key{0, entry->objectID, EventCode::Movement};
+        pendingMoves.push(0, std::move(entry->mssg), key);
+      } else {
+        transport.send(*entry->mssg, entry->delivery);
+        if (entry->isMove) {
+          movesSent.fetch_add(1, memory_order_relaxed);
+        }
+        entry->mssg.reset();
+      }
+      outbox->pop();
+    }
+  }
+
+  void sendPendingMoves() {
+    while (!pendingMoves.empty()) {
+      unique_ptr<SerializedMessage> move = pendingMoves.pop().second;
+      transport.send(*move, Delivery::Unreliable);
+      movesSent.fetch_add(1, memory_order_relaxed);
+    }
+    movesCoalesced.store(pendingMoves.getStats().coalesced,
+                         memory_order_relaxed);
+  }
+
+  // Network thread: Hand a frame over to the game's thread (see pollFrame).
+  void toInbox(const char *frame, size_t frameLen, Delivery delivery) {
+    InboxFrame *slot;
+    while (!(slot = inbox->prepare())) {
+      // The game is behind. Unreliable frames may be lost anyway; reliable
+      // ones wait, as they would for a full socket buffer.
+      if (delivery == Delivery::Unreliable ||
+          stopIO.load(memory_order_acquire)) {
+        inboxDropped.fetch_add(1, memory_order_relaxed);
+        return;
+      }
+      this_thread::sleep_for(chrono::microseconds(100));
+    }
+
+    slot->bytes.assign(frame, frame + frameLen);
+    slot->receivedNs = nowNs();
+    inbox->publish();
+  }
+
+  // Game thread: Callbacks for the frames in the inbox.
+  size_t dispatchInbox() {
+    size_t dispatched = 0;
+
+    // Bounded, in case the network thread keeps refilling it.
+    while (dispatched < inbox->getCapacity()) {
+      InboxFrame *slot = inbox->front();
+      if (!slot) {
+        break;
+      }
+
+      const char *frame = slot->bytes.data();
+      handleIncomingMessage(deserialize<Header>(frame), frame + sizeof(Header),
+                            slot->receivedNs);
+      inbox->pop();
+      dispatched++;
+    }
+    return dispatched;
+  }
+
+  // Under projectileMutex: If spawn is the server's copy of one of our
+  // unnamed shots (same spawn point, heading, speed and seed), that shot
+  // takes its names.
+  bool nameOwnShot(const ProjectileSpawn &spawn) {
+    auto same = [&](const ProjectileSpawn &ours) {
+      return ours.xCoord == spawn.xCoord && ours.yCoord == spawn.yCoord &&
+             ours.rotation == spawn.rotation && ours.spread == spawn.spread &&
+             ours.speed == spawn.speed && ours.seed == spawn.seed &&
+             ours.lifetimeTicks == spawn.lifetimeTicks &&
+             ours.pellets == spawn.pellets;
+    };
+    auto it = find_if(unnamedShots.begin(), unnamedShots.end(), same);
+    if (it == unnamedShots.end()) {
+      return false;
+    }
+    projectiles.rename(it->objectID, spawn); // Unless it already expired.
+    unnamedShots.erase(it);
+    return true;
+  }
+
+  // For an object this client moves, the server's Location becomes the
+  // reconciled prediction: It, plus the moves the server hasn't acked.
+  // False if it's someone else's object.
+  bool reconcile(Coord2D &coords) {
+    lock_guard<mutex> lock(predictionMutex);
+    auto it = predictors.find(coords.objectID);
+    if (it == predictors.end()) {
+      return false;
+    }
+
+    // Without an ack (seq 0), it can't be reconciled: Passed on as is.
+    MovePredictor &predictor = it->second;
+    if (coords.seq != 0) {
+      predictor.reconcile(coords.seq, coords.xCoord, coords.yCoord);
+      coords.xCoord = predictor.getX();
+      coords.yCoord = predictor.getY();
+    }
+    return true;
+  }
+
+  static int64_t nowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // A Verification answering a sendRequest (vs. one for the callbacks).
+  static bool isRequestReply(const Header &hdr, const char *mssg) {
+    Verification reply;
+    return hdr.mssgType == EventCode::Verification &&
+           deserialize(mssg, hdr.mssgLength, reply) && reply.requestID != 0;
+  }
+
+  // sendPipelined() runs right after the Register is sent, so what it sends
+  // doesn't wait for the reply.
+  template <typename PipelinedFunc>
+  bool registerPipelined(PipelinedFunc sendPipelined) {
+    unique_lock<mutex> lock(registerMutex);
+    auto timeout = chrono::milliseconds(REGISTER_TIMEOUT_MS);
+
+    if (!registerCV.wait_for(lock, timeout, [&] { return connected; })) {
+      return false;
+    }
+
+    lock.unlock();
+    if (!sendRegister()) {
+      return false;
+    }
+    sendPipelined();
+    lock.lock();
+
+    if (!registerCV.wait_for(lock, timeout,
+                             [&] { return sessionID.load() != 0; })) {
+      cerr << "ClientNetworkAPI: Registration timed out." << endl;
+      return false;
+    }
+
+    lock.unlock();
+    bindUnreliableChannel();
+    return true;
+  }
+
+  bool isConnected() {
+    lock_guard<mutex> lock(registerMutex);
+    return connected;
+  }
+
+  bool sendRegister() {
+    Header hdr(EventCode::Register, 0, 0);
+    return sendTCPMessage(SerializedMessage(serialize(hdr), nullptr));
+  }
+
+  // Send our sessionID and the server's nonce over UDP, so the server
+  // maps that address too.
+  // @TODO: Retry until the server confirms the UDP mapping.
+  void bindUnreliableChannel() {
+    uint64_t nonce;
+    {
+      lock_guard<mutex> lock(registerMutex);
+      nonce = bindNonce;
+    }
+    sendUDPMessage(SerializedMessage(sessionID.load(), Registration(nonce)));
+  }
+
+  void expireSessionWaiters() {
+    vector<SessionWaiter> expired;
+    {
+      lock_guard<mutex> lock(registerMutex);
+      if (sessionWaiters.empty()) {
+        return;
+      }
+
+      auto now = chrono::steady_clock::now();
+      for (auto it = sessionWaiters.begin(); it != sessionWaiters.end();) {
+        if (it->deadline <= now) {
+          expired.push_back(std::move(*it));
+          it = sessionWaiters.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    for (SessionWaiter &waiter : expired) {
+      waiter.notify(0);
+    }
+  }
+
+  static vector<string> parseGameList(const Verification &reply) {
+    vector<string> games;
+    if (!reply.status) {
+      return games;
+    }
+
+    string detail = reply.getDetail();
+    for (size_t start = 0; start < detail.size();) {
+      size_t end = min(detail.find('\n', start), detail.size());
+      if (end > start) {
+        games.push_back(detail.substr(start, end - start));
+      }
+      start = end + 1;
+    }
+    return games;
+  }
+
+  optional<Verification> waitForRequest(RequestType type,
+                                        const string &argument) {
+    auto answered = make_shared<promise<optional<Verification>>>();
+    future<optional<Verification>> reply = answered->get_future();
+
+    uint32_t requestID =
+        sendRequest(type, argument, [answered](const Verification *reply) {
+          answered->set_value(reply ? optional<Verification>(*reply)
+                                    : nullopt);
+        });
+    if (requestID == 0) {
+      return nullopt;
+    }
+    return reply.get();
+  }
+
+  bool sendUDPMessage(SerializedMessage &&mssg) {
+    return sendFrame(std::move(mssg), Delivery::Unreliable);
+  }
+
+  template <typename mssgStruct>
+  void sendVerification(bool verificationStatus,
+                        const mssgStruct &mssgToVerify);
+
+  void onDisconnect() {
+    cerr << "ClientNetworkAPI: Server closed the connection." << endl;
+    disconnected.store(true, memory_order_release);
+  }
+
+  void onFrame(const char *frame, size_t frameLen, Delivery delivery) {
+    Tracer &tracer = Tracer::instance();
+    tracer.beginTrace();
+    tracer.stamp(TraceStage::SocketRead);
+
+    if (frameLen < sizeof(Header)) {
+      tracer.endTrace();
+      return;
+    }
+
+    struct Header hdr = deserialize<Header>(frame);
+    tracer.stamp(TraceStage::HeaderDecode);
+
+    // The server compresses large reliable mssgs (see compressFrame).
+    if (hdr.flags & HEADER_COMPRESSED) {
+      if (!decompressFrame(frame, frameLen, inflated)) {
+        tracer.endTrace();
+        return;
+      }
+      frame = inflated.data();
+      frameLen = inflated.size();
+      hdr = deserialize<Header>(frame);
+    }
+
+    if (frameLen < sizeof(Header) + hdr.mssgLength) {
+      tracer.endTrace();
+      return;
+    }
+
+    if (hdr.mssgType == EventCode::Register) {
+      // Server's reply to registerPlayer, carrying our sessionID (and the
+      // nonce that binds our UDP address). Only over TCP: Anyone could
+      // send a datagram claiming to be it.
+      Registration registration;
+      if (delivery != Delivery::Reliable ||
+          !deserialize(frame + sizeof(Header), hdr.mssgLength,
+                       registration)) {
+        tracer.endTrace();
+        return;
+      }
+
+      vector<SessionWaiter> waiters;
+      {
+        lock_guard<mutex> lock(registerMutex);
+        bindNonce = registration.bindNonce;
+        sessionID.store(hdr.senderID);
+        registerCV.notify_all();
+        waiters.swap(sessionWaiters);
+      }
+
+      for (SessionWaiter &waiter : waiters) {
+        waiter.notify(hdr.senderID);
+      }
+
+    } else if (hdr.mssgType == EventCode::Ping) {
+      // Echo right away: The server measures RTT and loss from these.
+      Ping ping;
+      if (deserialize(frame + sizeof(Header), hdr.mssgLength, ping)) {
+        sendUDPMessage(SerializedMessage(sessionID.load(), ping));
+      }
+
+    } else if (threaded.load(memory_order_relaxed) &&
+               !isRequestReply(hdr, frame + sizeof(Header))) {
+      // Callbacks run on the game's thread (see startNetworkThread).
+      toInbox(frame, sizeof(Header) + hdr.mssgLength, delivery);
+
+    } else {
+      handleIncomingMessage(hdr, frame + sizeof(Header));
+    }
+
+    tracer.endTrace();
+  }
+
+  // receivedNs: When it arrived (for interpolation). Malformed mssgs
+  // (ex. shorter than their type) are dropped.
+  void handleIncomingMessage(const Header &hdr, const char *mssg,
+                             int64_t receivedNs = nowNs()) {
+    if (hdr.mssgType == EventCode::Location) {
+      Coord2D coords;
+      if (!deserialize(mssg, hdr.mssgLength, coords)) {
+        return;
+      }
+      if (!reconcile(coords)) {
+        lock_guard<mutex> lock(interpolationMutex);
+        interpolation.add(coords.objectID, coords.xCoord, coords.yCoord,
+                          coords.seq, receivedNs);
+      }
+      observers.notifyObservers(static_cast<uint8_t>(hdr.mssgType),
+                                coords.objectID, coords.xCoord, coords.yCoord);
+
+    } else if (hdr.mssgType == EventCode::Chat) {
+      ChatMessage chatMssg;
+      if (!deserialize(mssg, hdr.mssgLength, chatMssg)) {
+        return;
+      }
+      observers.notifyObservers(static_cast<uint8_t>(hdr.mssgType),
+                                chatMssg.message);
+
+    } else if (hdr.mssgType == EventCode::Action) {
+      Action act;
+      if (!deserialize(mssg, hdr.mssgLength, act)) {
+        return;
+      }
+      observers.notifyObservers(static_cast<uint8_t>(hdr.mssgType),
+                                act.actionType, act.actionValue,
+                                act.impactedID);
+
+    } else if (hdr.mssgType == EventCode::Projectile) {
+      // Flown from its arrival (our own shots are already flying, and
+      // take the server's names).
+      Projectile shot;
+      if (!deserialize(mssg, hdr.mssgLength, shot)) {
+        return;
+      }
+      {
+        lock_guard<mutex> lock(projectileMutex);
+        if (!nameOwnShot(shot.spawn)) {
+          projectiles.add(shot.spawn, receivedNs);
+        }
+      }
+      observers.notifyObservers(static_cast<uint8_t>(hdr.mssgType),
+                                shot.spawn);
+
+    } else if (hdr.mssgType == EventCode::MapChunk) {
+      // Too big to pass by value; valid during the callbacks only.
+      MapChunk chunk;
+      if (!deserialize(mssg, hdr.mssgLength, chunk)) {
+        return;
+      }
+      observers.notifyObservers(static_cast<uint8_t>(hdr.mssgType),
+                                static_cast<const MapChunk *>(&chunk));
+
+    } else if (hdr.mssgType == EventCode::Verification) {
+      Verification vStatus;
+      if (!deserialize(mssg, hdr.mssgLength, vStatus)) {
+        return;
+      }
+
+      // A late answer (its request timed out) is dropped.
+      if (vStatus.requestID != 0) {
+        pendingRequests.complete(vStatus);
+      } else {
+        observers.notifyObservers(static_cast<uint8_t>(hdr.mssgType),
+                                  vStatus.status);
+      }
+    }
+
+    Tracer::instance().stamp(TraceStage::Dispatch);
+  }
+};
+
+// ============================================================
+// ------------------------------------------------------------
+
+template <ServerTransport Transport>
+class BasicServerNetworkAPI : NetworkAPI {
+public:
+  using Peer = typename Transport::Peer;
+
+  // Arguments go to the transport (ex. host, tcpPort, udpPort for sockets).
+  template <typename... TransportArgs>
+  BasicServerNetworkAPI(TransportArgs &&...transportArgs)
+      : transport(std::forward<TransportArgs>(transportArgs)...) {
+    sessionID = 0;
+  }
+
+  // Room ticks send through this (the queues, their mutexes, the capture,
+  // the map stream), so they stop before any of it is destroyed.
+  ~BasicServerNetworkAPI() { rooms.stop(); }
+
+  // The client events every game has to handle.
+  bool allEventsHaveCallbacks() {
+    for (EventCode eventKey : {EventCode::Register, EventCode::Movement,
+                               EventCode::Chat, EventCode::Action}) {
+      if (!observers.hasObservers(static_cast<uint8_t>(eventKey))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename... Args>
+  void start(vector<pair<EventCode, std::function<void(Args...)>>> callbacks) {
+    registerCallbacks(callbacks);
+
+    if (!allEventsHaveCallbacks()) {
+      cerr << "ServerNetworkAPI Error: Not all events have a registered "
+              "callback."
+           << endl;
+      // @TODO: Error handling
+    }
+
+    if (!transport.open()) {
+      cerr << "ServerNetworkAPI failed to open its transport." << endl;
+      return;
+    }
+
+    // Start a thread to periodically send queued mssgs, per client and
+    // by priority (see SendScheduler).
+    thread writeThread(&BasicServerNetworkAPI::runWrite, this);
+
+    // Read loop: One thread for every client and transport.
+    while (true) {
+      pump(-1);
+    }
+
+    writeThread.join();
+  }
+
+  /**
+   * One pass of the read loop: Hand every frame the transport has
+   * (waiting up to timeoutMs) to the callbacks. With flushWrites(), drives
+   * the server on the calling thread instead of start()'s threads,
+   * (ex. a benchmark on InMemoryServerTransport).
+   */
+  size_t pump(int timeoutMs) { return transport.poll(timeoutMs, *this); }
+
+  /**
+   * One send tick, on the calling thread: Hand queued mssgs to the
+   * scheduler, which sends what fits each client's bandwidth budget.
+   */
+  void flushWrites() {
+    lock_guard<mutex> lock(schedulerMutex);
+
+    syncSendRecipients();
+    drainIntoScheduler();
+    streamMapToRecipients();
+
+    // Congestion probes skip the budget and queues, so their RTT is the
+    // network's.
+    sendScheduler.probe([&](const Peer &peer, uint32_t seq) {
+      return transport.send(peer, SerializedMessage(sessionID, Ping(seq)),
+                            Delivery::Unreliable);
+    });
+
+    sendScheduler.tick([&](const Peer &peer, const OutboundMssg &mssg) {
+      bool sent = mssg.file ? sendFile(peer, *mssg.file)
+                            : transport.send(peer, *mssg.mssg, mssg.delivery);
+      Tracer::instance().stamp(mssg.traceID(), TraceStage::SocketWrite);
+      return sent;
+    });
+  }
+
+  // Set before start(). See SchedulerConfig.
+  void setSendConfig(const SchedulerConfig &config) {
+    lock_guard<mutex> lock(schedulerMutex);
+    sendScheduler = SendScheduler<Peer>(config);
+  }
+
+  // Budget (send rate), RTT/loss, sent and pending counts for one client.
+  SchedulerStats getSendStats(uint32_t clientID) {
+    lock_guard<mutex> lock(schedulerMutex);
+    return sendScheduler.getStats(clientID);
+  }
+
+  // As above, for every connected client.
+  map<uint32_t, SchedulerStats> getSendStats() {
+    lock_guard<mutex> lock(schedulerMutex);
+    map<uint32_t, SchedulerStats> allStats;
+    for (uint32_t id : sendScheduler.getSessionIDs()) {
+      allStats.emplace(id, sendScheduler.getStats(id));
+    }
+    return allStats;
+  }
+
+  // Set before start(). Limits are per EventCode (see RateLimitConfig).
+  void setRateLimits(const RateLimitConfig &config) {
+    rateLimiter.setConfig(config);
   }
 
-  void start(char *server, char *serverPort_) {
-    tcpClient.initSocket();
-    tcpClient.connectToServer(server, serverPort);
-    udpClient.initSocket();
+  // Incoming mssgs dropped for being over a limit, per EventCode.
+  RateLimitStats getRateLimitStats() const { return rateLimiter.getStats(); }
 
-    // Event header-reading event loops
-    tcpClient.pollForHeader(-1, handleIncomingTCPHeader, sizeof(Header));
-    udpClient.pollForHeader(-1, handleIncomingUDPHeader, sizeof(Header));
+  /**
+   * An objectID for a projectile the game spawns itself (ex. a mob's
+   * shot). Clients' shots are named from here as they arrive. Wraps below
+   * PROVISIONAL_PROJECTILE_BIT, skipping 0.
+   */
+  uint32_t newProjectileID() {
+    uint32_t id;
+    do {
+      id = nextProjectileID.fetch_add(1, memory_order_relaxed) &
+           ~PROVISIONAL_PROJECTILE_BIT;
+    } while (id == 0);
+    return id;
+  }
 
-    // Client will not use thread for writing from buffers.
-    // Just send-on-invoke.
+  /**
+   * The seq of the latest Movement processed for objectID (0 if none).
+   * Locations for it carry this ack automatically; a game that applies
+   * moves later (ex. on a tick) sets Coord2D::seq itself instead.
+   */
+  uint32_t getInputSeq(uint32_t objectID) {
+    lock_guard<mutex> lock(inputSeqMutex);
+    auto it = objectInputs.find(objectID);
+    return it == objectInputs.end() ? 0 : it->second.seq;
   }
 
-  void tcpPollSocket() {
-    while
-      true() {
-        if (tcpClient.socketReadyToRead()) {
-          // read
-        }
-      }
+  /**
+   * Also accept processes on the same host (mob AI, bots) over shared
+   * memory, under 'name'. They register like any other client, and
+   * exchange mssgs with the server without the TCP/UDP stack.
+   */
+  bool startSharedMemory(const string &name)
+    requires requires(Transport &t) { t.listenSharedMemory(name); }
+  {
+    return transport.listenSharedMemory(name);
   }
 
-  // Sends request over TCP
-  // Recieves verification over TCP
-  bool connectToGame(string gamename);
+  // Register a callback for a specific event
+  template <typename... Args>
+  void registerCallback(EventCode eventType,
+                        std::function<void(Args...)> callback) {
+    if (callback) {
+      observers.registerObserver(static_cast<uint8_t>(eventType), callback);
+    }
+  }
 
-  // Send & recieve verification over TCP
-  bool registerPlayer();
+  template <typename... Args>
+  void registerCallbacks(
+      vector<pair<EventCode, std::function<void(Args...)>>> callbacks) {
+    for (const auto &callback : callbacks) {
+      registerCallback(callback.first, callback.second);
+    }
+  }
 
-  // Send request & recieve list over TCP
-  vector<String> getGameList();
+  // sendToID for messages that go to every client.
+  static constexpr uint32_t BROADCAST_ID = UINT32_MAX;
 
-  // @TODO: Returns true when server sends verification
-  // Sends move over UDP, recieves verification over UDP
-  bool sendMove(uint32_t xCoord, uint32_t yCoord) {
-    Coord2D coord(xCoord, yCoord);
-    SerializedMessage mssg(sessionID, coord);
-    sendUDPMessage(mssg);
+  /**
+   * Queue a message for one client (sendToID), or for every client
+   * if sendToID is BROADCAST_ID. Sent by the write thread.
+   */
+  template <typename mssgStruct>
+  void sendTCPEvent(uint32_t sendToID, const mssgStruct &mssg) {
+    enqueueTCPMessage(sendToID,
+                      makeOutbound(withInputAck(mssg), Delivery::Reliable));
   }
 
-  // Sends mssg over TCP
-  void sendChat(char *chatMssg) {
-    ChatMessage chatMessage(chatMssg);
-    SerializedMessage mssg(sessionID, chatMessage);
-    sendTCPMessage(mssg);
+  // State mssgs (latestWins, ex. Coord2D) replace a queued, unsent one
+  // for the same recipient and objectID.
+  template <typename mssgStruct>
+  void sendUDPEvent(uint32_t sendToID, const mssgStruct &mssg) {
+    OutboundMssg outbound =
+        makeOutbound(withInputAck(mssg), Delivery::Unreliable);
+
+    if constexpr (latestWins<mssgStruct>) {
+      enqueueUDPMessage(sendToID, std::move(outbound),
+                        CoalesceKey{sendToID, mssg.objectID, mssg.getType()});
+    } else {
+      enqueueUDPMessage(sendToID, std::move(outbound));
+    }
   }
 
-private:
-  TCPClient tcpClient;
-  UDP udpClient;
+  // =======================================
+  // Rooms (see server/Rooms.h)
 
-  template <typename mssgStruct> void sendTCPMessage(mssgStruct mssg) {
-    char *mssg = serialize(mssg);
-    tcpClient.write(mssg);
-  }
+  // Rooms tick on a shared pool of this many threads (0: One per core).
+  // Set before the first createRoom.
+  void setRoomThreads(size_t threads) { rooms.setThreadCount(threads); }
 
-  template <typename mssgStruct> void sendUDPMessage(mssgStruct mssg) {
-    char *mssg = serialize(mssg);
-    tcpClient.write(mssg);
+  /**
+   * A room ticks tickHz times a second, on a pool worker, with the
+   * Movements, Actions and Projectiles its members sent since its last tick
+   * (those skip their callbacks). Returns its ID (0 if invalid).
+   */
+  uint32_t createRoom(const string &name, double tickHz, RoomTick tick) {
+    return rooms.createRoom(name, tickHz, std::move(tick));
   }
 
-  template <typename mssgStruct>
-  sendVerification(bool verificationStatus, const mssgStruct &mssgToVerify);
+  bool closeRoom(uint32_t roomID) { return rooms.closeRoom(roomID); }
 
-  void handleIncomingUDPHeader(const char *header) override {
-    struct Header hdr = deserialize<Header>(header);
-    char *mssg = udpClient.read(hdr.senderID, mssgLength);
-    handleIncomingMessage(hdr.mssgType, mssg);
+  // The first room named 'name' (ex. a JoinGame Request's), or 0.
+  uint32_t findRoom(const string &name) const { return rooms.findRoom(name); }
+
+  // A session is in one room at most; joining moves it.
+  bool joinRoom(uint32_t roomID, uint32_t sessionID) {
+    return validClientSessionID(sessionID) && rooms.join(roomID, sessionID);
   }
 
-  void handleIncomingTCPHeader(const char *header) override {
-    struct Header hdr = deserialize<Header>(header);
-    char *mssg = tcpClient.read(hdr.senderID, mssgLength);
-    handleIncomingMessage(hdr.mssgType, mssg);
+  void leaveRoom(uint32_t sessionID) { rooms.leave(sessionID); }
+
+  // The session's room, or 0.
+  uint32_t getRoomOf(uint32_t sessionID) const {
+    return rooms.roomOf(sessionID);
   }
 
-  void handleIncomingMessage(const char *hdrMssg, const char *mssg) {
-    // @TODO
+  // Per-room ticks, CPU time and overruns (see RoomStats).
+  RoomStats getRoomStats(uint32_t roomID) const {
+    return rooms.getStats(roomID);
   }
 
-}
+  map<uint32_t, RoomStats> getRoomStats() const { return rooms.getStats(); }
 
-// ============================================================
-// ------------------------------------------------------------
+  WorkStealingStats getRoomPoolStats() const { return rooms.getPoolStats(); }
 
-class ServerNetworkAPI : NetworkAPI {
-public:
-  ServerNetworkAPI(char *host, char *tcpPort, char *udpPort) {
-    sessionID = 0;
-    tcpServer = TCPServer(host, tcpPort);
-    udpServer = UDP(host, udpPort);
+  // As sendTCPEvent, to every member of roomID.
+  template <typename mssgStruct>
+  void sendTCPEventToRoom(uint32_t roomID, const mssgStruct &mssg) {
+    shared_ptr<Room> room = rooms.getRoom(roomID);
+    if (!room) {
+      return;
+    }
+
+    OutboundMssg outbound =
+        makeOutbound(withInputAck(mssg), Delivery::Reliable);
+    room->forEachMember(
+        [&](uint32_t memberID) { enqueueTCPMessage(memberID, outbound); });
   }
 
-  bool allEventsHaveCallbacks() {
-    for (const auto eventKey : EventCode) {
-      if (Observers.count(eventKey) == 0) {
-        return false;
-      }
+  // As sendUDPEvent, to every member of roomID. One serialized copy is
+  // shared by every member's queue.
+  template <typename mssgStruct>
+  void sendUDPEventToRoom(uint32_t roomID, const mssgStruct &mssg) {
+    shared_ptr<Room> room = rooms.getRoom(roomID);
+    if (!room) {
+      return;
     }
-    return true;
+
+    OutboundMssg outbound =
+        makeOutbound(withInputAck(mssg), Delivery::Unreliable);
+    room->forEachMember([&](uint32_t memberID) {
+      if constexpr (latestWins<mssgStruct>) {
+        enqueueUDPMessage(
+            memberID, outbound,
+            CoalesceKey{memberID, mssg.objectID, mssg.getType()});
+      } else {
+        enqueueUDPMessage(memberID, outbound);
+      }
+    });
   }
 
-  template <typename... Args>
-  void start(vector<pair<EventCode, std::function<void(Args...)>>> callbacks) {
-    registerCallbacks(callbacks);
+  // =======================================
+  // Map streaming (see server/MapStream.h)
 
-    if (!allEventsHaveCallbacks()) {
-      cerr << "ServerNetworkAPI Error: Not all events have a registered "
-              "callback."
-           << endl;
-      // @TODO: Error handling
+  /**
+   * Send clients the map in chunks (made by generator) as they move: Each
+   * send tick streams the chunks around a client's entity (its publicID),
+   * where the server last sent it (ex. a Location from the game), not
+   * where the client says it is. Set before start(). False if the chunk
+   * cache couldn't be made; chunks are still streamed, but encoded per
+   * client.
+   */
+  bool startMapStreaming(MapGenerator generator,
+                         const MapStreamConfig &config = {}) {
+    mapStream = make_unique<MapStream>(std::move(generator), config);
+    return mapStream->open();
+  }
+
+  // Ex. ahead of a teleport, before its Location is sent.
+  // Returns the number of chunks queued.
+  size_t streamMapAround(uint32_t sessionID, uint32_t xCoord,
+                         uint32_t yCoord) {
+    if (!mapStream || !validClientSessionID(sessionID)) {
+      return 0;
     }
+    return mapStream->streamAround(
+        sessionID, xCoord, yCoord, [&](OutboundMssg chunk) {
+          enqueueTCPMessage(sessionID, std::move(chunk));
+        });
+  }
 
-    tcpServer.initSocket();
-    tcpServer.acceptConnections(); // Listen & accept(s)
+  // Chunks encoded vs. sent from the cache (see MapStreamStats).
+  MapStreamStats getMapStreamStats() const {
+    return mapStream ? mapStream->getStats() : MapStreamStats();
+  }
 
-    udpServer.initSocket();
-    udpServer.bindSocket();
+  CoalescingQueueStats getUDPQueueStats() {
+    lock_guard<mutex> lock(udpQueueMutex);
+    return udpMssgQueue.getStats();
+  }
 
-    // TCP & UDP objects resonsible for read-polling
-    tcpServer.pollForHeader(-1, handleIncomingTCPHeader, sizeof(Header));
-    udpServer.pollForHeader(-1, handleIncomingUDPHeader, sizeof(Header));
+  // Transport-specific settings (ex. setUDPImpairment for sockets).
+  Transport &getTransport() { return transport; }
 
-    // Start threads for TCP & UDP to periodically write queued mssgs.
-    thread tcpWriteThread(runTCPWrite);
-    thread udpWriteThread(runUDPWrite);
+  /**
+   * Capture mode: Append every incoming message (after header decode)
+   * to a memory-mapped traffic log, for replaying later.
+   */
+  bool startCapture(const string &path) {
+    if (!trafficCapture.open(path)) {
+      return false;
+    }
+    capturing.store(true, memory_order_release);
+    return true;
+  }
 
-    tcpWriteThread.join();
-    udpWriteThread.join();
+  void stopCapture() {
+    capturing.store(false, memory_order_release);
+    trafficCapture.close();
   }
 
-  // Register a callback for a specific event
-  template <typename... Args>
-  void registerCallback(EventCode, std::function<void(Args...)> callback) {
-    if (callback) {
-      Observer observer(callback);
-      observers.registerObserver(eventType, observer);
+  /**
+   * Feed a captured traffic log to the registered callbacks, without sockets.
+   * speed: 1 = captured pace, N = N times faster, 0 = as fast as possible.
+   * The log's sessions exist only while it replays, so it's refused if one
+   * of them is a live session (ex. replaying on a server clients are on).
+   * Returns the number of messages replayed.
+   */
+  uint64_t replayCapture(const string &path, double speed) {
+    TrafficLogReader log;
+    if (!log.open(path)) {
+      return 0;
     }
-  }
 
-  template <typename... Args>
-  void registerCallbacks(
-      vector<pair<EventCode, std::function<void(Args...)>>> callbacks) {
-    if (callbacks) {
-      for (const auto &callback : callbacks) {
-        registerCallback(callback.first, callback.second);
-      }
+    vector<uint32_t> replayedIDs;
+    if (!addReplayedSessions(log, replayedIDs)) {
+      return 0;
     }
-  }
 
-  template <typename... Args> void boradcastEvent(EventCode code, Args args);
+    uint64_t replayed = replayTrafficLog(
+        log, speed, [&](const TrafficRecord &rec, const unsigned char *mssg) {
+          handleIncomingMessage(rec.senderID, rec.mssgType,
+                                reinterpret_cast<const char *>(mssg),
+                                rec.mssgLength);
+        });
+
+    removeReplayedSessions(replayedIDs);
+    return replayed;
+  }
 
 private:
-  TCPServer tcpServer;
-  UDP udpServer;
+  // The transport calls back into onConnect/onDisconnect/onFrame.
+  friend Transport;
+
+  Transport transport;
 
-  // Maps sessionID to client connections (TCP sfd, UDP addr)
-  map<uint32_t, Connection> sessions;
+  // Maps sessionID to client connections (transport peer)
+  map<uint32_t, Connection<Peer>> sessions;
 
   // Map event (subject) types to callback functions (observer(s))
   Observers observers;
 
   // Queue mssgs for sendings. Mssg should  already have headers.
-  // First value is the SEND-TO sessionID. If negative, mssg will be broadcast.
-  queue<pair<uint32_t, const SerializedMessage &>> udpMssgQueue;
-  queue<pair<uint32_t, const SerializedMessage &>> tcpMssgQueue;
-  int UDP_WRITE_DELAY_MS = 0.01; // @TODO: Replace polling with
-  int TCP_WRITE_DELAY_MS = 0.1;  //        condition_variable.
+  // First value is the SEND-TO sessionID. If BROADCAST_ID, mssg is broadcast.
+  // Shared so a broadcast doesn't copy the mssg per recipient.
+  // UDP carries per-entity state, so stale updates are coalesced away.
+  CoalescingQueue<OutboundMssg> udpMssgQueue;
+  queue<pair<uint32_t, OutboundMssg>> tcpMssgQueue;
+
+  // Per-client, prioritized sending with a bandwidth budget.
+  SendScheduler<Peer> sendScheduler;
+  vector<typename SendScheduler<Peer>::Recipient> sendRecipients;
+
+  // Maps each registered client's sources (ex. its TCP connection and UDP
+  // address) to its sessionID. Written on the read thread only.
+  SourceSessionMap sourceSessions;
+
+  // Incoming mssg limits (read thread only).
+  RateLimiter rateLimiter;
+
+  atomic<uint32_t> nextProjectileID{1};
+
+  // Per moved objectID: The session moving it, and its latest Movement
+  // seq (acked in its Locations).
+  struct ObjectInput {
+    uint32_t ownerID = 0; // sessionID
+    uint32_t seq = 0;
+  };
+  mutex inputSeqMutex;
+  unordered_map<uint32_t, ObjectInput> objectInputs;
+
+  // Rooms, their members, and the pool their ticks run on.
+  RoomManager rooms;
+
+  // Map chunks sent to each client (see startMapStreaming).
+  unique_ptr<MapStream> mapStream;
+
+  // Capture mode (see startCapture).
+  TrafficLogWriter trafficCapture;
+  atomic<bool> capturing{false};
 
   // Protect objects shared across threads.
   mutex sessionMutex;
   mutex udpQueueMutex;
   mutex tcpQueueMutex;
+  mutex schedulerMutex;
 
   // =======================================
   // 0 as a session ID is reserved for the server.
   bool validClientSessionID(uint32_t id) {
     if (id > 0) {
       lock_guard<mutex> lock(sessionMutex);
-      if (session.count(id) > 0) {
+      if (sessions.count(id) > 0) {
         return true;
       }
     }
     return false;
   }
 
+  // A live mssg must come from a registered session, over that session's
+  // own channel (the senderID in the header alone could be spoofed).
+  // Lock-free: Resolved from where the frame came from.
+  bool validSender(uint32_t id, const Peer &from, Delivery delivery) {
+    return id > 0 &&
+           sourceSessions.find(Transport::sourceKey(from, delivery)) == id;
+  }
+
   // bool validPublicID(uint32_t id);  // publicID for Game
 
+  // The player object of a session (0 if it has none).
+  uint32_t publicIDOf(uint32_t id) {
+    lock_guard<mutex> lock(sessionMutex);
+    auto it = sessions.find(id);
+    return it == sessions.end() ? 0 : it->second.publicID;
+  }
+
+  // Replayed traffic must pass validClientSessionID like live traffic, so
+  // the log's sessions are added (into ids) for the replay. False, adding
+  // none, if one is already a session.
+  bool addReplayedSessions(const TrafficLogReader &log, vector<uint32_t> &ids) {
+    log.forEach([&](const TrafficRecord &rec, const unsigned char *) {
+      auto pos = lower_bound(ids.begin(), ids.end(), rec.sessionID);
+      if (rec.sessionID > 0 && (pos == ids.end() || *pos != rec.sessionID)) {
+        ids.insert(pos, rec.sessionID);
+      }
+      return true;
+    });
+
+    lock_guard<mutex> lock(sessionMutex);
+    for (uint32_t id : ids) {
+      if (sessions.count(id) != 0) {
+        cerr << "ServerNetAPI can't replay: The log's session " << id
+             << " is a live session." << endl;
+        ids.clear();
+        return false;
+      }
+    }
+
+    for (uint32_t id : ids) {
+      Connection<Peer> replayedClient(id, Peer{});
+      replayedClient.replayed = true;
+      sessions.emplace(id, replayedClient);
+    }
+    return true;
+  }
+
+  void removeReplayedSessions(const vector<uint32_t> &ids) {
+    lock_guard<mutex> lock(sessionMutex);
+    for (uint32_t id : ids) {
+      auto it = sessions.find(id);
+      if (it != sessions.end() && it->second.replayed) {
+        sessions.erase(it);
+      }
+    }
+  }
+
   // =======================================
+  // Unpredictable (from the kernel's CSPRNG), and never 0.
+  static uint64_t newBindNonce() {
+    uint64_t nonce = 0;
+    while (nonce == 0) {
+      if (getrandom(&nonce, sizeof(nonce), 0) != sizeof(nonce)) {
+        random_device device;
+        nonce = (uint64_t(device()) << 32) | device();
+      }
+    }
+    return nonce;
+  }
+
   uint32_t determineNewSessionID() {
     lock_guard<mutex> lock(sessionMutex);
 
@@ -258,39 +1591,54 @@ private:
     return -1;
   }
 
-  void startClientRegistration(int clientSfd) {
+  void startClientRegistration(const Peer &peer) {
     // At this point:
-    //  Client called TCP connect and UDP connect,
-    //  and clientSFD = TCP server accepted a TCP client conn.
+    //  Client connected, and sent a Register header over its
+    //  reliable (TCP) channel.
+    uint64_t reliableKey = Transport::sourceKey(peer, Delivery::Reliable);
+    if (sourceSessions.find(reliableKey) != SourceSessionMap::NO_SESSION) {
+      return; // Already registered.
+    }
 
     // 1. Call uint32_t sessionID = GameServer::registerClient(...)
-    uint32_t objectID; // To be determined by GameServer
-    observers.notifyObservers(EventCode.Register, &objectID);
+    uint32_t objectID = UINT32_MAX; // To be determined by GameServer
+    observers.notifyObservers(static_cast<uint8_t>(EventCode::Register),
+                              &objectID);
 
     // If registration denied, close connection and discontinue.
-    if (objectID < 0) {
-      tcpServer.closeConnection(clientSfd);
+    if (objectID == UINT32_MAX) {
+      transport.closePeer(peer);
       return;
     }
 
     // Determine sessionID
-    uint32_t sessionID = determineNewSessionID();
-    if (sessionID < 0) {
+    uint32_t newSessionID = determineNewSessionID();
+    if (newSessionID == uint32_t(-1)) {
       cerr << "ServerNetAPI can't assign new sessionID, reached MAX." << endl;
       return;
     }
 
-    // Add sessionID & TCP sfd to map to not deny client as "unregistered".
-    lock_guard<mutex> lock(sessionMutex);
-    Connection newClient(objectID, sessionIclientSfd);
-    sessions[sessionID] = newclient;
+    // Add sessionID & peer to map to not deny client as "unregistered".
+    if (!sourceSessions.insert(reliableKey, newSessionID)) {
+      cerr << "ServerNetAPI can't register client, source map is full."
+           << endl;
+      transport.closePeer(peer);
+      return;
+    }
+    Connection<Peer> client(objectID, peer);
+    client.bindNonce = newBindNonce();
+    {
+      lock_guard<mutex> lock(sessionMutex);
+      sessions.emplace(newSessionID, client);
+    }
+    reserveObject(objectID, newSessionID);
 
-    // 2. TCP send sessionID
-    Header hdr sendTCPMssg(sessionID, hdr);
+    // 2. TCP send sessionID, and the nonce to bind UDP with
+    SerializedMessage reply(newSessionID, Registration(client.bindNonce));
+    transport.send(peer, reply, Delivery::Reliable);
 
-    // 3. UDP addr = UDP recieve sessionID
-    struct sockaddr_in udpAddr;
-    char *udpMssg = udpServer.read(udpAddr);
+    // 3. Client sends both back over UDP,
+    //    handled by completeClientRegistration.
 
     // @TODO: Add retries and timeout
 
@@ -303,194 +1651,450 @@ private:
     // 5. TCP recieve verification
     //    If false/timeout, retry.
     // -----------------------------
+  }
+
+  // Only with the session's nonce: Anyone can send a Register with a
+  // guessed sessionID, to have its events sent to them.
+  void completeClientRegistration(uint32_t id, const Peer &from,
+                                  const char *mssg, uint32_t mssgLength) {
+    Registration registration;
+    if (!deserialize(mssg, mssgLength, registration)) {
+      return;
+    }
 
     // 6. Complete mapping
     // Update UDP connection value
-    sessions[sessionID].udpAddr = udpAddr;
-    sessions[sessionID].publicID = objectID;
+    lock_guard<mutex> lock(sessionMutex);
+    auto it = sessions.find(id);
+    if (it != sessions.end() && !it->second.replayed &&
+        it->second.bindNonce == registration.bindNonce) {
+      Transport::bindUnreliable(it->second.peer, from);
+
+      // Only the first address is bound, so map the session's own.
+      sourceSessions.insert(
+          Transport::sourceKey(it->second.peer, Delivery::Unreliable), id);
+    }
   }
 
-  void handleIncomingUDPHeader(const char *header) override {
-    struct Header hdr = deserialize<Header>(hdrMssg);
+  // =======================================
+  // Transport callbacks
 
-    if (hdr.mssgType == EventCode::Register) {
-      // sessionID invalid before registration. That's OK.
-      startClientRegistration(hdr.senderID);
+  // Registration waits for the client's Register mssg.
+  void onConnect(const Peer &peer) {}
 
-    } else {
-      char *mssg = udpServer.read(hdr.senderID, mssgLength);
-      handleIncomingMessage(hdr.mssgType, mssg);
+  void onDisconnect(const Peer &peer) {
+    uint64_t reliableKey = Transport::sourceKey(peer, Delivery::Reliable);
+    uint32_t id = sourceSessions.find(reliableKey);
+    if (id == SourceSessionMap::NO_SESSION) {
+      return; // Never registered.
     }
+
+    rooms.leave(id);
+    releaseObjects(id);
+    if (mapStream) {
+      mapStream->forget(id);
+    }
+
+    lock_guard<mutex> lock(sessionMutex);
+    auto it = sessions.find(id);
+    if (it != sessions.end()) {
+      sourceSessions.erase(
+          Transport::sourceKey(it->second.peer, Delivery::Unreliable));
+      sessions.erase(it);
+    }
+    sourceSessions.erase(reliableKey);
   }
 
-  void handleIncomingTCPHeader(const char *header) override {
-    struct Header hdr = deserialize<Header>(hdrMssg);
+  void onFrame(const Peer &peer, const char *frame, size_t frameLen,
+               Delivery delivery) {
+    Tracer &tracer = Tracer::instance();
+    tracer.beginTrace();
+    tracer.stamp(TraceStage::SocketRead);
+
+    if (frameLen < sizeof(Header)) {
+      tracer.endTrace();
+      return;
+    }
+
+    struct Header hdr = deserialize<Header>(frame);
+    tracer.stamp(TraceStage::HeaderDecode);
+
+    if (frameLen < sizeof(Header) + hdr.mssgLength) {
+      tracer.endTrace();
+      return;
+    }
+
+    // Drop floods before the session lookup, decode and callbacks.
+    if (!rateLimiter.allowSource(Transport::sourceKey(peer, delivery),
+                                 hdr.mssgType)) {
+      tracer.endTrace();
+      return;
+    }
+
+    // Sent before the client had its sessionID (pipelined behind its
+    // Register): The session is whichever is bound to this channel.
+    if (hdr.senderID == 0 && delivery == Delivery::Reliable &&
+        hdr.mssgType != EventCode::Register) {
+      hdr.senderID =
+          sourceSessions.find(Transport::sourceKey(peer, delivery));
+    }
+
     if (hdr.mssgType == EventCode::Register) {
       // sessionID invalid before registration. That's OK.
-      startClientRegistration(hdr.senderID);
+      if (delivery == Delivery::Reliable) {
+        startClientRegistration(peer);
+      } else {
+        completeClientRegistration(hdr.senderID, peer,
+                                   frame + sizeof(Header), hdr.mssgLength);
+      }
+
+    } else if (!validSender(hdr.senderID, peer, delivery)) {
+      // Unregistered, or spoofed.
+
+    } else if (!rateLimiter.allowSession(hdr.senderID, hdr.mssgType)) {
+      // Over this session's limit.
+
+    } else if (hdr.mssgType == EventCode::Ping) {
+      Ping ping;
+      if (deserialize(frame + sizeof(Header), hdr.mssgLength, ping)) {
+        lock_guard<mutex> lock(schedulerMutex);
+        sendScheduler.onProbeEcho(hdr.senderID, ping.seq);
+      }
 
     } else {
-      char *mssg = tcpServer.read(hdr.senderID, hdr.mssgLength);
-      handleIncomingMessage(hdr.mssgType, mssg);
+      const char *mssg = frame + sizeof(Header);
+
+      if (capturing.load(memory_order_acquire)) {
+        trafficCapture.append(delivery == Delivery::Reliable
+                                  ? TrafficTransport::TCP
+                                  : TrafficTransport::UDP,
+                              hdr.senderID, hdr.senderID, hdr.mssgType, mssg,
+                              hdr.mssgLength);
+      }
+
+      dispatchMessage(hdr.senderID, hdr.mssgType, mssg, hdr.mssgLength);
     }
+
+    tracer.endTrace();
   }
 
-  void handleIncomingMessage(uint32_t senderID, EventCode code, char *mssg) {
-    if (!validSessionID(hdr.senderID)) {
+  // =======================================
+
+  void handleIncomingMessage(uint32_t senderID, EventCode code,
+                             const char *mssg, uint32_t mssgLength) {
+    if (!validClientSessionID(senderID)) {
       // @TODO: Log
       return;
+    }
 
-      // Trigger callbacks observing event.
-    } else if (hdr.mssgType == EventCode::Movement) {
-      Coord2D coords = deserialize<Coord2D>(mssg);
-      observers.notifyObservers(hdr.mssgType, coords.xCoord, coords.yCoord);
+    dispatchMessage(senderID, code, mssg, mssgLength);
+  }
 
-    } else if (hdr.mssgType == EventCode::Chat) {
-      ChatMessage chatMssg = deserialize<ChatMessage>(mssg);
-      observers.notifyObservers(hdr.mssgType, chatMssg.message);
+  /**
+   * Records a move's seq before the callbacks see it. False for a move of
+   * another session's object (a player's publicID is its session's; any
+   * other object is the first mover's until it disconnects), or one older
+   * than one already processed (ex. reordered UDP), which would put the
+   * object back where it was. objectID 0 is the sender's own player.
+   */
+  bool acceptInput(uint32_t senderID, const Coord2D &move) {
+    if (move.objectID == 0) {
+      return true;
+    }
 
-    } else if (hdr.mssgType == EventCode::Event) {
-      Action act = deserialize<Action>(mssg);
-      observers.notifyObservers(hdr.mssgType, act.actionType, act.actionValue,
-                                act.impactedID);
+    lock_guard<mutex> lock(inputSeqMutex);
+    auto [it, added] = objectInputs.try_emplace(move.objectID);
+    ObjectInput &input = it->second;
+    if (added) {
+      input.ownerID = senderID;
+    } else if (input.ownerID != senderID) {
+      return false;
+    }
 
-    } else if (hdr.mssgType == EventCode::Verification) {
-      Verification vStatus = deserialize<Verification>(mssg);
-      observers.notifyObservers(hdr.mssgType, vStatus.status);
+    if (move.seq == 0) {
+      return true; // Sent without a seq.
     }
+    if (input.seq != 0 && int32_t(move.seq - input.seq) <= 0) {
+      return false;
+    }
+    input.seq = move.seq;
+    return true;
   }
 
-  template <typename mssgStruct>
-  void sendTCPMssg(uint32_t clientID, const mssgStruct &mssg) {
-    lock_guard<mutex> lock(sessionMutex);
+  // A player's own object is reserved to its session from registration.
+  void reserveObject(uint32_t objectID, uint32_t sessionID) {
+    lock_guard<mutex> lock(inputSeqMutex);
+    objectInputs[objectID] = {sessionID, 0};
+  }
 
-    auto it = sessions.find(clientID);
-    if (it != sessions.end()) {
-      tcpServer.writeTo(it->second.sfd, mssg);
-    }
+  // On disconnect: Its objects can be moved by others (ex. a new session).
+  void releaseObjects(uint32_t sessionID) {
+    lock_guard<mutex> lock(inputSeqMutex);
+    erase_if(objectInputs, [&](const auto &entry) {
+      return entry.second.ownerID == sessionID;
+    });
   }
 
+  // Locations ack the owner's latest input, unless the game set one itself.
   template <typename mssgStruct>
-  void sendUDPMssg(uint32_t clientID, const mssgStruct &mssg) {
-    lock_guard<mutex> lock(sessionMutex);
-
-    auto it = sessions.find(clientID);
-    if (it != sessions.end()) {
-      udpServer.writeTo(it->second.inAddr, mssg);
+  mssgStruct withInputAck(const mssgStruct &mssg) {
+    mssgStruct acked = mssg;
+    if constexpr (is_same_v<mssgStruct, Coord2D>) {
+      acked.mssgType = EventCode::Location; // Coords from the server.
+      if (acked.seq == 0) {
+        acked.seq = getInputSeq(mssg.objectID);
+      }
     }
+    return acked;
   }
 
-  /**
-   *  Broadcast a message to all except the sender, over TCP.
-   */
-  template <typename mssgStruct>
-  void broadcastTCPMssg(uint32_t senderID, const mssgStruct &mssg) {
-    lock_guard<mutex> lock(sessionMutex);
+  // A room member's input goes to its room's next tick. False if the
+  // sender isn't in a room.
+  bool toRoom(uint32_t senderID, const Coord2D &move) {
+    RoomInput input;
+    input.senderID = senderID;
+    input.mssgType = EventCode::Movement;
+    input.objectID = move.objectID;
+    input.xCoord = move.xCoord;
+    input.yCoord = move.yCoord;
+    input.seq = move.seq;
+    return rooms.submitInput(input);
+  }
 
-    for (auto conn = sessions.begin(); conn != sessions.end(); ++conn) {
-      if (conn->first != senderID) {
-        tcpServer.writeTo(conn->second.sfd, mssg);
-      }
-    }
+  bool toRoom(uint32_t senderID, const Action &act) {
+    RoomInput input;
+    input.senderID = senderID;
+    input.mssgType = EventCode::Action;
+    input.actionType = act.actionType;
+    input.actionValue = act.actionValue;
+    input.impactedID = act.impactedID;
+    return rooms.submitInput(input);
   }
 
-  /**
-   *  Broadcast a message to all except the sender, over UDP.
-   */
-  template <typename mssgStruct>
-  void broadcastUDPMssg(uint32_t senderID, const mssgStruct &mssg) {
-    lock_guard<mutex> lock(sessionMutex);
+  bool toRoom(uint32_t senderID, const Projectile &shot) {
+    RoomInput input;
+    input.senderID = senderID;
+    input.mssgType = EventCode::Projectile;
+    input.projectile = shot.spawn;
+    return rooms.submitInput(input);
+  }
+
+  // Trigger callbacks observing event. Malformed mssgs (ex. shorter than
+  // their type) are dropped.
+  void dispatchMessage(uint32_t senderID, EventCode code, const char *mssg,
+                       uint32_t mssgLength) {
+    if (code == EventCode::Movement) {
+      Coord2D coords;
+      if (!deserialize(mssg, mssgLength, coords) ||
+          !acceptInput(senderID, coords)) {
+        return;
+      }
+      if (toRoom(senderID, coords)) {
+        return;
+      }
+      observers.notifyObservers(static_cast<uint8_t>(code), coords.objectID,
+                                coords.xCoord, coords.yCoord);
 
-    for (auto conn = sessions.begin(); conn != sessions.end(); ++conn) {
-      if (conn->first != senderID) {
-        udpServer.writeTo(conn->second, mssg);
+    } else if (code == EventCode::Chat) {
+      ChatMessage chatMssg;
+      if (!deserialize(mssg, mssgLength, chatMssg)) {
+        return;
       }
+      observers.notifyObservers(static_cast<uint8_t>(code), chatMssg.message);
+
+    } else if (code == EventCode::Action) {
+      Action act;
+      if (!deserialize(mssg, mssgLength, act) || toRoom(senderID, act)) {
+        return;
+      }
+      observers.notifyObservers(static_cast<uint8_t>(code), act.actionType,
+                                act.actionValue, act.impactedID);
+
+    } else if (code == EventCode::Projectile) {
+      // Named here, whatever the client sent: Its objectID could be
+      // another shot's, and its ownerID someone else (whom its pellets
+      // would then pass through). Outside a room, the game sets spawnTick
+      // and sends it on.
+      Projectile shot;
+      if (!deserialize(mssg, mssgLength, shot)) {
+        return;
+      }
+      shot.spawn.objectID = newProjectileID();
+      shot.spawn.ownerID = publicIDOf(senderID);
+      if (toRoom(senderID, shot)) {
+        return;
+      }
+      observers.notifyObservers(static_cast<uint8_t>(code), senderID,
+                                shot.spawn);
+
+    } else if (code == EventCode::Verification) {
+      Verification vStatus;
+      if (!deserialize(mssg, mssgLength, vStatus)) {
+        return;
+      }
+      observers.notifyObservers(static_cast<uint8_t>(code), vStatus.status);
+
+    } else if (code == EventCode::Request) {
+      // Observers fill in the reply (denied if none does).
+      Request request;
+      if (!deserialize(mssg, mssgLength, request)) {
+        return;
+      }
+      Verification reply(request.requestID, false);
+      observers.notifyObservers(static_cast<uint8_t>(code), senderID,
+                                static_cast<uint8_t>(request.requestType),
+                                request.getArgument(), &reply);
+      sendTCPEvent(senderID, reply);
     }
+
+    Tracer::instance().stamp(TraceStage::Dispatch);
   }
 
   // =======================================
 
-  // TCP & UDP objects responsible for read-polling
-
   /**
-   * Periodically deques message for tcp queue
-   * and sends to relevant parties.
-   *
-   * If the SEND-TO sfd is negative, the mssg is broadcasted.
+   * Periodically runs a send tick (see flushWrites).
    * @TODO Use condition_variable to wake up thread only when queue is updated.
    */
-  void runTCPWrite() {
+  void runWrite() {
     while (true) {
       std::this_thread::sleep_for(
-          std::chrono::milliseconds(TCP_WRITE_DELAY_MS));
+          std::chrono::milliseconds(sendScheduler.getConfig().tickMs));
+      flushWrites();
+    }
+  }
 
-      while (auto mssg = dequeTCPMssg(); mssg.first != 0) {
-        if (mssg.first < 0) {
-          broadcastTCPMssg(sessionID, mssg.second);
-        } else {
-          sendTCPMssg(mssg.first, mssg.second);
+  // Write thread only: Everything the scheduler may send to this tick.
+  void syncSendRecipients() {
+    sendRecipients.clear();
+    {
+      lock_guard<mutex> lock(sessionMutex);
+      for (const auto &[id, conn] : sessions) {
+        if (!conn.replayed) {
+          sendRecipients.push_back({id, conn.publicID, conn.peer});
         }
       }
     }
-  }
 
-  /**
-   * Periodically deques message for udp queue
-   * and sends to relevant parties.
-   *
-   * If the SEND-TO addr is negative, the mssg is broadcasted.
-   * @TODO Use condition_variable to wake up thread only when queue is updated.
-   */
-  void runUDPWrite() {
-    while (true) {
-      std::this_thread::sleep_for(
-          std::chrono::milliseconds(UDP_WRITE_DELAY_MS));
+    sendScheduler.syncRecipients(sendRecipients, [&](const Peer &peer) {
+      if constexpr (requires { transport.measureCapacity(peer); }) {
+        return transport.measureCapacity(peer);
+      } else {
+        return uint64_t(0); // Unknown; the scheduler uses its default.
+      }
+    });
+  }
 
-      while (auto mssg = dequeUDPMssg(); mssg.first != 0) {
-        if (mssg.first < 0) {
-          broadcastUDPMssg(sessionID, mssg.second);
-        } else {
-          sendUDPMssg(mssg.first, mssg.second);
-        }
+  // Write thread only: Chunks around where each client's entity was last
+  // sent (see startMapStreaming).
+  void streamMapToRecipients() {
+    if (!mapStream) {
+      return;
+    }
+    for (const auto &recipient : sendRecipients) {
+      auto position = sendScheduler.getPosition(recipient.publicID);
+      if (recipient.publicID == 0 || !position) {
+        continue;
       }
+      mapStream->streamAround(recipient.sessionID, position->first,
+                              position->second, [&](OutboundMssg chunk) {
+                                sendScheduler.enqueue(recipient.sessionID,
+                                                      chunk, BROADCAST_ID);
+                              });
+    }
+  }
+
+  // A cached frame (see FileFrame), without a copy if the transport can.
+  bool sendFile(const Peer &peer, const FileFrame &frame) {
+    if constexpr (requires { transport.sendFileFrame(peer, frame); }) {
+      return transport.sendFileFrame(peer, frame);
+    } else {
+      SerializedMessage copy(const_cast<unsigned char *>(frame.data));
+      return transport.send(peer, copy, Delivery::Reliable);
+    }
+  }
+
+  void drainIntoScheduler() {
+    for (auto mssg = dequeTCPMssg(); mssg.first != 0; mssg = dequeTCPMssg()) {
+      Tracer::instance().stamp(mssg.second.traceID(), TraceStage::Dequeue);
+      sendScheduler.enqueue(mssg.first, mssg.second, BROADCAST_ID);
+    }
+
+    for (auto mssg = dequeUDPMssg(); mssg.first != 0; mssg = dequeUDPMssg()) {
+      Tracer::instance().stamp(mssg.second.traceID(), TraceStage::Dequeue);
+      sendScheduler.enqueue(mssg.first, mssg.second, BROADCAST_ID);
+    }
+  }
+
+  template <typename mssgStruct>
+  OutboundMssg makeOutbound(const mssgStruct &mssg, Delivery delivery) {
+    OutboundMssg outbound;
+    outbound.mssg = make_shared<SerializedMessage>(sessionID, mssg);
+    outbound.bytes = sizeof(Header) + frameMssgLength(*outbound.mssg);
+    outbound.delivery = delivery;
+    outbound.mssgType = mssg.getType();
+
+    if constexpr (latestWins<mssgStruct>) {
+      outbound.isState = true;
+      outbound.objectID = mssg.objectID;
+      outbound.xCoord = mssg.xCoord;
+      outbound.yCoord = mssg.yCoord;
     }
+    return outbound;
   }
 
-  pair<uint32_t, const SerializedMessage &> dequeUDPMssg() {
+  pair<uint32_t, OutboundMssg> dequeUDPMssg() {
     lock_guard<mutex> lock(udpQueueMutex);
 
     if (udpMssgQueue.empty()) {
-      return {0, SerializedMessage{}};
+      return {0, {}};
     }
 
-    pair<uint32_t, const SerializedMessage &> mssg = udpMssgQueue.front();
-    udpMssgQueue.pop();
-    return mssg;
+    return udpMssgQueue.pop();
   }
 
-  pair<uint32_t, const SerializedMessage &> dequeTCPMssg() {
+  pair<uint32_t, OutboundMssg> dequeTCPMssg() {
     lock_guard<mutex> lock(tcpQueueMutex);
 
     if (tcpMssgQueue.empty()) {
-      return {0, SerializedMessage{}};
+      return {0, {}};
     }
 
-    pair<uint32_t, const SerializedMessage &> mssg = tcpMssgQueue.front();
+    pair<uint32_t, OutboundMssg> mssg = std::move(tcpMssgQueue.front());
     tcpMssgQueue.pop();
     return mssg;
   }
 
-  void enqueueTCPMessage(uint32_t sendToID, const SerializedMessage &mssg) {
+  void enqueueTCPMessage(uint32_t sendToID, OutboundMssg mssg) {
+    Tracer::instance().stamp(mssg.traceID(), TraceStage::Enqueue);
+
     lock_guard<mutex> lock(tcpQueueMutex);
-    tcpMssgQueue.push({sendToID, mssg});
+    tcpMssgQueue.push({sendToID, std::move(mssg)});
+  }
+
+  void enqueueUDPMessage(uint32_t sendToID, OutboundMssg mssg) {
+    Tracer::instance().stamp(mssg.traceID(), TraceStage::Enqueue);
+
+    lock_guard<mutex> lock(udpQueueMutex);
+    udpMssgQueue.push(sendToID, std::move(mssg));
   }
 
-  void enqueueUDPMessage(uint32_t sendToID, const SerializedMessage &mssg) {
+  void enqueueUDPMessage(uint32_t sendToID, OutboundMssg mssg,
+                         const CoalesceKey &key) {
+    Tracer::instance().stamp(mssg.traceID(), TraceStage::Enqueue);
+
     lock_guard<mutex> lock(udpQueueMutex);
-    udpMssgQueue.push({sendToID, mssg});
+    udpMssgQueue.push(sendToID, std::move(mssg), key);
   }
 };
 
+// The usual setup: TCP + UDP sockets (plus shared memory on the server).
+using ClientNetworkAPI = BasicClientNetworkAPI<SocketClientTransport>;
+using ServerNetworkAPI = BasicServerNetworkAPI<SocketServerTransport>;
+
+// A process on the server's host, over shared memory only.
+using ShmClientNetworkAPI = BasicClientNetworkAPI<ShmClientTransport>;
+
 #endif // NETWORKAPI_H
 
 /*
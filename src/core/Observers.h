@@ -20,13 +20,17 @@
 
 using namespace std;
 
+#ifndef OBSERVERS_H
+#define OBSERVERS_H
+
 /**
  *  Interface needed for storing Observers with different args togather.
  */
 class Updatable {
 public:
+  // Observers are called through their Observer<Args...> type
+  // (see notifyObservers), as only it knows the parameters.
   virtual ~Updatable() = default;
-  virtual void update() = 0; // This can't do anything on it's own.
 };
 
 /**
@@ -38,13 +42,7 @@ public:
   template <typename ObserverFunc>
   Observer(ObserverFunc observerFunc) : observerFunc(observerFunc) {}
 
-  void update() override {
-    // throw logic_error("Observer update must be called with parameters.");
-    //  The Observer update function may not actually have arguments.
-    update();
-  }
-
-  // update(...) with any numbers of args.
+  // update(...) with any numbers of args (including none).
   void update(Args... args) { observerFunc(args...); }
 
 protected:
@@ -91,11 +89,17 @@ public:
     }
   }
 
+  bool hasObservers(uint8_t subjectCode) const {
+    return observers.count(subjectCode) > 0;
+  }
+
 private:
   // Maps 1 Subject (code) to 1+ Observer(s) to notify on an event
   map<uint8_t, vector<std::shared_ptr<Updatable>>> observers;
 };
 
+#endif // OBSERVERS_H
+
 /*
 Example usage:
 
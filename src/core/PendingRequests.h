@@ -0,0 +1,113 @@
+#ifndef PENDINGREQUESTS_H
+#define PENDINGREQUESTS_H
+
+/**
+ * Client-side table of Requests waiting for their Verification.
+ *
+ * Each Request gets a requestID and a deadline, so many can be in flight at
+ * once (pipelined) and the server may answer them in any order. Whichever
+ * comes first, the answer or the deadline, completes the request: its
+ * callback gets the Verification, or nullptr on timeout.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "messages.h"
+
+using namespace std;
+
+class PendingRequests {
+public:
+  using Callback = std::function<void(const Verification *)>;
+  using Clock = chrono::steady_clock;
+
+  // A new requestID, pending until complete() or its timeout.
+  uint32_t add(int timeoutMs, Callback callback) {
+    lock_guard<mutex> lock(pendingMutex);
+
+    uint32_t requestID = nextID++;
+    if (nextID == 0) {
+      nextID = 1; // 0 means "not for a request".
+    }
+
+    pending[requestID] = {Clock::now() + chrono::milliseconds(timeoutMs),
+                          std::move(callback)};
+    return requestID;
+  }
+
+  // Drop a request that couldn't be sent, without calling back.
+  void cancel(uint32_t requestID) {
+    lock_guard<mutex> lock(pendingMutex);
+    pending.erase(requestID);
+  }
+
+  // False if the requestID isn't pending (ex. it already timed out).
+  bool complete(const Verification &reply) {
+    Callback callback;
+    {
+      lock_guard<mutex> lock(pendingMutex);
+      auto it = pending.find(reply.requestID);
+      if (it == pending.end()) {
+        return false;
+      }
+      callback = std::move(it->second.callback);
+      pending.erase(it);
+    }
+
+    // Outside the lock, so the callback may send another request.
+    if (callback) {
+      callback(&reply);
+    }
+    return true;
+  }
+
+  // Times out overdue requests. Returns how many.
+  size_t expire() {
+    vector<Callback> expired;
+    {
+      lock_guard<mutex> lock(pendingMutex);
+      if (pending.empty()) {
+        return 0;
+      }
+
+      Clock::time_point now = Clock::now();
+      for (auto it = pending.begin(); it != pending.end();) {
+        if (it->second.deadline <= now) {
+          expired.push_back(std::move(it->second.callback));
+          it = pending.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    for (Callback &callback : expired) {
+      if (callback) {
+        callback(nullptr);
+      }
+    }
+    return expired.size();
+  }
+
+  size_t size() {
+    lock_guard<mutex> lock(pendingMutex);
+    return pending.size();
+  }
+
+private:
+  struct Pending {
+    Clock::time_point deadline;
+    Callback callback;
+  };
+
+  mutex pendingMutex;
+  unordered_map<uint32_t, Pending> pending;
+  uint32_t nextID = 1;
+};
+
+#endif // PENDINGREQUESTS_H
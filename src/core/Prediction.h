@@ -0,0 +1,144 @@
+#ifndef PREDICTION_H
+#define PREDICTION_H
+
+/**
+ * Client-side prediction and server reconciliation, for an object this
+ * client moves (ex. its player).
+ *
+ * Each move gets an input sequence number (Coord2D::seq), and is applied
+ * locally right away instead of waiting a round trip for the server's
+ * Location. The server's Location carries the seq of the last input it
+ * processed for that object (the ack), so the client can tell which of its
+ * moves the authoritative position already includes:
+ *   predicted = server position + the moves after the ack, replayed.
+ * When the server agrees, nothing visibly changes; when it doesn't (ex. it
+ * stopped the player at a wall), the prediction snaps to its position, plus
+ * the moves it hasn't seen yet.
+ *
+ * Moves are absolute coords on the wire, so each input is kept as its delta
+ * from the position predicted when it was made (what the game applied).
+ *
+ * Reference:
+ * https://www.gabrielgambetta.com/client-side-prediction-server-reconciliation.html
+ */
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+using namespace std;
+
+struct PredictionStats {
+  uint64_t inputs = 0;
+  uint64_t acks = 0;
+  uint64_t corrections = 0; // Acks that moved the prediction.
+  uint64_t staleAcks = 0;   // Older than one already applied, or evicted.
+  uint32_t unacked = 0;     // Inputs the server hasn't acked yet.
+  double lastCorrection = 0; // Distance the last correction moved it.
+};
+
+// Not thread-safe; the client locks around it.
+class MovePredictor {
+public:
+  // Unacked inputs kept (~2s at 60 moves/s). Older ones can't be replayed.
+  static constexpr uint32_t HISTORY = 128;
+
+  // Applies a move locally. Returns its seq (never 0) to send with it.
+  uint32_t record(uint32_t xCoord, uint32_t yCoord) {
+    uint32_t seq = nextSeq++;
+    if (nextSeq == 0) {
+      nextSeq = 1; // 0 means "no seq".
+    }
+
+    Input &input = history[seq % HISTORY];
+    input.seq = seq;
+    input.dx = int64_t(xCoord) - predictedX;
+    input.dy = int64_t(yCoord) - predictedY;
+    if (!hasPosition) {
+      input.dx = input.dy = 0; // The first move is where the object is.
+      hasPosition = true;
+    }
+
+    predictedX = xCoord;
+    predictedY = yCoord;
+    lastSeq = seq;
+    stats.inputs++;
+    return seq;
+  }
+
+  /**
+   * The server's position for the object, after processing input ackSeq.
+   * Replays the inputs after it. Returns false (and ignores it) if it is
+   * older than an ack already applied (ex. reordered UDP).
+   */
+  bool reconcile(uint32_t ackSeq, uint32_t serverX, uint32_t serverY) {
+    if (ackSeq == 0 || (ackedSeq != 0 && !isNewer(ackSeq, ackedSeq)) ||
+        isNewer(ackSeq, lastSeq)) {
+      stats.staleAcks++;
+      return false;
+    }
+
+    // If inputs after the ack were overwritten, they can't be replayed.
+    uint32_t unacked = lastSeq - ackSeq;
+    if (unacked >= HISTORY) {
+      stats.staleAcks++;
+      return false;
+    }
+
+    int64_t x = serverX;
+    int64_t y = serverY;
+    for (uint32_t seq = ackSeq + 1; seq != lastSeq + 1; seq++) {
+      if (seq == 0) {
+        continue; // Skipped when the seq wrapped.
+      }
+      const Input &input = history[seq % HISTORY];
+      x += input.dx;
+      y += input.dy;
+    }
+
+    double moved = hypot(double(x - predictedX), double(y - predictedY));
+    if (moved > 0) {
+      stats.corrections++;
+      stats.lastCorrection = moved;
+    }
+
+    predictedX = x;
+    predictedY = y;
+    hasPosition = true;
+    ackedSeq = ackSeq;
+    stats.acks++;
+    return true;
+  }
+
+  uint32_t getX() const { return uint32_t(predictedX); }
+  uint32_t getY() const { return uint32_t(predictedY); }
+
+  PredictionStats getStats() const {
+    PredictionStats current = stats;
+    current.unacked = lastSeq - ackedSeq;
+    return current;
+  }
+
+private:
+  struct Input {
+    uint32_t seq = 0;
+    int64_t dx = 0; // From the prediction before this input.
+    int64_t dy = 0;
+  };
+
+  array<Input, HISTORY> history;
+  uint32_t nextSeq = 1;
+  uint32_t lastSeq = 0;  // Latest recorded input.
+  uint32_t ackedSeq = 0; // Latest input the server acked.
+
+  bool hasPosition = false;
+  int64_t predictedX = 0;
+  int64_t predictedY = 0;
+
+  PredictionStats stats;
+
+  // Sequence numbers wrap, so compare the difference (RFC 1982).
+  static bool isNewer(uint32_t a, uint32_t b) { return int32_t(a - b) > 0; }
+};
+
+#endif // PREDICTION_H
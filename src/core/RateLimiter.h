@@ -0,0 +1,223 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+/**
+ * Token-bucket rate limiting of incoming mssgs, per EventCode.
+ *
+ * Checked by the server right after a frame's Header is read, so a flood is
+ * dropped before the session lookup, decode and observer callbacks:
+ *   1. Per source (the transport's sourceKey: a UDP address, a TCP
+ *      connection, ...), before anything else.
+ *   2. Per session, once the sender is known to own its sessionID (checking
+ *      first would let a spoofed senderID drain someone else's bucket).
+ *
+ * Buckets live in fixed-size open-addressing tables allocated up front, so
+ * checking (and dropping) never allocates, and a spoofed-address flood can
+ * only evict idle buckets, not grow memory.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "events.h"
+
+using namespace std;
+
+// perSec = 0: No limit.
+struct RateLimit {
+  double perSec = 0;
+  double burst = 0; // Mssgs allowed at once, after being idle.
+};
+
+struct RateLimitConfig {
+  bool enabled = true;
+
+  // Indexed by EventCode.
+  array<RateLimit, 256> perSession;
+  array<RateLimit, 256> perSource;
+
+  size_t tableSize = 1 << 16; // Buckets per table (rounded up to 2^n).
+
+  RateLimitConfig() {
+    perSession.fill({100, 200});
+    perSource.fill({200, 400});
+
+    setLimit(EventCode::Movement, {120, 60}, {240, 120});
+    setLimit(EventCode::Action, {30, 30}, {60, 60});
+    setLimit(EventCode::Projectile, {30, 30}, {60, 60});
+    setLimit(EventCode::Chat, {5, 10}, {10, 20});
+    setLimit(EventCode::Ping, {50, 20}, {100, 40});
+    setLimit(EventCode::Register, {2, 5}, {2, 5});
+    setLimit(EventCode::Request, {10, 20}, {20, 40});
+  }
+
+  void setLimit(EventCode code, RateLimit session, RateLimit source) {
+    perSession[static_cast<uint8_t>(code)] = session;
+    perSource[static_cast<uint8_t>(code)] = source;
+  }
+};
+
+struct RateLimitStats {
+  array<uint64_t, 256> droppedBySource = {}; // Indexed by EventCode.
+  array<uint64_t, 256> droppedBySession = {};
+  uint64_t sourceEvictions = 0; // Idle buckets reused for a new source.
+};
+
+/**
+ * Not thread-safe, except getStats(); driven by the server's read thread.
+ */
+class RateLimiter {
+public:
+  RateLimiter(const RateLimitConfig &config = RateLimitConfig()) {
+    setConfig(config);
+  }
+
+  // Forgets every bucket (drop counters are kept).
+  void setConfig(const RateLimitConfig &newConfig) {
+    config = newConfig;
+    sourceBuckets.reset(config.tableSize);
+    sessionBuckets.reset(config.tableSize);
+  }
+
+  bool allowSource(uint64_t sourceKey, EventCode code) {
+    uint8_t index = static_cast<uint8_t>(code);
+    if (!config.enabled || config.perSource[index].perSec == 0) {
+      return true;
+    }
+
+    if (sourceBuckets.take(sourceKey, index, config.perSource[index], now())) {
+      return true;
+    }
+    droppedBySource[index].fetch_add(1, memory_order_relaxed);
+    return false;
+  }
+
+  bool allowSession(uint32_t sessionID, EventCode code) {
+    uint8_t index = static_cast<uint8_t>(code);
+    if (!config.enabled || config.perSession[index].perSec == 0) {
+      return true;
+    }
+
+    if (sessionBuckets.take(sessionID, index, config.perSession[index],
+                            now())) {
+      return true;
+    }
+    droppedBySession[index].fetch_add(1, memory_order_relaxed);
+    return false;
+  }
+
+  RateLimitStats getStats() const {
+    RateLimitStats stats;
+    for (size_t i = 0; i < 256; i++) {
+      stats.droppedBySource[i] = droppedBySource[i].load(memory_order_relaxed);
+      stats.droppedBySession[i] =
+          droppedBySession[i].load(memory_order_relaxed);
+    }
+    stats.sourceEvictions =
+        sourceBuckets.evictions.load(memory_order_relaxed);
+    return stats;
+  }
+
+private:
+  struct TokenBucket {
+    float tokens = 0;
+    int64_t lastNs = 0;
+  };
+
+  class BucketTable {
+  public:
+    atomic<uint64_t> evictions{0};
+
+    void reset(size_t size) {
+      size_t capacity = 16;
+      while (capacity < size) {
+        capacity <<= 1;
+      }
+      slots.assign(capacity, Slot());
+      mask = capacity - 1;
+    }
+
+    // Take a token for (key, code), if there is one.
+    bool take(uint64_t key, uint8_t code, const RateLimit &limit,
+              int64_t nowNs) {
+      TokenBucket &bucket = find(key, code, limit, nowNs);
+
+      double refill = (nowNs - bucket.lastNs) * limit.perSec / 1e9;
+      bucket.tokens = min<double>(limit.burst, bucket.tokens + refill);
+      bucket.lastNs = nowNs;
+
+      if (bucket.tokens < 1) {
+        return false;
+      }
+      bucket.tokens -= 1;
+      return true;
+    }
+
+  private:
+    static constexpr size_t MAX_PROBES = 8;
+
+    struct Slot {
+      uint64_t key = 0;
+      uint8_t code = 0;
+      bool used = false;
+      TokenBucket bucket;
+    };
+
+    vector<Slot> slots;
+    size_t mask = 0;
+
+    // The (key, code) bucket. A new one starts full. If the probe window is
+    // full, the least recently used bucket in it is reused.
+    TokenBucket &find(uint64_t key, uint8_t code, const RateLimit &limit,
+                      int64_t nowNs) {
+      uint64_t hash = (key ^ (uint64_t(code) << 56)) * 0x9E3779B97F4A7C15ull;
+      size_t start = (hash >> 32) & mask;
+      Slot *oldest = nullptr;
+
+      for (size_t probe = 0; probe < MAX_PROBES; probe++) {
+        Slot &slot = slots[(start + probe) & mask];
+
+        if (slot.used && slot.key == key && slot.code == code) {
+          return slot.bucket;
+        }
+        if (!slot.used) {
+          return claim(slot, key, code, limit, nowNs);
+        }
+        if (!oldest || slot.bucket.lastNs < oldest->bucket.lastNs) {
+          oldest = &slot;
+        }
+      }
+
+      evictions.fetch_add(1, memory_order_relaxed);
+      return claim(*oldest, key, code, limit, nowNs);
+    }
+
+    static TokenBucket &claim(Slot &slot, uint64_t key, uint8_t code,
+                              const RateLimit &limit, int64_t nowNs) {
+      slot.used = true;
+      slot.key = key;
+      slot.code = code;
+      slot.bucket = {float(limit.burst), nowNs};
+      return slot.bucket;
+    }
+  };
+
+  RateLimitConfig config;
+  BucketTable sourceBuckets;
+  BucketTable sessionBuckets;
+
+  array<atomic<uint64_t>, 256> droppedBySource = {};
+  array<atomic<uint64_t>, 256> droppedBySession = {};
+
+  static int64_t now() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+};
+
+#endif // RATELIMITER_H
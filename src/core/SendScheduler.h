@@ -0,0 +1,436 @@
+#ifndef SENDSCHEDULER_H
+#define SENDSCHEDULER_H
+
+/**
+ * Per-client send scheduler with a bandwidth budget.
+ *
+ * Every tick, each client's budget grows by its capacity (bytes/sec, from
+ * the transport's measurement when it has one) times the time elapsed, and
+ * is spent by priority:
+ *   1. Reliable mssgs: Always sent, in order. They may overdraw the budget,
+ *      which later ticks repay.
+ *   2. Unreliable events (ex. Action): In order, while the budget lasts.
+ *   3. Entity state (latestWins, ex. Coord2D): Near entities before far ones.
+ *      Each pending update gains its tier's weight every tick it waits
+ *      (a priority accumulator), and the highest totals go first, so far
+ *      entities still get through on a weak link instead of starving.
+ *   4. Bulk reliable mssgs (ex. map chunks): In order among themselves,
+ *      from what's left, and before state from their own share of the
+ *      budget (bulkShare), so neither starves the other. Each may overdraw
+ *      the budget, as one can be larger than a tick's worth of a weak link.
+ * A newer state update for the same entity replaces the pending one,
+ * keeping its accumulated priority.
+ *
+ * The budget rate is the lower of the link's measured capacity and the
+ * client's congestion controller (see CongestionControl.h), which probes
+ * the UDP path. So on a congested link, fewer state updates fit each tick
+ * and each entity is refreshed less often, instead of queueing in a router.
+ *
+ * Reference (priority accumulator):
+ * https://gafferongames.com/post/state_synchronization/
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "CongestionControl.h"
+#include "Transport.h"
+#include "messages.h"
+
+using namespace std;
+
+// A queued mssg, with what the scheduler needs to know about it.
+struct OutboundMssg {
+  shared_ptr<SerializedMessage> mssg; // Unless it's a file.
+  optional<FileFrame> file;           // Reliable only (see FileFrame).
+  uint32_t bytes = 0; // On the wire (Header + message).
+  Delivery delivery = Delivery::Reliable;
+  bool bulk = false; // Reliable, but within the budget (see 4. above).
+
+  // Entity state (latestWins): Which entity, and where it is.
+  bool isState = false;
+  EventCode mssgType = EventCode::Location;
+  uint32_t objectID = 0;
+  uint32_t xCoord = 0;
+  uint32_t yCoord = 0;
+
+  uint64_t traceID() const { return mssg ? mssg->traceID : 0; }
+};
+
+struct SchedulerConfig {
+  uint32_t tickMs = 10;
+  uint64_t defaultBytesPerSec = 128 * 1024; // Until (or unless) measured.
+  uint64_t minBytesPerSec = 8 * 1024;       // Floor for a measurement.
+  uint64_t maxBytesPerSec = 0;              // 0 = no cap.
+  uint32_t measureIntervalMs = 250;
+  double burstTicks = 4; // Unspent budget kept, in ticks.
+
+  uint32_t nearRadius = 64; // Same units as Coord2D.
+  double nearWeight = 4.0;  // Accumulator gain per tick.
+  double farWeight = 1.0;
+
+  size_t maxPendingEvents = 1024; // Oldest unreliable events dropped past this.
+  double bulkShare = 0.25; // Of the budget, kept for bulk mssgs before state.
+
+  CongestionConfig congestion;
+  uint64_t maxCongestionBytesPerSec = 4 * 1024 * 1024; // If maxBytesPerSec = 0.
+};
+
+struct SchedulerStats {
+  uint64_t bytesPerSec = 0;           // Current budget rate.
+  uint64_t capacityBytesPerSec = 0;   // Measured by the transport.
+  uint64_t congestionBytesPerSec = 0; // Congestion controller's rate.
+  CongestionStats congestion;
+  uint64_t sentBytes = 0;
+  uint64_t sentMssgs = 0;
+  uint64_t superseded = 0;    // State replaced by a newer update while pending.
+  uint64_t droppedEvents = 0; // Unreliable events over maxPendingEvents.
+  size_t pendingState = 0;
+  size_t pendingEvents = 0;
+  size_t pendingBulk = 0;
+};
+
+/**
+ * Not thread-safe; driven by the server's write thread.
+ * Peer is the transport's handle, which tick() hands back to send(...).
+ */
+template <typename Peer> class SendScheduler {
+public:
+  struct Recipient {
+    uint32_t sessionID;
+    uint32_t publicID; // The client's own entity, for near/far.
+    Peer peer;
+  };
+
+  SendScheduler(const SchedulerConfig &config = SchedulerConfig())
+      : config(config) {}
+
+  const SchedulerConfig &getConfig() const { return config; }
+
+  /**
+   * Set who can be sent to (call before each tick). Clients that left are
+   * dropped along with what was pending for them. measure(peer) returns the
+   * link's capacity in bytes/sec (0 = unknown), and is only called every
+   * measureIntervalMs per client.
+   */
+  template <typename MeasureFunc>
+  void syncRecipients(const vector<Recipient> &recipients,
+                      MeasureFunc measure) {
+    Clock::time_point now = Clock::now();
+
+    for (const Recipient &recipient : recipients) {
+      auto [it, added] = clients.try_emplace(recipient.sessionID);
+      ClientState &client = it->second;
+      client.publicID = recipient.publicID;
+      client.peer = recipient.peer;
+      client.seen = syncGeneration;
+
+      if (added) {
+        client.bytesPerSec = config.defaultBytesPerSec;
+        client.congestion = CongestionController(
+            config.congestion, config.defaultBytesPerSec,
+            config.minBytesPerSec,
+            config.maxBytesPerSec > 0 ? config.maxBytesPerSec
+                                      : config.maxCongestionBytesPerSec);
+        client.budget = burstBytes(client);
+        client.lastTick = now;
+      }
+
+      if (added || now - client.lastMeasured >=
+                       chrono::milliseconds(config.measureIntervalMs)) {
+        client.lastMeasured = now;
+        updateCapacity(client, measure(client.peer));
+      }
+    }
+
+    for (auto it = clients.begin(); it != clients.end();) {
+      it = it->second.seen == syncGeneration ? next(it) : clients.erase(it);
+    }
+    syncGeneration++;
+  }
+
+  // broadcastID sends to every current recipient.
+  void enqueue(uint32_t sendToID, const OutboundMssg &mssg,
+               uint32_t broadcastID) {
+    if (mssg.isState) {
+      positions[mssg.objectID] = {mssg.xCoord, mssg.yCoord};
+    }
+
+    if (sendToID == broadcastID) {
+      for (auto &[id, client] : clients) {
+        enqueueFor(client, mssg);
+      }
+    } else if (auto it = clients.find(sendToID); it != clients.end()) {
+      enqueueFor(it->second, mssg);
+    }
+  }
+
+  /**
+   * Send each client its due congestion probe (a Ping numbered seq).
+   * sendProbe(peer, seq) returns false if it couldn't go out (ex. the
+   * client's UDP address isn't bound yet). Links with unlimited capacity
+   * aren't probed.
+   */
+  template <typename ProbeFunc> void probe(ProbeFunc sendProbe) {
+    Clock::time_point now = Clock::now();
+
+    for (auto &[id, client] : clients) {
+      if (client.unlimited) {
+        continue;
+      }
+
+      client.congestion.expireProbes(now);
+      if (client.congestion.probeDue(now) &&
+          sendProbe(client.peer, client.congestion.nextProbeSeq())) {
+        client.congestion.onProbeSent(now);
+      }
+    }
+  }
+
+  // A client echoed Ping seq.
+  void onProbeEcho(uint32_t sessionID, uint32_t seq) {
+    auto it = clients.find(sessionID);
+    if (it != clients.end()) {
+      it->second.congestion.onProbeEcho(seq, Clock::now());
+    }
+  }
+
+  /**
+   * Spend each client's budget. send(peer, mssg) returns false if the
+   * transport couldn't take it (it is then dropped, like a lost datagram).
+   */
+  template <typename SendFunc> void tick(SendFunc send) {
+    Clock::time_point now = Clock::now();
+
+    for (auto &[id, client] : clients) {
+      double elapsedSec =
+          chrono::duration<double>(now - client.lastTick).count();
+      client.lastTick = now;
+      client.budget = min(client.budget + budgetRate(client) * elapsedSec,
+                          burstBytes(client));
+      client.bulkBudget =
+          min(client.bulkBudget +
+                  budgetRate(client) * config.bulkShare * elapsedSec,
+              burstBytes(client) * config.bulkShare);
+
+      auto spend = [&](const OutboundMssg &mssg) {
+        if (send(client.peer, mssg)) {
+          client.stats.sentBytes += mssg.bytes;
+          client.stats.sentMssgs++;
+        }
+        if (!client.unlimited) {
+          client.budget -= mssg.bytes;
+        }
+      };
+
+      // 1. Reliable
+      while (!client.reliable.empty()) {
+        spend(client.reliable.front());
+        client.reliable.pop_front();
+      }
+
+      // 2. Unreliable events
+      while (!client.events.empty() &&
+             fits(client, client.events.front().bytes)) {
+        spend(client.events.front());
+        client.events.pop_front();
+      }
+
+      // 4. Bulk, from its share (unless reliables overdrew the budget)
+      while (!client.bulk.empty() &&
+             (client.unlimited ||
+              (client.bulkBudget > 0 && client.budget > 0))) {
+        client.bulkBudget -= client.bulk.front().bytes;
+        spend(client.bulk.front());
+        client.bulk.pop_front();
+      }
+
+      // 3. Entity state, by accumulated priority
+      order.clear();
+      for (auto &[key, pending] : client.state) {
+        pending.accumulator += isNear(client, pending.mssg)
+                                   ? config.nearWeight
+                                   : config.farWeight;
+        order.push_back(&pending);
+      }
+      sort(order.begin(), order.end(),
+           [](const PendingState *a, const PendingState *b) {
+             return a->accumulator > b->accumulator;
+           });
+
+      for (PendingState *pending : order) {
+        if (client.budget <= 0 && !client.unlimited) {
+          break;
+        }
+        if (fits(client, pending->mssg.bytes)) {
+          spend(pending->mssg);
+          pending->sent = true;
+        }
+      }
+
+      erase_if(client.state, [](const auto &entry) {
+        return entry.second.sent;
+      });
+
+      // 4. Bulk, from what's left
+      while (!client.bulk.empty() && client.budget > 0) {
+        spend(client.bulk.front());
+        client.bulk.pop_front();
+      }
+    }
+  }
+
+  // objectID's last position sent to clients (ex. a client's own entity).
+  optional<pair<uint32_t, uint32_t>> getPosition(uint32_t objectID) const {
+    auto it = positions.find(objectID);
+    if (it == positions.end()) {
+      return nullopt;
+    }
+    return it->second;
+  }
+
+  SchedulerStats getStats(uint32_t sessionID) const {
+    auto it = clients.find(sessionID);
+    if (it == clients.end()) {
+      return {};
+    }
+
+    const ClientState &client = it->second;
+    SchedulerStats stats = client.stats;
+    stats.bytesPerSec =
+        client.unlimited ? UNLIMITED_CAPACITY : uint64_t(budgetRate(client));
+    stats.capacityBytesPerSec =
+        client.unlimited ? UNLIMITED_CAPACITY : uint64_t(client.bytesPerSec);
+    stats.congestionBytesPerSec = uint64_t(client.congestion.getRate());
+    stats.congestion = client.congestion.getStats();
+    stats.pendingState = client.state.size();
+    stats.pendingEvents = client.events.size();
+    stats.pendingBulk = client.bulk.size();
+    return stats;
+  }
+
+  vector<uint32_t> getSessionIDs() const {
+    vector<uint32_t> ids;
+    for (const auto &[id, client] : clients) {
+      ids.push_back(id);
+    }
+    return ids;
+  }
+
+private:
+  using Clock = chrono::steady_clock;
+
+  struct PendingState {
+    OutboundMssg mssg;
+    double accumulator = 0;
+    bool sent = false;
+  };
+
+  struct ClientState {
+    uint32_t publicID = 0;
+    Peer peer;
+    uint64_t seen = 0;
+
+    double bytesPerSec = 0; // Measured capacity (or the default).
+    bool measured = false;
+    bool unlimited = false;
+    CongestionController congestion;
+    double budget = 0;
+    double bulkBudget = 0; // Its share, spent before state.
+    Clock::time_point lastTick;
+    Clock::time_point lastMeasured;
+
+    deque<OutboundMssg> reliable;
+    deque<OutboundMssg> events;
+    deque<OutboundMssg> bulk;
+    unordered_map<uint64_t, PendingState> state; // Key: objectID, type.
+
+    SchedulerStats stats;
+  };
+
+  SchedulerConfig config;
+  unordered_map<uint32_t, ClientState> clients;
+  uint64_t syncGeneration = 1;
+
+  // Last known position of each entity (from state passing through).
+  unordered_map<uint32_t, pair<uint32_t, uint32_t>> positions;
+
+  vector<PendingState *> order; // Reused every tick.
+
+  double budgetRate(const ClientState &client) const {
+    if (!config.congestion.enabled) {
+      return client.bytesPerSec;
+    }
+    if (!client.measured) {
+      return client.congestion.getRate(); // Probing is all we know.
+    }
+    return min(client.bytesPerSec, client.congestion.getRate());
+  }
+
+  double burstBytes(const ClientState &client) const {
+    return budgetRate(client) * config.tickMs / 1000.0 * config.burstTicks;
+  }
+
+  bool fits(const ClientState &client, uint32_t bytes) const {
+    return client.unlimited || client.budget >= bytes;
+  }
+
+  void updateCapacity(ClientState &client, uint64_t measured) {
+    client.unlimited = measured == UNLIMITED_CAPACITY;
+    if (client.unlimited || measured == 0) {
+      return;
+    }
+    client.measured = true;
+
+    double bytesPerSec = max<double>(measured, config.minBytesPerSec);
+    if (config.maxBytesPerSec > 0) {
+      bytesPerSec = min<double>(bytesPerSec, config.maxBytesPerSec);
+    }
+
+    // Smooth, so one noisy sample doesn't swing the budget.
+    client.bytesPerSec = 0.75 * client.bytesPerSec + 0.25 * bytesPerSec;
+  }
+
+  void enqueueFor(ClientState &client, const OutboundMssg &mssg) {
+    if (mssg.delivery == Delivery::Reliable) {
+      (mssg.bulk ? client.bulk : client.reliable).push_back(mssg);
+
+    } else if (mssg.isState) {
+      uint64_t key = (uint64_t(mssg.objectID) << 8) |
+                     static_cast<uint8_t>(mssg.mssgType);
+      auto [it, added] = client.state.try_emplace(key);
+      if (!added) {
+        client.stats.superseded++; // Keeps its accumulated priority.
+      }
+      it->second.mssg = mssg;
+
+    } else {
+      client.events.push_back(mssg);
+      if (client.events.size() > config.maxPendingEvents) {
+        client.events.pop_front();
+        client.stats.droppedEvents++;
+      }
+    }
+  }
+
+  // Unknown positions count as near, so nothing is deprioritized blindly.
+  bool isNear(const ClientState &client, const OutboundMssg &mssg) const {
+    auto self = positions.find(client.publicID);
+    if (self == positions.end() || mssg.objectID == client.publicID) {
+      return true;
+    }
+
+    int64_t dx = int64_t(mssg.xCoord) - int64_t(self->second.first);
+    int64_t dy = int64_t(mssg.yCoord) - int64_t(self->second.second);
+    int64_t radius = config.nearRadius;
+    return dx * dx + dy * dy <= radius * radius;
+  }
+};
+
+#endif // SENDSCHEDULER_H
@@ -0,0 +1,569 @@
+#ifndef SHAREDMEMORYTRANSPORT_H
+#define SHAREDMEMORYTRANSPORT_H
+
+/**
+ * Shared-memory transport for processes on the same host as the server
+ * (mob-AI controllers, test bots), so they skip the TCP/UDP stack.
+ *
+ * A connection is a memfd segment holding two single-producer/single-consumer
+ * rings (client->server and server->client) of length-prefixed frames, plus an
+ * eventfd per ring to wake a sleeping reader. The reader only asks to be woken
+ * (readerWaiting) after it runs out of data, so a busy link makes no syscalls.
+ *
+ * Setup goes through a Unix domain socket: the client connects to the
+ * server's ShmListener, which creates the segment and eventfds and passes
+ * them over with SCM_RIGHTS. That socket stays open, and its hang-up tells
+ * either side the other has gone.
+ *
+ * The abstract socket has no file permissions, so any local process could
+ * connect: The listener checks each peer's uid (SO_PEERCRED) against the
+ * server's own and any allowed ones, and refuses connections past
+ * maxChannels, as each one costs a segment and two eventfds.
+ *
+ * References:
+ * https://man7.org/linux/man-pages/man2/memfd_create.2.html
+ * https://man7.org/linux/man-pages/man2/eventfd.2.html
+ * https://man7.org/linux/man-pages/man7/unix.7.html (SCM_RIGHTS,
+ * SO_PEERCRED)
+ */
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Lives at the start of each ring, in shared memory.
+struct ShmRingHeader {
+  alignas(64) atomic<uint64_t> writePos;
+  alignas(64) atomic<uint64_t> readPos;
+  alignas(64) atomic<uint32_t> readerWaiting;
+};
+
+/**
+ * One direction of a connection. Exactly one process pushes, one pops.
+ * Frames are a uint32_t length followed by the bytes, wrapping at the end.
+ *
+ * The other process can write anything to the segment, so nothing read
+ * from it is trusted: The capacity is this side's own copy, and a frame
+ * length or position that doesn't fit it marks the ring corrupt.
+ */
+class ShmRing {
+public:
+  ShmRing() = default;
+  // capacity: Bytes of frame data; a power of 2.
+  ShmRing(void *base, int eventFd, uint64_t capacity)
+      : capacity(capacity), eventFd(eventFd) {
+    hdr = static_cast<ShmRingHeader *>(base);
+    data = static_cast<unsigned char *>(base) + sizeof(ShmRingHeader);
+  }
+
+  static size_t bytesNeeded(uint64_t capacity) {
+    return sizeof(ShmRingHeader) + capacity;
+  }
+
+  // Only the creating side initializes the header.
+  void init() { new (hdr) ShmRingHeader(); }
+
+  size_t maxFrameSize() const { return capacity / 2; }
+
+  /**
+   * Push one frame made of up to two parts (ex. Header, then message).
+   * Returns false if the ring doesn't have room right now.
+   */
+  bool push(const void *part1, size_t len1, const void *part2 = nullptr,
+            size_t len2 = 0) {
+    uint32_t frameLen = static_cast<uint32_t>(len1 + len2);
+    if (frameLen > maxFrameSize()) {
+      return false;
+    }
+
+    uint64_t w = hdr->writePos.load(memory_order_relaxed);
+    uint64_t r = hdr->readPos.load(memory_order_acquire);
+    if (w - r > capacity) {
+      corrupt = true; // The reader is past what was written.
+      return false;
+    }
+    if (capacity - (w - r) < sizeof(frameLen) + frameLen) {
+      return false; // Full.
+    }
+
+    copyIn(w, &frameLen, sizeof(frameLen));
+    copyIn(w + sizeof(frameLen), part1, len1);
+    if (len2 > 0) {
+      copyIn(w + sizeof(frameLen) + len1, part2, len2);
+    }
+
+    // seq_cst pairs with the reader's readerWaiting store, so either the
+    // reader sees this frame, or this sees the reader waiting.
+    hdr->writePos.store(w + sizeof(frameLen) + frameLen, memory_order_seq_cst);
+    if (hdr->readerWaiting.load(memory_order_seq_cst)) {
+      uint64_t one = 1;
+      ssize_t ignored = ::write(eventFd, &one, sizeof(one));
+      (void)ignored;
+    }
+
+    return true;
+  }
+
+  /**
+   * Pop one frame into 'frame'. Returns false if the ring is empty, or
+   * corrupt (see isCorrupt).
+   */
+  bool pop(vector<unsigned char> &frame) {
+    uint64_t r = hdr->readPos.load(memory_order_relaxed);
+    uint64_t w = hdr->writePos.load(memory_order_acquire);
+    if (r == w || corrupt) {
+      return false;
+    }
+
+    uint64_t used = w - r;
+    uint32_t frameLen;
+    if (used < sizeof(frameLen) || used > capacity) {
+      corrupt = true;
+      return false;
+    }
+    copyOut(r, &frameLen, sizeof(frameLen));
+    if (frameLen > maxFrameSize() || frameLen > used - sizeof(frameLen)) {
+      corrupt = true;
+      return false;
+    }
+    frame.resize(frameLen);
+    copyOut(r + sizeof(frameLen), frame.data(), frameLen);
+
+    hdr->readPos.store(r + sizeof(frameLen) + frameLen, memory_order_release);
+    return true;
+  }
+
+  // The other side broke the protocol; nothing more can be read or sent.
+  bool isCorrupt() const { return corrupt; }
+
+  bool empty() const {
+    return hdr->readPos.load(memory_order_relaxed) ==
+           hdr->writePos.load(memory_order_acquire);
+  }
+
+  /**
+   * Reader side, before sleeping on the eventfd. Returns false (and stays
+   * awake) if data arrived in the meantime.
+   */
+  bool prepareToWait() {
+    hdr->readerWaiting.store(1, memory_order_seq_cst);
+    if (!empty()) {
+      hdr->readerWaiting.store(0, memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  // Reader side, after waking up.
+  void finishWait() {
+    hdr->readerWaiting.store(0, memory_order_relaxed);
+    uint64_t count;
+    ssize_t ignored = ::read(eventFd, &count, sizeof(count)); // Non-blocking.
+    (void)ignored;
+  }
+
+  int getEventFd() const { return eventFd; }
+
+private:
+  ShmRingHeader *hdr = nullptr;
+  unsigned char *data = nullptr;
+  uint64_t capacity = 0;
+  int eventFd = -1;
+  bool corrupt = false;
+
+  void copyIn(uint64_t pos, const void *src, size_t len) {
+    size_t offset = pos & (capacity - 1);
+    size_t first = min<size_t>(len, capacity - offset);
+    memcpy(data + offset, src, first);
+    memcpy(data, static_cast<const unsigned char *>(src) + first, len - first);
+  }
+
+  void copyOut(uint64_t pos, void *dst, size_t len) const {
+    size_t offset = pos & (capacity - 1);
+    size_t first = min<size_t>(len, capacity - offset);
+    memcpy(dst, data + offset, first);
+    memcpy(static_cast<unsigned char *>(dst) + first, data, len - first);
+  }
+};
+
+// =======================================
+
+/**
+ * One end of a shared-memory connection: sends on one ring,
+ * receives on the other.
+ */
+class ShmChannel {
+public:
+  ShmChannel(const ShmChannel &) = delete;
+  ShmChannel &operator=(const ShmChannel &) = delete;
+
+  ~ShmChannel() {
+    if (segment != nullptr) {
+      munmap(segment, segmentSize);
+    }
+    for (int fd : {controlFd, toServerFd, toClientFd}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  /**
+   * Send a frame (ex. serialized Header + message).
+   * Returns false if the peer is behind and the ring is full.
+   */
+  bool send(const void *hdr, size_t hdrLen, const void *mssg,
+            size_t mssgLen) {
+    if (outRing.push(hdr, hdrLen, mssg, mssgLen)) {
+      return true;
+    }
+    if (outRing.isCorrupt()) {
+      hangUp();
+    }
+    return false;
+  }
+
+  /**
+   * Receive a frame without blocking. If the peer corrupted the ring, the
+   * channel is hung up (see hangUp).
+   */
+  bool receive(vector<unsigned char> &frame) {
+    if (inRing.pop(frame)) {
+      return true;
+    }
+    if (inRing.isCorrupt()) {
+      hangUp();
+    }
+    return false;
+  }
+
+  /**
+   * Close the connection from this side (ex. the peer broke the protocol).
+   * Both sides then see a hang-up on the control socket, as if the other
+   * had gone.
+   */
+  void hangUp() {
+    if (!peerClosed) {
+      cerr << "ShmChannel hanging up on its peer." << endl;
+    }
+    peerClosed = true;
+    shutdown(controlFd, SHUT_RDWR);
+  }
+
+  /**
+   * Block until a frame arrives, the peer hangs up, or timeoutMs passes
+   * (negative = no timeout). Returns true if a frame may be ready.
+   */
+  bool waitForFrame(int timeoutMs) {
+    if (!inRing.prepareToWait()) {
+      return true;
+    }
+
+    struct pollfd pfds[2];
+    pfds[0] = {inRing.getEventFd(), POLLIN, 0};
+    pfds[1] = {controlFd, POLLIN, 0};
+    int ready = poll(pfds, 2, timeoutMs);
+    inRing.finishWait();
+
+    if (pfds[1].revents & (POLLHUP | POLLERR | POLLIN)) {
+      peerClosed = true;
+    }
+    return ready > 0 && !inRing.empty();
+  }
+
+  bool isPeerClosed() const { return peerClosed; }
+
+  // For a reader polling several channels at once.
+  int getReceiveEventFd() const { return inRing.getEventFd(); }
+  int getControlFd() const { return controlFd; }
+  bool prepareToWait() { return inRing.prepareToWait(); }
+  void finishWait() { inRing.finishWait(); }
+  void markPeerClosed() { peerClosed = true; }
+
+  size_t maxFrameSize() const { return outRing.maxFrameSize(); }
+
+private:
+  friend class ShmListener;
+  friend unique_ptr<ShmChannel> connectSharedMemory(const string &name);
+
+  void *segment = nullptr;
+  size_t segmentSize = 0;
+  int controlFd = -1;  // Unix socket; hang-up = peer gone.
+  int toServerFd = -1; // eventfd for the client->server ring.
+  int toClientFd = -1; // eventfd for the server->client ring.
+  ShmRing inRing;
+  ShmRing outRing;
+  // Atomic: A server's write thread can hang up (see sendShmFrame) while
+  // its read thread polls.
+  atomic<bool> peerClosed{false};
+
+  ShmChannel() = default;
+
+  // Both rings, back to back, in one segment.
+  bool map(int memFd, uint64_t capacity, bool isServer, bool initRings) {
+    segmentSize = 2 * ShmRing::bytesNeeded(capacity);
+    segment = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   memFd, 0);
+    if (segment == MAP_FAILED) {
+      segment = nullptr;
+      cerr << "ShmChannel failed to map segment: " << strerror(errno) << endl;
+      return false;
+    }
+
+    unsigned char *base = static_cast<unsigned char *>(segment);
+    ShmRing toServer(base, toServerFd, capacity);
+    ShmRing toClient(base + ShmRing::bytesNeeded(capacity), toClientFd,
+                     capacity);
+
+    if (initRings) {
+      toServer.init();
+      toClient.init();
+    }
+
+    inRing = isServer ? toServer : toClient;
+    outRing = isServer ? toClient : toServer;
+    return true;
+  }
+};
+
+// =======================================
+
+// Abstract-namespace Unix socket address (no file left behind).
+inline socklen_t shmControlAddr(const string &name, struct sockaddr_un &addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  string path = "zomboid-shm-" + name;
+  size_t len = min(path.size(), sizeof(addr.sun_path) - 2);
+  memcpy(addr.sun_path + 1, path.data(), len); // sun_path[0] = '\0'
+  return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+/**
+ * Server side: Accepts local processes and hands each a new segment.
+ */
+class ShmListener {
+public:
+  static constexpr uint64_t DEFAULT_RING_BYTES = 1 << 20;
+  static constexpr size_t DEFAULT_MAX_CHANNELS = 64;
+
+  ~ShmListener() {
+    if (listenFd >= 0) {
+      close(listenFd);
+    }
+  }
+
+  bool listen(const string &name, uint64_t ringBytes = DEFAULT_RING_BYTES) {
+    if (ringBytes == 0 || (ringBytes & (ringBytes - 1)) != 0) {
+      cerr << "ShmListener ring size must be a power of 2." << endl;
+      return false;
+    }
+    this->ringBytes = ringBytes;
+
+    listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+      cerr << "ShmListener failed to create socket: " << strerror(errno)
+           << endl;
+      return false;
+    }
+
+    struct sockaddr_un addr;
+    socklen_t addrLen = shmControlAddr(name, addr);
+    if (::bind(listenFd, (struct sockaddr *)&addr, addrLen) < 0 ||
+        ::listen(listenFd, SOMAXCONN) < 0) {
+      cerr << "ShmListener failed to listen on '" << name << "': ("
+           << errno << ") " << strerror(errno) << endl;
+      close(listenFd);
+      listenFd = -1;
+      return false;
+    }
+
+    return true;
+  }
+
+  int getListenFd() const { return listenFd; }
+
+  // Also accept processes running as uid (the server's own always are).
+  void allowUid(uid_t uid) { allowedUids.push_back(uid); }
+
+  void setMaxChannels(size_t maxChannels) { this->maxChannels = maxChannels; }
+
+  /**
+   * Blocks until a local process connects (poll getListenFd() to avoid it).
+   * openChannels: How many of this listener's channels are still open.
+   * Returns nullptr (and hangs up) if the peer isn't an allowed user, or
+   * there are already maxChannels open.
+   */
+  unique_ptr<ShmChannel> accept(size_t openChannels) {
+    int controlFd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (controlFd < 0) {
+      cerr << "ShmListener accept failed: " << strerror(errno) << endl;
+      return nullptr;
+    }
+
+    if (!isAllowedPeer(controlFd)) {
+      close(controlFd);
+      return nullptr;
+    }
+    if (openChannels >= maxChannels) {
+      cerr << "ShmListener refused a peer: " << maxChannels
+           << " channels already open." << endl;
+      close(controlFd);
+      return nullptr;
+    }
+
+    unique_ptr<ShmChannel> channel(new ShmChannel());
+    channel->controlFd = controlFd;
+
+    int memFd = memfd_create("zomboid-shm", MFD_CLOEXEC);
+    channel->toServerFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    channel->toClientFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    bool ok = memFd >= 0 && channel->toServerFd >= 0 &&
+              channel->toClientFd >= 0 &&
+              ftruncate(memFd, 2 * ShmRing::bytesNeeded(ringBytes)) == 0 &&
+              channel->map(memFd, ringBytes, true, true) &&
+              sendFds(controlFd, ringBytes,
+                      {memFd, channel->toServerFd, channel->toClientFd});
+
+    if (memFd >= 0) {
+      close(memFd); // The mappings keep the segment alive.
+    }
+
+    if (!ok) {
+      cerr << "ShmListener failed to set up segment: " << strerror(errno)
+           << endl;
+      return nullptr;
+    }
+    return channel;
+  }
+
+private:
+  int listenFd = -1;
+  uint64_t ringBytes = DEFAULT_RING_BYTES;
+  size_t maxChannels = DEFAULT_MAX_CHANNELS;
+  vector<uid_t> allowedUids;
+
+  bool isAllowedPeer(int controlFd) const {
+    struct ucred cred;
+    socklen_t credLen = sizeof(cred);
+    if (getsockopt(controlFd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) < 0) {
+      cerr << "ShmListener failed to read peer credentials: "
+           << strerror(errno) << endl;
+      return false;
+    }
+
+    if (cred.uid == geteuid() ||
+        find(allowedUids.begin(), allowedUids.end(), cred.uid) !=
+            allowedUids.end()) {
+      return true;
+    }
+    cerr << "ShmListener refused a peer running as uid " << cred.uid
+         << " (pid " << cred.pid << ")." << endl;
+    return false;
+  }
+
+  static bool sendFds(int sock, uint64_t ringBytes, vector<int> fds) {
+    struct iovec iov = {&ringBytes, sizeof(ringBytes)};
+    char control[CMSG_SPACE(3 * sizeof(int))] = {};
+
+    struct msghdr mh = {};
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds.data(), 3 * sizeof(int));
+
+    return sendmsg(sock, &mh, MSG_NOSIGNAL) == sizeof(ringBytes);
+  }
+};
+
+/**
+ * Client side: Connect to a server's ShmListener on the same host.
+ * Returns nullptr if no server is listening under that name, or it refused
+ * this process (see ShmListener::accept).
+ */
+inline unique_ptr<ShmChannel> connectSharedMemory(const string &name) {
+  int controlFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (controlFd < 0) {
+    cerr << "ShmChannel failed to create socket: " << strerror(errno) << endl;
+    return nullptr;
+  }
+
+  struct sockaddr_un addr;
+  socklen_t addrLen = shmControlAddr(name, addr);
+  if (connect(controlFd, (struct sockaddr *)&addr, addrLen) < 0) {
+    cerr << "ShmChannel failed to connect to '" << name << "': ("
+         << errno << ") " << strerror(errno) << endl;
+    close(controlFd);
+    return nullptr;
+  }
+
+  unique_ptr<ShmChannel> channel(new ShmChannel());
+  channel->controlFd = controlFd;
+
+  // Receive ring size + (memfd, toServer eventfd, toClient eventfd).
+  uint64_t ringBytes = 0;
+  struct iovec iov = {&ringBytes, sizeof(ringBytes)};
+  char control[CMSG_SPACE(3 * sizeof(int))] = {};
+
+  struct msghdr mh = {};
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = control;
+  mh.msg_controllen = sizeof(control);
+
+  ssize_t received = recvmsg(controlFd, &mh, MSG_CMSG_CLOEXEC);
+  if (received != sizeof(ringBytes)) {
+    // 0: The server hung up (ex. refused this user, or is full).
+    cerr << "ShmChannel handshake failed: "
+         << (received == 0 ? "server refused the connection" : strerror(errno))
+         << endl;
+    return nullptr;
+  }
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh);
+  if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+    cerr << "ShmChannel handshake did not include the segment." << endl;
+    return nullptr;
+  }
+
+  int fds[3];
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  channel->toServerFd = fds[1];
+  channel->toClientFd = fds[2];
+
+  if (ringBytes == 0 || (ringBytes & (ringBytes - 1)) != 0) {
+    cerr << "ShmChannel handshake sent a ring size that isn't a power of 2."
+         << endl;
+    close(fds[0]);
+    return nullptr;
+  }
+
+  bool mapped = channel->map(fds[0], ringBytes, false, false);
+  close(fds[0]);
+
+  return mapped ? std::move(channel) : nullptr;
+}
+
+#endif // SHAREDMEMORYTRANSPORT_H
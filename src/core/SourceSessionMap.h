@@ -0,0 +1,152 @@
+#ifndef SOURCESESSIONMAP_H
+#define SOURCESESSIONMAP_H
+
+/**
+ * Flat open-addressing map from a frame's source (the transport's sourceKey:
+ * a UDP address, a TCP connection, a shared-memory channel, ...) to the
+ * session registered on it.
+ *
+ * Filled during registration, so an incoming frame's sender is checked with
+ * one hash and a probe or two, without taking sessionMutex: a frame whose
+ * header senderID isn't the session bound to its source is spoofed (or
+ * unregistered), and is dropped.
+ *
+ * One writer (the server's read thread, where registration and disconnects
+ * happen), any number of lock-free readers. Fixed capacity, allocated up
+ * front; removal leaves a tombstone that a later insert reuses.
+ *
+ * Tombstones are never turned back into empty slots, so after enough joins
+ * and leaves a miss would find no empty slot to stop at. Instead, the
+ * writer keeps the longest distance any key was placed from its home slot
+ * (maxProbe), and lookups stop there: A miss (ex. a spoofed source) costs
+ * as much as the longest live cluster ever was, not the whole table.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+class SourceSessionMap {
+public:
+  static constexpr uint32_t NO_SESSION = 0; // 0 is reserved for the server.
+
+  SourceSessionMap(size_t minCapacity = 1 << 16) {
+    capacity = 16;
+    while (capacity < minCapacity) {
+      capacity <<= 1;
+    }
+    mask = capacity - 1;
+    slots = make_unique<Slot[]>(capacity);
+  }
+
+  // The session bound to sourceKey, or NO_SESSION.
+  uint32_t find(uint64_t sourceKey) const {
+    size_t index = home(sourceKey);
+    size_t limit = maxProbe.load(memory_order_acquire);
+
+    for (size_t probe = 0; probe <= limit; probe++) {
+      const Slot &slot = slots[(index + probe) & mask];
+      uint64_t key = slot.key.load(memory_order_acquire);
+
+      if (key == sourceKey) {
+        return slot.sessionID.load(memory_order_relaxed);
+      }
+      if (key == EMPTY) {
+        return NO_SESSION;
+      }
+    }
+    return NO_SESSION;
+  }
+
+  // Writer only. Binds (or rebinds) sourceKey. False if the map is full.
+  bool insert(uint64_t sourceKey, uint32_t sessionID) {
+    size_t index = home(sourceKey);
+    size_t limit = maxProbe.load(memory_order_relaxed);
+    Slot *reusable = nullptr;
+    size_t reusableProbe = 0;
+
+    // A bound key is within maxProbe of home; past that, only look for a
+    // free slot.
+    for (size_t probe = 0; probe < capacity; probe++) {
+      Slot &slot = slots[(index + probe) & mask];
+      uint64_t key = slot.key.load(memory_order_relaxed);
+
+      if (key == sourceKey) {
+        slot.sessionID.store(sessionID, memory_order_relaxed);
+        return true;
+      }
+      if ((key == TOMBSTONE || key == EMPTY) && !reusable) {
+        reusable = &slot;
+        reusableProbe = probe;
+      }
+      if (key == EMPTY || (reusable && probe >= limit)) {
+        break;
+      }
+    }
+
+    if (!reusable) {
+      return false;
+    }
+
+    // Readers must probe this far before they can see the key.
+    if (reusableProbe > limit) {
+      maxProbe.store(reusableProbe, memory_order_release);
+    }
+
+    // Value before key, so a reader that sees the key sees its session.
+    reusable->sessionID.store(sessionID, memory_order_relaxed);
+    reusable->key.store(sourceKey, memory_order_release);
+    size++;
+    return true;
+  }
+
+  // Writer only.
+  void erase(uint64_t sourceKey) {
+    size_t index = home(sourceKey);
+    size_t limit = maxProbe.load(memory_order_relaxed);
+
+    for (size_t probe = 0; probe <= limit; probe++) {
+      Slot &slot = slots[(index + probe) & mask];
+      uint64_t key = slot.key.load(memory_order_relaxed);
+
+      if (key == sourceKey) {
+        slot.sessionID.store(NO_SESSION, memory_order_relaxed);
+        slot.key.store(TOMBSTONE, memory_order_release);
+        size--;
+        return;
+      }
+      if (key == EMPTY) {
+        return;
+      }
+    }
+  }
+
+  size_t getSize() const { return size; }
+
+  // The most slots a lookup probes, minus one (see above).
+  size_t getMaxProbe() const { return maxProbe.load(memory_order_relaxed); }
+
+private:
+  // Never valid source keys.
+  static constexpr uint64_t EMPTY = UINT64_MAX;
+  static constexpr uint64_t TOMBSTONE = UINT64_MAX - 1;
+
+  struct Slot {
+    atomic<uint64_t> key{EMPTY};
+    atomic<uint32_t> sessionID{NO_SESSION};
+  };
+
+  unique_ptr<Slot[]> slots;
+  size_t capacity = 0;
+  size_t mask = 0;
+  size_t size = 0;
+  atomic<size_t> maxProbe{0}; // Only grows.
+
+  size_t home(uint64_t sourceKey) const {
+    return ((sourceKey * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+  }
+};
+
+#endif // SOURCESESSIONMAP_H
@@ -0,0 +1,114 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+/**
+ * Bounded lock-free queue between exactly two threads: one pushes, the other
+ * pops (ex. the client's network thread and the game loop).
+ *
+ * Slots are allocated up front and reused, so a slot's buffers (ex. a frame's
+ * vector) keep their capacity: fill one in place with prepare()/publish(),
+ * and read it in place with front()/pop(), and the steady state allocates
+ * nothing. Neither side ever waits: a full queue fails the push.
+ *
+ * Same scheme as ShmRing (see SharedMemoryTransport.h), with typed slots:
+ * Each side owns its index and only reads the other's, with acquire/release,
+ * and caches it so most calls don't touch the other side's cache line.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+using namespace std;
+
+template <typename T> class SpscQueue {
+public:
+  SpscQueue(size_t minCapacity = 1024) {
+    capacity = 2;
+    while (capacity < minCapacity) {
+      capacity <<= 1;
+    }
+    mask = capacity - 1;
+    slots = make_unique<T[]>(capacity);
+  }
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  // ---- Producer ----
+
+  // The next free slot to fill, or nullptr if full. Not visible until publish().
+  T *prepare() {
+    uint64_t w = writePos.load(memory_order_relaxed);
+    if (w - cachedReadPos == capacity) {
+      cachedReadPos = readPos.load(memory_order_acquire);
+      if (w - cachedReadPos == capacity) {
+        return nullptr;
+      }
+    }
+    return &slots[w & mask];
+  }
+
+  // Hands the slot from prepare() to the consumer.
+  void publish() {
+    writePos.store(writePos.load(memory_order_relaxed) + 1,
+                   memory_order_release);
+  }
+
+  bool tryPush(T &&item) {
+    T *slot = prepare();
+    if (!slot) {
+      return false;
+    }
+    *slot = std::move(item);
+    publish();
+    return true;
+  }
+
+  // ---- Consumer ----
+
+  // The oldest published slot, or nullptr if empty. Stays until pop().
+  T *front() {
+    uint64_t r = readPos.load(memory_order_relaxed);
+    if (r == cachedWritePos) {
+      cachedWritePos = writePos.load(memory_order_acquire);
+      if (r == cachedWritePos) {
+        return nullptr;
+      }
+    }
+    return &slots[r & mask];
+  }
+
+  // Releases the slot from front() back to the producer.
+  void pop() {
+    readPos.store(readPos.load(memory_order_relaxed) + 1,
+                  memory_order_release);
+  }
+
+  // ---- Either ----
+
+  // Approximate while the other side is running.
+  size_t size() const {
+    return writePos.load(memory_order_acquire) -
+           readPos.load(memory_order_acquire);
+  }
+
+  size_t getCapacity() const { return capacity; }
+
+private:
+  unique_ptr<T[]> slots;
+  size_t capacity = 0;
+  size_t mask = 0;
+
+  // Producer's line: its index, and its last look at the consumer's.
+  alignas(64) atomic<uint64_t> writePos{0};
+  uint64_t cachedReadPos = 0;
+
+  // Consumer's line.
+  alignas(64) atomic<uint64_t> readPos{0};
+  uint64_t cachedWritePos = 0;
+};
+
+#endif // SPSCQUEUE_H
@@ -4,12 +4,15 @@
 #include <arpa/inet.h> // inet_ntoa
 #include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #include <sys/ioctl.h> // For checking if socket actually has data
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/uio.h> // writev()
 #include <unistd.h>  // write()
 
+#include <cerrno>
 #include <cstdio>
 #include <cstring>
 #include <functional>
@@ -24,13 +27,20 @@ using namespace std;
 
 class TCP {
 public:
-  TCP(char *host_, char *port_);
-  virtual ~TCP();
+  TCP(char *host_, char *port_) : host(host_), port(port_) {}
+  // Over a socket made elsewhere (ex. a socketpair): No host or port.
+  TCP() = default;
+  virtual ~TCP() { closeConnection(); }
 
   // Server and Client share 'socket' and 'close' network calls,
   // but need different 'socket' implementations.
   virtual bool initSocket() = 0;
-  virtual void closeConnection() { close(this->sockfd); }
+  virtual void closeConnection() {
+    if (this->sfd >= 0) {
+      close(this->sfd);
+      this->sfd = -1;
+    }
+  }
 
   // https://linux.die.net/man/2/poll
   bool socketReadyToRead(int sfd) const {
@@ -65,7 +75,7 @@ public:
 
     int err = 0; // Check socket status:
     socklen_t len = sizeof(err);
-    if (getsockopt(sfd, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || err != 0) {
+    if (getsockopt(sfd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0) {
       return false;
     }
 
@@ -77,7 +87,7 @@ public:
       return false;
     }
 
-    if (!sfd_is_valid(sfd)) {
+    if (!sfdIsValid(sfd)) {
       cerr << "TCP writeTo: Cannot write to closed or invalid socket (sfd = "
            << sfd << ")." << endl;
       return false;
@@ -108,6 +118,141 @@ public:
     return false;
   }
 
+  /**
+   * Write a frame (ex. serialized Header, then message) with one
+   * sendmsg(), so it goes out without being copied into one buffer first.
+   * Resumes after partial writes. MSG_NOSIGNAL: A peer that hung up is an
+   * error, not a SIGPIPE.
+   */
+  bool writeFrame(int sfd, const void *part1, size_t len1, const void *part2,
+                  size_t len2) const {
+    struct iovec iov[2] = {{const_cast<void *>(part1), len1},
+                           {const_cast<void *>(part2), len2}};
+    int iovIdx = 0;
+    int iovCount = len2 > 0 ? 2 : 1;
+
+    while (iovIdx < iovCount) {
+      struct msghdr mh = {};
+      mh.msg_iov = iov + iovIdx;
+      mh.msg_iovlen = iovCount - iovIdx;
+      ssize_t written = sendmsg(sfd, &mh, MSG_NOSIGNAL);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        cerr << "TCP writeFrame error: (" << errno << "): " << strerror(errno)
+             << endl;
+        return false;
+      }
+
+      // Skip past what was written.
+      while (iovIdx < iovCount && size_t(written) >= iov[iovIdx].iov_len) {
+        written -= iov[iovIdx].iov_len;
+        iovIdx++;
+      }
+      if (iovIdx < iovCount) {
+        iov[iovIdx].iov_base = static_cast<char *>(iov[iovIdx].iov_base) + written;
+        iov[iovIdx].iov_len -= written;
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   * As much of a frame as a non-blocking sfd takes now (ex. 0 if its send
+   * buffer is full), or -1 on error (ex. the peer hung up).
+   */
+  ssize_t writeSome(int sfd, const void *part1, size_t len1,
+                    const void *part2, size_t len2) const {
+    struct iovec iov[2] = {{const_cast<void *>(part1), len1},
+                           {const_cast<void *>(part2), len2}};
+    struct msghdr mh = {};
+    mh.msg_iov = iov;
+    mh.msg_iovlen = len2 > 0 ? 2 : 1;
+
+    while (true) {
+      ssize_t written = sendmsg(sfd, &mh, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (written >= 0) {
+        return written;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+      }
+      if (errno != EINTR) {
+        return -1;
+      }
+    }
+  }
+
+  /**
+   * Write length bytes of file fd, from offset, with sendfile(): They go from
+   * the page cache to the socket without a copy through user space.
+   * Resumes after partial writes. sendfile() takes no MSG_NOSIGNAL, so
+   * SIGPIPE has to be ignored (see SocketServerTransport::open).
+   */
+  bool writeFile(int sfd, int fd, off_t offset, size_t length) const {
+    while (length > 0) {
+      ssize_t written = sendfile(sfd, fd, &offset, length);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        cerr << "TCP writeFile error: (" << errno << "): " << strerror(errno)
+             << endl;
+        return false;
+      }
+      if (written == 0) {
+        return false; // The file is shorter than length.
+      }
+      length -= written;
+    }
+
+    return true;
+  }
+
+  // writeFile on a non-blocking sfd: As much as it takes now, or -1.
+  ssize_t writeFileSome(int sfd, int fd, off_t offset, size_t length) const {
+    while (true) {
+      ssize_t written = sendfile(sfd, fd, &offset, length);
+      if (written >= 0) {
+        return written;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return 0;
+      }
+      if (errno != EINTR) {
+        return -1;
+      }
+    }
+  }
+
+  /**
+   * Read exactly bytesToRead into buf (no allocation).
+   * Returns false if the peer closed the connection or on error.
+   */
+  bool readExactly(int sfd, void *buf, size_t bytesToRead) const {
+    size_t totalRead = 0;
+
+    while (totalRead < bytesToRead) {
+      ssize_t bytesRead = recv(sfd, static_cast<char *>(buf) + totalRead,
+                               bytesToRead - totalRead, MSG_WAITALL);
+      if (bytesRead == 0) {
+        return false; // Peer closed.
+      } else if (bytesRead < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      totalRead += bytesRead;
+    }
+
+    return true;
+  }
+
+  int getSfd() const { return sfd; }
+
   char *readFrom(int sfd, size_t bytesToRead) const {
     char *mssg = new char[bytesToRead];
 
@@ -0,0 +1,262 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+/**
+ * Sampling per-message pipeline tracer.
+ *
+ * Every Nth incoming message is given a traceID, and each stage it passes
+ * through (socket read, header decode, dispatch, enqueue, dequeue, write)
+ * stamps a timestamp into a fixed-size lock-free ring. The ring can be dumped
+ * as Chrome/Perfetto trace JSON (chrome://tracing or ui.perfetto.dev).
+ *
+ * Messages created while a traced message is being handled (ex. a callback
+ * queueing a broadcast) inherit its traceID through the thread-local
+ * "current" trace, so a request can be followed to the write of its response.
+ *
+ * References:
+ * https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+ * https://en.wikipedia.org/wiki/Seqlock
+ */
+
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum class TraceStage : uint8_t {
+  SocketRead,   // Header bytes read off the socket.
+  HeaderDecode, // Header deserialized.
+  Dispatch,     // Observers notified (callbacks finished).
+  Enqueue,      // Response/broadcast queued for the write threads.
+  Dequeue,      // Write thread picked the message up.
+  SocketWrite   // write()/sendto() returned.
+};
+
+inline const char *traceStageName(TraceStage stage) {
+  switch (stage) {
+  case TraceStage::SocketRead:
+    return "SocketRead";
+  case TraceStage::HeaderDecode:
+    return "HeaderDecode";
+  case TraceStage::Dispatch:
+    return "Dispatch";
+  case TraceStage::Enqueue:
+    return "Enqueue";
+  case TraceStage::Dequeue:
+    return "Dequeue";
+  case TraceStage::SocketWrite:
+    return "SocketWrite";
+  }
+  return "Unknown";
+}
+
+class Tracer {
+public:
+  // Must be a power of 2 (index is masked, not mod'ed).
+  static constexpr size_t RING_SIZE = 1 << 16;
+
+  static Tracer &instance() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  /**
+   * Trace 1 in every 'everyN' messages. 0 disables tracing
+   * (stamps then cost a thread-local load and a branch).
+   */
+  void setSampleRate(uint32_t everyN) {
+    sampleEvery.store(everyN, memory_order_relaxed);
+  }
+
+  /**
+   * Called when a new incoming message is read.
+   * Returns a traceID if this message is sampled, or 0 if not,
+   * and makes it the calling thread's current trace.
+   */
+  uint64_t beginTrace() {
+    uint32_t everyN = sampleEvery.load(memory_order_relaxed);
+    uint64_t traceID = 0;
+
+    if (everyN > 0 &&
+        sampleCounter.fetch_add(1, memory_order_relaxed) % everyN == 0) {
+      traceID = nextTraceID.fetch_add(1, memory_order_relaxed);
+    }
+
+    currentTrace() = traceID;
+    return traceID;
+  }
+
+  void endTrace() { currentTrace() = 0; }
+
+  // Trace of the message being handled on this thread (0 if none).
+  static uint64_t &currentTrace() {
+    thread_local uint64_t traceID = 0;
+    return traceID;
+  }
+
+  void stamp(TraceStage stage) { stamp(currentTrace(), stage); }
+
+  /**
+   * Record that 'traceID' reached 'stage'. Lock-free; safe from any thread.
+   * When the ring wraps, the oldest stamps are overwritten (and a stamp
+   * whose slot another thread is still writing is dropped).
+   */
+  void stamp(uint64_t traceID, TraceStage stage) {
+    if (traceID == 0) {
+      return; // Not sampled.
+    }
+
+    uint64_t idx = head.fetch_add(1, memory_order_relaxed);
+    Slot &slot = ring[idx & (RING_SIZE - 1)];
+
+    // Seqlock: Odd sequence = slot is being written. A writer a whole ring
+    // behind can land on the same slot, so it's claimed (even -> odd), and
+    // the stamp dropped if another writer has it.
+    uint64_t seq = slot.seq.load(memory_order_relaxed);
+    if ((seq & 1) || !slot.seq.compare_exchange_strong(
+                         seq, seq + 1, memory_order_relaxed)) {
+      return;
+    }
+    atomic_thread_fence(memory_order_release);
+
+    slot.traceID.store(traceID, memory_order_relaxed);
+    slot.timestampNs.store(nowNs(), memory_order_relaxed);
+    slot.threadID.store(threadID(), memory_order_relaxed);
+    slot.stage.store(static_cast<uint8_t>(stage), memory_order_relaxed);
+
+    slot.seq.store(seq + 2, memory_order_release);
+  }
+
+  /**
+   * Write the ring's contents in Chrome trace event format.
+   * Each traced message is an async track (id = traceID), with one span
+   * per stage measured from the previous stage's stamp.
+   */
+  bool dumpChromeTrace(const string &path) const {
+    ofstream out(path);
+    if (!out) {
+      cerr << "Tracer failed to open '" << path << "' for writing." << endl;
+      return false;
+    }
+
+    // Group stamps by trace, in time order.
+    map<uint64_t, vector<Stamp>> traces;
+    for (const Stamp &s : snapshot()) {
+      traces[s.traceID].push_back(s);
+    }
+
+    out << "{\"traceEvents\":[";
+    bool first = true;
+
+    for (auto &[traceID, stamps] : traces) {
+      sort(stamps.begin(), stamps.end(),
+           [](const Stamp &a, const Stamp &b) {
+             return a.timestampNs < b.timestampNs;
+           });
+
+      for (size_t i = 1; i < stamps.size(); i++) {
+        const Stamp &from = stamps[i - 1];
+        const Stamp &to = stamps[i];
+        const char *name = traceStageName(static_cast<TraceStage>(to.stage));
+
+        // Chrome trace timestamps are in microseconds.
+        writeEvent(out, first, name, 'b', traceID, from.timestampNs,
+                   from.threadID);
+        writeEvent(out, first, name, 'e', traceID, to.timestampNs,
+                   to.threadID);
+      }
+    }
+
+    out << "],\"displayTimeUnit\":\"ns\"}" << endl;
+    return out.good();
+  }
+
+private:
+  struct Slot {
+    atomic<uint64_t> seq{0};
+    atomic<uint64_t> traceID{0};
+    atomic<uint64_t> timestampNs{0};
+    atomic<uint32_t> threadID{0};
+    atomic<uint8_t> stage{0};
+  };
+
+  struct Stamp {
+    uint64_t traceID;
+    uint64_t timestampNs;
+    uint32_t threadID;
+    uint8_t stage;
+  };
+
+  atomic<uint32_t> sampleEvery{0};
+  atomic<uint64_t> sampleCounter{0};
+  atomic<uint64_t> nextTraceID{1}; // 0 means "not traced".
+  atomic<uint64_t> head{0};
+  vector<Slot> ring = vector<Slot>(RING_SIZE);
+
+  Tracer() = default;
+
+  static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+  }
+
+  // The kernel's thread ID (as in top -H), which fits in 32 bits, unlike
+  // pthread_self()'s.
+  static uint32_t threadID() {
+    thread_local uint32_t id = static_cast<uint32_t>(gettid());
+    return id;
+  }
+
+  // Copy out every complete slot (slots mid-write are skipped).
+  vector<Stamp> snapshot() const {
+    vector<Stamp> stamps;
+    stamps.reserve(RING_SIZE);
+
+    for (const Slot &slot : ring) {
+      uint64_t before = slot.seq.load(memory_order_acquire);
+      if (before == 0 || (before & 1)) {
+        continue; // Never written, or being written.
+      }
+
+      Stamp s;
+      s.traceID = slot.traceID.load(memory_order_relaxed);
+      s.timestampNs = slot.timestampNs.load(memory_order_relaxed);
+      s.threadID = slot.threadID.load(memory_order_relaxed);
+      s.stage = slot.stage.load(memory_order_relaxed);
+
+      atomic_thread_fence(memory_order_acquire);
+      if (slot.seq.load(memory_order_relaxed) == before) {
+        stamps.push_back(s);
+      }
+    }
+
+    return stamps;
+  }
+
+  static void writeEvent(ofstream &out, bool &first, const char *name,
+                         char phase, uint64_t traceID, uint64_t timestampNs,
+                         uint32_t tid) {
+    if (!first) {
+      out << ",";
+    }
+    first = false;
+
+    out << "{\"name\":\"" << name << "\",\"cat\":\"pipeline\",\"ph\":\""
+        << phase << "\",\"id\":" << traceID << ",\"pid\":1,\"tid\":" << tid
+        << ",\"ts\":" << (timestampNs / 1000) << "." << setw(3)
+        << setfill('0') << (timestampNs % 1000) << "}";
+  }
+};
+
+#endif // TRACER_H
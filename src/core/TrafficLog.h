@@ -0,0 +1,340 @@
+#ifndef TRAFFICLOG_H
+#define TRAFFICLOG_H
+
+/**
+ * Record-and-replay of framed traffic.
+ *
+ * TrafficLogWriter appends every decoded Header + payload, with its arrival
+ * time and session, to an append-only memory-mapped binary log.
+ * TrafficLogReader maps a log back in, and replayTrafficLog(...) feeds its
+ * records to a handler at the captured pace (1x), N times faster, or as fast
+ * as possible, so real match traffic can be profiled without sockets.
+ *
+ * File layout (little-endian, host struct layout):
+ *   TrafficLogFileHeader
+ *   TrafficRecord, payload (padded to 8 bytes)
+ *   TrafficRecord, payload ...
+ *
+ * References:
+ * https://man7.org/linux/man-pages/man2/mmap.2.html
+ * https://man7.org/linux/man-pages/man2/mremap.2.html
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "events.h"
+
+using namespace std;
+
+enum class TrafficTransport : uint8_t { TCP = 'T', UDP = 'U' };
+
+struct TrafficLogFileHeader {
+  char magic[8];         // "ZDTRAFIC"
+  uint32_t version;      // TRAFFIC_LOG_VERSION
+  uint32_t reserved;     //
+  uint64_t dataEnd;      // Offset one past the last complete record.
+  uint64_t startEpochNs; // Wall-clock time capture started (for reference).
+};
+
+struct TrafficRecord {
+  uint64_t arrivalNs; // Monotonic arrival time.
+  uint32_t sessionID; // Session the message was read for.
+  uint32_t senderID;  // Header senderID.
+  uint32_t mssgLength;
+  EventCode mssgType;
+  TrafficTransport transport;
+  uint16_t reserved;
+};
+
+static const char TRAFFIC_LOG_MAGIC[8] = {'Z', 'D', 'T', 'R',
+                                          'A', 'F', 'I', 'C'};
+static const uint32_t TRAFFIC_LOG_VERSION = 1;
+
+// Records are kept 8-byte aligned so they can be read in place.
+inline size_t trafficRecordSize(uint32_t mssgLength) {
+  return (sizeof(TrafficRecord) + mssgLength + 7) & ~size_t(7);
+}
+
+inline uint64_t trafficNowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+}
+
+// =======================================
+
+class TrafficLogWriter {
+public:
+  // The mapping grows by this much when full.
+  static constexpr size_t GROW_BYTES = 64 << 20;
+
+  TrafficLogWriter() = default;
+  TrafficLogWriter(const TrafficLogWriter &) = delete;
+  TrafficLogWriter &operator=(const TrafficLogWriter &) = delete;
+
+  ~TrafficLogWriter() { close(); }
+
+  bool open(const string &path) {
+    close();
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      cerr << "TrafficLog failed to open '" << path << "': (" << errno << ") "
+           << strerror(errno) << "." << endl;
+      return false;
+    }
+
+    if (!mapSize(GROW_BYTES)) {
+      close();
+      return false;
+    }
+
+    TrafficLogFileHeader *fileHdr = fileHeader();
+    memcpy(fileHdr->magic, TRAFFIC_LOG_MAGIC, sizeof(fileHdr->magic));
+    fileHdr->version = TRAFFIC_LOG_VERSION;
+    fileHdr->reserved = 0;
+    fileHdr->startEpochNs =
+        chrono::duration_cast<chrono::nanoseconds>(
+            chrono::system_clock::now().time_since_epoch())
+            .count();
+    fileHdr->dataEnd = sizeof(TrafficLogFileHeader);
+    writeOffset = sizeof(TrafficLogFileHeader);
+
+    return true;
+  }
+
+  bool isOpen() const { return base != nullptr; }
+
+  /**
+   * Append one message. Safe to call from the TCP and UDP read threads.
+   */
+  bool append(TrafficTransport transport, uint32_t sessionID,
+              uint32_t senderID, EventCode mssgType, const void *payload,
+              uint32_t mssgLength) {
+    uint64_t arrivalNs = trafficNowNs();
+    size_t recordSize = trafficRecordSize(mssgLength);
+
+    lock_guard<mutex> lock(writeMutex);
+    if (base == nullptr) {
+      return false;
+    }
+
+    if (writeOffset + recordSize > mappedSize &&
+        !mapSize(max(mappedSize + GROW_BYTES, writeOffset + recordSize))) {
+      return false;
+    }
+
+    unsigned char *dst = static_cast<unsigned char *>(base) + writeOffset;
+
+    TrafficRecord rec;
+    rec.arrivalNs = arrivalNs;
+    rec.sessionID = sessionID;
+    rec.senderID = senderID;
+    rec.mssgLength = mssgLength;
+    rec.mssgType = mssgType;
+    rec.transport = transport;
+    rec.reserved = 0;
+
+    memcpy(dst, &rec, sizeof(rec));
+    if (mssgLength > 0) {
+      memcpy(dst + sizeof(rec), payload, mssgLength);
+    }
+
+    writeOffset += recordSize;
+
+    // Publish last, so a reader of a live log never sees a partial record.
+    __atomic_store_n(&fileHeader()->dataEnd, writeOffset, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // Trims the file to the data written and unmaps it.
+  void close() {
+    lock_guard<mutex> lock(writeMutex);
+
+    if (base != nullptr) {
+      munmap(base, mappedSize);
+      base = nullptr;
+      mappedSize = 0;
+    }
+
+    if (fd >= 0) {
+      if (ftruncate(fd, writeOffset) < 0) {
+        cerr << "TrafficLog failed to trim log: " << strerror(errno) << endl;
+      }
+      ::close(fd);
+      fd = -1;
+    }
+  }
+
+private:
+  int fd = -1;
+  void *base = nullptr;
+  size_t mappedSize = 0;
+  size_t writeOffset = 0;
+  mutex writeMutex;
+
+  TrafficLogFileHeader *fileHeader() {
+    return static_cast<TrafficLogFileHeader *>(base);
+  }
+
+  // Grow the file, then the mapping (which may move).
+  bool mapSize(size_t newSize) {
+    if (ftruncate(fd, newSize) < 0) {
+      cerr << "TrafficLog failed to grow log: " << strerror(errno) << endl;
+      return false;
+    }
+
+    void *mapped =
+        base == nullptr
+            ? mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+            : mremap(base, mappedSize, newSize, MREMAP_MAYMOVE);
+
+    if (mapped == MAP_FAILED) {
+      cerr << "TrafficLog failed to map log: " << strerror(errno) << endl;
+      return false;
+    }
+
+    base = mapped;
+    mappedSize = newSize;
+    return true;
+  }
+};
+
+// =======================================
+
+class TrafficLogReader {
+public:
+  TrafficLogReader() = default;
+  TrafficLogReader(const TrafficLogReader &) = delete;
+  TrafficLogReader &operator=(const TrafficLogReader &) = delete;
+
+  ~TrafficLogReader() {
+    if (base != nullptr) {
+      munmap(base, mappedSize);
+    }
+  }
+
+  bool open(const string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      cerr << "TrafficLog failed to open '" << path << "': (" << errno << ") "
+           << strerror(errno) << "." << endl;
+      return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(TrafficLogFileHeader)) {
+      cerr << "TrafficLog '" << path << "' is too small to be a log." << endl;
+      ::close(fd);
+      return false;
+    }
+
+    mappedSize = st.st_size;
+    base = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // The mapping keeps the file open.
+
+    if (base == MAP_FAILED) {
+      cerr << "TrafficLog failed to map '" << path << "'." << endl;
+      base = nullptr;
+      return false;
+    }
+
+    const TrafficLogFileHeader *fileHdr = fileHeader();
+    if (memcmp(fileHdr->magic, TRAFFIC_LOG_MAGIC, sizeof(fileHdr->magic)) != 0 ||
+        fileHdr->version != TRAFFIC_LOG_VERSION) {
+      cerr << "TrafficLog '" << path << "' has an unknown format." << endl;
+      return false;
+    }
+
+    return true;
+  }
+
+  const TrafficLogFileHeader *fileHeader() const {
+    return static_cast<const TrafficLogFileHeader *>(base);
+  }
+
+  /**
+   * Calls onRecord(record, payload) for each record, in capture order.
+   * Stop early by returning false from onRecord.
+   */
+  template <typename RecordFunc> void forEach(RecordFunc onRecord) const {
+    if (base == nullptr) {
+      return;
+    }
+
+    const unsigned char *bytes = static_cast<const unsigned char *>(base);
+    size_t end = min<size_t>(
+        __atomic_load_n(&fileHeader()->dataEnd, __ATOMIC_ACQUIRE), mappedSize);
+    size_t offset = sizeof(TrafficLogFileHeader);
+
+    while (offset + sizeof(TrafficRecord) <= end) {
+      const TrafficRecord *rec =
+          reinterpret_cast<const TrafficRecord *>(bytes + offset);
+      size_t recordSize = trafficRecordSize(rec->mssgLength);
+
+      if (offset + recordSize > end) {
+        cerr << "TrafficLog: Truncated record at offset " << offset << "."
+             << endl;
+        return;
+      }
+
+      if (!onRecord(*rec, bytes + offset + sizeof(TrafficRecord))) {
+        return;
+      }
+      offset += recordSize;
+    }
+  }
+
+private:
+  void *base = nullptr;
+  size_t mappedSize = 0;
+};
+
+// =======================================
+
+/**
+ * Feed a log's records to onRecord(record, payload).
+ * speed: 1 = captured pace, N = N times faster, 0 = as fast as possible.
+ * Returns the number of records replayed.
+ */
+template <typename RecordFunc>
+uint64_t replayTrafficLog(const TrafficLogReader &log, double speed,
+                          RecordFunc onRecord) {
+  uint64_t replayed = 0;
+  uint64_t firstArrivalNs = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  log.forEach([&](const TrafficRecord &rec, const unsigned char *payload) {
+    if (replayed == 0) {
+      firstArrivalNs = rec.arrivalNs;
+    }
+
+    if (speed > 0) {
+      auto due = start + chrono::nanoseconds(static_cast<int64_t>(
+                             (rec.arrivalNs - firstArrivalNs) / speed));
+      this_thread::sleep_until(due);
+    }
+
+    onRecord(rec, payload);
+    replayed++;
+    return true;
+  });
+
+  return replayed;
+}
+
+#endif // TRAFFICLOG_H
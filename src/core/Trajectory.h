@@ -0,0 +1,487 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+/**
+ * Deterministic projectile flight, shared by the server and clients.
+ *
+ * A shot is sent once, as its spawn parameters (a Projectile mssg: spawn
+ * point, heading, speed, seed and the tick it was fired on), instead of a
+ * Coord2D per projectile per tick. The server and every client then fly it
+ * locally with the code below, which only uses integer math on 16.16
+ * fixed-point positions: the same spawn gives the same position at every
+ * tick on every machine, whatever its compiler or FPU.
+ *
+ * A shot can be several pellets (ex. a shotgun): each one's heading is
+ * picked within the spread from the seed, so the whole fan is one mssg too.
+ *
+ * The server steps its projectiles by its tick number, and checks them
+ * against its entities (collide). A client doesn't know the server's tick,
+ * so it flies each one from when it arrived: it starts from its spawn point
+ * then, in step with the shooter, who is also drawn a little in the past
+ * (see Interpolation.h). Hits are the server's call (ex. an Action); the
+ * client's flight is for drawing.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// What a Projectile mssg carries (see messages.h).
+struct ProjectileSpawn {
+  uint32_t objectID = 0; // The projectile's own.
+  uint32_t ownerID = 0;  // Who fired it. Its pellets never hit it.
+  uint32_t xCoord = 0;   // Spawn point.
+  uint32_t yCoord = 0;
+  uint16_t rotation = 0; // Heading in 1/65536 turns. 0: +x, 16384: +y.
+  uint16_t spread = 0;   // Pellets fly within +-spread of rotation.
+  uint32_t speed = 0;    // Units per tick, 16.16 fixed-point.
+  uint32_t seed = 0;     // Picks each pellet's heading within spread.
+  uint32_t spawnTick = 0;     // The room tick it was fired on.
+  uint16_t lifetimeTicks = 0; // Flies this many ticks, then expires.
+  uint16_t tickHz = 30;       // Ticks a second (the room's).
+  uint8_t pellets = 1;        // 1 to MAX_PELLETS.
+};
+
+// The server names every shot (objectID, ownerID). A client's own shot
+// flies under an objectID with this bit set until the server's copy
+// arrives; the server's are below it.
+static constexpr uint32_t PROVISIONAL_PROJECTILE_BIT = 1u << 31;
+
+/**
+ * sin over a quarter turn in 16.16 fixed-point, for Trajectory. Built at
+ * compile time from +, -, * and / only, which IEEE 754 rounds exactly, so
+ * every build gets the same table (std::sin can differ between C libraries).
+ */
+struct TrajectorySinTable {
+  static constexpr size_t STEPS = 1024; // Per quarter turn.
+
+  int32_t values[STEPS + 1] = {};
+
+  constexpr TrajectorySinTable() {
+    constexpr double HALF_PI = 1.57079632679489661923;
+    for (size_t i = 0; i <= STEPS; i++) {
+      double x = HALF_PI * double(i) / double(STEPS);
+      double term = x;
+      double sum = x;
+      for (int n = 1; n <= 10; n++) { // Taylor series.
+        term = -term * x * x / double((2 * n) * (2 * n + 1));
+        sum += term;
+      }
+      values[i] = int32_t(sum * 65536 + 0.5);
+    }
+  }
+};
+
+inline constexpr TrajectorySinTable trajectorySinTable{};
+
+/**
+ * One pellet's flight. Positions are 16.16 fixed-point; a straight line
+ * from the spawn point at a constant velocity per tick.
+ */
+class Trajectory {
+public:
+  static constexpr int FIXED_SHIFT = 16;
+  static constexpr int64_t FIXED_ONE = int64_t(1) << FIXED_SHIFT;
+
+  Trajectory(const ProjectileSpawn &spawn, uint8_t pellet = 0)
+      : heading(pelletHeading(spawn, pellet)),
+        xStart(int64_t(spawn.xCoord) << FIXED_SHIFT),
+        yStart(int64_t(spawn.yCoord) << FIXED_SHIFT),
+        xVelocity(int64_t(spawn.speed) * cosFixed(heading) >> FIXED_SHIFT),
+        yVelocity(int64_t(spawn.speed) * sinFixed(heading) >> FIXED_SHIFT) {}
+
+  uint16_t getHeading() const { return heading; }
+
+  // Fixed-point, after ticks in flight (0: The spawn point). Exact.
+  void positionAt(uint32_t ticks, int64_t &xFixed, int64_t &yFixed) const {
+    xFixed = xStart + xVelocity * int64_t(ticks);
+    yFixed = yStart + yVelocity * int64_t(ticks);
+  }
+
+  // In units, between ticks (ex. to draw it). Not exact.
+  void positionAt(double ticks, double &xCoord, double &yCoord) const {
+    xCoord = (double(xStart) + double(xVelocity) * ticks) / FIXED_ONE;
+    yCoord = (double(yStart) + double(yVelocity) * ticks) / FIXED_ONE;
+  }
+
+  // The pellet's heading: rotation, offset within +-spread by the seed.
+  static uint16_t pelletHeading(const ProjectileSpawn &spawn, uint8_t pellet) {
+    if (spawn.spread == 0) {
+      return spawn.rotation;
+    }
+    uint32_t range = 2 * uint32_t(spawn.spread) + 1;
+    int32_t offset = int32_t(mix(spawn.seed, pellet) % range) - spawn.spread;
+    return uint16_t(spawn.rotation + offset);
+  }
+
+  // sin and cos of a 1/65536-turn angle, times FIXED_ONE.
+  static int32_t sinFixed(uint16_t angle) {
+    uint16_t quarter = angle >> 14;
+    uint16_t within = angle & 0x3FFF;
+    int32_t value =
+        quarterSin((quarter & 1) ? uint16_t(0x4000 - within) : within);
+    return (quarter & 2) ? -value : value;
+  }
+
+  static int32_t cosFixed(uint16_t angle) {
+    return sinFixed(uint16_t(angle + 0x4000));
+  }
+
+private:
+  uint16_t heading;
+  int64_t xStart;
+  int64_t yStart;
+  int64_t xVelocity; // Per tick.
+  int64_t yVelocity;
+
+  // within: [0, 0x4000]. Linear between the table's steps.
+  static int32_t quarterSin(uint16_t within) {
+    const int32_t *table = trajectorySinTable.values;
+    uint32_t step = within >> 4;
+    int32_t frac = within & 0xF;
+    if (step == TrajectorySinTable::STEPS) {
+      return table[step];
+    }
+    int32_t low = table[step];
+    int32_t high = table[step + 1];
+    return low + (((high - low) * frac) >> 4);
+  }
+
+  // Hashes (seed, pellet) to a well-mixed 32 bits (murmur3's finalizer).
+  static uint32_t mix(uint32_t seed, uint32_t pellet) {
+    uint32_t h = seed ^ (pellet * 0x9E3779B9u);
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+  }
+};
+
+/**
+ * The path a pellet flew in one tick, from (ax, ay) by (dx, dy), as a
+ * capsule radius wide: An entity hits it if its position is within radius
+ * of the segment. t is how far along (0 to 1) the closest point is.
+ */
+struct PelletPath {
+  static constexpr float NONE = 2; // A t past the end: No hit yet.
+
+  float ax, ay;
+  float dx, dy;
+  float invLengthSq; // 0 if it didn't move: Tested as a point.
+  float radius;
+  float radiusSq;
+  uint32_t skipID; // Its owner.
+
+  PelletPath(float ax, float ay, float bx, float by, float radius,
+             uint32_t skipID)
+      : ax(ax), ay(ay), dx(bx - ax), dy(by - ay), radius(radius),
+        radiusSq(radius * radius), skipID(skipID) {
+    float lengthSq = dx * dx + dy * dy;
+    invLengthSq = lengthSq > 0 ? 1 / lengthSq : 0;
+  }
+};
+
+// Entity positions as parallel arrays (ex. an EntityStore's), searched
+// one by one.
+struct EntityArrays {
+  size_t count = 0;
+  const uint32_t *objectIDs = nullptr;
+  const float *xCoords = nullptr;
+  const float *yCoords = nullptr;
+
+  /**
+   * The entity closest to the start of path, if it's before t: Sets
+   * objectID and t, and returns true. Ties go to the lower objectID, so the
+   * order entities are searched in doesn't matter.
+   */
+  bool firstAlong(const PelletPath &path, uint32_t &objectID,
+                  float &t) const {
+    bool found = false;
+    for (size_t i = 0; i < count; i++) {
+      float px = xCoords[i] - path.ax;
+      float py = yCoords[i] - path.ay;
+      float along = (px * path.dx + py * path.dy) * path.invLengthSq;
+      along = min(max(along, 0.0f), 1.0f);
+      float ex = px - along * path.dx;
+      float ey = py - along * path.dy;
+
+      if (ex * ex + ey * ey <= path.radiusSq &&
+          isBefore(along, objectIDs[i], t, objectID) &&
+          objectIDs[i] != path.skipID) {
+        objectID = objectIDs[i];
+        t = along;
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  static bool isBefore(float along, uint32_t id, float t, uint32_t bestID) {
+    return along < t || (along == t && id < bestID);
+  }
+};
+
+struct ProjectilePosition {
+  uint32_t objectID = 0;
+  uint32_t ownerID = 0;
+  uint8_t pellet = 0;
+  double xCoord = 0;
+  double yCoord = 0;
+};
+
+struct ProjectileHit {
+  uint32_t objectID = 0; // The projectile.
+  uint8_t pellet = 0;
+  uint32_t targetID = 0;
+  uint32_t tick = 0;
+  double xCoord = 0; // Where the pellet was when it hit.
+  double yCoord = 0;
+};
+
+struct ProjectileStats {
+  uint64_t spawned = 0;
+  uint64_t duplicates = 0; // Already flying (ex. this client fired it).
+  uint64_t hits = 0;       // Pellets that hit something.
+  uint64_t expired = 0;    // Projectiles past their lifetime, or all hit.
+  size_t active = 0;
+};
+
+/**
+ * The projectiles in flight. Not thread-safe; a room's are only touched by
+ * its tick, and the client locks around its own.
+ *
+ * The server steps them by tick number (positionsAt, collide, expire);
+ * a client by steady_clock time since each was added (sampleAt, expireAt).
+ */
+class ProjectileSet {
+public:
+  static constexpr uint8_t MAX_PELLETS = 64;
+
+  /**
+   * False if objectID is already flying, or the spawn is invalid (no
+   * pellets, or too many). addedNs: When it arrived (clients only).
+   */
+  bool add(const ProjectileSpawn &spawn, int64_t addedNs = 0) {
+    if (spawn.pellets == 0 || spawn.pellets > MAX_PELLETS) {
+      return false;
+    }
+    if (indexOf.count(spawn.objectID) != 0) {
+      stats.duplicates++;
+      return false;
+    }
+
+    Flight flight;
+    flight.spawn = spawn;
+    flight.addedNs = addedNs;
+    flight.alive = spawn.pellets == MAX_PELLETS
+                       ? UINT64_MAX
+                       : (uint64_t(1) << spawn.pellets) - 1;
+    for (uint8_t p = 0; p < spawn.pellets; p++) {
+      flight.pellets.emplace_back(spawn, p);
+    }
+
+    indexOf.emplace(spawn.objectID, flights.size());
+    flights.push_back(std::move(flight));
+    stats.spawned++;
+    return true;
+  }
+
+  bool remove(uint32_t objectID) {
+    auto found = indexOf.find(objectID);
+    if (found == indexOf.end()) {
+      return false;
+    }
+    removeAt(found->second);
+    return true;
+  }
+
+  /**
+   * Give flight objectID the server's names for it (objectID, ownerID and
+   * spawnTick from spawn), ex. a client's own shot once the server's copy
+   * arrives. It keeps flying from when it was added. False if objectID
+   * isn't flying, or spawn.objectID already is.
+   */
+  bool rename(uint32_t objectID, const ProjectileSpawn &spawn) {
+    auto found = indexOf.find(objectID);
+    if (found == indexOf.end() || indexOf.count(spawn.objectID) != 0) {
+      return false;
+    }
+    size_t index = found->second;
+    indexOf.erase(found);
+    indexOf.emplace(spawn.objectID, index);
+
+    ProjectileSpawn &named = flights[index].spawn;
+    named.objectID = spawn.objectID;
+    named.ownerID = spawn.ownerID;
+    named.spawnTick = spawn.spawnTick;
+    return true;
+  }
+
+  size_t size() const { return flights.size(); }
+
+  // ---- Server: By tick number ----
+
+  // Every live pellet's position at tick, into out.
+  void positionsAt(uint32_t tick, vector<ProjectilePosition> &out) const {
+    out.clear();
+    for (const Flight &flight : flights) {
+      int32_t ticks = int32_t(tick - flight.spawn.spawnTick);
+      if (ticks < 0 || ticks > flight.spawn.lifetimeTicks) {
+        continue;
+      }
+      forEachAlive(flight, [&](uint8_t p) {
+        int64_t x, y;
+        flight.pellets[p].positionAt(uint32_t(ticks), x, y);
+        out.push_back({flight.spawn.objectID, flight.spawn.ownerID, p,
+                       double(x) / Trajectory::FIXED_ONE,
+                       double(y) / Trajectory::FIXED_ONE});
+      });
+    }
+  }
+
+  /**
+   * Pellets that hit an entity (within radius of the path a pellet flew
+   * from tick - 1 to tick) are stopped, and reported in out; each hits the
+   * first entity along its path. world finds it, with
+   *   bool firstAlong(const PelletPath &path, uint32_t &objectID,
+   *                   float &t) const
+   * (ex. EntityArrays below, or server/BroadPhase.h's SpatialHash).
+   * Returns the hit count.
+   */
+  template <typename World>
+  size_t collide(uint32_t tick, const World &world, float radius,
+                 vector<ProjectileHit> &out) {
+    out.clear();
+
+    for (Flight &flight : flights) {
+      int32_t ticks = int32_t(tick - flight.spawn.spawnTick);
+      if (ticks < 0 || ticks > flight.spawn.lifetimeTicks) {
+        continue;
+      }
+
+      forEachAlive(flight, [&](uint8_t p) {
+        double ax, ay, bx, by;
+        flight.pellets[p].positionAt(double(max(ticks - 1, 0)), ax, ay);
+        flight.pellets[p].positionAt(double(ticks), bx, by);
+        PelletPath path(float(ax), float(ay), float(bx), float(by), radius,
+                        flight.spawn.ownerID);
+
+        uint32_t targetID = 0;
+        float t = PelletPath::NONE;
+        if (world.firstAlong(path, targetID, t)) {
+          out.push_back({flight.spawn.objectID, p, targetID, tick,
+                         ax + t * (bx - ax), ay + t * (by - ay)});
+          flight.alive &= ~(uint64_t(1) << p);
+          stats.hits++;
+        }
+      });
+    }
+    return out.size();
+  }
+
+  // Against every one of count entities (ex. an EntityStore's arrays).
+  size_t collide(uint32_t tick, size_t count, const uint32_t *objectIDs,
+                 const float *xCoords, const float *yCoords, float radius,
+                 vector<ProjectileHit> &out) {
+    return collide(tick, EntityArrays{count, objectIDs, xCoords, yCoords},
+                   radius, out);
+  }
+
+  // Drops the ones past their lifetime at tick, or with every pellet hit.
+  size_t expire(uint32_t tick) {
+    return expireIf([&](const Flight &flight) {
+      return int32_t(tick - flight.spawn.spawnTick) >
+             int32_t(flight.spawn.lifetimeTicks);
+    });
+  }
+
+  // ---- Client: By time since add() ----
+
+  // Every live pellet's position at nowNs, between ticks, into out.
+  void sampleAt(int64_t nowNs, vector<ProjectilePosition> &out) const {
+    out.clear();
+    for (const Flight &flight : flights) {
+      double ticks = ticksSinceAdded(flight, nowNs);
+      if (ticks > flight.spawn.lifetimeTicks) {
+        continue;
+      }
+      forEachAlive(flight, [&](uint8_t p) {
+        ProjectilePosition position{flight.spawn.objectID,
+                                    flight.spawn.ownerID, p};
+        flight.pellets[p].positionAt(ticks, position.xCoord,
+                                     position.yCoord);
+        out.push_back(position);
+      });
+    }
+  }
+
+  size_t expireAt(int64_t nowNs) {
+    return expireIf([&](const Flight &flight) {
+      return ticksSinceAdded(flight, nowNs) > flight.spawn.lifetimeTicks;
+    });
+  }
+
+  ProjectileStats getStats() const {
+    ProjectileStats current = stats;
+    current.active = flights.size();
+    return current;
+  }
+
+private:
+  struct Flight {
+    ProjectileSpawn spawn;
+    int64_t addedNs = 0;
+    uint64_t alive = 0; // Bit per pellet not yet stopped by a hit.
+    vector<Trajectory> pellets;
+  };
+
+  vector<Flight> flights;
+  unordered_map<uint32_t, size_t> indexOf; // objectID to flights index.
+
+  ProjectileStats stats;
+
+  template <typename Fn> static void forEachAlive(const Flight &flight, Fn fn) {
+    for (uint8_t p = 0; p < flight.spawn.pellets; p++) {
+      if (flight.alive & (uint64_t(1) << p)) {
+        fn(p);
+      }
+    }
+  }
+
+  static double ticksSinceAdded(const Flight &flight, int64_t nowNs) {
+    double ticks = double(nowNs - flight.addedNs) * flight.spawn.tickHz / 1e9;
+    return ticks < 0 ? 0 : ticks;
+  }
+
+  template <typename Pred> size_t expireIf(Pred done) {
+    size_t expired = 0;
+    for (size_t i = 0; i < flights.size();) {
+      if (flights[i].alive == 0 || done(flights[i])) {
+        removeAt(i);
+        expired++;
+      } else {
+        i++;
+      }
+    }
+    stats.expired += expired;
+    return expired;
+  }
+
+  // The last flight moves into index.
+  void removeAt(size_t index) {
+    indexOf.erase(flights[index].spawn.objectID);
+    if (index != flights.size() - 1) {
+      flights[index] = std::move(flights.back());
+      indexOf[flights[index].spawn.objectID] = index;
+    }
+    flights.pop_back();
+  }
+};
+
+#endif // TRAJECTORY_H
@@ -0,0 +1,232 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+/**
+ * Transport policies for BasicServerNetworkAPI / BasicClientNetworkAPI.
+ *
+ * The network APIs are templates over their transport, so the
+ * read -> decode -> dispatch path compiles to direct (inlinable) calls for
+ * whichever transport is picked, with no virtual dispatch:
+ * - SocketServerTransport / SocketClientTransport: TCP + UDP
+ *   (+ shared memory for co-located processes on the server),
+ * - ShmClientTransport: shared memory only,
+ * - InMemoryServerTransport / InMemoryClientTransport: in-process loopback,
+ *   for running server logic in benchmarks without the kernel.
+ *
+ * A frame is a serialized Header followed by its message. A transport hands
+ * every frame it receives to its "sink" (the network API):
+ *   Server: sink.onConnect(peer), sink.onDisconnect(peer),
+ *           sink.onFrame(peer, frame, frameLen, delivery)
+ *   Client: sink.onDisconnect(), sink.onFrame(frame, frameLen, delivery)
+ */
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Compression.h"
+#include "SharedMemoryTransport.h"
+#include "messages.h"
+
+using namespace std;
+
+// What a message needs from the transport. Reliable = TCP-class (ordered,
+// never dropped), Unreliable = UDP-class (may be dropped or reordered).
+enum class Delivery : uint8_t { Reliable, Unreliable };
+
+// Largest frame a stream transport will accept before dropping the peer.
+static constexpr uint32_t MAX_FRAME_BYTES = 1 << 20;
+
+inline uint32_t frameMssgLength(const SerializedMessage &mssg) {
+  return deserialize<Header>(mssg.header).mssgLength;
+}
+
+/**
+ * A compressed frame: The Header, flagged HEADER_COMPRESSED with the
+ * mssgLength of what follows, then the message's own length (uint32_t) and
+ * its LZ block (see Compression.h). False, with out untouched, if it
+ * wouldn't be smaller.
+ */
+inline bool compressFrame(const SerializedMessage &mssg,
+                          vector<unsigned char> &out) {
+  Header hdr = deserialize<Header>(mssg.header);
+  size_t prefix = sizeof(Header) + sizeof(uint32_t);
+  if (hdr.mssgLength <= sizeof(uint32_t)) {
+    return false;
+  }
+
+  size_t capacity = hdr.mssgLength - sizeof(uint32_t) - 1;
+  out.resize(prefix + capacity);
+  size_t packed = lzCompress(mssg.message, hdr.mssgLength,
+                             out.data() + prefix, capacity);
+  if (packed == 0) {
+    return false;
+  }
+
+  uint32_t rawLength = hdr.mssgLength;
+  hdr.flags |= HEADER_COMPRESSED;
+  hdr.mssgLength = uint32_t(sizeof(uint32_t) + packed);
+  memcpy(out.data(), &hdr, sizeof(Header));
+  memcpy(out.data() + sizeof(Header), &rawLength, sizeof(rawLength));
+  out.resize(prefix + packed);
+  return true;
+}
+
+/**
+ * The frame compressFrame was given, into out. False if it's malformed,
+ * or would be over MAX_FRAME_BYTES.
+ */
+inline bool decompressFrame(const char *frame, size_t frameLen,
+                            vector<char> &out) {
+  Header hdr = deserialize<Header>(frame);
+  uint32_t rawLength;
+  if (frameLen < sizeof(Header) + sizeof(rawLength) ||
+      hdr.mssgLength < sizeof(rawLength) ||
+      frameLen < sizeof(Header) + hdr.mssgLength) {
+    return false;
+  }
+  memcpy(&rawLength, frame + sizeof(Header), sizeof(rawLength));
+  if (rawLength > MAX_FRAME_BYTES) {
+    return false;
+  }
+
+  out.resize(sizeof(Header) + rawLength);
+  const char *block = frame + sizeof(Header) + sizeof(rawLength);
+  if (!lzDecompress(reinterpret_cast<const uint8_t *>(block),
+                    hdr.mssgLength - sizeof(rawLength),
+                    reinterpret_cast<uint8_t *>(out.data()) + sizeof(Header),
+                    rawLength)) {
+    return false;
+  }
+
+  hdr.flags &= ~HEADER_COMPRESSED;
+  hdr.mssgLength = rawLength;
+  memcpy(out.data(), &hdr, sizeof(Header));
+  return true;
+}
+
+/**
+ * A reliable frame already serialized into a file (ex. a cached map chunk,
+ * see server/MapStream.h), so a transport can send it straight from the page
+ * cache (sendfile) instead of copying it through a SerializedMessage.
+ * data: The same bytes, mapped, for transports that can't.
+ */
+struct FileFrame {
+  int fd = -1;
+  off_t offset = 0;
+  uint32_t length = 0; // Header + message.
+  const unsigned char *data = nullptr;
+};
+
+/**
+ * Send a frame on a shared-memory channel. Reliable sends wait (briefly)
+ * for room in a full ring; unreliable ones are dropped, like UDP. A
+ * reliable frame that still doesn't fit (ex. the peer stopped reading)
+ * can't be dropped without breaking the stream, so the channel is hung up
+ * instead, like a TCP client over its pending limit.
+ */
+inline bool sendShmFrame(ShmChannel &channel, const void *header,
+                         const void *mssg, uint32_t mssgLength,
+                         Delivery delivery) {
+  static constexpr int SHM_RELIABLE_TIMEOUT_MS = 100;
+
+  auto deadline = chrono::steady_clock::now() +
+                  chrono::milliseconds(SHM_RELIABLE_TIMEOUT_MS);
+
+  while (!channel.send(header, sizeof(Header), mssg, mssgLength)) {
+    if (delivery == Delivery::Unreliable || channel.isPeerClosed()) {
+      return false;
+    }
+    if (sizeof(Header) + mssgLength > channel.maxFrameSize() ||
+        chrono::steady_clock::now() > deadline) {
+      cerr << "Reliable shared-memory frame of " << mssgLength
+           << " bytes didn't fit in the peer's ring." << endl;
+      channel.hangUp();
+      return false;
+    }
+    this_thread::yield();
+  }
+
+  return true;
+}
+
+inline bool sendShmFrame(ShmChannel &channel, const SerializedMessage &mssg,
+                         Delivery delivery) {
+  return sendShmFrame(channel, mssg.header, mssg.message,
+                      frameMssgLength(mssg), delivery);
+}
+
+// =======================================
+// Sinks the concepts below are checked against.
+
+template <typename Peer> struct ServerSinkArchetype {
+  void onConnect(const Peer &peer);
+  void onDisconnect(const Peer &peer);
+  void onFrame(const Peer &peer, const char *frame, size_t frameLen,
+               Delivery delivery);
+};
+
+struct ClientSinkArchetype {
+  void onDisconnect();
+  void onFrame(const char *frame, size_t frameLen, Delivery delivery);
+};
+
+// measureCapacity(peer) result for a link with no real limit.
+static constexpr uint64_t UNLIMITED_CAPACITY = UINT64_MAX;
+
+/**
+ * Server side:
+ * - Peer: Copyable handle to one client's channel(s).
+ * - open(): Start listening.
+ * - poll(timeoutMs, sink): Deliver what has arrived, waiting up to timeoutMs
+ *   (negative = no timeout). Returns the number of events delivered.
+ * - send(peer, mssg, delivery): Send one frame. Called from the write thread.
+ * - closePeer(peer): Drop a client.
+ * - bindUnreliable(sessionPeer, from): Attach the unreliable channel a
+ *   registering client sent from to its session.
+ * - sourceKey(from, delivery): Identifies the channel a frame came over
+ *   (ex. a UDP address). Sessions are looked up by it, so senderIDs can't be
+ *   spoofed; and floods are rate limited by it. Never UINT64_MAX - 1 or above.
+ * Optional:
+ * - measureCapacity(peer): Estimated bytes/sec the link to peer can carry,
+ *   0 if unknown, or UNLIMITED_CAPACITY. Sets the peer's send budget
+ *   (see SendScheduler).
+ * - sendFileFrame(peer, fileFrame): Send a FileFrame reliably without
+ *   copying it (otherwise, its mapped bytes go through send()).
+ */
+template <typename T>
+concept ServerTransport =
+    copy_constructible<typename T::Peer> &&
+    requires(T transport, const typename T::Peer &peer,
+             typename T::Peer &sessionPeer, const SerializedMessage &mssg,
+             ServerSinkArchetype<typename T::Peer> &sink) {
+      { transport.open() } -> same_as<bool>;
+      { transport.poll(0, sink) } -> convertible_to<size_t>;
+      { transport.send(peer, mssg, Delivery::Reliable) } -> same_as<bool>;
+      transport.closePeer(peer);
+      T::bindUnreliable(sessionPeer, peer);
+      { T::sourceKey(peer, Delivery::Reliable) } -> same_as<uint64_t>;
+    };
+
+/**
+ * Client side:
+ * - connect(): Open the channel(s) to the server.
+ * - poll(timeoutMs, sink): As for the server.
+ * - send(mssg, delivery): Send one frame.
+ */
+template <typename T>
+concept ClientTransport =
+    requires(T transport, const SerializedMessage &mssg,
+             ClientSinkArchetype &sink) {
+      { transport.connect() } -> same_as<bool>;
+      { transport.poll(0, sink) } -> convertible_to<size_t>;
+      { transport.send(mssg, Delivery::Reliable) } -> same_as<bool>;
+    };
+
+#endif // TRANSPORT_H
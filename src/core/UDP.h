@@ -5,6 +5,7 @@
 #include <bits/stdc++.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,129 +19,279 @@
 #include <cstring>
 #include <iostream>
 #include <string>
+#include <memory>
 #include <thread>
 
+#include "NetImpairment.h"
+
 using namespace std;
 
 class UDP {
 public:
-  UDP(char *host_, char *port_) host(host_), port(port_);
-  ~UDP();
+  UDP(char *host_, char *port_) : host(host_), port(port_) {}
+  ~UDP() { closeConnection(); }
 
-  void initSocket() {
+  /**
+   * Opens the socket, and resolves host:port (IPv4) into writeToAddr:
+   * The server's address for a client, or the one to bind for the server
+   * (any interface if host is null).
+   */
+  bool initSocket() {
     sfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sfd < 0) {
-      cerr << "UDP failed to init socket." << endl;
-      // @TODO: Error handling
+      cerr << "UDP failed to init socket: (" << errno << ") "
+           << strerror(errno) << "." << endl;
+      return false;
     }
 
     // Fill out server info
     memset(&writeToAddr, 0, sizeof(writeToAddr));
-    servaddr.sin_family = AF_UNSPEC; // IPv4 or IPv6
-    servaddr.sin_port = htons(port);
-    servaddr.sin_addr.s_addr = inet_addr(host);
-    socklen_t servaddr_len = sizeof(writeToAddr);
+    writeToAddr.sin_family = AF_INET;
+    writeToAddr.sin_port = htons(uint16_t(atoi(port)));
+    writeToAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (host != nullptr) {
+      struct addrinfo hints, *result = nullptr;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_DGRAM;
+
+      int status = getaddrinfo(host, port, &hints, &result);
+      if (status != 0) {
+        cerr << "UDP failed to resolve host '" << host << "': "
+             << gai_strerror(status) << "." << endl;
+        return false;
+      }
+      memcpy(&writeToAddr, result->ai_addr, sizeof(writeToAddr));
+      freeaddrinfo(result);
+    }
 
-    // make socket non-blocking?
+    return true;
   }
 
   // Only needed for server.
   // For client, it lets them use send() instead of sendto().
   void bindSocket() {
-    memset(&writeToAddr, 0, sizeof(writeToAddr));
-
     // Bind the socket with the server address
     if (bind(sfd, (const struct sockaddr *)&writeToAddr, sizeof(writeToAddr)) <
         0) {
       cerr << "UDP bind failed: (" << errno << ") " << strerror(errno) << "."
            << endl;
-      close(sfd);
+      closeConnection();
     }
   }
 
+  /**
+   * For a client: Fix the socket's peer to writeToAddr (the server), so the
+   * kernel drops datagrams from anyone else (ex. a spoofed Register).
+   */
+  bool connectSocket() {
+    if (::connect(sfd, (const struct sockaddr *)&writeToAddr,
+                  sizeof(writeToAddr)) < 0) {
+      cerr << "UDP connect failed: (" << errno << ") " << strerror(errno)
+           << "." << endl;
+      return false;
+    }
+    return true;
+  }
+
   // @TODO Could probably just make client bind and use the proper send()
   int write(const char *mssg, size_t mssgLen) {
-    if (!writeToAddr) {
+    if (writeToAddr.sin_port == 0) {
       cerr << "UDP cannot send to unitialized writeToAddr." << endl;
       return -1;
     }
 
-    int sendStatus =
-        sendto(sfd, mssg, mssgLen, 0, (const struct sockaddr *)&writeToAddr,
-               sizeof(writeToAddr));
+    int sendStatus = sendDatagram(writeToAddr, mssg, mssgLen);
     return sendStatus;
   }
 
-  int writeTo(struct sockaddr_in addr;, const char *mssg, size_t mssgLen) {
-    int sendStatus = sendto(sfd, mssg, mssgLen, 0,
-                            (const struct sockaddr *)&addr, sizeof(addr));
+  int writeTo(const struct sockaddr_in &addr, const char *mssg,
+              size_t mssgLen) {
+    int sendStatus = sendDatagram(addr, mssg, mssgLen);
     return sendStatus;
   }
 
+  // Caller deletes[] the mssg. nullptr if nothing was read.
   char *read(size_t bytesToRead) {
-    char[bytesToRead] mssg;
-    int recStatus =
-        recvfrom(sfd, mssg, bytesToRead, 0, &writeToAddr, sizeof(writeToAddr));
+    struct sockaddr_in addr;
+    return read(addr, bytesToRead);
   }
 
   /**
-   * Returns mssg, and fills out udpConn values
-   * with address of sender.
+   * Returns mssg (caller deletes[] it, nullptr if nothing was read),
+   * and fills out udpConn values with address of sender.
    *
    * Can help server track clients.
    */
-  char *read(struct sockaddr_in addr;, size_t bytesToRead) {
-    char mssg[bytesToRead];
-    int recStatus = recvfrom(sfd, mssg, bytesToRead, 0, &addr, sizeof(addr));
+  char *read(struct sockaddr_in &addr, size_t bytesToRead) {
+    char *mssg = new char[bytesToRead];
+    if (recvDatagram(mssg, bytesToRead, addr) < 0) {
+      delete[] mssg;
+      return nullptr;
+    }
     return mssg;
   }
 
   // Same as above, but returns udpConn and fills out message.
   sockaddr_in read(char *mssg, size_t bytesToRead) {
     struct sockaddr_in addr;
-    int recStatus = recvfrom(sfd, mssg, bytesToRead, 0, &addr, sizeof(addr));
+    recvDatagram(mssg, bytesToRead, addr);
     return addr;
   }
 
+  /**
+   * Run datagrams through an in-process impairment shim (delay, jitter,
+   * loss, duplication, reordering, bandwidth cap) for testing under
+   * internet-like conditions. Outbound applies to write/writeTo, inbound
+   * to reads. A default (disabled) ImpairmentConfig turns a direction off.
+   */
+  void setImpairment(const ImpairmentConfig &outbound,
+                     const ImpairmentConfig &inbound) {
+    outboundLink = outbound.enabled() ? make_unique<ImpairedLink>(outbound)
+                                      : nullptr;
+    inboundLink =
+        inbound.enabled() ? make_unique<ImpairedLink>(inbound) : nullptr;
+  }
+
+  /**
+   * Send outbound datagrams the shim was holding that are now due.
+   * Called from the write and poll loops; a no-op without a shim.
+   */
+  void pumpImpairment() {
+    if (outboundLink) {
+      outboundLink->deliverDue(
+          [&](const sockaddr_in &addr, const char *mssg, size_t mssgLen) {
+            sendto(sfd, mssg, mssgLen, 0, (const struct sockaddr *)&addr,
+                   sizeof(addr));
+          });
+    }
+  }
+
+  ImpairmentStats getOutboundImpairmentStats() const {
+    return outboundLink ? outboundLink->getStats() : ImpairmentStats{};
+  }
+
+  ImpairmentStats getInboundImpairmentStats() const {
+    return inboundLink ? inboundLink->getStats() : ImpairmentStats{};
+  }
+
   /**
    * Set timeout to negative for no timeout.
    */
   void pollForHeader(int timeout, void (*readHeaderCallback)(const char *),
                      size_t hdrLength) {
 
-    int ready;
-    char hdrBuffer[hdrLength];
-    ssize_t s;
-
     struct pollfd pfds[1];
     pfds[0].fd = sfd;
     pfds[0].events = POLLIN;
 
     while (true) {
-      int numBytes = poll(pfds, 1, timeout);
+      pumpImpairment();
+
+      // Wake up for datagrams the shim is holding back.
+      int pollTimeout = timeout;
+      if (inboundLink || outboundLink) {
+        int nextRelease = nextImpairmentRelease();
+        if (nextRelease >= 0 && (pollTimeout < 0 || nextRelease < pollTimeout)) {
+          pollTimeout = nextRelease;
+        }
+      }
+
+      int numBytes = poll(pfds, 1, pollTimeout);
+      if (numBytes == 0 && inboundLink &&
+          inboundLink->msUntilNextRelease() == 0) {
+        numBytes = 1; // A held-back datagram is now due.
+      }
 
       if (numBytes < 0) {
-        cerr << "UDP poll error for socket " << pfd.fd << "." << endl;
+        cerr << "UDP poll error for socket " << pfds[0].fd << "." << endl;
         // @TODO: Handle error.
 
       } else if (numBytes > 0) {
         char *header = read(hdrLength);
-        readHeaderCallback(header);
+        if (header != nullptr) {
+          readHeaderCallback(header);
+          delete[] header;
+        }
       }
     }
   }
 
-  void closeConnection() { close(this->sockfd); }
+  void closeConnection() {
+    if (sfd >= 0) {
+      close(sfd);
+      sfd = -1;
+    }
+  }
+
+  int getSfd() const { return sfd; }
 
 protected:
   const char *host;
   const char *port;
-  int sfd; // Socket is shared for ALL in/out communication.
+  int sfd = -1; // Socket is shared for ALL in/out communication.
 
   // For a client, this would be the server address.
-  struct sockaddr_in writeToAddr;
+  struct sockaddr_in writeToAddr = {};
 
   // Have NetworkAPI handle client storage
+
+  // Optional impairment shims (see setImpairment).
+  unique_ptr<ImpairedLink> outboundLink;
+  unique_ptr<ImpairedLink> inboundLink;
+
+public:
+  // Every datagram goes out through here, so the shim can hold it back.
+  int sendDatagram(const struct sockaddr_in &addr, const char *mssg,
+                   size_t mssgLen) {
+    if (outboundLink) {
+      outboundLink->submit(addr, mssg, mssgLen);
+      pumpImpairment();
+      return mssgLen; // Accepted by the shim, as the kernel would.
+    }
+
+    return sendto(sfd, mssg, mssgLen, 0, (const struct sockaddr *)&addr,
+                  sizeof(addr));
+  }
+
+  /**
+   * Every datagram comes in through here. With an inbound shim, whatever
+   * the kernel has queued is moved into the shim, and the next datagram
+   * that is due is returned (-1 with EAGAIN if none are due yet).
+   */
+  int recvDatagram(char *mssg, size_t bytesToRead, struct sockaddr_in &addr) {
+    socklen_t addrLen = sizeof(addr);
+
+    if (!inboundLink) {
+      return recvfrom(sfd, mssg, bytesToRead, 0, (struct sockaddr *)&addr,
+                      &addrLen);
+    }
+
+    char dgram[65536];
+    struct sockaddr_in from;
+    ssize_t len;
+    while ((len = recvfrom(sfd, dgram, sizeof(dgram), MSG_DONTWAIT,
+                           (struct sockaddr *)&from, &addrLen)) >= 0) {
+      inboundLink->submit(from, dgram, len);
+      addrLen = sizeof(from);
+    }
+
+    ssize_t received = inboundLink->receiveDue(mssg, bytesToRead, addr);
+    if (received < 0) {
+      errno = EAGAIN;
+    }
+    return received;
+  }
+
+  int nextImpairmentRelease() const {
+    int inMs = inboundLink ? inboundLink->msUntilNextRelease() : -1;
+    int outMs = outboundLink ? outboundLink->msUntilNextRelease() : -1;
+    if (inMs < 0 || outMs < 0) {
+      return max(inMs, outMs);
+    }
+    return min(inMs, outMs);
+  }
 };
 
 #endif // UDP_H
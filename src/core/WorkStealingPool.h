@@ -0,0 +1,198 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+/**
+ * Fixed-size thread pool where each worker has its own task deque.
+ *
+ * A worker takes its own tasks from the back (the newest, likely still in
+ * its cache), and when it runs out, steals from the front of another
+ * worker's deque (the oldest). So many short tasks (ex. room ticks, see
+ * server/Rooms.h) spread over every core without one shared queue that all
+ * threads contend on, and a worker stuck on a long task doesn't hold up the
+ * tasks queued behind it.
+ *
+ * Tasks submitted from a worker go to its own deque; from any other thread,
+ * round-robin over the workers. Idle workers sleep until there's work.
+ *
+ * Each deque has its own mutex rather than a lock-free (Chase-Lev) deque:
+ * tasks here are whole ticks, so the lock is never the bottleneck.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct WorkStealingStats {
+  size_t threads = 0;
+  uint64_t executed = 0;
+  uint64_t stolen = 0; // Executed by a worker other than the one queued on.
+  size_t queued = 0;   // Waiting now.
+};
+
+class WorkStealingPool {
+public:
+  // 0 threads: One per core.
+  WorkStealingPool(size_t threadCount = 0) {
+    if (threadCount == 0) {
+      threadCount = max(1u, thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threadCount; i++) {
+      workers.push_back(make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threadCount; i++) {
+      workers[i]->thread = std::thread(&WorkStealingPool::run, this, i);
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  // Runs what's already queued, then joins the workers.
+  ~WorkStealingPool() {
+    waitIdle();
+    {
+      lock_guard<mutex> lock(sleepMutex);
+      stopping = true;
+    }
+    sleepCV.notify_all();
+    for (auto &worker : workers) {
+      worker->thread.join();
+    }
+  }
+
+  void submit(function<void()> task) {
+    size_t target = currentWorker().pool == this
+                        ? currentWorker().index
+                        : nextWorker.fetch_add(1, memory_order_relaxed) %
+                              workers.size();
+
+    // Counted before it can be taken, so the counts never go below 0.
+    pending.fetch_add(1, memory_order_relaxed);
+    queued.fetch_add(1, memory_order_release);
+    {
+      lock_guard<mutex> lock(workers[target]->tasksMutex);
+      workers[target]->tasks.push_back(std::move(task));
+    }
+
+    // Taking the lock orders this with a worker about to sleep, so the
+    // wake up isn't lost.
+    { lock_guard<mutex> lock(sleepMutex); }
+    sleepCV.notify_one();
+  }
+
+  // Blocks until every submitted task has run. Not from a worker.
+  void waitIdle() {
+    unique_lock<mutex> lock(idleMutex);
+    idleCV.wait(lock, [&] { return pending.load(memory_order_acquire) == 0; });
+  }
+
+  size_t getThreadCount() const { return workers.size(); }
+
+  WorkStealingStats getStats() const {
+    WorkStealingStats stats;
+    stats.threads = workers.size();
+    stats.executed = executed.load(memory_order_relaxed);
+    stats.stolen = stolen.load(memory_order_relaxed);
+    stats.queued = queued.load(memory_order_relaxed);
+    return stats;
+  }
+
+private:
+  struct Worker {
+    mutex tasksMutex;
+    deque<function<void()>> tasks;
+    std::thread thread;
+  };
+
+  struct WorkerID {
+    const WorkStealingPool *pool = nullptr;
+    size_t index = 0;
+  };
+
+  vector<unique_ptr<Worker>> workers;
+  atomic<size_t> nextWorker{0};
+
+  atomic<size_t> queued{0};   // In a deque.
+  atomic<size_t> pending{0};  // In a deque, or running.
+  atomic<uint64_t> executed{0};
+  atomic<uint64_t> stolen{0};
+
+  mutex sleepMutex;
+  condition_variable sleepCV;
+  bool stopping = false;
+
+  mutex idleMutex;
+  condition_variable idleCV;
+
+  // Which pool (and worker) the calling thread belongs to, if any.
+  static WorkerID &currentWorker() {
+    static thread_local WorkerID id;
+    return id;
+  }
+
+  void run(size_t index) {
+    currentWorker() = {this, index};
+    function<void()> task;
+
+    while (true) {
+      if (popOwn(index, task) || steal(index, task)) {
+        queued.fetch_sub(1, memory_order_relaxed);
+        task();
+        task = nullptr;
+        executed.fetch_add(1, memory_order_relaxed);
+
+        if (pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+          { lock_guard<mutex> lock(idleMutex); }
+          idleCV.notify_all();
+        }
+        continue;
+      }
+
+      unique_lock<mutex> lock(sleepMutex);
+      sleepCV.wait(lock, [&] {
+        return stopping || queued.load(memory_order_acquire) > 0;
+      });
+      if (stopping && queued.load(memory_order_acquire) == 0) {
+        return;
+      }
+    }
+  }
+
+  bool popOwn(size_t index, function<void()> &task) {
+    Worker &worker = *workers[index];
+    lock_guard<mutex> lock(worker.tasksMutex);
+    if (worker.tasks.empty()) {
+      return false;
+    }
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+  }
+
+  // Starts at the next worker over, so thieves don't all pick the same one.
+  bool steal(size_t index, function<void()> &task) {
+    for (size_t i = 1; i < workers.size(); i++) {
+      Worker &victim = *workers[(index + i) % workers.size()];
+      lock_guard<mutex> lock(victim.tasksMutex);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        stolen.fetch_add(1, memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+#endif // WORKSTEALINGPOOL_H
@@ -9,7 +9,11 @@ enum class EventCode : uint8_t {
   Chat = 'C',         // Chat message
   Location = 'L',     // Location update (sent by server)
   Movement = 'M',     // Movement (send by clients)
-  Action = 'A'        // Action (e.g., attack, interact)
+  Action = 'A',       // Action (e.g., attack, interact)
+  Ping = 'T',         // RTT probe (sent by server, echoed by clients)
+  Request = 'Q',      // Request (e.g., join game), answered by Verification
+  Projectile = 'P',   // Projectile spawn (flown locally, see Trajectory.h)
+  MapChunk = 'K'      // A square of the map (sent by server, see MapStream.h)
 };
 
 #endif // EVENTS_H
\ No newline at end of file
@@ -1,8 +1,14 @@
+#include <algorithm>
+#include <bit>
 #include <cstdint>
 #include <cstring> // For memcpy
 #include <netinet/in.h>
+#include <string>
+#include <type_traits>
 #include <vector>
 
+#include "Tracer.h"
+#include "Trajectory.h"
 #include "events.h"
 
 using namespace std;
@@ -10,30 +16,171 @@ using namespace std;
 #ifndef MESSAGES_H
 #define MESSAGES_H
 
-/*
-template <typename mssgStruct>
-mssgStruct deserialize(unsigned char *message) {
-  struct mssgStruct *mssg = (struct mssgStruct *)message;
-  return mssg;
-}
-*/
+/**
+ * Wire format: A Header, sent as is (fixed layout, little-endian like every
+ * host this runs on), then the message, written field by field in
+ * little-endian order with no padding. Mssgs aren't memcpy'd: That would
+ * send their vtable pointer (see MessageProperties), padding, and a
+ * std::string's pointer instead of its text, and a receiver would read
+ * sizeof(struct) bytes from a frame that's shorter.
+ */
+static_assert(std::endian::native == std::endian::little,
+              "Headers are sent in host byte order.");
+
+// Writes fields at out; its owner sized the buffer (see size()).
+class WireWriter {
+public:
+  WireWriter(unsigned char *out) : pos(out) {}
+
+  void u8(uint8_t value) { *pos++ = value; }
+
+  void u16(uint16_t value) {
+    u8(uint8_t(value));
+    u8(uint8_t(value >> 8));
+  }
+
+  void u32(uint32_t value) {
+    u16(uint16_t(value));
+    u16(uint16_t(value >> 16));
+  }
+
+  void u64(uint64_t value) {
+    u32(uint32_t(value));
+    u32(uint32_t(value >> 32));
+  }
+
+  void bytes(const void *data, size_t length) {
+    if (length > 0) {
+      memcpy(pos, data, length);
+      pos += length;
+    }
+  }
+
+private:
+  unsigned char *pos;
+};
+
+/**
+ * Reads fields from length bytes. Reading past the end reads zeros and
+ * clears ok(), so a decode checks once, at the end.
+ */
+class WireReader {
+public:
+  WireReader(const unsigned char *in, size_t length)
+      : pos(in), end(in + length) {}
+
+  uint8_t u8() {
+    if (pos == end) {
+      valid = false;
+      return 0;
+    }
+    return *pos++;
+  }
+
+  uint16_t u16() {
+    uint16_t low = u8();
+    return uint16_t(low | (uint16_t(u8()) << 8));
+  }
+
+  uint32_t u32() {
+    uint32_t low = u16();
+    return low | (uint32_t(u16()) << 16);
+  }
+
+  uint64_t u64() {
+    uint64_t low = u32();
+    return low | (uint64_t(u32()) << 32);
+  }
+
+  void bytes(void *out, size_t length) {
+    if (remaining() < length) {
+      valid = false;
+      memset(out, 0, length);
+      pos = end;
+      return;
+    }
+    if (length > 0) {
+      memcpy(out, pos, length);
+      pos += length;
+    }
+  }
+
+  size_t remaining() const { return size_t(end - pos); }
+  bool ok() const { return valid; }
+
+private:
+  const unsigned char *pos;
+  const unsigned char *end;
+  bool valid = true;
+};
+
+struct MessageProperties;
 
 // Reference:
 // https://stackoverflow.com/questions/19201488/converting-struct-to-char-and-back
 
-template <typename mssgStruct> mssgStruct deserialize(unsigned char *message) {
+// A Header (or another fixed-layout struct sent as is).
+template <typename mssgStruct> mssgStruct deserialize(const void *message) {
+  static_assert(is_trivially_copyable_v<mssgStruct> &&
+                    !is_base_of_v<MessageProperties, mssgStruct>,
+                "Decode mssgs with deserialize(message, length, out).");
   mssgStruct mssg;
   std::memcpy(&mssg, message, sizeof(mssg));
   return mssg;
 }
 
+/**
+ * A mssg, from the length bytes that followed its Header. False if they
+ * aren't one (ex. a truncated or spoofed frame); out may be partly set.
+ */
+template <typename mssgStruct>
+bool deserialize(const void *message, size_t length, mssgStruct &out) {
+  WireReader in(static_cast<const unsigned char *>(message), length);
+  return out.decode(in) && in.ok();
+}
+
+// A mssg's wire form is size() bytes; a Header's is itself.
 template <typename mssgStruct>
 unsigned char *serialize(const mssgStruct &message) {
-  unsigned char *mssg = new unsigned char[sizeof(message)];
-  memcpy(mssg, &message, sizeof(message));
-  return mssg;
+  if constexpr (is_base_of_v<MessageProperties, mssgStruct>) {
+    unsigned char *mssg = new unsigned char[message.size()];
+    WireWriter out(mssg);
+    message.encode(out);
+    return mssg;
+  } else {
+    static_assert(is_trivially_copyable_v<mssgStruct>);
+    unsigned char *mssg = new unsigned char[sizeof(message)];
+    memcpy(mssg, &message, sizeof(message));
+    return mssg;
+  }
 }
 
+// Header flags.
+static constexpr uint8_t HEADER_COMPRESSED = 1; // See compressFrame.
+
+// MUST be the first part of any message.
+struct Header {
+  uint32_t senderID = 0;   // Or sessionID (32 bits)
+  EventCode mssgType{};    // Type of message (enum)
+  uint8_t flags = 0;       // HEADER_* bits (in what was padding)
+  uint16_t reserved = 0;   // Sent as 0, so no padding goes out uninitialized.
+  uint32_t mssgLength = 0; // Length of following message in bytes (32 bits)
+
+  Header() = default; // For deserialize.
+
+  Header(EventCode type, uint32_t id, uint32_t length)
+      : senderID(id), mssgType(type), mssgLength(length) {}
+
+  template <typename mssgStruct>
+  Header(uint32_t id, const mssgStruct &mssg)
+      : senderID(id), mssgType(mssg.getType()), mssgLength(mssg.size()) {}
+
+  // Headers are sent as is.
+  size_t getSerializedSize() const { return sizeof(Header); }
+};
+
+static_assert(sizeof(Header) == 12 && is_trivially_copyable_v<Header>);
+
 /**
  * Full message (Header + Message) stored in serialized form.
  * For handling de/serialization for reading/writing over the network.
@@ -42,6 +189,10 @@ struct SerializedMessage {
   unsigned char *header = nullptr;
   unsigned char *message = nullptr;
 
+  // Non-zero if this message is sampled by the Tracer. Not sent over the wire.
+  // Messages built while handling a traced message inherit its trace.
+  uint64_t traceID = Tracer::currentTrace();
+
   template <typename mssgStruct>
   SerializedMessage(uint32_t senderID, const mssgStruct &mssg) {
     Header hdrStruct = Header(senderID, mssg);
@@ -72,79 +223,210 @@ struct SerializedMessage {
     delete[] message;
   }
 
-  template <typename mssgStruct> mssgStruct getMessage() {
-    return deserialize(message);
+  // False if the message isn't a valid mssgStruct.
+  template <typename mssgStruct> bool getMessage(mssgStruct &out) const {
+    return deserialize(message, getHeader().mssgLength, out);
   }
 
-  Header getHeader() { return deserialize(header); }
+  Header getHeader() const { return deserialize<Header>(header); }
 
-  bool mssgTypeMatches() {
-    return (header.messageType == getDeserializedMessage().getType());
-  }
-};
-
-// MUST be the first part of any message.
-struct Header {
-  uint32_t senderID = 0;   // Or sessionID (32 bits)
-  EventCode mssgType;      // Type of message (enum)
-  uint32_t mssgLength = 0; // Length of following message in bytes (32 bits)
-
-  Header(EventCode type, uint32_t id, uint32_t length)
-      : mssgType(type), senderID(id), mssgLength(length) {}
-
-  template <typename mssgStruct>
-  Header(uint32_t id, const mssgStruct &mssg)
-      : mssgType(mssg.getType()), senderID(id), mssgLength(mssg.size()) {}
-
-  size_t getSerializedSize() const {
-    return sizeof(senderID) + sizeof(mssgLength) + messageType.size() + 1;
+  template <typename mssgStruct> bool mssgTypeMatches() const {
+    mssgStruct mssg;
+    return getMessage(mssg) && getHeader().mssgType == mssg.getType();
   }
 };
 
 // https://stackoverflow.com/questions/44261983/c-struct-implement-derived-interface
+// Every mssg also has bool decode(WireReader &), the inverse of encode.
 struct MessageProperties { // Struct Interface.
   virtual EventCode getType() const = 0;
-  virtual size_t size() const = 0; // Size of mssg in bytes.
+  virtual size_t size() const = 0; // Size of mssg on the wire, in bytes.
+  virtual void encode(WireWriter &out) const = 0; // Writes size() bytes.
 
   virtual ~MessageProperties() = default;
 };
 
-// @TODO
-// Track what the verification is for with requestIDs - Requires management
-// OR
-// append with the message that was verified - Network congestion
+// Answers the Request with the same requestID (0 = not for a request).
+// detail is optional text, such as a list ('\n' separated) or a reason.
+static constexpr size_t VERIFICATION_DETAIL_LENGTH = 256;
+
 struct Verification : public MessageProperties {
-  bool status;
+  uint32_t requestID = 0;
+  bool status = false;
+  char detail[VERIFICATION_DETAIL_LENGTH] = {};
+
+  Verification() = default;
 
   Verification(bool status) : status(status) {}
 
+  Verification(uint32_t requestID, bool status)
+      : requestID(requestID), status(status) {}
+
+  // Truncated to fit.
+  void setDetail(const string &text) {
+    size_t length = min(text.size(), VERIFICATION_DETAIL_LENGTH - 1);
+    memcpy(detail, text.data(), length);
+    detail[length] = '\0';
+  }
+
+  string getDetail() const { return string(detail, detailLength()); }
+
+  size_t detailLength() const {
+    return strnlen(detail, VERIFICATION_DETAIL_LENGTH - 1);
+  }
+
+  // requestID, status, then detail's length (1 byte) and its text, so a
+  // reply without one is 6 bytes, not 261.
+  static constexpr size_t MIN_WIRE_SIZE = 4 + 1 + 1;
+  static_assert(VERIFICATION_DETAIL_LENGTH - 1 <= UINT8_MAX);
+
   EventCode getType() const override { return EventCode::Verification; }
-  size_t size() const override { return sizeof(status); }
+  size_t size() const override { return MIN_WIRE_SIZE + detailLength(); }
+
+  void encode(WireWriter &out) const override {
+    size_t length = detailLength();
+    out.u32(requestID);
+    out.u8(status);
+    out.u8(uint8_t(length));
+    out.bytes(detail, length);
+  }
+
+  bool decode(WireReader &in) {
+    requestID = in.u32();
+    status = in.u8() != 0;
+    size_t length = in.u8(); // Fits, by the static_assert.
+    in.bytes(detail, length);
+    detail[length] = '\0';
+    return in.ok();
+  }
+};
+
+enum class RequestType : uint8_t {
+  JoinGame = 'J', // argument: Game name
+  GameList = 'G'  // Verification detail: Game names
+};
+
+static constexpr size_t REQUEST_ARGUMENT_LENGTH = 64;
+
+// Client -> server. Many may be in flight; each is answered by a
+// Verification carrying its requestID, in any order.
+struct Request : public MessageProperties {
+  uint32_t requestID = 0;
+  RequestType requestType = RequestType::GameList;
+  char argument[REQUEST_ARGUMENT_LENGTH] = {};
+
+  Request() = default; // For deserialize.
+
+  Request(uint32_t id, RequestType type, const string &arg = "")
+      : requestID(id), requestType(type) {
+    size_t length = min(arg.size(), REQUEST_ARGUMENT_LENGTH - 1);
+    memcpy(argument, arg.data(), length);
+  }
+
+  string getArgument() const { return string(argument, argumentLength()); }
+
+  size_t argumentLength() const {
+    return strnlen(argument, REQUEST_ARGUMENT_LENGTH - 1);
+  }
+
+  // requestID, requestType, then argument's length (1 byte) and its text.
+  static constexpr size_t MIN_WIRE_SIZE = 4 + 1 + 1;
+  static_assert(REQUEST_ARGUMENT_LENGTH - 1 <= UINT8_MAX);
+
+  EventCode getType() const override { return EventCode::Request; }
+  size_t size() const override { return MIN_WIRE_SIZE + argumentLength(); }
+
+  void encode(WireWriter &out) const override {
+    size_t length = argumentLength();
+    out.u32(requestID);
+    out.u8(static_cast<uint8_t>(requestType));
+    out.u8(uint8_t(length));
+    out.bytes(argument, length);
+  }
+
+  bool decode(WireReader &in) {
+    requestID = in.u32();
+    requestType = static_cast<RequestType>(in.u8());
+    size_t length = in.u8();
+    if (length >= REQUEST_ARGUMENT_LENGTH) {
+      return false;
+    }
+    in.bytes(argument, length);
+    argument[length] = '\0';
+    return in.ok();
+  }
 };
 
 struct ChatMessage : public MessageProperties {
   string message;
+
+  ChatMessage() = default; // For deserialize.
+
   ChatMessage(const std::string &mssg) { message = mssg; }
 
   EventCode getType() const override { return EventCode::Chat; }
   size_t size() const override { return message.length(); }
+
+  // The text, without a terminator: The Header has its length.
+  void encode(WireWriter &out) const override {
+    out.bytes(message.data(), message.length());
+  }
+
+  bool decode(WireReader &in) {
+    message.resize(in.remaining());
+    in.bytes(message.data(), message.size());
+    return in.ok();
+  }
 };
 
 struct Coord2D : public MessageProperties {
   // If A is responsible for sending B's coords,
   //  changing the header senderID can cause issues,
   // such as A spawning B, and B not being registered in the server.
-  uint32_t objectID;
-  uint32_t xCoord;
-  uint32_t yCoord;
+  uint32_t objectID = 0;
+  uint32_t xCoord = 0;
+  uint32_t yCoord = 0;
+
+  // Movement: The client's input sequence number (0 = none).
+  // Location: The seq of the last input the server processed for objectID,
+  // so its owner can reconcile its prediction (see Prediction.h).
+  uint32_t seq = 0;
+
+  // Movement from a client; the server's sends make it a Location.
+  EventCode mssgType = EventCode::Movement;
+
+  Coord2D() = default; // For deserialize.
+
+  Coord2D(uint32_t id, uint32_t x, uint32_t y, uint32_t seq = 0)
+      : objectID(id), xCoord(x), yCoord(y), seq(seq) {}
+
+  static constexpr size_t WIRE_SIZE = 4 * 4;
 
-  Coord2D(unit32_t id, uint32_t x, uint32_t y)
-      : objectID(id), xCoord(x), yCoord(y) {}
+  EventCode getType() const override { return mssgType; }
+  size_t size() const override { return WIRE_SIZE; }
 
-  EventCode getType() const override { return EventCode::Coord2D; }
-  size_t size() const override { return sizeof(xCoord) + sizeof(yCoord); }
+  // mssgType goes in the Header.
+  void encode(WireWriter &out) const override {
+    out.u32(objectID);
+    out.u32(xCoord);
+    out.u32(yCoord);
+    out.u32(seq);
+  }
+
+  bool decode(WireReader &in) {
+    objectID = in.u32();
+    xCoord = in.u32();
+    yCoord = in.u32();
+    seq = in.u32();
+    return in.ok();
+  }
 };
 
+// State mssgs: A newer one for the same objectID makes a queued one stale,
+// so only the latest needs sending (see CoalescingQueue).
+template <typename mssgStruct> inline constexpr bool latestWins = false;
+template <> inline constexpr bool latestWins<Coord2D> = true;
+
 struct Action : public MessageProperties {
   // If A spawned B, and B commited action on C,
   // it will be as if A commited on C. Deduce impactor from header.
@@ -152,20 +434,173 @@ struct Action : public MessageProperties {
   // If a client machine is in charge of a mob,
   // then it needs to registered the mob,
   // and use the mob's publicID for the header's sessionID.
-  uint8_t actionType;
-  uint32_t actionValue;
+  uint8_t actionType = 0;
+  uint32_t actionValue = 0;
   uint32_t impactedID = 0;
 
+  Action() = default; // For deserialize.
+
   Action(uint8_t actType, uint32_t actVal)
       : actionType(actType), actionValue(actVal) {}
 
   Action(uint8_t actType, uint32_t actVal, uint32_t idOfImpacted)
       : actionType(actType), actionValue(actVal), impactedID(idOfImpacted) {}
 
+  static constexpr size_t WIRE_SIZE = 1 + 4 + 4;
+
   EventCode getType() const override { return EventCode::Action; }
 
-  size_t size() const override {
-    return sizeof(actionType) + sizeof(actionValue) + sizeof(impactedID);
+  size_t size() const override { return WIRE_SIZE; }
+
+  void encode(WireWriter &out) const override {
+    out.u8(actionType);
+    out.u32(actionValue);
+    out.u32(impactedID);
+  }
+
+  bool decode(WireReader &in) {
+    actionType = in.u8();
+    actionValue = in.u32();
+    impactedID = in.u32();
+    return in.ok();
+  }
+};
+
+// One per shot, instead of a Coord2D per projectile per tick: The server and
+// clients fly it themselves from its spawn (see Trajectory.h).
+// Reliable, since there's no later update to make up for a lost one.
+struct Projectile : public MessageProperties {
+  ProjectileSpawn spawn;
+
+  Projectile() = default; // For deserialize.
+
+  Projectile(const ProjectileSpawn &spawn) : spawn(spawn) {}
+
+  static constexpr size_t WIRE_SIZE = 9 * 4 + 4 * 2 + 1;
+
+  EventCode getType() const override { return EventCode::Projectile; }
+  size_t size() const override { return WIRE_SIZE; }
+
+  void encode(WireWriter &out) const override {
+    out.u32(spawn.objectID);
+    out.u32(spawn.ownerID);
+    out.u32(spawn.xCoord);
+    out.u32(spawn.yCoord);
+    out.u16(spawn.rotation);
+    out.u16(spawn.spread);
+    out.u32(spawn.speed);
+    out.u32(spawn.seed);
+    out.u32(spawn.spawnTick);
+    out.u16(spawn.lifetimeTicks);
+    out.u16(spawn.tickHz);
+    out.u8(spawn.pellets);
+  }
+
+  bool decode(WireReader &in) {
+    spawn.objectID = in.u32();
+    spawn.ownerID = in.u32();
+    spawn.xCoord = in.u32();
+    spawn.yCoord = in.u32();
+    spawn.rotation = in.u16();
+    spawn.spread = in.u16();
+    spawn.speed = in.u32();
+    spawn.seed = in.u32();
+    spawn.spawnTick = in.u32();
+    spawn.lifetimeTicks = in.u16();
+    spawn.tickHz = in.u16();
+    spawn.pellets = in.u8();
+    return in.ok();
+  }
+};
+
+enum class ActionType : uint8_t {
+  ProjectileHit = 'H' // actionValue: The projectile's objectID
+};
+
+// A pellet hit (see ProjectileSet::collide), as an Action on its target.
+inline Action toAction(const ProjectileHit &hit) {
+  return Action(static_cast<uint8_t>(ActionType::ProjectileHit), hit.objectID,
+                hit.targetID);
+}
+
+static constexpr int32_t MAP_CHUNK_TILES = 32; // A chunk is 32x32 tiles.
+
+// Server -> client: A square of the map, sent once per client when it comes
+// near (see server/MapStream.h).
+struct MapChunk : public MessageProperties {
+  int32_t chunkX = 0; // In chunks.
+  int32_t chunkY = 0;
+  uint8_t tiles[MAP_CHUNK_TILES * MAP_CHUNK_TILES] = {}; // Row-major.
+
+  MapChunk() = default; // For deserialize.
+
+  MapChunk(int32_t chunkX, int32_t chunkY) : chunkX(chunkX), chunkY(chunkY) {}
+
+  static constexpr size_t WIRE_SIZE = 4 + 4 + sizeof(tiles);
+
+  EventCode getType() const override { return EventCode::MapChunk; }
+  size_t size() const override { return WIRE_SIZE; }
+
+  void encode(WireWriter &out) const override {
+    out.u32(uint32_t(chunkX));
+    out.u32(uint32_t(chunkY));
+    out.bytes(tiles, sizeof(tiles));
+  }
+
+  bool decode(WireReader &in) {
+    chunkX = int32_t(in.u32());
+    chunkY = int32_t(in.u32());
+    in.bytes(tiles, sizeof(tiles));
+    return in.ok();
+  }
+};
+
+// Congestion probe: The server sends it over UDP, and the client echoes it
+// back unchanged (see CongestionControl.h).
+struct Ping : public MessageProperties {
+  uint32_t seq = 0;
+
+  Ping() = default; // For deserialize.
+
+  Ping(uint32_t seq) : seq(seq) {}
+
+  static constexpr size_t WIRE_SIZE = 4;
+
+  EventCode getType() const override { return EventCode::Ping; }
+  size_t size() const override { return WIRE_SIZE; }
+
+  void encode(WireWriter &out) const override { out.u32(seq); }
+
+  bool decode(WireReader &in) {
+    seq = in.u32();
+    return in.ok();
+  }
+};
+
+/**
+ * The server's reply to a Register over the reliable channel (with the
+ * client's sessionID in its Header), and the client's UDP bind: It sends
+ * bindNonce back over the unreliable channel, so that address becomes its
+ * session's. The nonce is random, so only the client that registered can
+ * bind (a sessionID is easy to guess).
+ */
+struct Registration : public MessageProperties {
+  uint64_t bindNonce = 0;
+
+  Registration() = default; // For deserialize.
+
+  Registration(uint64_t bindNonce) : bindNonce(bindNonce) {}
+
+  static constexpr size_t WIRE_SIZE = 8;
+
+  EventCode getType() const override { return EventCode::Register; }
+  size_t size() const override { return WIRE_SIZE; }
+
+  void encode(WireWriter &out) const override { out.u64(bindNonce); }
+
+  bool decode(WireReader &in) {
+    bindNonce = in.u64();
+    return in.ok();
   }
 };
 
@@ -0,0 +1,315 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+/**
+ * Broad-phase for projectile hits: A spatial hash over a room's entities.
+ *
+ * Testing every pellet against every mob is pellets x mobs checks a tick
+ * (5M for 1k shots in a 5k mob room). Instead, entities are bucketed each
+ * tick by the grid cell they're in, and a pellet only tests the buckets of
+ * the cells its path (plus the hit radius) overlaps. Cells hash into a fixed
+ * number of buckets, so the world needs no bounds; two cells sharing a bucket
+ * only costs a few extra tests.
+ *
+ * build() copies the positions into bucket order, so each bucket's entities
+ * are contiguous, and the narrow-phase (a capsule, the pellet's path, against
+ * each entity's position; see core/Trajectory.h's PelletPath) tests 8 of
+ * them at once with AVX2, or 4 with SSE2, falling back to scalar code. Which
+ * one is chosen at compile time: x86-64 always has SSE2; AVX2 needs -mavx2
+ * (or -march=native).
+ *
+ * Use it as the world in ProjectileSet::collide():
+ *   room.grid.build(room.entities);
+ *   room.projectiles.collide(tick, room.grid, radius, hits);
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "../core/Trajectory.h"
+#include "EntityStore.h"
+
+using namespace std;
+
+struct SpatialHashStats {
+  uint64_t builds = 0;
+  uint64_t queries = 0;
+  uint64_t cellsVisited = 0;
+  uint64_t candidates = 0; // Entities tested by the narrow-phase.
+  uint64_t hits = 0;
+};
+
+// Not thread-safe; a room's is only touched by its tick.
+class SpatialHash {
+public:
+  // The narrow-phase this build uses: "avx2", "sse2" or "scalar".
+  static const char *simdName() {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+  }
+
+  /**
+   * cellSize: About the distance a pellet flies in a tick, or a bit more.
+   * buckets: Rounded up to a power of 2; more than the cells entities are
+   * usually spread over.
+   */
+  SpatialHash(float cellSize = 64, uint32_t buckets = 4096)
+      : cellSize(cellSize), invCellSize(1 / cellSize) {
+    uint32_t rounded = 1;
+    while (rounded < buckets) {
+      rounded <<= 1;
+    }
+    bucketMask = rounded - 1;
+  }
+
+  float getCellSize() const { return cellSize; }
+
+  // Scalar narrow-phase even if SIMD is available (ex. to compare them).
+  void setSimd(bool enabled) { simd = enabled; }
+
+  // Once per tick, after the entities moved.
+  void build(const EntityStore &entities) {
+    build(entities.size(), entities.objectIDs(), entities.xCoords(),
+          entities.yCoords());
+  }
+
+  void build(size_t count, const uint32_t *objectIDs, const float *xCoords,
+             const float *yCoords) {
+    size_t buckets = size_t(bucketMask) + 1;
+    bucketStart.assign(buckets + 1, 0);
+    bucketOf.resize(count);
+
+    // Counting sort by bucket.
+    for (size_t i = 0; i < count; i++) {
+      uint32_t bucket = bucketAt(cellOf(xCoords[i]), cellOf(yCoords[i]));
+      bucketOf[i] = bucket;
+      bucketStart[bucket + 1]++;
+    }
+    for (size_t b = 0; b < buckets; b++) {
+      bucketStart[b + 1] += bucketStart[b];
+    }
+
+    // Padded, so the narrow-phase can load a full vector at the end.
+    ids.assign(count + LANES, 0);
+    xs.assign(count + LANES, NAN);
+    ys.assign(count + LANES, NAN);
+    entityCount = count;
+    cursor.assign(bucketStart.begin(), bucketStart.end() - 1);
+    for (size_t i = 0; i < count; i++) {
+      uint32_t at = cursor[bucketOf[i]]++;
+      ids[at] = objectIDs[i];
+      xs[at] = xCoords[i];
+      ys[at] = yCoords[i];
+    }
+    stats.builds++;
+  }
+
+  /**
+   * As EntityArrays::firstAlong, over the entities in the cells path
+   * overlaps (as of the last build).
+   */
+  bool firstAlong(const PelletPath &path, uint32_t &objectID,
+                  float &t) const {
+    stats.queries++;
+
+    float bx = path.ax + path.dx;
+    float by = path.ay + path.dy;
+    int32_t x0 = cellOf(min(path.ax, bx) - path.radius);
+    int32_t x1 = cellOf(max(path.ax, bx) + path.radius);
+    int32_t y0 = cellOf(min(path.ay, by) - path.radius);
+    int32_t y1 = cellOf(max(path.ay, by) + path.radius);
+
+    // A path over more cells than there are buckets: Every bucket, once.
+    int64_t cells = (int64_t(x1) - x0 + 1) * (int64_t(y1) - y0 + 1);
+    if (cells > int64_t(bucketMask)) {
+      stats.cellsVisited += bucketMask + 1;
+      bool found = testRange(path, 0, entityCount, objectID, t);
+      stats.hits += found;
+      return found;
+    }
+
+    bool found = false;
+    for (int32_t cy = y0; cy <= y1; cy++) {
+      for (int32_t cx = x0; cx <= x1; cx++) {
+        uint32_t bucket = bucketAt(cx, cy);
+        found |= testRange(path, bucketStart[bucket],
+                           bucketStart[bucket + 1], objectID, t);
+      }
+    }
+    stats.cellsVisited += uint64_t(cells);
+    stats.hits += found;
+    return found;
+  }
+
+  SpatialHashStats getStats() const { return stats; }
+
+private:
+#if defined(__AVX2__)
+  static constexpr size_t LANES = 8;
+#elif defined(__SSE2__)
+  static constexpr size_t LANES = 4;
+#else
+  static constexpr size_t LANES = 1;
+#endif
+
+  float cellSize;
+  float invCellSize;
+  uint32_t bucketMask;
+  bool simd = true;
+
+  // Entities in bucket order: Bucket b is [bucketStart[b], bucketStart[b+1]).
+  // Then LANES of padding.
+  size_t entityCount = 0;
+  vector<uint32_t> bucketStart;
+  vector<uint32_t> ids;
+  vector<float> xs;
+  vector<float> ys;
+
+  // build() scratch.
+  vector<uint32_t> bucketOf;
+  vector<uint32_t> cursor;
+
+  mutable SpatialHashStats stats;
+
+  int32_t cellOf(float coord) const {
+    return int32_t(floor(coord * invCellSize));
+  }
+
+  // Teschner et al., "Optimized Spatial Hashing for Collision Detection".
+  uint32_t bucketAt(int32_t cx, int32_t cy) const {
+    return ((uint32_t(cx) * 73856093u) ^ (uint32_t(cy) * 19349663u)) &
+           bucketMask;
+  }
+
+  // The narrow-phase, over entities [begin, end).
+  bool testRange(const PelletPath &path, size_t begin, size_t end,
+                 uint32_t &objectID, float &t) const {
+    stats.candidates += end - begin;
+
+#if defined(__AVX2__)
+    if (simd) {
+      return testAVX2(path, begin, end, objectID, t);
+    }
+#elif defined(__SSE2__)
+    if (simd) {
+      return testSSE2(path, begin, end, objectID, t);
+    }
+#endif
+
+    EntityArrays range{end - begin, ids.data() + begin, xs.data() + begin,
+                       ys.data() + begin};
+    return range.firstAlong(path, objectID, t);
+  }
+
+  /**
+   * Lanes within radius are rare, so they're only extracted (and their
+   * owner and t checked) when the mask isn't empty. The last vector of a
+   * range runs past its end (into the next bucket, or the padding), so
+   * those lanes are masked off.
+   */
+  bool pickLane(const PelletPath &path, size_t base, int mask,
+                const float *along, uint32_t &objectID, float &t) const {
+    bool found = false;
+    while (mask != 0) {
+      int lane = __builtin_ctz(unsigned(mask));
+      mask &= mask - 1;
+      uint32_t id = ids[base + lane];
+      if (EntityArrays::isBefore(along[lane], id, t, objectID) &&
+          id != path.skipID) {
+        objectID = id;
+        t = along[lane];
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  // The lanes of a vector at most left lanes from the end.
+  static int laneMask(size_t left) {
+    return left >= LANES ? (1 << LANES) - 1 : (1 << left) - 1;
+  }
+
+#if defined(__AVX2__)
+  bool testAVX2(const PelletPath &path, size_t begin, size_t end,
+                uint32_t &objectID, float &t) const {
+    const __m256 ax = _mm256_set1_ps(path.ax);
+    const __m256 ay = _mm256_set1_ps(path.ay);
+    const __m256 dx = _mm256_set1_ps(path.dx);
+    const __m256 dy = _mm256_set1_ps(path.dy);
+    const __m256 invLengthSq = _mm256_set1_ps(path.invLengthSq);
+    const __m256 radiusSq = _mm256_set1_ps(path.radiusSq);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1);
+
+    bool found = false;
+    for (size_t i = begin; i < end; i += LANES) {
+      __m256 px = _mm256_sub_ps(_mm256_loadu_ps(&xs[i]), ax);
+      __m256 py = _mm256_sub_ps(_mm256_loadu_ps(&ys[i]), ay);
+      __m256 along = _mm256_mul_ps(
+          _mm256_add_ps(_mm256_mul_ps(px, dx), _mm256_mul_ps(py, dy)),
+          invLengthSq);
+      along = _mm256_min_ps(_mm256_max_ps(along, zero), one);
+      __m256 ex = _mm256_sub_ps(px, _mm256_mul_ps(along, dx));
+      __m256 ey = _mm256_sub_ps(py, _mm256_mul_ps(along, dy));
+      __m256 distSq =
+          _mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey));
+      int mask =
+          _mm256_movemask_ps(_mm256_cmp_ps(distSq, radiusSq, _CMP_LE_OQ)) &
+          laneMask(end - i);
+
+      if (mask != 0) {
+        alignas(32) float lanes[8];
+        _mm256_store_ps(lanes, along);
+        found |= pickLane(path, i, mask, lanes, objectID, t);
+      }
+    }
+    return found;
+  }
+#elif defined(__SSE2__)
+  bool testSSE2(const PelletPath &path, size_t begin, size_t end,
+                uint32_t &objectID, float &t) const {
+    const __m128 ax = _mm_set1_ps(path.ax);
+    const __m128 ay = _mm_set1_ps(path.ay);
+    const __m128 dx = _mm_set1_ps(path.dx);
+    const __m128 dy = _mm_set1_ps(path.dy);
+    const __m128 invLengthSq = _mm_set1_ps(path.invLengthSq);
+    const __m128 radiusSq = _mm_set1_ps(path.radiusSq);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1);
+
+    bool found = false;
+    for (size_t i = begin; i < end; i += LANES) {
+      __m128 px = _mm_sub_ps(_mm_loadu_ps(&xs[i]), ax);
+      __m128 py = _mm_sub_ps(_mm_loadu_ps(&ys[i]), ay);
+      __m128 along = _mm_mul_ps(
+          _mm_add_ps(_mm_mul_ps(px, dx), _mm_mul_ps(py, dy)), invLengthSq);
+      along = _mm_min_ps(_mm_max_ps(along, zero), one);
+      __m128 ex = _mm_sub_ps(px, _mm_mul_ps(along, dx));
+      __m128 ey = _mm_sub_ps(py, _mm_mul_ps(along, dy));
+      __m128 distSq = _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey));
+      int mask =
+          _mm_movemask_ps(_mm_cmple_ps(distSq, radiusSq)) & laneMask(end - i);
+
+      if (mask != 0) {
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, along);
+        found |= pickLane(path, i, mask, lanes, objectID, t);
+      }
+    }
+    return found;
+  }
+#endif
+};
+
+#endif // BROADPHASE_H
@@ -0,0 +1,329 @@
+#ifndef ENTITYSTORE_H
+#define ENTITYSTORE_H
+
+/**
+ * Server-side entity state (players, mobs) as a struct of arrays.
+ *
+ * Each field lives in its own dense array, indexed the same way: objectIDs,
+ * positions, velocities, the last input seq, the last action, and dirty
+ * flags. A pass over one field (ex. integrating positions, finding what
+ * changed for a snapshot, or which entities are near a player) streams
+ * through contiguous memory with no pointer chasing, and the loops below are
+ * written without branches so the compiler can vectorize them. GCC only does
+ * at -O3 (or -O2 -fvect-cost-model=dynamic); at plain -O2 they stay scalar:
+ * integrating 4096 entities took ~10us instead of 2-3us (see MicroBench's
+ * entities.*).
+ *
+ * Entities are referred to by EntityHandle, which stays valid until that
+ * entity is destroyed (and is detectably stale after). Dense indices don't:
+ * destroying an entity moves the last one into its place.
+ *
+ * Positions are floats so velocities can move an entity by less than a unit
+ * per tick; they're rounded into Coord2D's uint32_t coords when sent.
+ */
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+struct EntityHandle {
+  uint32_t slot = UINT32_MAX;
+  uint32_t generation = 0;
+
+  bool operator==(const EntityHandle &other) const {
+    return slot == other.slot && generation == other.generation;
+  }
+};
+
+// Dirty flags: What changed since the last clearDirty().
+enum EntityDirty : uint8_t {
+  DIRTY_POSITION = 1 << 0,
+  DIRTY_ACTION = 1 << 1,
+  DIRTY_ALL = 0xFF
+};
+
+// Not thread-safe; a room's entities are only touched by its tick.
+class EntityStore {
+public:
+  static constexpr EntityHandle NO_ENTITY{};
+
+  void reserve(size_t count) {
+    columns.objectIDs.reserve(count);
+    columns.xCoords.reserve(count);
+    columns.yCoords.reserve(count);
+    columns.xVelocities.reserve(count);
+    columns.yVelocities.reserve(count);
+    columns.seqs.reserve(count);
+    columns.dirty.reserve(count);
+    columns.actionTypes.reserve(count);
+    columns.actionValues.reserve(count);
+    columns.impactedIDs.reserve(count);
+    slotOf.reserve(count);
+  }
+
+  // A new entity, marked dirty. If objectID already has one, returns it.
+  EntityHandle create(uint32_t objectID, float xCoord, float yCoord) {
+    auto existing = byObjectID.find(objectID);
+    if (existing != byObjectID.end()) {
+      return existing->second;
+    }
+
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+      slot = freeSlots.back();
+      freeSlots.pop_back();
+    } else {
+      slot = uint32_t(slots.size());
+      slots.push_back({});
+    }
+
+    slots[slot].index = uint32_t(columns.objectIDs.size());
+    columns.objectIDs.push_back(objectID);
+    columns.xCoords.push_back(xCoord);
+    columns.yCoords.push_back(yCoord);
+    columns.xVelocities.push_back(0);
+    columns.yVelocities.push_back(0);
+    columns.seqs.push_back(0);
+    columns.dirty.push_back(DIRTY_POSITION);
+    columns.actionTypes.push_back(0);
+    columns.actionValues.push_back(0);
+    columns.impactedIDs.push_back(0);
+    slotOf.push_back(slot);
+
+    EntityHandle handle{slot, slots[slot].generation};
+    byObjectID.emplace(objectID, handle);
+    return handle;
+  }
+
+  // The last entity moves into its dense index.
+  bool destroy(EntityHandle handle) {
+    if (!isValid(handle)) {
+      return false;
+    }
+
+    uint32_t index = slots[handle.slot].index;
+    uint32_t last = uint32_t(columns.objectIDs.size() - 1);
+    byObjectID.erase(columns.objectIDs[index]);
+
+    if (index != last) {
+      columns.objectIDs[index] = columns.objectIDs[last];
+      columns.xCoords[index] = columns.xCoords[last];
+      columns.yCoords[index] = columns.yCoords[last];
+      columns.xVelocities[index] = columns.xVelocities[last];
+      columns.yVelocities[index] = columns.yVelocities[last];
+      columns.seqs[index] = columns.seqs[last];
+      columns.dirty[index] = columns.dirty[last];
+      columns.actionTypes[index] = columns.actionTypes[last];
+      columns.actionValues[index] = columns.actionValues[last];
+      columns.impactedIDs[index] = columns.impactedIDs[last];
+      slotOf[index] = slotOf[last];
+      slots[slotOf[index]].index = index;
+    }
+
+    columns.objectIDs.pop_back();
+    columns.xCoords.pop_back();
+    columns.yCoords.pop_back();
+    columns.xVelocities.pop_back();
+    columns.yVelocities.pop_back();
+    columns.seqs.pop_back();
+    columns.dirty.pop_back();
+    columns.actionTypes.pop_back();
+    columns.actionValues.pop_back();
+    columns.impactedIDs.pop_back();
+    slotOf.pop_back();
+
+    slots[handle.slot].generation++; // Outstanding handles go stale.
+    freeSlots.push_back(handle.slot);
+    return true;
+  }
+
+  bool isValid(EntityHandle handle) const {
+    // A destroyed entity's slot has moved on to the next generation.
+    return handle.slot < slots.size() &&
+           slots[handle.slot].generation == handle.generation;
+  }
+
+  // NO_ENTITY if objectID has none.
+  EntityHandle find(uint32_t objectID) const {
+    auto it = byObjectID.find(objectID);
+    return it == byObjectID.end() ? NO_ENTITY : it->second;
+  }
+
+  size_t size() const { return columns.objectIDs.size(); }
+  bool empty() const { return columns.objectIDs.empty(); }
+
+  void clear() {
+    for (EntityHandle handle : handles()) {
+      destroy(handle);
+    }
+  }
+
+  // Every valid handle, in dense order.
+  vector<EntityHandle> handles() const {
+    vector<EntityHandle> all;
+    all.reserve(size());
+    for (uint32_t slot : slotOf) {
+      all.push_back({slot, slots[slot].generation});
+    }
+    return all;
+  }
+
+  // A valid handle's dense index, into the arrays below.
+  uint32_t indexOf(EntityHandle handle) const {
+    return slots[handle.slot].index;
+  }
+
+  // ---- Dense arrays, [0, size()) ----
+  // Pointers are invalidated by create() and destroy().
+
+  const uint32_t *objectIDs() const { return columns.objectIDs.data(); }
+  float *xCoords() { return columns.xCoords.data(); }
+  float *yCoords() { return columns.yCoords.data(); }
+  // Units per second.
+  float *xVelocities() { return columns.xVelocities.data(); }
+  float *yVelocities() { return columns.yVelocities.data(); }
+  const float *xCoords() const { return columns.xCoords.data(); }
+  const float *yCoords() const { return columns.yCoords.data(); }
+
+  // The seq of the last Movement applied (for Coord2D::seq in Locations:
+  // the server's own ack covers moves still waiting for a tick).
+  uint32_t *seqs() { return columns.seqs.data(); }
+  const uint32_t *seqs() const { return columns.seqs.data(); }
+
+  uint8_t *dirtyFlags() { return columns.dirty.data(); }
+  const uint8_t *dirtyFlags() const { return columns.dirty.data(); }
+
+  // The last Action the entity took (DIRTY_ACTION if new).
+  const uint8_t *actionTypes() const { return columns.actionTypes.data(); }
+  const uint32_t *actionValues() const { return columns.actionValues.data(); }
+  const uint32_t *impactedIDs() const { return columns.impactedIDs.data(); }
+
+  // ---- By handle ----
+
+  void setPosition(EntityHandle handle, float xCoord, float yCoord,
+                   uint32_t seq = 0) {
+    uint32_t i = indexOf(handle);
+    columns.xCoords[i] = xCoord;
+    columns.yCoords[i] = yCoord;
+    if (seq != 0) {
+      columns.seqs[i] = seq;
+    }
+    columns.dirty[i] |= DIRTY_POSITION;
+  }
+
+  void setVelocity(EntityHandle handle, float xVelocity, float yVelocity) {
+    uint32_t i = indexOf(handle);
+    columns.xVelocities[i] = xVelocity;
+    columns.yVelocities[i] = yVelocity;
+  }
+
+  void setAction(EntityHandle handle, uint8_t actionType, uint32_t actionValue,
+                 uint32_t impactedID) {
+    uint32_t i = indexOf(handle);
+    columns.actionTypes[i] = actionType;
+    columns.actionValues[i] = actionValue;
+    columns.impactedIDs[i] = impactedID;
+    columns.dirty[i] |= DIRTY_ACTION;
+  }
+
+  // ---- Whole-store passes ----
+
+  // Moves every entity by its velocity. Moving ones are marked dirty.
+  void integrate(float dtSec) {
+    size_t count = size();
+    float *__restrict x = columns.xCoords.data();
+    float *__restrict y = columns.yCoords.data();
+    const float *__restrict vx = columns.xVelocities.data();
+    const float *__restrict vy = columns.yVelocities.data();
+    uint8_t *__restrict dirty = columns.dirty.data();
+
+    for (size_t i = 0; i < count; i++) {
+      x[i] += vx[i] * dtSec;
+      y[i] += vy[i] * dtSec;
+      dirty[i] |= uint8_t((vx[i] != 0.0f) | (vy[i] != 0.0f)) * DIRTY_POSITION;
+    }
+  }
+
+  /**
+   * The dense indices of entities with any of mask's dirty flags
+   * (ex. the ones a snapshot needs to send), into out. Returns the count.
+   */
+  size_t collectDirty(uint8_t mask, vector<uint32_t> &out) const {
+    size_t count = size();
+    out.resize(count);
+    uint32_t *__restrict indices = out.data();
+    const uint8_t *__restrict dirty = columns.dirty.data();
+
+    // Always write, only advance on a match: No branch to mispredict.
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+      indices[found] = uint32_t(i);
+      found += (dirty[i] & mask) != 0;
+    }
+    out.resize(found);
+    return found;
+  }
+
+  // After a snapshot is sent.
+  void clearDirty(uint8_t mask = DIRTY_ALL) {
+    size_t count = size();
+    uint8_t *__restrict dirty = columns.dirty.data();
+    uint8_t keep = uint8_t(~mask);
+    for (size_t i = 0; i < count; i++) {
+      dirty[i] &= keep;
+    }
+  }
+
+  /**
+   * Interest query: The dense indices of entities within radius of
+   * (xCoord, yCoord), into out. Returns the count.
+   */
+  size_t queryRadius(float xCoord, float yCoord, float radius,
+                     vector<uint32_t> &out) const {
+    size_t count = size();
+    out.resize(count);
+    uint32_t *__restrict indices = out.data();
+    const float *__restrict x = columns.xCoords.data();
+    const float *__restrict y = columns.yCoords.data();
+    float radiusSq = radius * radius;
+
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+      float dx = x[i] - xCoord;
+      float dy = y[i] - yCoord;
+      indices[found] = uint32_t(i);
+      found += dx * dx + dy * dy <= radiusSq;
+    }
+    out.resize(found);
+    return found;
+  }
+
+private:
+  struct Slot {
+    uint32_t index = 0; // Into the dense arrays.
+    uint32_t generation = 0;
+  };
+
+  // One array per field, all indexed by the dense index.
+  struct Columns {
+    vector<uint32_t> objectIDs;
+    vector<float> xCoords;
+    vector<float> yCoords;
+    vector<float> xVelocities;
+    vector<float> yVelocities;
+    vector<uint32_t> seqs;
+    vector<uint8_t> dirty;
+    vector<uint8_t> actionTypes;
+    vector<uint32_t> actionValues;
+    vector<uint32_t> impactedIDs;
+  } columns;
+  vector<uint32_t> slotOf; // Dense index to slot.
+
+  vector<Slot> slots;
+  vector<uint32_t> freeSlots;
+  unordered_map<uint32_t, EntityHandle> byObjectID;
+};
+
+#endif // ENTITYSTORE_H
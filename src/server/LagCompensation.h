@@ -0,0 +1,252 @@
+#ifndef LAGCOMPENSATION_H
+#define LAGCOMPENSATION_H
+
+/**
+ * Lag compensation: Where entities were in recent ticks, for server-side
+ * hit validation.
+ *
+ * A client's Action (ex. a shot) was aimed at the world it drew: the
+ * server's state from about RTT/2 ago, drawn a little further in the past
+ * by its interpolation delay (see core/Interpolation.h). Checking the hit
+ * against the server's current positions would miss targets that have since
+ * moved. Instead, the server rewinds the target to the tick the shooter saw
+ * (viewTick) and checks there (wasWithin).
+ *
+ * Each entity has a ring of its positions over the last TICKS ticks,
+ * indexed by tick number, so a lookup is one array read. Only entities that
+ * moved are recorded in a tick (ex. the EntityStore's dirty ones), not the
+ * whole world; when an entity moves after standing still, the ticks it
+ * skipped are filled in with where it stood, so lookups stay O(1).
+ *
+ * Reference:
+ * https://developer.valvesoftware.com/wiki/Lag_Compensation
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "EntityStore.h"
+
+using namespace std;
+
+struct LagHistoryStats {
+  uint64_t recorded = 0; // Positions recorded.
+  uint64_t filled = 0;   // Skipped ticks filled in.
+  uint64_t lookups = 0;
+  uint64_t misses = 0;   // Unknown entity, or a tick out of the window.
+  size_t entities = 0;
+};
+
+// Not thread-safe; a room's history is only touched by its tick.
+class LagHistory {
+public:
+  // Ticks kept per entity (~2s at 30Hz). Older ones can't be rewound to.
+  static constexpr uint32_t TICKS = 64;
+
+  LagHistory(double tickHz = 30) : tickHz(tickHz) {}
+
+  /**
+   * objectID's position at the end of tick. Only needed when it moved;
+   * an entity not recorded in a tick stays where it was last recorded.
+   */
+  void record(uint32_t tick, uint32_t objectID, float xCoord, float yCoord) {
+    advance(tick);
+
+    auto found = rowOf.find(objectID);
+    if (found == rowOf.end()) {
+      found = rowOf.emplace(objectID, addRow()).first;
+      rows[found->second].firstTick = tick;
+    } else if (isOlder(tick, rows[found->second].lastTick)) {
+      return; // History isn't rewritten.
+    }
+
+    uint32_t r = found->second;
+    Row &row = rows[r];
+    Sample *ring = &samples[size_t(r) * TICKS];
+
+    // Fill the ticks since its last record with where it stood.
+    if (tick != row.lastTick && row.recorded) {
+      uint32_t skipped = tick - row.lastTick - 1;
+      uint32_t from =
+          skipped >= TICKS ? tick - (TICKS - 1) : row.lastTick + 1;
+      for (uint32_t t = from; t != tick; t++) {
+        ring[t % TICKS] = {row.lastX, row.lastY};
+        stats.filled++;
+      }
+    }
+
+    ring[tick % TICKS] = {xCoord, yCoord};
+    row.lastTick = tick;
+    row.lastX = xCoord;
+    row.lastY = yCoord;
+    row.recorded = true;
+    stats.recorded++;
+  }
+
+  /**
+   * Every entity in the store that moved this tick (DIRTY_POSITION).
+   * Call once per tick, before the store's clearDirty().
+   */
+  void record(uint32_t tick, const EntityStore &entities) {
+    advance(tick);
+
+    size_t count = entities.size();
+    const uint32_t *objectIDs = entities.objectIDs();
+    const float *x = entities.xCoords();
+    const float *y = entities.yCoords();
+    const uint8_t *dirty = entities.dirtyFlags();
+
+    for (size_t i = 0; i < count; i++) {
+      if (dirty[i] & DIRTY_POSITION) {
+        record(tick, objectIDs[i], x[i], y[i]);
+      }
+    }
+  }
+
+  // Ex. when the entity despawns. Its rewinds miss from then on.
+  void forget(uint32_t objectID) {
+    auto found = rowOf.find(objectID);
+    if (found != rowOf.end()) {
+      rows[found->second] = Row();
+      freeRows.push_back(found->second);
+      rowOf.erase(found);
+    }
+  }
+
+  /**
+   * Where objectID was at the end of tick. False if it wasn't known then,
+   * or tick is more than TICKS behind the latest recorded one.
+   */
+  bool lookup(uint32_t objectID, uint32_t tick, float &xCoord,
+              float &yCoord) {
+    stats.lookups++;
+
+    // Also misses a tick after the latest (the subtraction wraps).
+    auto found = rowOf.find(objectID);
+    if (found == rowOf.end() || latestTick - tick >= TICKS ||
+        isOlder(tick, rows[found->second].firstTick)) {
+      stats.misses++;
+      return false;
+    }
+
+    const Row &row = rows[found->second];
+    if (!isOlder(tick, row.lastTick)) {
+      xCoord = row.lastX; // Hasn't moved since.
+      yCoord = row.lastY;
+      return true;
+    }
+
+    const Sample &sample =
+        samples[size_t(found->second) * TICKS + tick % TICKS];
+    xCoord = sample.xCoord;
+    yCoord = sample.yCoord;
+    return true;
+  }
+
+  // Between two ticks (ex. the shooter's view), interpolated.
+  bool lookup(uint32_t objectID, double tick, float &xCoord, float &yCoord) {
+    uint32_t before = uint32_t(int64_t(floor(tick)));
+    float t = float(tick - floor(tick));
+
+    float x0, y0, x1, y1;
+    if (!lookup(objectID, before, x0, y0)) {
+      return false;
+    }
+    if (t == 0 || before == latestTick ||
+        !lookup(objectID, before + 1, x1, y1)) {
+      xCoord = x0;
+      yCoord = y0;
+      return true;
+    }
+
+    xCoord = x0 + (x1 - x0) * t;
+    yCoord = y0 + (y1 - y0) * t;
+    return true;
+  }
+
+  /**
+   * The (fractional) tick a client saw at currentTick: half its RTT
+   * behind (ex. getSendStats(sessionID).congestion.srttMs), plus its
+   * interpolation delay. Clamped to the window.
+   */
+  double viewTick(uint32_t currentTick, double rttMs,
+                  double interpolationDelayMs) const {
+    double behindTicks = (rttMs / 2 + interpolationDelayMs) * tickHz / 1000;
+    behindTicks = fmin(fmax(behindTicks, 0), TICKS - 1);
+    return double(currentTick) - behindTicks;
+  }
+
+  /**
+   * Hit validation: Was objectID within radius of (xCoord, yCoord) at tick?
+   * False if its position then is unknown.
+   */
+  bool wasWithin(uint32_t objectID, double tick, float xCoord, float yCoord,
+                 float radius) {
+    float x, y;
+    if (!lookup(objectID, tick, x, y)) {
+      return false;
+    }
+    float dx = x - xCoord;
+    float dy = y - yCoord;
+    return dx * dx + dy * dy <= radius * radius;
+  }
+
+  uint32_t getLatestTick() const { return latestTick; }
+
+  LagHistoryStats getStats() const {
+    LagHistoryStats current = stats;
+    current.entities = rowOf.size();
+    return current;
+  }
+
+private:
+  struct Sample {
+    float xCoord = 0;
+    float yCoord = 0;
+  };
+
+  struct Row {
+    uint32_t firstTick = 0;
+    uint32_t lastTick = 0;
+    float lastX = 0;
+    float lastY = 0;
+    bool recorded = false;
+  };
+
+  double tickHz;
+  uint32_t latestTick = 0;
+  bool started = false;
+
+  // Row r's ring is samples[r * TICKS, (r + 1) * TICKS).
+  vector<Sample> samples;
+  vector<Row> rows;
+  vector<uint32_t> freeRows;
+  unordered_map<uint32_t, uint32_t> rowOf; // objectID to row.
+
+  LagHistoryStats stats;
+
+  // Tick numbers wrap, so compare the difference (RFC 1982).
+  static bool isOlder(uint32_t a, uint32_t b) { return int32_t(a - b) < 0; }
+
+  void advance(uint32_t tick) {
+    if (!started || isOlder(latestTick, tick)) {
+      latestTick = tick;
+      started = true;
+    }
+  }
+
+  uint32_t addRow() {
+    if (!freeRows.empty()) {
+      uint32_t r = freeRows.back();
+      freeRows.pop_back();
+      return r;
+    }
+    rows.emplace_back();
+    samples.resize(samples.size() + TICKS);
+    return uint32_t(rows.size() - 1);
+  }
+};
+
+#endif // LAGCOMPENSATION_H
@@ -0,0 +1,313 @@
+#ifndef MAPSTREAM_H
+#define MAPSTREAM_H
+
+/**
+ * Map streaming: The server's map, sent to each client a chunk at a time,
+ * as it comes near.
+ *
+ * The map is MAP_CHUNK_TILES x MAP_CHUNK_TILES tile chunks (see MapChunk),
+ * made by the game's MapGenerator the first time any client needs one.
+ * Streaming around a client's position (the server's, not what it claims:
+ * ex. its entity's last Location, every send tick) queues the chunks within
+ * viewChunks of it that it hasn't been sent, nearest first, and within the
+ * map's bounds. A client moving within its chunk costs one comparison.
+ * Chunks are bulk mssgs (see SendScheduler): reliable, but within the
+ * client's bandwidth budget.
+ *
+ * A chunk is generated and serialized (Header + MapChunk) once, into a cache
+ * file mapped in memory; every client after the first is sent the same
+ * bytes. Transports that support it (see FileFrame) send them with
+ * sendfile(), straight from the page cache, so a burst of 50 joining
+ * players costs one encode per chunk and no copies, instead of 50 of each.
+ * (The encode is most of that: For one small frame, sendfile() is no faster
+ * than writev(); see MicroBench's map.*.)
+ *
+ * Cached chunks are compressed (see compressFrame) when that makes them
+ * smaller; like the encode, that's paid once per chunk, not per client.
+ *
+ * The cache file is sparse (sized up front, filled as chunks are encoded)
+ * and mapped once, so cached frames never move. When it's full, chunks are
+ * encoded per client, in memory, like any other mssg.
+ *
+ * References:
+ * https://man7.org/linux/man-pages/man2/sendfile.2.html
+ * https://man7.org/linux/man-pages/man2/mmap.2.html
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../core/SendScheduler.h"
+#include "../core/Transport.h"
+#include "../core/messages.h"
+
+using namespace std;
+
+// Fills a chunk's tiles (MAP_CHUNK_TILES^2, row-major). Must be
+// deterministic: A chunk is generated once, for every client.
+using MapGenerator =
+    function<void(int32_t chunkX, int32_t chunkY, uint8_t *tiles)>;
+
+struct MapStreamConfig {
+  int32_t viewChunks = 2;       // Sent around a client's chunk, each way.
+  int32_t widthChunks = 256;    // The map, from (0, 0). Positions past its
+  int32_t heightChunks = 256;   // edge stream the edge.
+  uint32_t tileSize = 16;       // World units per tile.
+  size_t cacheBytes = 64 << 20; // Cache file size (~60k chunks).
+  string cachePath;             // Empty: An unlinked temp file.
+  bool compress = true;         // Cached chunks (see compressFrame).
+};
+
+struct MapStreamStats {
+  uint64_t encoded = 0;     // Chunks generated and serialized.
+  uint64_t cacheHits = 0;   // Chunks sent from the cache.
+  uint64_t uncached = 0;    // Chunks encoded per client (cache full).
+  uint64_t chunksSent = 0;  // Queued to clients.
+  uint64_t bytesSent = 0;
+  uint64_t rawBytes = 0;    // Cached chunks, before compression.
+  uint64_t cachedBytes = 0; // And after.
+  size_t cachedChunks = 0;
+  size_t cacheBytesUsed = 0;
+  size_t sessions = 0;
+};
+
+// Thread-safe (ex. the write thread streams, while read threads forget).
+class MapStream {
+public:
+  MapStream(MapGenerator generator, const MapStreamConfig &config = {})
+      : generator(std::move(generator)), config(config) {}
+
+  MapStream(const MapStream &) = delete;
+  MapStream &operator=(const MapStream &) = delete;
+
+  ~MapStream() { close(); }
+
+  /**
+   * Create and map the cache file. Without it, chunks are still streamed,
+   * but encoded per client.
+   */
+  bool open() {
+    lock_guard<mutex> lock(streamMutex);
+
+    string path = config.cachePath;
+    if (path.empty()) {
+      char tempPath[] = "/tmp/mapchunksXXXXXX";
+      fd = mkstemp(tempPath);
+      if (fd >= 0) {
+        unlink(tempPath); // Removed when closed.
+      }
+      path = tempPath;
+    } else {
+      fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0) {
+      cerr << "MapStream failed to open '" << path << "': (" << errno << ") "
+           << strerror(errno) << endl;
+      return false;
+    }
+
+    if (ftruncate(fd, config.cacheBytes) < 0) {
+      cerr << "MapStream failed to size its cache: " << strerror(errno)
+           << endl;
+      close();
+      return false;
+    }
+
+    void *mapped = mmap(nullptr, config.cacheBytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+      cerr << "MapStream failed to map its cache: " << strerror(errno)
+           << endl;
+      close();
+      return false;
+    }
+
+    base = static_cast<unsigned char *>(mapped);
+    used = 0;
+    return true;
+  }
+
+  // In chunks, clamped to [0, limitChunks).
+  static int32_t chunkOf(uint32_t coord, uint32_t tileSize,
+                         int32_t limitChunks) {
+    uint32_t chunk = coord / tileSize / MAP_CHUNK_TILES;
+    return int32_t(min<uint32_t>(chunk, uint32_t(max(limitChunks, 1)) - 1));
+  }
+
+  /**
+   * Queue (with send) the chunks around (xCoord, yCoord) sessionID hasn't
+   * been sent yet, nearest first. Returns how many.
+   * send: void(OutboundMssg), called with the lock held.
+   */
+  template <typename SendFunc>
+  size_t streamAround(uint32_t sessionID, uint32_t xCoord, uint32_t yCoord,
+                      SendFunc &&send) {
+    int32_t centerX = chunkOf(xCoord, config.tileSize, config.widthChunks);
+    int32_t centerY = chunkOf(yCoord, config.tileSize, config.heightChunks);
+
+    lock_guard<mutex> lock(streamMutex);
+
+    SessionChunks &session = sessions[sessionID];
+    if (session.moved && session.lastX == centerX &&
+        session.lastY == centerY) {
+      return 0; // Still in the same chunk.
+    }
+    session.moved = true;
+    session.lastX = centerX;
+    session.lastY = centerY;
+
+    // Rings outward from the client's chunk.
+    size_t queued = 0;
+    for (int32_t ring = 0; ring <= config.viewChunks; ring++) {
+      for (int32_t cy = centerY - ring; cy <= centerY + ring; cy++) {
+        bool edgeRow = cy == centerY - ring || cy == centerY + ring;
+        int32_t step = edgeRow ? 1 : 2 * ring;
+        for (int32_t cx = centerX - ring; cx <= centerX + ring; cx += step) {
+          if (cx < 0 || cy < 0 || cx >= config.widthChunks ||
+              cy >= config.heightChunks ||
+              !session.sent.insert(keyOf(cx, cy)).second) {
+            continue;
+          }
+          OutboundMssg chunk = chunkMssg(cx, cy);
+          stats.chunksSent++;
+          stats.bytesSent += chunk.bytes;
+          send(std::move(chunk));
+          queued++;
+        }
+      }
+    }
+    return queued;
+  }
+
+  // Ex. when the client disconnects. Streaming to it again starts over.
+  void forget(uint32_t sessionID) {
+    lock_guard<mutex> lock(streamMutex);
+    sessions.erase(sessionID);
+  }
+
+  const MapStreamConfig &getConfig() const { return config; }
+
+  MapStreamStats getStats() const {
+    lock_guard<mutex> lock(streamMutex);
+    MapStreamStats current = stats;
+    current.cachedChunks = index.size();
+    current.cacheBytesUsed = used;
+    current.sessions = sessions.size();
+    return current;
+  }
+
+private:
+  struct SessionChunks {
+    unordered_set<uint64_t> sent;
+    int32_t lastX = 0;
+    int32_t lastY = 0;
+    bool moved = false;
+  };
+
+  MapGenerator generator;
+  MapStreamConfig config;
+
+  // The cache file: Frames are appended at used, and never move.
+  int fd = -1;
+  unsigned char *base = nullptr;
+  size_t used = 0;
+  unordered_map<uint64_t, FileFrame> index; // Chunk key to its frame.
+  vector<unsigned char> packed;             // compressFrame's output.
+
+  unordered_map<uint32_t, SessionChunks> sessions;
+
+  MapStreamStats stats;
+  mutable mutex streamMutex;
+
+  // Queued frames point into the mapping, so only once they're sent.
+  void close() {
+    if (base != nullptr) {
+      munmap(base, config.cacheBytes);
+      base = nullptr;
+    }
+    if (fd >= 0) {
+      ::close(fd);
+      fd = -1;
+    }
+    index.clear();
+    used = 0;
+  }
+
+  static uint64_t keyOf(int32_t cx, int32_t cy) {
+    return (uint64_t(uint32_t(cx)) << 32) | uint32_t(cy);
+  }
+
+  shared_ptr<SerializedMessage> encode(int32_t cx, int32_t cy) {
+    MapChunk chunk(cx, cy);
+    generator(cx, cy, chunk.tiles);
+    stats.encoded++;
+    return make_shared<SerializedMessage>(0, chunk); // From the server.
+  }
+
+  // The chunk's frame from the cache, encoding it the first time.
+  OutboundMssg chunkMssg(int32_t cx, int32_t cy) {
+    OutboundMssg outbound;
+    outbound.delivery = Delivery::Reliable;
+    outbound.bulk = true;
+    outbound.mssgType = EventCode::MapChunk;
+
+    auto found = index.find(keyOf(cx, cy));
+    if (found != index.end()) {
+      stats.cacheHits++;
+      outbound.file = found->second;
+      outbound.bytes = found->second.length;
+      return outbound;
+    }
+
+    shared_ptr<SerializedMessage> encoded = encode(cx, cy);
+    uint32_t mssgLength = frameMssgLength(*encoded);
+    uint32_t rawLength = sizeof(Header) + mssgLength;
+    bool compressed = base != nullptr && config.compress &&
+                      compressFrame(*encoded, packed);
+    uint32_t length = compressed ? uint32_t(packed.size()) : rawLength;
+
+    if (base == nullptr || config.cacheBytes - used < length) {
+      stats.uncached++;
+      outbound.bytes = rawLength;
+      outbound.mssg = std::move(encoded);
+      return outbound;
+    }
+
+    FileFrame frame;
+    frame.fd = fd;
+    frame.offset = off_t(used);
+    frame.length = length;
+    frame.data = base + used;
+    if (compressed) {
+      memcpy(base + used, packed.data(), length);
+    } else {
+      memcpy(base + used, encoded->header, sizeof(Header));
+      memcpy(base + used + sizeof(Header), encoded->message, mssgLength);
+    }
+    used += length;
+    stats.rawBytes += rawLength;
+    stats.cachedBytes += length;
+    outbound.bytes = length;
+
+    index.emplace(keyOf(cx, cy), frame);
+    outbound.file = frame;
+    return outbound;
+  }
+};
+
+#endif // MAPSTREAM_H
@@ -0,0 +1,493 @@
+#ifndef ROOMS_H
+#define ROOMS_H
+
+/**
+ * Rooms: Many independent matches in one server process.
+ *
+ * Each room has its own sessions (members), entity state and tick function.
+ * Movements, Actions and Projectiles from a member are queued on its room
+ * instead of going to the server's callbacks, and the room's tick gets them all at once,
+ * tickHz times a second. Ticks of every room run on one shared
+ * WorkStealingPool (see core/WorkStealingPool.h), so hundreds of small
+ * matches spread over all cores, and a busy room's tick doesn't delay the
+ * rooms queued behind it on the same worker.
+ *
+ * A room never ticks on two threads at once: if its previous tick is still
+ * running when the next one is due, that one is skipped (an overrun).
+ * So a room's entities need no locking, as long as only its tick touches them.
+ *
+ * Each tick's CPU time is measured on the worker's thread CPU clock,
+ * so getStats() shows which rooms the CPU goes to.
+ */
+
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../core/Trajectory.h"
+#include "../core/WorkStealingPool.h"
+#include "../core/events.h"
+#include "BroadPhase.h"
+#include "EntityStore.h"
+#include "LagCompensation.h"
+
+using namespace std;
+
+// A Movement, Action or Projectile from one of the room's members, for its
+// next tick.
+struct RoomInput {
+  uint32_t senderID = 0;
+  EventCode mssgType = EventCode::Movement;
+
+  // Movement
+  uint32_t objectID = 0;
+  uint32_t xCoord = 0;
+  uint32_t yCoord = 0;
+  uint32_t seq = 0;
+
+  // Action
+  uint8_t actionType = 0;
+  uint32_t actionValue = 0;
+  uint32_t impactedID = 0;
+
+  // Projectile (spawnTick as the client sent it)
+  ProjectileSpawn projectile;
+};
+
+struct RoomStats {
+  uint64_t ticks = 0;
+  uint64_t overruns = 0;  // Skipped: the previous tick was still running.
+  uint64_t inputs = 0;
+  uint64_t cpuNs = 0;     // Thread CPU time spent in its ticks.
+  uint64_t maxTickNs = 0; // Longest tick, wall clock.
+  uint64_t maxLateNs = 0; // Longest a due tick waited for a worker.
+  size_t members = 0;
+};
+
+class Room;
+
+// Runs on a pool worker. dtSec: Time since the room's previous tick.
+using RoomTick =
+    function<void(Room &room, const vector<RoomInput> &inputs, double dtSec)>;
+
+class Room {
+public:
+  const uint32_t id;
+  const string name;
+
+  // Tick only: The room's entities (see EntityStore.h). Locations sent from
+  // a tick should carry entities.seqs() as Coord2D::seq.
+  EntityStore entities;
+
+  // Tick only: Recent positions of its entities, for lag-compensated hit
+  // checks (see LagCompensation.h). The tick records into it, ex.
+  // history.record(room.getTickNumber(), entities) before clearDirty().
+  LagHistory history;
+
+  // Tick only: Shots in flight (see core/Trajectory.h). The tick adds the
+  // Projectile inputs with spawnTick set to getTickNumber(), sends them to
+  // the members (sendTCPEventToRoom), and steps them with collide() and
+  // expire() each tick. The members fly them too, so their positions are
+  // never sent.
+  ProjectileSet projectiles;
+
+  // Tick only: Broad-phase for the projectiles' hits (see BroadPhase.h):
+  // grid.build(entities), then projectiles.collide(tick, grid, radius, hits),
+  // and send each hit as toAction(hit).
+  SpatialHash grid;
+
+  Room(uint32_t id, const string &name, double tickHz, RoomTick tick)
+      : id(id), name(name), history(tickHz), tickHz(tickHz),
+        periodNs(int64_t(1e9 / tickHz)), tick(std::move(tick)) {}
+
+  double getTickHz() const { return tickHz; }
+
+  // Tick only: When the running tick was due (steady_clock ns).
+  int64_t getTickDueNs() const { return tickDueNs; }
+
+  // Tick only: The running tick's number (counts from 1, wraps).
+  uint32_t getTickNumber() const { return tickNumber; }
+
+  // fn(sessionID), with the member list locked (don't join/leave from fn).
+  template <typename Fn> void forEachMember(Fn &&fn) const {
+    lock_guard<mutex> lock(memberMutex);
+    for (uint32_t sessionID : members) {
+      fn(sessionID);
+    }
+  }
+
+  size_t getMemberCount() const {
+    lock_guard<mutex> lock(memberMutex);
+    return members.size();
+  }
+
+  RoomStats getStats() const {
+    RoomStats current;
+    {
+      lock_guard<mutex> lock(statsMutex);
+      current = stats;
+    }
+    current.members = getMemberCount();
+    return current;
+  }
+
+private:
+  friend class RoomManager;
+
+  const double tickHz;
+  const int64_t periodNs;
+  RoomTick tick;
+
+  mutable mutex memberMutex;
+  vector<uint32_t> members;
+
+  // Filled by the read thread, swapped out at the start of each tick.
+  mutex inputMutex;
+  vector<RoomInput> inputs;
+  vector<RoomInput> ticking; // Tick only.
+
+  atomic<bool> running{false};
+  atomic<bool> closed{false};
+  int64_t lastTickNs = 0; // Tick only.
+  int64_t tickDueNs = 0;  // Tick only.
+  uint32_t tickNumber = 0; // Tick only.
+
+  mutable mutex statsMutex;
+  RoomStats stats;
+
+  static int64_t steadyNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static int64_t threadCpuNs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  void addMember(uint32_t sessionID) {
+    lock_guard<mutex> lock(memberMutex);
+    members.push_back(sessionID);
+  }
+
+  void removeMember(uint32_t sessionID) {
+    lock_guard<mutex> lock(memberMutex);
+    members.erase(remove(members.begin(), members.end(), sessionID),
+                  members.end());
+  }
+
+  void pushInput(const RoomInput &input) {
+    lock_guard<mutex> lock(inputMutex);
+    inputs.push_back(input);
+  }
+
+  void countOverrun() {
+    lock_guard<mutex> lock(statsMutex);
+    stats.overruns++;
+  }
+
+  // On a pool worker, with running set by the clock.
+  void runTick(int64_t dueNs) {
+    int64_t startNs = steadyNs();
+    int64_t cpuStartNs = threadCpuNs();
+
+    {
+      lock_guard<mutex> lock(inputMutex);
+      swap(inputs, ticking);
+    }
+
+    double dtSec =
+        lastTickNs == 0 ? 1.0 / tickHz : double(startNs - lastTickNs) / 1e9;
+    lastTickNs = startNs;
+    tickDueNs = dueNs;
+    tickNumber++;
+
+    tick(*this, ticking, dtSec);
+
+    size_t inputCount = ticking.size();
+    ticking.clear(); // Keeps its capacity for the next swap.
+
+    int64_t cpuNs = threadCpuNs() - cpuStartNs;
+    int64_t wallNs = steadyNs() - startNs;
+    {
+      lock_guard<mutex> lock(statsMutex);
+      stats.ticks++;
+      stats.inputs += inputCount;
+      stats.cpuNs += uint64_t(max<int64_t>(cpuNs, 0));
+      stats.maxTickNs = max(stats.maxTickNs, uint64_t(wallNs));
+      stats.maxLateNs =
+          max(stats.maxLateNs, uint64_t(max<int64_t>(startNs - dueNs, 0)));
+    }
+
+    running.store(false, memory_order_release);
+  }
+};
+
+/**
+ * The server's rooms, which session is in which, and their tick clock.
+ * Thread-safe. The pool and clock thread start with the first room.
+ */
+class RoomManager {
+public:
+  RoomManager() = default;
+  RoomManager(const RoomManager &) = delete;
+  RoomManager &operator=(const RoomManager &) = delete;
+
+  // Lets the running ticks finish.
+  ~RoomManager() { stop(); }
+
+  // No more ticks after this returns (the running ones finish first). For
+  // an owner whose members the ticks use, before those go away.
+  void stop() {
+    {
+      lock_guard<mutex> lock(clockMutex);
+      if (!pool) {
+        return;
+      }
+      stopping = true;
+    }
+    clockCV.notify_all();
+    clockThread.join();
+    pool.reset(); // Waits for the running ticks.
+  }
+
+  // Pool size, before the first room (0, the default: One per core).
+  void setThreadCount(size_t threads) {
+    lock_guard<mutex> lock(clockMutex);
+    threadCount = threads;
+  }
+
+  // Returns the new room's ID, or 0 if tickHz or tick is invalid.
+  uint32_t createRoom(const string &name, double tickHz, RoomTick tick) {
+    if (tickHz <= 0 || !tick) {
+      cerr << "RoomManager: Room '" << name << "' needs a tick and tickHz > 0."
+           << endl;
+      return 0;
+    }
+
+    start();
+
+    shared_ptr<Room> room;
+    {
+      unique_lock<shared_mutex> lock(roomsMutex);
+      uint32_t roomID = nextRoomID++;
+      room = make_shared<Room>(roomID, name, tickHz, std::move(tick));
+      rooms.emplace(roomID, room);
+    }
+
+    lock_guard<mutex> lock(clockMutex);
+    dueTicks.push({Room::steadyNs() + room->periodNs, room});
+    clockCV.notify_one();
+    return room->id;
+  }
+
+  // Its members are left in no room. A running tick finishes first.
+  bool closeRoom(uint32_t roomID) {
+    unique_lock<shared_mutex> lock(roomsMutex);
+    auto it = rooms.find(roomID);
+    if (it == rooms.end()) {
+      return false;
+    }
+
+    it->second->closed.store(true, memory_order_release);
+    it->second->forEachMember(
+        [&](uint32_t sessionID) { sessionRooms.erase(sessionID); });
+    rooms.erase(it);
+    return true;
+  }
+
+  // The first room named 'name', or 0.
+  uint32_t findRoom(const string &name) const {
+    shared_lock<shared_mutex> lock(roomsMutex);
+    for (const auto &[roomID, room] : rooms) {
+      if (room->name == name) {
+        return roomID;
+      }
+    }
+    return 0;
+  }
+
+  // Moves the session out of its current room, if any.
+  bool join(uint32_t roomID, uint32_t sessionID) {
+    unique_lock<shared_mutex> lock(roomsMutex);
+    auto room = rooms.find(roomID);
+    if (room == rooms.end()) {
+      return false;
+    }
+
+    removeFromRoom(sessionID);
+    sessionRooms[sessionID] = roomID;
+    room->second->addMember(sessionID);
+    return true;
+  }
+
+  void leave(uint32_t sessionID) {
+    unique_lock<shared_mutex> lock(roomsMutex);
+    removeFromRoom(sessionID);
+  }
+
+  // The session's room, or 0.
+  uint32_t roomOf(uint32_t sessionID) const {
+    shared_lock<shared_mutex> lock(roomsMutex);
+    auto it = sessionRooms.find(sessionID);
+    return it == sessionRooms.end() ? 0 : it->second;
+  }
+
+  shared_ptr<Room> getRoom(uint32_t roomID) const {
+    shared_lock<shared_mutex> lock(roomsMutex);
+    auto it = rooms.find(roomID);
+    return it == rooms.end() ? nullptr : it->second;
+  }
+
+  /**
+   * Queues input for its sender's room's next tick.
+   * False if the sender isn't in a room.
+   */
+  bool submitInput(const RoomInput &input) {
+    shared_lock<shared_mutex> lock(roomsMutex);
+    auto session = sessionRooms.find(input.senderID);
+    if (session == sessionRooms.end()) {
+      return false;
+    }
+    rooms.at(session->second)->pushInput(input);
+    return true;
+  }
+
+  RoomStats getStats(uint32_t roomID) const {
+    shared_ptr<Room> room = getRoom(roomID);
+    return room ? room->getStats() : RoomStats();
+  }
+
+  map<uint32_t, RoomStats> getStats() const {
+    shared_lock<shared_mutex> lock(roomsMutex);
+    map<uint32_t, RoomStats> allStats;
+    for (const auto &[roomID, room] : rooms) {
+      allStats.emplace(roomID, room->getStats());
+    }
+    return allStats;
+  }
+
+  WorkStealingStats getPoolStats() const {
+    lock_guard<mutex> lock(clockMutex);
+    return pool ? pool->getStats() : WorkStealingStats();
+  }
+
+  size_t getRoomCount() const {
+    shared_lock<shared_mutex> lock(roomsMutex);
+    return rooms.size();
+  }
+
+private:
+  struct DueTick {
+    int64_t dueNs;
+    shared_ptr<Room> room;
+
+    bool operator>(const DueTick &other) const { return dueNs > other.dueNs; }
+  };
+
+  // Rooms and memberships. Shared for the read thread's input lookups.
+  mutable shared_mutex roomsMutex;
+  unordered_map<uint32_t, shared_ptr<Room>> rooms;
+  unordered_map<uint32_t, uint32_t> sessionRooms; // sessionID to roomID.
+  uint32_t nextRoomID = 1;
+
+  // Tick clock.
+  mutable mutex clockMutex;
+  condition_variable clockCV;
+  priority_queue<DueTick, vector<DueTick>, greater<DueTick>> dueTicks;
+  unique_ptr<WorkStealingPool> pool;
+  size_t threadCount = 0;
+  thread clockThread;
+  bool stopping = false;
+
+  // With roomsMutex held.
+  void removeFromRoom(uint32_t sessionID) {
+    auto session = sessionRooms.find(sessionID);
+    if (session == sessionRooms.end()) {
+      return;
+    }
+    auto room = rooms.find(session->second);
+    if (room != rooms.end()) {
+      room->second->removeMember(sessionID);
+    }
+    sessionRooms.erase(session);
+  }
+
+  void start() {
+    lock_guard<mutex> lock(clockMutex);
+    if (pool) {
+      return;
+    }
+    pool = make_unique<WorkStealingPool>(threadCount);
+    clockThread = thread(&RoomManager::runClock, this);
+  }
+
+  /**
+   * Submits each room's tick to the pool when it's due. A room that fell
+   * behind (ex. a tick longer than its period) skips the ticks it missed,
+   * instead of running them back to back.
+   */
+  void runClock() {
+    unique_lock<mutex> lock(clockMutex);
+    vector<DueTick> ready;
+
+    while (!stopping) {
+      if (dueTicks.empty()) {
+        clockCV.wait(lock);
+        continue;
+      }
+
+      int64_t waitNs = dueTicks.top().dueNs - Room::steadyNs();
+      if (waitNs > 0) {
+        clockCV.wait_for(lock, chrono::nanoseconds(waitNs));
+        continue;
+      }
+
+      int64_t now = Room::steadyNs();
+      while (!dueTicks.empty() && dueTicks.top().dueNs <= now) {
+        ready.push_back(dueTicks.top());
+        dueTicks.pop();
+      }
+
+      for (DueTick &due : ready) {
+        if (due.room->closed.load(memory_order_acquire)) {
+          continue; // Dropped from the clock.
+        }
+
+        if (due.room->running.exchange(true, memory_order_acq_rel)) {
+          due.room->countOverrun();
+        } else {
+          pool->submit([room = due.room, dueNs = due.dueNs] {
+            room->runTick(dueNs);
+          });
+        }
+
+        int64_t nextNs = due.dueNs + due.room->periodNs;
+        if (nextNs <= now) {
+          nextNs = now + due.room->periodNs;
+        }
+        dueTicks.push({nextNs, std::move(due.room)});
+      }
+      ready.clear();
+    }
+  }
+};
+
+#endif // ROOMS_H
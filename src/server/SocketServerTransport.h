@@ -0,0 +1,709 @@
+#ifndef SOCKETSERVERTRANSPORT_H
+#define SOCKETSERVERTRANSPORT_H
+
+/**
+ * Server transport over the kernel: a listening TCP socket and its accepted
+ * clients (reliable), one UDP socket for every client (unreliable), and
+ * optionally a ShmListener for co-located processes (both delivery classes
+ * go over their shared-memory channel).
+ *
+ * poll() multiplexes all of them with one poll() call, so a single read
+ * thread serves every client.
+ *
+ * TCP clients' sockets are non-blocking, so no one client can stall the
+ * others: Frames are parsed out of a per-connection buffer as their bytes
+ * arrive, and what a send can't write right away is queued for poll() to
+ * flush when the socket can take more. A client that lets over
+ * MAX_PENDING_BYTES queue up (it isn't reading) is dropped.
+ *
+ * A Peer holds its TCPConnection, not its sfd: The socket is closed when
+ * the last Peer copy (ex. the write thread's) lets go of it, so a new
+ * client that gets the same fd can't be sent an old one's frames.
+ *
+ * Large reliable mssgs to TCP clients are compressed (see compressFrame),
+ * per connection, while it pays off on that client's link.
+ */
+
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../core/SharedMemoryTransport.h"
+#include "../core/Transport.h"
+#include "../core/UDP.h"
+#include "TCPServer.h"
+
+using namespace std;
+
+// Queued to one TCP client, past which it's dropped.
+static constexpr size_t MAX_PENDING_BYTES = 4 << 20;
+
+class SocketServerTransport {
+public:
+  /**
+   * One TCP client. The read thread owns inBuf; the rest is written by
+   * whichever thread sends to it (the write thread, or the read thread's
+   * replies), under writeMutex.
+   */
+  struct TCPConnection {
+    int sfd = -1;
+    uint64_t id = 0; // Unique for the transport's life, unlike sfd.
+
+    // Bytes received, not yet a whole frame. Read thread only.
+    vector<char> inBuf;
+    size_t inUsed = 0;
+
+    mutex writeMutex;
+    vector<unsigned char> outBuf; // Not yet taken by the socket,
+    size_t outSent = 0;           // from here on.
+    bool failed = false;          // Closed, write error, or too much queued.
+
+    AdaptiveCompressor compressor;
+    uint32_t untilMeasure = 0; // Tries until its capacity is measured again.
+
+    ~TCPConnection() {
+      if (sfd >= 0) {
+        close(sfd);
+      }
+    }
+  };
+
+  struct Peer {
+    shared_ptr<TCPConnection> tcp;   // Set for a TCP client
+    struct sockaddr_in udpAddr = {}; // UDP address (port 0 until bound)
+    shared_ptr<ShmChannel> shm;      // Set for a shared-memory client
+  };
+
+  SocketServerTransport(char *host, char *tcpPort, char *udpPort)
+      : tcpServer(host, tcpPort), udpServer(host, udpPort) {}
+
+  ~SocketServerTransport() {
+    if (wakeFd >= 0) {
+      close(wakeFd);
+    }
+  }
+
+  bool open() {
+    if (!tcpServer.initSocket() || !tcpServer.listenForConnections()) {
+      return false;
+    }
+
+    // A client hanging up mid-sendfile() would otherwise kill the server
+    // (sendfile takes no MSG_NOSIGNAL).
+    signal(SIGPIPE, SIG_IGN);
+
+    // Sends wake poll() when a client's first bytes queue up.
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+      cerr << "SocketServerTransport eventfd failed: (" << errno << ") "
+           << strerror(errno) << endl;
+      return false;
+    }
+
+    udpServer.initSocket();
+    udpServer.bindSocket();
+
+    // Reads are driven by poll(), and drain the socket until EAGAIN.
+    int flags = fcntl(udpServer.getSfd(), F_GETFL, 0);
+    fcntl(udpServer.getSfd(), F_SETFL, flags | O_NONBLOCK);
+    return true;
+  }
+
+  // Also accept co-located clients on shared memory (see ShmListener): At
+  // most maxChannels at once, running as this user or one allowed below.
+  bool listenSharedMemory(
+      const string &name,
+      size_t maxChannels = ShmListener::DEFAULT_MAX_CHANNELS) {
+    shmListener.setMaxChannels(maxChannels);
+    return shmListener.listen(name);
+  }
+
+  // Let shared-memory clients running as uid in too.
+  void allowSharedMemoryUid(uid_t uid) { shmListener.allowUid(uid); }
+
+  // See CompressionConfig (ex. enabled = false). Set before open().
+  void setCompression(const CompressionConfig &config) {
+    compressionConfig = config;
+  }
+
+  // Summed over every TCP client so far.
+  CompressionStats getCompressionStats() {
+    lock_guard<mutex> lock(connectionsMutex);
+    CompressionStats total = closedCompression;
+    size_t active = 0;
+    for (const shared_ptr<TCPConnection> &conn : clients) {
+      lock_guard<mutex> writeLock(conn->writeMutex);
+      addStats(total, conn->compressor.getStats());
+      active += conn->compressor.isActive();
+    }
+    total.active = active > 0;
+    return total;
+  }
+
+  // See UDP::setImpairment.
+  void setUDPImpairment(const ImpairmentConfig &outbound,
+                        const ImpairmentConfig &inbound) {
+    udpServer.setImpairment(outbound, inbound);
+  }
+
+  template <typename Sink> size_t poll(int timeoutMs, Sink &sink) {
+    size_t delivered = drainSharedMemory(sink);
+
+    // Only sleep if every shared-memory ring is empty (and has asked to be
+    // woken), and the UDP impairment shim has nothing due sooner.
+    bool canSleep = delivered == 0;
+    for (shared_ptr<ShmChannel> &channel : channels) {
+      canSleep = channel->prepareToWait() && canSleep;
+    }
+
+    int pollTimeout = canSleep ? timeoutMs : 0;
+    int nextRelease = udpServer.nextImpairmentRelease();
+    if (nextRelease >= 0 && (pollTimeout < 0 || nextRelease < pollTimeout)) {
+      pollTimeout = nextRelease;
+    }
+
+    // [TCP listen][UDP][shm listen][wake][TCP clients...]
+    // [shm channels (2 each)...]
+    pfds.clear();
+    pfds.push_back({tcpServer.getSfd(), POLLIN, 0});
+    pfds.push_back({udpServer.getSfd(), POLLIN, 0});
+    pfds.push_back({shmListener.getListenFd(), POLLIN, 0});
+    pfds.push_back({wakeFd, POLLIN, 0});
+    for (const shared_ptr<TCPConnection> &conn : clients) {
+      short events = POLLIN;
+      {
+        lock_guard<mutex> lock(conn->writeMutex);
+        if (conn->failed) {
+          events = 0; // Only its hang-up is left to see (see failWrites).
+        } else if (conn->outSent < conn->outBuf.size()) {
+          events |= POLLOUT;
+        }
+      }
+      pfds.push_back({conn->sfd, events, 0});
+    }
+    for (shared_ptr<ShmChannel> &channel : channels) {
+      pfds.push_back({channel->getReceiveEventFd(), POLLIN, 0});
+      pfds.push_back({channel->getControlFd(), POLLIN, 0});
+    }
+
+    int ready = ::poll(pfds.data(), pfds.size(), pollTimeout);
+    for (shared_ptr<ShmChannel> &channel : channels) {
+      channel->finishWait();
+    }
+
+    if (ready < 0 && errno != EINTR) {
+      cerr << "SocketServerTransport poll error: (" << errno << ") "
+           << strerror(errno) << endl;
+      return delivered;
+    }
+
+    udpServer.pumpImpairment();
+    delivered += readUDP(sink);
+
+    if (pfds[3].revents & POLLIN) {
+      uint64_t wakes;
+      ssize_t ignored = read(wakeFd, &wakes, sizeof(wakes));
+      (void)ignored;
+    }
+
+    size_t clientBase = 4;
+    size_t channelBase = clientBase + clients.size();
+
+    // TCP clients (before accepting, so indexes still line up).
+    vector<shared_ptr<TCPConnection>> closedClients;
+    for (size_t i = 0; i < clients.size(); i++) {
+      TCPConnection &conn = *clients[i];
+      short revents = pfds[clientBase + i].revents;
+      if (revents == 0 && !isFailed(conn)) {
+        continue;
+      }
+      bool open = !isFailed(conn);
+      if (open && (revents & POLLOUT)) {
+        open = flushPending(conn);
+      }
+      if (open && (revents & ~POLLOUT)) {
+        open = readTCP(clients[i], sink, delivered);
+      }
+      if (!open) {
+        closedClients.push_back(clients[i]);
+      }
+    }
+
+    // Shared-memory hang-ups (whatever the peer left is drained first).
+    vector<shared_ptr<ShmChannel>> closedChannels;
+    for (size_t i = 0; i < channels.size(); i++) {
+      if (pfds[channelBase + 2 * i + 1].revents != 0) {
+        channels[i]->markPeerClosed();
+        closedChannels.push_back(channels[i]);
+      }
+    }
+
+    for (shared_ptr<TCPConnection> &conn : closedClients) {
+      Peer peer;
+      peer.tcp = conn;
+      sink.onDisconnect(peer);
+      removePeer(peer);
+      delivered++;
+    }
+
+    for (shared_ptr<ShmChannel> &channel : closedChannels) {
+      Peer peer;
+      peer.shm = channel;
+      delivered += drainChannel(channel, sink);
+      sink.onDisconnect(peer);
+      removePeer(peer);
+      delivered++;
+    }
+
+    if (pfds[0].revents & POLLIN) {
+      int clientSfd = tcpServer.acceptConnection();
+      if (clientSfd >= 0) {
+        int flags = fcntl(clientSfd, F_GETFL, 0);
+        fcntl(clientSfd, F_SETFL, flags | O_NONBLOCK);
+
+        auto conn = make_shared<TCPConnection>();
+        conn->sfd = clientSfd;
+        conn->id = nextConnectionID++;
+        conn->compressor = AdaptiveCompressor(compressionConfig);
+        {
+          lock_guard<mutex> lock(connectionsMutex);
+          clients.push_back(conn);
+        }
+
+        Peer peer;
+        peer.tcp = conn;
+        sink.onConnect(peer);
+        delivered++;
+      }
+    }
+
+    if (pfds[2].fd >= 0 && (pfds[2].revents & POLLIN)) {
+      unique_ptr<ShmChannel> channel = shmListener.accept(channels.size());
+      if (channel) {
+        channels.push_back(std::move(channel));
+        Peer peer;
+        peer.shm = channels.back();
+        sink.onConnect(peer);
+        delivered++;
+      }
+    }
+
+    for (const Peer &peer : closingPeers) {
+      removePeer(peer);
+    }
+    closingPeers.clear();
+
+    return delivered;
+  }
+
+  bool send(const Peer &peer, const SerializedMessage &mssg,
+            Delivery delivery) {
+    if (peer.shm) {
+      return sendShmFrame(*peer.shm, mssg, delivery);
+    }
+
+    uint32_t mssgLength = frameMssgLength(mssg);
+
+    if (delivery == Delivery::Reliable) {
+      TCPConnection *conn = peer.tcp.get();
+      if (!conn) {
+        return false;
+      }
+      lock_guard<mutex> lock(conn->writeMutex);
+      thread_local vector<unsigned char> packed;
+      if (compress(*conn, peer, mssg, mssgLength, packed)) {
+        return writeOrQueue(*conn, packed.data(), packed.size(), nullptr, 0);
+      }
+      return writeOrQueue(*conn, mssg.header, sizeof(Header), mssg.message,
+                          mssgLength);
+    }
+
+    if (peer.udpAddr.sin_port == 0) {
+      return false; // Client hasn't bound its UDP address yet.
+    }
+
+    // A datagram has to go out in one piece.
+    thread_local vector<char> datagram;
+    datagram.resize(sizeof(Header) + mssgLength);
+    memcpy(datagram.data(), mssg.header, sizeof(Header));
+    if (mssgLength > 0) {
+      memcpy(datagram.data() + sizeof(Header), mssg.message, mssgLength);
+    }
+    return udpServer.sendDatagram(peer.udpAddr, datagram.data(),
+                                  datagram.size()) >= 0;
+  }
+
+  // Reliable, without copying frame (see FileFrame).
+  bool sendFileFrame(const Peer &peer, const FileFrame &frame) {
+    if (peer.shm) {
+      return sendShmFrame(*peer.shm, frame.data, frame.data + sizeof(Header),
+                          frame.length - sizeof(Header), Delivery::Reliable);
+    }
+
+    TCPConnection *conn = peer.tcp.get();
+    if (!conn) {
+      return false;
+    }
+    lock_guard<mutex> lock(conn->writeMutex);
+    if (conn->failed) {
+      return false;
+    }
+
+    // Straight from the page cache if nothing's queued ahead of it;
+    // whatever the socket can't take now is queued from the mapping.
+    size_t written = 0;
+    if (conn->outSent == conn->outBuf.size()) {
+      ssize_t sent = tcpServer.writeFileSome(conn->sfd, frame.fd, frame.offset,
+                                             frame.length);
+      if (sent < 0) {
+        failWrites(*conn);
+        return false;
+      }
+      written = size_t(sent);
+    }
+    return queueUnsent(*conn, frame.data, frame.length, nullptr, 0, written);
+  }
+
+  // The UDP address (IP:port, as players behind one NAT share an IP),
+  // TCP connection (its id: An sfd is reused), or shared-memory channel.
+  // Tagged by kind.
+  static uint64_t sourceKey(const Peer &from, Delivery delivery) {
+    if (from.shm) {
+      return (uint64_t(2) << 62) |
+             (reinterpret_cast<uintptr_t>(from.shm.get()) >> 4);
+    }
+    if (delivery == Delivery::Reliable) {
+      return (uint64_t(1) << 62) | (from.tcp ? from.tcp->id : 0);
+    }
+    return (uint64_t(from.udpAddr.sin_addr.s_addr) << 16) |
+           from.udpAddr.sin_port;
+  }
+
+  /**
+   * Bytes/sec the peer's link can take right now, estimated from its TCP
+   * connection (congestion window / RTT); UDP shares the same path.
+   * 0 if unknown (ex. no RTT sample yet).
+   */
+  uint64_t measureCapacity(const Peer &peer) const {
+    if (peer.shm) {
+      return UNLIMITED_CAPACITY;
+    }
+
+    struct tcp_info info = {};
+    socklen_t infoLen = sizeof(info);
+    if (!peer.tcp ||
+        getsockopt(peer.tcp->sfd, IPPROTO_TCP, TCP_INFO, &info, &infoLen) <
+            0 ||
+        info.tcpi_rtt == 0) {
+      return 0;
+    }
+
+    // tcpi_rtt is in microseconds.
+    return uint64_t(info.tcpi_snd_cwnd) * info.tcpi_snd_mss * 1000000 /
+           info.tcpi_rtt;
+  }
+
+  // Called from the sink, so the peer is dropped once poll() is done with it.
+  void closePeer(const Peer &peer) { closingPeers.push_back(peer); }
+
+  // Only the first address is taken. A shared-memory session already has
+  // both delivery classes.
+  static void bindUnreliable(Peer &sessionPeer, const Peer &from) {
+    if (!sessionPeer.shm && sessionPeer.udpAddr.sin_port == 0) {
+      sessionPeer.udpAddr = from.udpAddr;
+    }
+  }
+
+private:
+  // Read in (up to) this much at a time; also inBuf's size when idle.
+  static constexpr size_t READ_CHUNK_BYTES = 16 << 10;
+
+  TCPServer tcpServer;
+  UDP udpServer;
+  ShmListener shmListener;
+  int wakeFd = -1;
+
+  // Changed by the read thread only, under connectionsMutex (for stats).
+  vector<shared_ptr<TCPConnection>> clients;
+  uint64_t nextConnectionID = 1;
+  CompressionStats closedCompression;
+  mutex connectionsMutex;
+
+  vector<shared_ptr<ShmChannel>> channels;
+  vector<Peer> closingPeers;
+
+  CompressionConfig compressionConfig;
+
+  // Reused every poll, so the read path doesn't allocate.
+  vector<struct pollfd> pfds;
+  vector<char> frameBuf = vector<char>(MAX_FRAME_BYTES + sizeof(Header));
+  vector<unsigned char> shmFrame;
+
+  static bool isFailed(TCPConnection &conn) {
+    lock_guard<mutex> lock(conn.writeMutex);
+    return conn.failed;
+  }
+
+  // Under writeMutex. poll() drops it, so it's woken to.
+  void failWrites(TCPConnection &conn) {
+    conn.failed = true;
+    conn.outBuf = {};
+    conn.outSent = 0;
+    wake();
+  }
+
+  void wake() {
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+  }
+
+  /**
+   * Under writeMutex: Write a frame (in up to 2 parts), as much of it as
+   * the socket takes now, and queue the rest. False if the connection
+   * failed (or just did).
+   */
+  bool writeOrQueue(TCPConnection &conn, const void *part1, size_t len1,
+                    const void *part2, size_t len2) {
+    if (conn.failed) {
+      return false;
+    }
+
+    // Not ahead of what's already queued.
+    size_t written = 0;
+    if (conn.outSent == conn.outBuf.size()) {
+      ssize_t sent = tcpServer.writeSome(conn.sfd, part1, len1, part2, len2);
+      if (sent < 0) {
+        failWrites(conn);
+        return false;
+      }
+      written = size_t(sent);
+    }
+    return queueUnsent(conn, part1, len1, part2, len2, written);
+  }
+
+  // Under writeMutex: Queue the parts, past the written bytes of them.
+  bool queueUnsent(TCPConnection &conn, const void *part1, size_t len1,
+                   const void *part2, size_t len2, size_t written) {
+    if (written == len1 + len2) {
+      return true;
+    }
+
+    bool wasEmpty = conn.outSent == conn.outBuf.size();
+    if (conn.outSent > 0 && conn.outSent >= conn.outBuf.size() / 2) {
+      conn.outBuf.erase(conn.outBuf.begin(),
+                        conn.outBuf.begin() + conn.outSent);
+      conn.outSent = 0;
+    }
+
+    const void *parts[2] = {part1, part2};
+    size_t lengths[2] = {len1, len2};
+    for (int i = 0; i < 2; i++) {
+      size_t skip = min(written, lengths[i]);
+      written -= skip;
+      const unsigned char *start =
+          static_cast<const unsigned char *>(parts[i]) + skip;
+      conn.outBuf.insert(conn.outBuf.end(), start,
+                         start + (lengths[i] - skip));
+    }
+
+    if (conn.outBuf.size() - conn.outSent > MAX_PENDING_BYTES) {
+      cerr << "SocketServerTransport: Dropping client " << conn.sfd
+           << ", over " << MAX_PENDING_BYTES << " bytes queued to it."
+           << endl;
+      failWrites(conn);
+      return false;
+    }
+    if (wasEmpty) {
+      wake(); // So poll() waits for it to be writable.
+    }
+    return true;
+  }
+
+  // When the socket polls writable. False if the client hung up.
+  bool flushPending(TCPConnection &conn) {
+    lock_guard<mutex> lock(conn.writeMutex);
+    if (conn.failed) {
+      return false;
+    }
+
+    ssize_t sent =
+        tcpServer.writeSome(conn.sfd, conn.outBuf.data() + conn.outSent,
+                            conn.outBuf.size() - conn.outSent, nullptr, 0);
+    if (sent < 0) {
+      failWrites(conn);
+      return false;
+    }
+
+    conn.outSent += size_t(sent);
+    if (conn.outSent == conn.outBuf.size()) {
+      conn.outBuf.clear();
+      conn.outSent = 0;
+      if (conn.outBuf.capacity() > MAX_PENDING_BYTES / 16) {
+        conn.outBuf.shrink_to_fit(); // Don't hold a burst's worth.
+      }
+    }
+    return true;
+  }
+
+  // Under writeMutex: True if mssg went into packed, compressed.
+  bool compress(TCPConnection &conn, const Peer &peer,
+                const SerializedMessage &mssg, uint32_t mssgLength,
+                vector<unsigned char> &packed) {
+    if (!conn.compressor.shouldTry(mssgLength)) {
+      return false;
+    }
+    if (conn.untilMeasure == 0) {
+      conn.compressor.setLinkCapacity(measureCapacity(peer));
+      conn.untilMeasure = compressionConfig.probeEvery;
+    }
+    conn.untilMeasure--;
+
+    auto start = chrono::steady_clock::now();
+    bool smaller = compressFrame(mssg, packed);
+    uint64_t costNs = chrono::duration_cast<chrono::nanoseconds>(
+                          chrono::steady_clock::now() - start)
+                          .count();
+    size_t packedLength =
+        smaller ? packed.size() - sizeof(Header) : mssgLength;
+    conn.compressor.record(mssgLength, packedLength, costNs);
+    return smaller;
+  }
+
+  static void addStats(CompressionStats &total, const CompressionStats &add) {
+    total.compressed += add.compressed;
+    total.incompressible += add.incompressible;
+    total.skipped += add.skipped;
+    total.small += add.small;
+    total.rawBytes += add.rawBytes;
+    total.wireBytes += add.wireBytes;
+    total.cpuNs += add.cpuNs;
+  }
+
+  /**
+   * Read what the client has sent (one recv, so a fast sender can't starve
+   * the others), and deliver every whole frame in it. Returns false if the
+   * client hung up (or sent garbage).
+   */
+  template <typename Sink>
+  bool readTCP(const shared_ptr<TCPConnection> &client, Sink &sink,
+               size_t &delivered) {
+    TCPConnection &conn = *client;
+    if (conn.inBuf.size() - conn.inUsed < READ_CHUNK_BYTES) {
+      conn.inBuf.resize(conn.inUsed + READ_CHUNK_BYTES);
+    }
+    ssize_t got = recv(conn.sfd, conn.inBuf.data() + conn.inUsed,
+                       conn.inBuf.size() - conn.inUsed, 0);
+    if (got == 0) {
+      return false; // Hung up.
+    }
+    if (got < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    conn.inUsed += size_t(got);
+
+    Peer peer;
+    peer.tcp = client;
+    size_t pos = 0;
+    while (conn.inUsed - pos >= sizeof(Header)) {
+      Header hdr = deserialize<Header>(conn.inBuf.data() + pos);
+      if (hdr.mssgLength > MAX_FRAME_BYTES) {
+        cerr << "SocketServerTransport: Dropping client " << conn.sfd
+             << ", frame of " << hdr.mssgLength << " bytes is too large."
+             << endl;
+        return false;
+      }
+
+      size_t frameLen = sizeof(Header) + hdr.mssgLength;
+      if (conn.inUsed - pos < frameLen) {
+        break; // The rest hasn't arrived yet.
+      }
+      sink.onFrame(peer, conn.inBuf.data() + pos, frameLen,
+                   Delivery::Reliable);
+      delivered++;
+      pos += frameLen;
+    }
+
+    // Keep the partial frame (if any), at the front.
+    if (pos > 0) {
+      memmove(conn.inBuf.data(), conn.inBuf.data() + pos, conn.inUsed - pos);
+      conn.inUsed -= pos;
+    }
+    if (conn.inUsed == 0 && conn.inBuf.size() > READ_CHUNK_BYTES) {
+      conn.inBuf.resize(READ_CHUNK_BYTES);
+      conn.inBuf.shrink_to_fit(); // Done with a large frame.
+    }
+    return true;
+  }
+
+  template <typename Sink> size_t readUDP(Sink &sink) {
+    size_t delivered = 0;
+    Peer peer;
+    int len;
+
+    while ((len = udpServer.recvDatagram(frameBuf.data(), frameBuf.size(),
+                                         peer.udpAddr)) >= 0) {
+      sink.onFrame(peer, frameBuf.data(), len, Delivery::Unreliable);
+      delivered++;
+    }
+
+    return delivered;
+  }
+
+  // Shared memory is lossless and ordered, so its frames are all Reliable.
+  template <typename Sink>
+  size_t drainChannel(const shared_ptr<ShmChannel> &channel, Sink &sink) {
+    size_t delivered = 0;
+    Peer peer;
+    peer.shm = channel;
+
+    while (channel->receive(shmFrame)) {
+      sink.onFrame(peer, reinterpret_cast<const char *>(shmFrame.data()),
+                   shmFrame.size(), Delivery::Reliable);
+      delivered++;
+    }
+
+    return delivered;
+  }
+
+  template <typename Sink> size_t drainSharedMemory(Sink &sink) {
+    size_t delivered = 0;
+    for (size_t i = 0; i < channels.size(); i++) {
+      delivered += drainChannel(channels[i], sink);
+    }
+    return delivered;
+  }
+
+  void removePeer(const Peer &peer) {
+    if (peer.shm) {
+      channels.erase(remove(channels.begin(), channels.end(), peer.shm),
+                     channels.end());
+      return;
+    }
+
+    lock_guard<mutex> lock(connectionsMutex);
+    auto it = find(clients.begin(), clients.end(), peer.tcp);
+    if (it == clients.end()) {
+      return;
+    }
+    clients.erase(it);
+
+    // Anything still sending to it stops. The sfd stays open (so it can't
+    // be reused) until the last Peer copy is gone.
+    lock_guard<mutex> writeLock(peer.tcp->writeMutex);
+    addStats(closedCompression, peer.tcp->compressor.getStats());
+    peer.tcp->failed = true;
+    shutdown(peer.tcp->sfd, SHUT_RDWR);
+  }
+};
+
+#endif // SOCKETSERVERTRANSPORT_H
@@ -9,9 +9,9 @@
 #include <thread>
 #include <vector>
 
-class TCPServer : public TCP {
+class TCPServer final : public TCP {
 public:
-  TCPServer(char *host_, char *port_) : host(host_), port(port_);
+  TCPServer(char *host_, char *port_) : TCP(host_, port_) {}
 
   bool initSocket() override {
     int sfd_ = -1;
@@ -28,7 +28,10 @@ public:
         int status = getaddrinfo(this->host, this->port, &hints, &result);
 
         if (status != 0) {
-            cerr << "TCP server failed to resolve host " << std::string(this->host) << "'. Error: ") << gai_strerror(status);
+          cerr << "TCP server failed to resolve host '"
+               << std::string(this->host) << "'. Error: "
+               << gai_strerror(status) << endl;
+          result = nullptr;
         }
 
         // Loop through results and try to bind
@@ -42,19 +45,21 @@ public:
 
           // SO_REUSEADDR allows immediatley re-using a port.
           const int on = 1; // Set after creating socket and before binding.
-          if (setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, (char *)&on,
+          if (setsockopt(sfd_, SOL_SOCKET, SO_REUSEADDR, (char *)&on,
                          sizeof(int)) < 0) {
             cerr << "TCP Server setsockopt SO_REUSEADDR failed: (" << errno
                  << ") " << strerror(errno) << endl;
           }
 
-          if (::bind(sfd, result_ptr->ai_addr, result_ptr->ai_addrlen) == -1) {
-            close(sfd); // Binding failed, close and try next result
+          if (::bind(sfd_, result_ptr->ai_addr, result_ptr->ai_addrlen) ==
+              -1) {
+            close(sfd_); // Binding failed, close and try next result
+            sfd_ = -1;
             continue;
           }
 
           // SUCCESSFULL binding, discontinue search.
-          this->sfd_ = sfd;
+          this->sfd = sfd_;
           break;
         }
 
@@ -93,7 +98,7 @@ public:
 
           // SO_REUSEADDR allows immediatley re-using a port.
           const int on = 1; // Set after creating socket and before binding.
-          if (setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, (char *)&on,
+          if (setsockopt(sfd_, SOL_SOCKET, SO_REUSEADDR, (char *)&on,
                          sizeof(int)) < 0) {
             cerr
                 << "TCP Server (bind_to_all_available) setsockopt SO_REUSEADDR "
@@ -101,12 +106,14 @@ public:
                 << errno << ") " << strerror(errno) << std::endl;
 
             // [2] Bind the socket
-          } else if (::bind(sfd, (sockaddr *)&acceptSockAddr,
+          } else if (::bind(sfd_, (sockaddr *)&acceptSockAddr,
                             sizeof(acceptSockAddr)) == -1) {
             // Discontinue on error.
             cerr << "TCP Server (bind to all) failed to bind socket. Error: ("
                  << std::to_string(errno) + ") "
                  << std::string(strerror(errno));
+            close(sfd_);
+            sfd_ = -1;
           }
         }
 
@@ -123,6 +130,26 @@ public:
 
   // Listen & Accept-Loop
   bool acceptConnections();
+
+  bool listenForConnections(int backlog = SOMAXCONN) {
+    if (listen(this->sfd, backlog) < 0) {
+      cerr << "TCP Server listen failed: (" << errno << ") " << strerror(errno)
+           << endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Returns the new client's sfd, or -1. Call when the listening
+  // socket polls readable, so it doesn't block.
+  int acceptConnection() {
+    int clientSfd = accept(this->sfd, nullptr, nullptr);
+    if (clientSfd < 0) {
+      cerr << "TCP Server accept failed: (" << errno << ") " << strerror(errno)
+           << endl;
+    }
+    return clientSfd;
+  }
 };
 
 #endif // TCPSERVER_H
\ No newline at end of file
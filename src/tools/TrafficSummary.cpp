@@ -0,0 +1,96 @@
+/**
+ * Offline summary of a traffic log captured by ServerNetworkAPI::startCapture.
+ *
+ * Prints message count, bytes and bandwidth per EventCode and transport,
+ * plus the busiest second of the capture.
+ *
+ * Compile (from the repo root):
+ *   g++ -std=c++20 -O2 src/tools/TrafficSummary.cpp -o traffic_summary
+ *
+ * Usage:
+ *   ./traffic_summary capture.log
+ */
+
+#include "../core/TrafficLog.h"
+#include "../core/messages.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+struct TrafficStats {
+  uint64_t count = 0;
+  uint64_t payloadBytes = 0;
+  uint64_t maxPayload = 0;
+};
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    cerr << "Usage: " << argv[0] << " <capture.log>" << endl;
+    return 1;
+  }
+
+  TrafficLogReader log;
+  if (!log.open(argv[1])) {
+    return 1;
+  }
+
+  map<pair<EventCode, TrafficTransport>, TrafficStats> stats;
+  map<uint64_t, uint64_t> bytesPerSecond;
+  uint64_t firstNs = 0, lastNs = 0, total = 0;
+
+  log.forEach([&](const TrafficRecord &rec, const unsigned char *) {
+    if (total++ == 0) {
+      firstNs = rec.arrivalNs;
+    }
+    lastNs = rec.arrivalNs;
+
+    TrafficStats &s = stats[{rec.mssgType, rec.transport}];
+    s.count++;
+    s.payloadBytes += rec.mssgLength;
+    s.maxPayload = max<uint64_t>(s.maxPayload, rec.mssgLength);
+
+    // Wire bytes include the Header.
+    bytesPerSecond[(rec.arrivalNs - firstNs) / 1000000000ull] +=
+        sizeof(Header) + rec.mssgLength;
+    return true;
+  });
+
+  if (total == 0) {
+    cout << "Empty capture." << endl;
+    return 0;
+  }
+
+  double durationSec = max(1e-9, (lastNs - firstNs) / 1e9);
+  cout << "Messages: " << total << " over " << fixed << setprecision(3)
+       << durationSec << " s\n\n";
+
+  cout << left << setw(8) << "Event" << setw(6) << "Via" << right << setw(12)
+       << "Count" << setw(12) << "Mssg/s" << setw(14) << "Wire bytes"
+       << setw(12) << "KiB/s" << setw(10) << "Avg B" << setw(10) << "Max B"
+       << "\n";
+
+  for (const auto &[key, s] : stats) {
+    uint64_t wireBytes = s.count * sizeof(Header) + s.payloadBytes;
+    cout << left << setw(8) << static_cast<char>(key.first) << setw(6)
+         << (key.second == TrafficTransport::TCP ? "TCP" : "UDP") << right
+         << setw(12) << s.count << setw(12) << setprecision(1)
+         << s.count / durationSec << setw(14) << wireBytes << setw(12)
+         << wireBytes / durationSec / 1024.0 << setw(10)
+         << double(s.payloadBytes) / s.count << setw(10) << s.maxPayload
+         << "\n";
+  }
+
+  auto peak = max_element(
+      bytesPerSecond.begin(), bytesPerSecond.end(),
+      [](const auto &a, const auto &b) { return a.second < b.second; });
+  cout << "\nPeak second: " << peak->first << " s in, "
+       << peak->second / 1024.0 << " KiB" << endl;
+
+  return 0;
+}